@@ -77,4 +77,30 @@ uint256 CBlockIndex::GetBlockTrust() const
         uint256 bnPoWTrust = ((~uint256(0) >> 20) / (bnTarget + 1));
         return bnPoWTrust > 1 ? bnPoWTrust : 1;
     }
-}
\ No newline at end of file
+}
+
+/**
+ * CBlockHashChain implementation
+ */
+void CBlockHashChain::SetTip(CBlockIndex* pindexTip)
+{
+    LOCK(cs);
+    chain.SetTip(pindexTip);
+}
+
+int CBlockHashChain::Height() const
+{
+    LOCK(cs);
+    return chain.Height();
+}
+
+bool CBlockHashChain::Get(int nHeight, uint256& hash) const
+{
+    LOCK(cs);
+
+    const CBlockIndex* pindex = chain[nHeight];
+    if (pindex == NULL)
+        return false;
+    hash = pindex->GetBlockHash();
+    return true;
+}
@@ -9,6 +9,7 @@
 
 #include "pow.h"
 #include "primitives/block.h"
+#include "sync.h"
 #include "tinyformat.h"
 #include "uint256.h"
 #include "util.h"
@@ -590,4 +591,31 @@ public:
     const CBlockIndex* FindFork(const CBlockIndex* pindex) const;
 };
 
+/**
+ * A copy of a chain's blocks by height, readable without the lock of the chain.
+ *
+ * Masternode and maxnode scores are computed against the hash of a block some
+ * way below the one they are for, once per node, by callers that hold the node
+ * manager lock, which is taken after cs_main elsewhere. SetTip is called with
+ * the chain's lock held whenever its tip moves, so every height of the chain
+ * answers the same here, however far back, and after a reorg no height answers
+ * with a block of the old branch.
+ */
+class CBlockHashChain
+{
+private:
+    mutable CCriticalSection cs;
+    CChain chain;
+
+public:
+    /** Follow the chain to its new tip, NULL empties it. */
+    void SetTip(CBlockIndex* pindexTip);
+
+    /** Height of the tip, -1 if there is none. */
+    int Height() const;
+
+    /** Hash of the block at nHeight, false if the chain has no block there. */
+    bool Get(int nHeight, uint256& hash) const;
+};
+
 #endif // BITCOIN_CHAIN_H
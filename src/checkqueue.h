@@ -6,31 +6,73 @@
 #define BITCOIN_CHECKQUEUE_H
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
 #include <vector>
 
 #include <boost/foreach.hpp>
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 
 template <typename T>
 class CCheckQueueControl;
 
-/** 
+/** Workers with a deque of their own, more than this take their work from the others */
+static const int MAX_CHECKQUEUE_WORKERS = 64;
+
+/**
  * Queue for verifications that have to be performed.
-  * The verifications are represented by a type T, which must provide an
-  * operator(), returning a bool.
-  *
-  * One thread (the master) is assumed to push batches of verifications
-  * onto the queue, where they are processed by N-1 worker threads. When
-  * the master is done adding work, it temporarily joins the worker pool
-  * as an N'th worker, until all jobs are done.
-  */
+ * The verifications are represented by a type T, which must provide an
+ * operator(), returning a bool.
+ *
+ * One thread (the master) is assumed to push batches of verifications
+ * onto the queue, where they are processed by N-1 worker threads. When
+ * the master is done adding work, it temporarily joins the worker pool
+ * as an N'th worker, until all jobs are done.
+ *
+ * Every worker, and the master, has a deque of its own. Add() spreads the
+ * verifications over the deques, each worker runs its own from the back
+ * and steals from the front of the others' once it runs dry, so workers
+ * only meet on a lock when one of them is out of work. Batches shrink as
+ * the queue drains so the workers finish at about the same time, and even
+ * a handful of verifications is spread over all of them. After the first
+ * failure the remaining verifications are dropped without being run.
+ */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    struct CWorkerQueue {
+        boost::mutex mutex;
+        std::deque<T> deque;
+        //! Size of the deque, so that empty ones are skipped without taking the lock
+        std::atomic<int> nSize;
+
+        CWorkerQueue() : nSize(0) {}
+    };
+
+    //! Deques of the master (slot 0) and the workers
+    CWorkerQueue vQueues[MAX_CHECKQUEUE_WORKERS + 1];
+
+    //! Number of worker threads that have started
+    std::atomic<int> nWorkers;
+
+    //! Verifications in the deques, not taken by a worker yet. Only counted once Add() put them all in place
+    std::atomic<int64_t> nQueued;
+
+    /**
+     * Number of verifications that haven't completed yet.
+     * This includes elements that are not anymore in a deque, but still in
+     * a worker's own batch.
+     */
+    std::atomic<int64_t> nTodo;
+
+    //! The temporary evaluation result.
+    std::atomic<bool> fAllOk;
+
+    //! Mutex for the workers and the master to sleep on, not taken while there's work
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -39,122 +81,172 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
-
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The maximum number of elements to be processed in one batch
+    unsigned int nBatchSize;
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! Slot the next Add() starts at, only used by the master
+    int nNextSlot;
 
-    //! The temporary evaluation result.
-    bool fAllOk;
+    int GetSlots() const
+    {
+        return std::min((int)nWorkers, MAX_CHECKQUEUE_WORKERS) + 1;
+    }
 
     /**
-     * Number of verifications that haven't completed yet.
-     * This includes elements that are not anymore in queue, but still in
-     * worker's own batches.
+     * Aim for a few batches per worker out of what is left, so that they all
+     * finish at about the same time. Don't do batches smaller than 1 (duh),
+     * or larger than nBatchSize.
      */
-    unsigned int nTodo;
-
-    //! Whether we're shutting down.
-    bool fQuit;
-
-    //! The maximum number of elements to be processed in one batch
-    unsigned int nBatchSize;
+    unsigned int GetBatchSize() const
+    {
+        int64_t nPerWorker = nQueued / (GetSlots() * 2);
+        return (unsigned int)std::max((int64_t)1, std::min((int64_t)nBatchSize, nPerWorker));
+    }
 
-    /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    /** Move up to nBatch elements of a deque into vChecks, from the front when stealing */
+    void Take(CWorkerQueue& queue, unsigned int nBatch, bool fSteal, std::vector<T>& vChecks)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
-        std::vector<T> vChecks;
-        vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
-        do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master he can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+        if (queue.nSize == 0)
+            return;
+        boost::unique_lock<boost::mutex> lock(queue.mutex);
+        unsigned int nNow = std::min(nBatch, (unsigned int)queue.deque.size());
+        // leave the owner at least half of what it has
+        if (fSteal && nNow > 1)
+            nNow = std::min(nNow, (unsigned int)(queue.deque.size() + 1) / 2);
+        if (nNow == 0)
+            return;
+        vChecks.resize(nNow);
+        for (unsigned int i = 0; i < nNow; i++) {
+            // swap jobs to the local batch vector instead of copying
+            if (fSteal) {
+                vChecks[i].swap(queue.deque.front());
+                queue.deque.pop_front();
+            } else {
+                vChecks[i].swap(queue.deque.back());
+                queue.deque.pop_back();
             }
-            // execute work
-            BOOST_FOREACH (T& check, vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
-        } while (true);
+        }
+        queue.nSize -= nNow;
+        nQueued -= nNow;
+    }
+
+    /** Run a batch from the own deque, or stolen from another one. False if there was nothing to do */
+    bool RunBatch(int nSlot, std::vector<T>& vChecks)
+    {
+        unsigned int nBatch = GetBatchSize();
+        int nSlots = GetSlots();
+        if (nSlot >= 0)
+            Take(vQueues[nSlot], nBatch, false, vChecks);
+        for (int i = 1; i <= nSlots && vChecks.empty(); i++) {
+            int nVictim = (std::max(nSlot, 0) + i) % nSlots;
+            if (nVictim != nSlot)
+                Take(vQueues[nVictim], nBatch, true, vChecks);
+        }
+        if (vChecks.empty())
+            return false;
+
+        // after a failure the rest only needs to be counted off
+        bool fOk = fAllOk;
+        BOOST_FOREACH (T& check, vChecks)
+            if (fOk)
+                fOk = check();
+        if (!fOk)
+            fAllOk = false;
+
+        int64_t nDone = vChecks.size();
+        vChecks.clear();
+        if ((nTodo -= nDone) == 0) {
+            // We processed the last element; inform the master he can exit and return the result
+            boost::unique_lock<boost::mutex> lock(mutex);
+            condMaster.notify_one();
+        }
+        return true;
     }
 
 public:
     //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    CCheckQueue(unsigned int nBatchSizeIn) : nWorkers(0), nQueued(0), nTodo(0), fAllOk(true), nBatchSize(nBatchSizeIn), nNextSlot(0) {}
 
     //! Worker thread
     void Thread()
     {
-        Loop();
+        int nSlot = ++nWorkers;
+        if (nSlot > MAX_CHECKQUEUE_WORKERS)
+            nSlot = -1;
+
+        std::vector<T> vChecks;
+        vChecks.reserve(nBatchSize);
+        while (true) {
+            if (RunBatch(nSlot, vChecks))
+                continue;
+            if (nQueued > 0) {
+                // another worker is taking the last ones, they may still fail to get them
+                boost::this_thread::yield();
+                continue;
+            }
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (nQueued <= 0)
+                condWorker.wait(lock); // wait
+        }
     }
 
     //! Wait until execution finishes, and return whether all evaluations where successful.
     bool Wait()
     {
-        return Loop(true);
+        std::vector<T> vChecks;
+        vChecks.reserve(nBatchSize);
+        while (true) {
+            if (RunBatch(0, vChecks))
+                continue;
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (nTodo == 0)
+                break;
+            if (nQueued <= 0)
+                condMaster.wait(lock);
+        }
+        bool fRet = fAllOk;
+        // reset the status for new work later
+        fAllOk = true;
+        return fRet;
     }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        BOOST_FOREACH (T& check, vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        // the result is known already, the checks needn't run
+        if (vChecks.empty() || !fAllOk)
+            return;
+
+        int nSlots = GetSlots();
+        size_t nPerSlot = (vChecks.size() + nSlots - 1) / nSlots;
         nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
+
+        size_t i = 0;
+        while (i < vChecks.size()) {
+            CWorkerQueue& queue = vQueues[nNextSlot];
+            nNextSlot = (nNextSlot + 1) % nSlots;
+
+            boost::unique_lock<boost::mutex> lock(queue.mutex);
+            size_t n = 0;
+            for (; n < nPerSlot && i < vChecks.size(); n++, i++) {
+                queue.deque.push_back(T());
+                vChecks[i].swap(queue.deque.back());
+            }
+            queue.nSize += n;
+        }
+
+        // workers may have taken some already and pushed this below zero for a moment
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nQueued += vChecks.size();
+        }
+        // wake no more workers than there are checks for
+        if (vChecks.size() >= (size_t)nSlots) {
             condWorker.notify_all();
+        } else {
+            for (size_t n = 0; n < vChecks.size(); n++)
+                condWorker.notify_one();
+        }
     }
 
     ~CCheckQueue()
@@ -163,8 +255,7 @@ public:
 
     bool IsIdle()
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        return (nTotal == nIdle && nTodo == 0 && fAllOk == true);
+        return nTodo == 0 && nQueued == 0 && fAllOk;
     }
 };
 
@@ -218,6 +218,16 @@ const CTxOut& CCoinsViewCache::GetOutputFor(const CTxIn& input) const
     return coins->vout[input.prevout.n];
 }
 
+bool CCoinsViewCache::GetUTXO(const COutPoint& outpoint, CTxOut& txout, int& nHeight) const
+{
+    const CCoins* coins = AccessCoins(outpoint.hash);
+    if (!coins || !coins->IsAvailable(outpoint.n))
+        return false;
+    txout = coins->vout[outpoint.n];
+    nHeight = coins->nHeight;
+    return true;
+}
+
 CAmount CCoinsViewCache::GetValueIn(const CTransaction& tx) const
 {
     if (tx.IsCoinBase())
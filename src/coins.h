@@ -475,6 +475,9 @@ public:
 
     const CTxOut& GetOutputFor(const CTxIn& input) const;
 
+    //! Look up a single unspent output and the height of the block that created it, false if it is spent or unknown
+    bool GetUTXO(const COutPoint& outpoint, CTxOut& txout, int& nHeight) const;
+
     friend class CCoinsModifier;
 
 private:
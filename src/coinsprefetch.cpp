@@ -0,0 +1,162 @@
+// Copyright (c) 2019 The Lytix developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinsprefetch.h"
+
+#include "primitives/block.h"
+#include "util.h"
+
+#include <set>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+
+CCoinsViewPrefetch::CCoinsViewPrefetch(CCoinsView* viewIn, int nThreads) : CCoinsViewBacked(viewIn), fStop(false), nGeneration(0), fWriting(false)
+{
+    for (int i = 0; i < nThreads; i++)
+        threadGroup.create_thread(boost::bind(&CCoinsViewPrefetch::Thread, this));
+}
+
+CCoinsViewPrefetch::~CCoinsViewPrefetch()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fStop = true;
+    }
+    cond.notify_all();
+    threadGroup.join_all();
+}
+
+bool CCoinsViewPrefetch::Take(const uint256& txid, CCoins& coins) const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    CPrefetchMap::iterator it = mapCoins.find(txid);
+    if (it == mapCoins.end())
+        return false;
+    // the cache above keeps its own copy, ours isn't needed anymore
+    coins.swap(it->second.coins);
+    mapCoins.erase(it);
+    return true;
+}
+
+bool CCoinsViewPrefetch::GetCoins(const uint256& txid, CCoins& coins) const
+{
+    if (Take(txid, coins))
+        return true;
+    return base->GetCoins(txid, coins);
+}
+
+bool CCoinsViewPrefetch::HaveCoins(const uint256& txid) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (mapCoins.count(txid))
+            return true;
+    }
+    return base->HaveCoins(txid);
+}
+
+bool CCoinsViewPrefetch::BatchWrite(CCoinsMap& mapCoinsIn, const uint256& hashBlock)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        // the write empties mapCoinsIn, so drop our copies of what it changes first
+        for (CPrefetchMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+            if (mapCoinsIn.count(it->first))
+                mapCoins.erase(it++);
+            else
+                ++it;
+        }
+        nGeneration++;
+        fWriting = true;
+    }
+
+    bool fOk = base->BatchWrite(mapCoinsIn, hashBlock);
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    nGeneration++;
+    fWriting = false;
+    return fOk;
+}
+
+void CCoinsViewPrefetch::DropUpTo(int nHeight)
+{
+    // what wasn't asked for by now is in the cache above already, or won't be needed
+    while (!mapHeights.empty() && mapHeights.begin()->first <= nHeight) {
+        CPrefetchMap::iterator it = mapCoins.find(mapHeights.begin()->second);
+        if (it != mapCoins.end() && it->second.nHeight == mapHeights.begin()->first)
+            mapCoins.erase(it);
+        mapHeights.erase(mapHeights.begin());
+    }
+    // and reads that can't be done in time anymore
+    queueTxids.erase(queueTxids.begin(), queueTxids.upper_bound(nHeight));
+}
+
+void CCoinsViewPrefetch::PrefetchInputs(const CBlock& block, int nHeight, int nTipHeight)
+{
+    // outputs created within the block are not in the database yet
+    std::set<uint256> setCreated;
+    std::set<uint256> setSpent;
+    BOOST_FOREACH (const CTransaction& tx, block.vtx) {
+        setCreated.insert(tx.GetHash());
+        if (tx.IsCoinBase() || tx.IsZerocoinSpend())
+            continue;
+        BOOST_FOREACH (const CTxIn& txin, tx.vin)
+            if (!setCreated.count(txin.prevout.hash))
+                setSpent.insert(txin.prevout.hash);
+    }
+
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        DropUpTo(nTipHeight);
+        if (nHeight <= nTipHeight || setSpent.empty())
+            return;
+        BOOST_FOREACH (const uint256& txid, setSpent)
+            queueTxids.insert(std::make_pair(nHeight, txid));
+    }
+    cond.notify_all();
+}
+
+void CCoinsViewPrefetch::Thread()
+{
+    RenameThread("lytix-prefetch");
+    while (true) {
+        int nHeight;
+        uint256 txid;
+        uint64_t nGenerationRead;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (!fStop && queueTxids.empty())
+                cond.wait(lock);
+            if (fStop)
+                return;
+            // the block that is connected first goes first
+            nHeight = queueTxids.begin()->first;
+            txid = queueTxids.begin()->second;
+            queueTxids.erase(queueTxids.begin());
+            nGenerationRead = nGeneration;
+        }
+
+        CCoins coins;
+        if (!base->GetCoins(txid, coins))
+            continue;
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (nGenerationRead != nGeneration || fWriting)
+            continue;
+        CPrefetchEntry& entry = mapCoins[txid];
+        // a later block spending other outputs of the same transaction keeps it around longer
+        if (nHeight > entry.nHeight) {
+            entry.nHeight = nHeight;
+            entry.coins.swap(coins);
+            mapHeights.insert(std::make_pair(nHeight, txid));
+        }
+    }
+}
+
+size_t CCoinsViewPrefetch::GetPrefetchedSize() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return mapCoins.size();
+}
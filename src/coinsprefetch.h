@@ -0,0 +1,87 @@
+// Copyright (c) 2019 The Lytix developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSPREFETCH_H
+#define BITCOIN_COINSPREFETCH_H
+
+#include "coins.h"
+#include "uint256.h"
+
+#include <map>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/unordered_map.hpp>
+
+class CBlock;
+
+//! -prefetchthreads default
+static const int DEFAULT_PREFETCH_THREADS = 4;
+//! max. -prefetchthreads
+static const int MAX_PREFETCH_THREADS = 16;
+//! Blocks stored up to this far ahead of the tip have their coins prefetched
+static const int MAX_PREFETCH_BLOCKS_AHEAD = 64;
+
+/**
+ * CCoinsView that reads the coins of upcoming blocks ahead of time.
+ *
+ * Sits between the coins database and pcoinsTip. When a block is stored ahead
+ * of the tip, the transactions its inputs spend are looked up on background
+ * threads, lowest block first, so that the lookups of its inputs that miss the
+ * pcoinsTip cache when it is connected don't each wait for a database read on
+ * the validation thread.
+ *
+ * The prefetched coins are a copy of what the database holds. A write drops
+ * the ones it changes and any read that overlapped it. Coins that weren't
+ * asked for by the time the tip passed their block are dropped too, so memory
+ * stays bounded by the blocks in the window.
+ */
+class CCoinsViewPrefetch : public CCoinsViewBacked
+{
+private:
+    struct CPrefetchEntry {
+        int nHeight;
+        CCoins coins;
+
+        CPrefetchEntry() : nHeight(-1) {}
+    };
+    typedef boost::unordered_map<uint256, CPrefetchEntry, CCoinsKeyHasher> CPrefetchMap;
+
+    mutable boost::mutex mutex;
+    boost::condition_variable cond;
+    boost::thread_group threadGroup;
+    bool fStop;
+
+    //! Transactions to read the coins of, by the height of the block that spends them
+    std::multimap<int, uint256> queueTxids;
+
+    //! Coins read ahead, and the same transactions by the height they were read for
+    mutable CPrefetchMap mapCoins;
+    std::multimap<int, uint256> mapHeights;
+
+    //! Bumped around every write, a read that overlapped one is stale
+    uint64_t nGeneration;
+    bool fWriting;
+
+    bool Take(const uint256& txid, CCoins& coins) const;
+    void DropUpTo(int nHeight);
+    void Thread();
+
+public:
+    CCoinsViewPrefetch(CCoinsView* viewIn, int nThreads);
+    ~CCoinsViewPrefetch();
+
+    bool GetCoins(const uint256& txid, CCoins& coins) const;
+    bool HaveCoins(const uint256& txid) const;
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
+
+    //! Read the coins the block at nHeight spends in the background, drop what is at or below nTipHeight
+    void PrefetchInputs(const CBlock& block, int nHeight, int nTipHeight);
+
+    //! Number of coins prefetched and not asked for yet
+    size_t GetPrefetchedSize() const;
+};
+
+#endif // BITCOIN_COINSPREFETCH_H
@@ -20,6 +20,7 @@
 #include "addrman.h"
 #include "amount.h"
 #include "checkpoints.h"
+#include "coinsprefetch.h"
 #include "compat/sanity.h"
 #include "httpserver.h"
 #include "httprpc.h"
@@ -39,6 +40,8 @@
 #include "rpc/server.h"
 #include "script/standard.h"
 #include "scheduler.h"
+#include "seencache.h"
+#include "sigverify.h"
 #include "spork.h"
 #include "sporkdb.h"
 #include "txdb.h"
@@ -67,6 +70,7 @@
 
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/replace.hpp>
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/interprocess/sync/file_lock.hpp>
 #include <boost/thread.hpp>
@@ -248,6 +252,8 @@ void PrepareShutdown()
         }
         delete pcoinsTip;
         pcoinsTip = NULL;
+        delete pcoinsprefetch;
+        pcoinsprefetch = NULL;
         delete pcoinscatcher;
         pcoinscatcher = NULL;
         delete pcoinsdbview;
@@ -390,6 +396,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxreorg=<n>", strprintf(_("Set the Maximum reorg depth (default: %u)"), Params(CBaseChainParams::MAIN).MaxReorganizationDepth()));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-prefetchthreads=<n>", strprintf(_("Set the number of threads that read the coins of blocks downloaded ahead of the tip during initial sync (0 to %d, default: %d, 0 on a single core)"), MAX_PREFETCH_THREADS, DEFAULT_PREFETCH_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), "lytix.pid"));
 #endif
@@ -546,6 +553,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-masternodeprivkey=<n>", _("Set the masternode private key"));
     strUsage += HelpMessageOpt("-masternodeaddr=<n>", strprintf(_("Set external address:port to get to this masternode (example: %s)"), "128.127.106.235:27071"));
     strUsage += HelpMessageOpt("-budgetvotemode=<mode>", _("Change automatic finalized budget voting behavior. mode=auto: Vote for only exact finalized budget match to my generated budget. (string, default: auto)"));
+    strUsage += HelpMessageOpt("-sigverifythreads=<n>", strprintf(_("Set the number of threads verifying masternode and maxnode message signatures (0 to %d, 0 = on the message handler thread, default: %d)"), MAX_SIGVERIFY_THREADS, DEFAULT_SIGVERIFY_THREADS));
+    strUsage += HelpMessageOpt("-maxmsgsigcachesize=<n>", strprintf(_("Limit size of the masternode message signature cache to <n> entries (default: %u)"), DEFAULT_MAX_MSGSIGCACHE_SIZE));
+    strUsage += HelpMessageOpt("-maxseencachesize=<n>", strprintf(_("Limit each cache of seen masternode, maxnode and budget messages to <n> entries (default: %u)"), DEFAULT_MAX_SEEN_CACHE_SIZE));
 
     strUsage += HelpMessageGroup(_("Maxnode options:"));
     strUsage += HelpMessageOpt("-maxnode=<n>", strprintf(_("Enable the client to act as a maxnode (0-1, default: %u)"), 0));
@@ -1401,6 +1411,14 @@ bool AppInit2()
     size_t nCoinDBCache = nTotalCache / 2; // use half of the remaining cache for coindb cache
     nTotalCache -= nCoinDBCache;
     nCoinCacheSize = nTotalCache / 300; // coins in memory require around 300 bytes
+    // with a single core the readers only take time from validation, unless asked for
+    int nPrefetchThreads = GetArg("-prefetchthreads", boost::thread::hardware_concurrency() > 1 ? DEFAULT_PREFETCH_THREADS : 0);
+    nPrefetchThreads = std::max(0, std::min(nPrefetchThreads, MAX_PREFETCH_THREADS));
+    LogPrintf("Using %d threads to prefetch coins\n", nPrefetchThreads);
+
+    // cached masternode and maxnode decisions that depend on sporks
+    sporkManager.NotifySporkChanged.connect(boost::bind(&CMasternodeMan::SporkChanged, &mnodeman, _1, _2));
+    sporkManager.NotifySporkChanged.connect(boost::bind(&CMaxnodeMan::SporkChanged, &maxnodeman, _1, _2));
 
     bool fLoaded = false;
     bool fRepair = false;
@@ -1415,6 +1433,7 @@ bool AppInit2()
             try {
                 UnloadBlockIndex();
                 delete pcoinsTip;
+                delete pcoinsprefetch;
                 delete pcoinsdbview;
                 delete pcoinscatcher;
                 delete pblocktree;
@@ -1428,7 +1447,13 @@ bool AppInit2()
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
-                pcoinsTip = new CCoinsViewCache(pcoinscatcher);
+                pcoinsprefetch = NULL;
+                if (nPrefetchThreads) {
+                    pcoinsprefetch = new CCoinsViewPrefetch(pcoinscatcher, nPrefetchThreads);
+                    pcoinsTip = new CCoinsViewCache(pcoinsprefetch);
+                } else {
+                    pcoinsTip = new CCoinsViewCache(pcoinscatcher);
+                }
 
                 if (fReindex)
                     pblocktree->WriteReindexing(true);
@@ -2046,6 +2071,12 @@ bool AppInit2()
 
     threadGroup.create_thread(boost::bind(&ThreadCheckObfuScationPool));
 
+    int nSigVerifyThreads = fLiteMode ? 0 : (int)GetArg("-sigverifythreads", DEFAULT_SIGVERIFY_THREADS);
+    nSigVerifyThreads = std::max(0, std::min(nSigVerifyThreads, MAX_SIGVERIFY_THREADS));
+    LogPrintf("Using %d threads for masternode message verification\n", nSigVerifyThreads);
+    for (int i = 0; i < nSigVerifyThreads; i++)
+        threadGroup.create_thread(&ThreadSigVerify);
+
     // ********************************************************* Step 11: start node
 
     if (!CheckDiskSpace())
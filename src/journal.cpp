@@ -0,0 +1,411 @@
+// Copyright (c) 2019 The Lytix developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "journal.h"
+
+#include "chainparams.h"
+#include "hash.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+
+// type, table, key and payload size
+static const unsigned int RECORD_HEADER_SIZE = 1 + 1 + 32 + 4;
+static const unsigned int RECORD_CHECKSUM_SIZE = 8;
+
+static uint64_t RecordSize(uint32_t nPayloadSize)
+{
+    return RECORD_HEADER_SIZE + nPayloadSize + RECORD_CHECKSUM_SIZE;
+}
+
+CFlatJournal::CFlatJournal(const std::string& strFilenameIn, const std::string& strMagicMessageIn) : strFilename(strFilenameIn),
+                                                                                                       strMagicMessage(strMagicMessageIn),
+                                                                                                       file(NULL),
+                                                                                                       nHeaderSize(0),
+                                                                                                       nFileSize(0),
+                                                                                                       nLiveSize(0),
+                                                                                                       ssPending(SER_DISK, CLIENT_VERSION)
+{
+}
+
+CFlatJournal::~CFlatJournal()
+{
+    if (file) fclose(file);
+}
+
+boost::filesystem::path CFlatJournal::GetPath() const
+{
+    return GetDataDir() / strFilename;
+}
+
+void CFlatJournal::SerializeHeader(CDataStream& ss) const
+{
+    ss << strMagicMessage;
+    ss << FLATDATA(Params().MessageStart());
+    ss << JOURNAL_VERSION;
+}
+
+CFlatJournal::ReadResult CFlatJournal::Open()
+{
+    LOCK(cs);
+
+    if (file) fclose(file);
+    mapEntries.clear();
+    ssPending.clear();
+    nHeaderSize = nFileSize = nLiveSize = 0;
+
+    boost::filesystem::path path = GetPath();
+    file = fopen(path.string().c_str(), "r+b");
+    if (!file) {
+        error("%s : Failed to open file %s", __func__, path.string());
+        return FileError;
+    }
+    uint64_t nFileSizeOnDisk = boost::filesystem::file_size(path);
+
+    CDataStream ssHeader(SER_DISK, CLIENT_VERSION);
+    SerializeHeader(ssHeader);
+    std::vector<char> vchHeader(ssHeader.size());
+    if (fread(&vchHeader[0], 1, vchHeader.size(), file) != vchHeader.size()) {
+        fclose(file);
+        file = NULL;
+        error("%s : Invalid magic message in %s", __func__, strFilename);
+        return IncorrectMagicMessage;
+    }
+
+    std::string strMagicMessageTmp;
+    unsigned char pchMsgTmp[4];
+    int nVersion;
+    CDataStream ssHeaderIn(vchHeader, SER_DISK, CLIENT_VERSION);
+    try {
+        ssHeaderIn >> strMagicMessageTmp;
+        if (strMagicMessageTmp != strMagicMessage) {
+            fclose(file);
+            file = NULL;
+            error("%s : Invalid magic message in %s", __func__, strFilename);
+            return IncorrectMagicMessage;
+        }
+        ssHeaderIn >> FLATDATA(pchMsgTmp);
+        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp))) {
+            fclose(file);
+            file = NULL;
+            error("%s : Invalid network magic number in %s", __func__, strFilename);
+            return IncorrectMagicNumber;
+        }
+        ssHeaderIn >> nVersion;
+    } catch (std::exception& e) {
+        nVersion = 0;
+    }
+    if (nVersion != JOURNAL_VERSION) {
+        fclose(file);
+        file = NULL;
+        error("%s : Unknown journal version in %s", __func__, strFilename);
+        return IncorrectFormat;
+    }
+    nHeaderSize = nFileSize = vchHeader.size();
+
+    // index the records, payloads are only checked once they are read
+    std::vector<char> vchRecordHeader(RECORD_HEADER_SIZE);
+    std::vector<char> vchChecksum(RECORD_CHECKSUM_SIZE);
+    while (true) {
+        if (fread(&vchRecordHeader[0], 1, RECORD_HEADER_SIZE, file) != RECORD_HEADER_SIZE)
+            break;
+
+        unsigned char nType;
+        unsigned char nTable;
+        uint256 key;
+        uint32_t nSize;
+        CDataStream ssRecordHeader(vchRecordHeader, SER_DISK, CLIENT_VERSION);
+        ssRecordHeader >> nType >> nTable >> key >> nSize;
+
+        if ((nType != RECORD_PUT && nType != RECORD_ERASE) || nSize > MAX_JOURNAL_RECORD_SIZE ||
+            nFileSize + RecordSize(nSize) > nFileSizeOnDisk)
+            break;
+
+        uint64_t nChecksum;
+        if (fseek(file, nSize, SEEK_CUR) != 0 || fread(&vchChecksum[0], 1, RECORD_CHECKSUM_SIZE, file) != RECORD_CHECKSUM_SIZE)
+            break;
+        CDataStream(vchChecksum, SER_DISK, CLIENT_VERSION) >> nChecksum;
+
+        JournalKey journalKey = std::make_pair(nTable, key);
+        std::map<JournalKey, CJournalEntry>::iterator it = mapEntries.find(journalKey);
+        if (it != mapEntries.end()) {
+            nLiveSize -= RecordSize(it->second.nSize);
+            mapEntries.erase(it);
+        }
+        if (nType == RECORD_PUT) {
+            CJournalEntry entry;
+            entry.nPos = nFileSize;
+            entry.nSize = nSize;
+            entry.nChecksum = nChecksum;
+            mapEntries.insert(std::make_pair(journalKey, entry));
+            nLiveSize += RecordSize(nSize);
+        }
+        nFileSize += RecordSize(nSize);
+    }
+
+    if (nFileSize < nFileSizeOnDisk) {
+        LogPrintf("%s : %s has %u bytes of damaged records at the end, dropping them\n", __func__, strFilename, nFileSizeOnDisk - nFileSize);
+        TruncateFile(file, nFileSize);
+    }
+
+    return Ok;
+}
+
+bool CFlatJournal::Reset()
+{
+    LOCK(cs);
+
+    if (file) fclose(file);
+    mapEntries.clear();
+    ssPending.clear();
+    nHeaderSize = nFileSize = nLiveSize = 0;
+
+    boost::filesystem::path path = GetPath();
+    file = fopen(path.string().c_str(), "w+b");
+    if (!file)
+        return error("%s : Failed to open file %s", __func__, path.string());
+
+    CDataStream ssHeader(SER_DISK, CLIENT_VERSION);
+    SerializeHeader(ssHeader);
+    if (fwrite(&ssHeader[0], 1, ssHeader.size(), file) != ssHeader.size()) {
+        fclose(file);
+        file = NULL;
+        return error("%s : Failed to write %s", __func__, path.string());
+    }
+    fflush(file);
+    FileCommit(file);
+    nHeaderSize = nFileSize = ssHeader.size();
+
+    return true;
+}
+
+bool CFlatJournal::IsOpen() const
+{
+    LOCK(cs);
+    return file != NULL;
+}
+
+bool CFlatJournal::OpenForWrite()
+{
+    if (IsOpen())
+        return true;
+
+    ReadResult result = Open();
+    if (result == IncorrectMagicMessage || result == IncorrectMagicNumber)
+        return error("%s : %s format is unknown or invalid, please fix it manually", __func__, strFilename);
+    if (result != Ok) {
+        LogPrintf("%s : recreating %s\n", __func__, strFilename);
+        return Reset();
+    }
+    return true;
+}
+
+bool CFlatJournal::Exists(unsigned char nTable, const uint256& key) const
+{
+    LOCK(cs);
+    return mapEntries.count(std::make_pair(nTable, key));
+}
+
+void CFlatJournal::GetKeys(unsigned char nTable, std::vector<uint256>& vKeys) const
+{
+    LOCK(cs);
+
+    std::vector<std::pair<uint64_t, uint256> > vPosKeys;
+    std::map<JournalKey, CJournalEntry>::const_iterator it = mapEntries.lower_bound(std::make_pair(nTable, uint256()));
+    for (; it != mapEntries.end() && it->first.first == nTable; ++it)
+        vPosKeys.push_back(std::make_pair(it->second.nPos, it->first.second));
+    std::sort(vPosKeys.begin(), vPosKeys.end());
+
+    vKeys.clear();
+    vKeys.reserve(vPosKeys.size());
+    for (unsigned int i = 0; i < vPosKeys.size(); i++)
+        vKeys.push_back(vPosKeys[i].second);
+}
+
+// requires cs
+bool CFlatJournal::ReadRaw(uint64_t nPos, unsigned int nSize, std::vector<char>& vch)
+{
+    vch.resize(nSize);
+    if (nSize == 0) return true;
+
+    // records that are not flushed yet are still in memory
+    if (nPos >= nFileSize) {
+        if (nPos - nFileSize + nSize > ssPending.size()) return false;
+        memcpy(&vch[0], &ssPending[nPos - nFileSize], nSize);
+        return true;
+    }
+
+    if (!file || fseek(file, nPos, SEEK_SET) != 0)
+        return false;
+    return fread(&vch[0], 1, nSize, file) == nSize;
+}
+
+bool CFlatJournal::ReadRecord(unsigned char nTable, const uint256& key, CDataStream& ssPayload)
+{
+    LOCK(cs);
+
+    std::map<JournalKey, CJournalEntry>::iterator it = mapEntries.find(std::make_pair(nTable, key));
+    if (it == mapEntries.end())
+        return false;
+    const CJournalEntry& entry = it->second;
+
+    std::vector<char> vchRecord;
+    if (!ReadRaw(entry.nPos, RecordSize(entry.nSize), vchRecord))
+        return error("%s : Failed to read record from %s", __func__, strFilename);
+
+    uint64_t nChecksum = Hash(vchRecord.begin(), vchRecord.end() - RECORD_CHECKSUM_SIZE).GetLow64();
+    if (nChecksum != entry.nChecksum)
+        return error("%s : Checksum mismatch in %s, record corrupted", __func__, strFilename);
+
+    ssPayload.clear();
+    ssPayload.write(&vchRecord[RECORD_HEADER_SIZE], entry.nSize);
+    return true;
+}
+
+// requires cs
+void CFlatJournal::Append(unsigned char nType, unsigned char nTable, const uint256& key, const CDataStream& ssPayload)
+{
+    CDataStream ssRecord(SER_DISK, CLIENT_VERSION);
+    ssRecord << nType << nTable << key << (uint32_t)ssPayload.size();
+    if (!ssPayload.empty())
+        ssRecord.write(&ssPayload[0], ssPayload.size());
+    uint64_t nChecksum = Hash(ssRecord.begin(), ssRecord.end()).GetLow64();
+    ssRecord << nChecksum;
+
+    JournalKey journalKey = std::make_pair(nTable, key);
+    std::map<JournalKey, CJournalEntry>::iterator it = mapEntries.find(journalKey);
+    if (it != mapEntries.end()) {
+        nLiveSize -= RecordSize(it->second.nSize);
+        mapEntries.erase(it);
+    }
+    if (nType == RECORD_PUT) {
+        CJournalEntry entry;
+        entry.nPos = nFileSize + ssPending.size();
+        entry.nSize = ssPayload.size();
+        entry.nChecksum = nChecksum;
+        mapEntries.insert(std::make_pair(journalKey, entry));
+        nLiveSize += RecordSize(entry.nSize);
+    }
+
+    ssPending.write(&ssRecord[0], ssRecord.size());
+}
+
+void CFlatJournal::WriteRecord(unsigned char nTable, const uint256& key, const CDataStream& ssPayload)
+{
+    LOCK(cs);
+
+    std::map<JournalKey, CJournalEntry>::const_iterator it = mapEntries.find(std::make_pair(nTable, key));
+    if (it != mapEntries.end() && it->second.nSize == ssPayload.size() && !ssPayload.empty()) {
+        // same checksum over the same header means the same payload
+        CDataStream ssRecord(SER_DISK, CLIENT_VERSION);
+        ssRecord << (unsigned char)RECORD_PUT << nTable << key << (uint32_t)ssPayload.size();
+        ssRecord.write(&ssPayload[0], ssPayload.size());
+        if (Hash(ssRecord.begin(), ssRecord.end()).GetLow64() == it->second.nChecksum)
+            return;
+    }
+
+    Append(RECORD_PUT, nTable, key, ssPayload);
+}
+
+void CFlatJournal::Erase(unsigned char nTable, const uint256& key)
+{
+    LOCK(cs);
+
+    if (!mapEntries.count(std::make_pair(nTable, key)))
+        return;
+    Append(RECORD_ERASE, nTable, key, CDataStream(SER_DISK, CLIENT_VERSION));
+}
+
+bool CFlatJournal::Flush()
+{
+    LOCK(cs);
+
+    if (!file)
+        return error("%s : %s is not open", __func__, strFilename);
+
+    if (!ssPending.empty()) {
+        if (fseek(file, nFileSize, SEEK_SET) != 0 ||
+            fwrite(&ssPending[0], 1, ssPending.size(), file) != ssPending.size())
+            return error("%s : Failed to write %s", __func__, strFilename);
+        fflush(file);
+        FileCommit(file);
+        nFileSize += ssPending.size();
+        ssPending.clear();
+    }
+
+    if (nFileSize >= JOURNAL_COMPACT_MIN_SIZE && nFileSize - nHeaderSize > 2 * nLiveSize)
+        return Compact();
+    return true;
+}
+
+// requires cs, nothing pending
+bool CFlatJournal::Compact()
+{
+    int64_t nStart = GetTimeMillis();
+    uint64_t nFileSizeOld = nFileSize;
+
+    boost::filesystem::path path = GetPath();
+    boost::filesystem::path pathTmp = path.string() + ".new";
+
+    FILE* fileNew = fopen(pathTmp.string().c_str(), "w+b");
+    if (!fileNew)
+        return error("%s : Failed to open file %s", __func__, pathTmp.string());
+
+    CDataStream ssHeader(SER_DISK, CLIENT_VERSION);
+    SerializeHeader(ssHeader);
+    bool fOk = fwrite(&ssHeader[0], 1, ssHeader.size(), fileNew) == ssHeader.size();
+
+    // copy the live records as they are, in file order
+    std::vector<std::pair<uint64_t, CJournalEntry*> > vEntries;
+    for (std::map<JournalKey, CJournalEntry>::iterator it = mapEntries.begin(); it != mapEntries.end(); ++it)
+        vEntries.push_back(std::make_pair(it->second.nPos, &it->second));
+    std::sort(vEntries.begin(), vEntries.end());
+
+    std::vector<uint64_t> vPosNew;
+    vPosNew.reserve(vEntries.size());
+    uint64_t nPos = ssHeader.size();
+    std::vector<char> vchRecord;
+    for (unsigned int i = 0; fOk && i < vEntries.size(); i++) {
+        unsigned int nSize = RecordSize(vEntries[i].second->nSize);
+        fOk = ReadRaw(vEntries[i].first, nSize, vchRecord) &&
+              fwrite(&vchRecord[0], 1, nSize, fileNew) == nSize;
+        vPosNew.push_back(nPos);
+        nPos += nSize;
+    }
+
+    if (fOk) {
+        fflush(fileNew);
+        FileCommit(fileNew);
+    }
+    fclose(fileNew);
+    if (!fOk || !RenameOver(pathTmp, path)) {
+        boost::filesystem::remove(pathTmp);
+        return error("%s : Failed to compact %s", __func__, strFilename);
+    }
+
+    fclose(file);
+    file = fopen(path.string().c_str(), "r+b");
+    if (!file)
+        return error("%s : Failed to reopen file %s", __func__, path.string());
+
+    for (unsigned int i = 0; i < vEntries.size(); i++)
+        vEntries[i].second->nPos = vPosNew[i];
+    nHeaderSize = ssHeader.size();
+    nFileSize = nPos;
+
+    LogPrint("masternode", "Compacted %s from %u to %u bytes  %dms\n", strFilename, nFileSizeOld, nFileSize, GetTimeMillis() - nStart);
+    return true;
+}
+
+size_t CFlatJournal::size() const
+{
+    LOCK(cs);
+    return mapEntries.size();
+}
+
+uint64_t CFlatJournal::GetFileSize() const
+{
+    LOCK(cs);
+    return nFileSize + ssPending.size();
+}
@@ -0,0 +1,188 @@
+// Copyright (c) 2019 The Lytix developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "clientversion.h"
+#include "streams.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+#include <boost/foreach.hpp>
+
+/** Version of the journal file layout */
+static const int JOURNAL_VERSION = 1;
+/** Journals are only compacted once they are at least this large */
+static const unsigned int JOURNAL_COMPACT_MIN_SIZE = 1024 * 1024;
+/** Upper bound for a single record, anything larger is treated as corruption */
+static const unsigned int MAX_JOURNAL_RECORD_SIZE = 32 * 1024 * 1024;
+
+/**
+ * Append-only record file for the masternode, payment and budget caches.
+ *
+ * The file starts with a header (magic message, network magic number, version)
+ * followed by records:
+ *
+ *   type (PUT or ERASE) | table | key | payload size | payload | checksum
+ *
+ * Every record carries its own checksum over everything before it, so a record
+ * that was torn by a crash only loses itself: Open() stops at the first damaged
+ * record and cuts the file there. A later record for the same table and key
+ * replaces an earlier one.
+ *
+ * Open() only reads record headers and keeps the position of each live record.
+ * Payloads are read on demand, so callers can load entries lazily, or stream
+ * them in file order with GetKeys(). Writes append only records whose payload
+ * differs from the stored one and Flush() commits them; once more than half of
+ * the file is superseded records it is rewritten with the live ones only.
+ */
+class CFlatJournal
+{
+public:
+    enum ReadResult {
+        Ok,
+        FileError,
+        IncorrectMagicMessage,
+        IncorrectMagicNumber,
+        IncorrectFormat
+    };
+
+    enum RecordType {
+        RECORD_PUT = 1,
+        RECORD_ERASE = 2
+    };
+
+private:
+    struct CJournalEntry {
+        uint64_t nPos;      // start of the record in the file
+        uint32_t nSize;     // payload size
+        uint64_t nChecksum; // checksum of the record, doubles as a payload fingerprint
+    };
+
+    typedef std::pair<unsigned char, uint256> JournalKey;
+
+    mutable CCriticalSection cs;
+    std::string strFilename;
+    std::string strMagicMessage;
+    FILE* file;
+
+    std::map<JournalKey, CJournalEntry> mapEntries;
+    uint64_t nHeaderSize;
+    uint64_t nFileSize;
+    uint64_t nLiveSize;
+
+    //! Records waiting for Flush()
+    CDataStream ssPending;
+
+    boost::filesystem::path GetPath() const;
+    void SerializeHeader(CDataStream& ss) const;
+    bool ReadRaw(uint64_t nPos, unsigned int nSize, std::vector<char>& vch);
+    void Append(unsigned char nType, unsigned char nTable, const uint256& key, const CDataStream& ssPayload);
+    bool Compact();
+
+public:
+    CFlatJournal(const std::string& strFilenameIn, const std::string& strMagicMessageIn);
+    ~CFlatJournal();
+
+    /// Open the file in the data directory and index its records
+    ReadResult Open();
+
+    /// Throw everything away and start an empty file
+    bool Reset();
+
+    bool IsOpen() const;
+
+    /// Open the file for writing, a missing or damaged file is started over
+    bool OpenForWrite();
+
+    bool Exists(unsigned char nTable, const uint256& key) const;
+
+    /// Keys of a table, in the order their records appear in the file
+    void GetKeys(unsigned char nTable, std::vector<uint256>& vKeys) const;
+
+    /// Payload of a record, false if there is none or it fails its checksum
+    bool ReadRecord(unsigned char nTable, const uint256& key, CDataStream& ssPayload);
+
+    /// Queue a record unless the same payload is already stored for the key
+    void WriteRecord(unsigned char nTable, const uint256& key, const CDataStream& ssPayload);
+
+    void Erase(unsigned char nTable, const uint256& key);
+
+    /// Write queued records to disk and compact the file if it's mostly dead records
+    bool Flush();
+
+    size_t size() const;
+    uint64_t GetFileSize() const;
+
+    template <typename T>
+    bool Read(unsigned char nTable, const uint256& key, T& obj)
+    {
+        CDataStream ssPayload(SER_DISK, CLIENT_VERSION);
+        if (!ReadRecord(nTable, key, ssPayload))
+            return false;
+        try {
+            ssPayload >> obj;
+        } catch (std::exception& e) {
+            return false;
+        }
+        return true;
+    }
+
+    template <typename T>
+    void Write(unsigned char nTable, const uint256& key, const T& obj)
+    {
+        CDataStream ssPayload(SER_DISK, CLIENT_VERSION);
+        ssPayload << obj;
+        WriteRecord(nTable, key, ssPayload);
+    }
+
+    /// Erase every record of the table whose key the container doesn't have
+    template <typename Container>
+    void EraseMissing(unsigned char nTable, const Container& keys)
+    {
+        std::vector<uint256> vKeys;
+        GetKeys(nTable, vKeys);
+        BOOST_FOREACH (const uint256& key, vKeys)
+            if (!keys.count(key))
+                Erase(nTable, key);
+    }
+
+    /**
+     * Bring a table in line with a map. Entries of immutable maps never change
+     * once stored, so they're only written when the key is new.
+     */
+    template <typename V>
+    void WriteMap(unsigned char nTable, const std::map<uint256, V>& map, bool fImmutable)
+    {
+        for (typename std::map<uint256, V>::const_iterator it = map.begin(); it != map.end(); ++it) {
+            if (fImmutable && Exists(nTable, it->first))
+                continue;
+            Write(nTable, it->first, it->second);
+        }
+        EraseMissing(nTable, map);
+    }
+
+    /// Load a table into a map, skipping damaged records
+    template <typename V>
+    void ReadMap(unsigned char nTable, std::map<uint256, V>& map)
+    {
+        std::vector<uint256> vKeys;
+        GetKeys(nTable, vKeys);
+        BOOST_FOREACH (const uint256& key, vKeys) {
+            V value;
+            if (Read(nTable, key, value))
+                map.insert(std::make_pair(key, value));
+        }
+    }
+};
+
+#endif // JOURNAL_H
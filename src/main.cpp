@@ -19,6 +19,7 @@
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
+#include "coinsprefetch.h"
 #include "init.h"
 #include "kernel.h"
 #include "master/node-budget.h"
@@ -31,6 +32,7 @@
 #include "net.h"
 #include "obfuscation.h"
 #include "pow.h"
+#include "sigverify.h"
 #include "spork.h"
 #include "sporkdb.h"
 #include "swifttx.h"
@@ -46,6 +48,7 @@
 #include "libzerocoin/Denominations.h"
 #include "invalid.h"
 
+#include <atomic>
 #include <sstream>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -53,6 +56,7 @@
 #include <boost/filesystem/fstream.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/thread.hpp>
+#include <boost/unordered_set.hpp>
 
 using namespace boost;
 using namespace std;
@@ -73,6 +77,7 @@ map<uint256, uint256> mapProofOfStake;
 set<pair<COutPoint, unsigned int> > setStakeSeen;
 map<unsigned int, unsigned int> mapHashedBlocks;
 CChain chainActive;
+CBlockHashChain chainActiveHashes;
 CBlockIndex* pindexBestHeader = NULL;
 int64_t nTimeBestReceived = 0;
 CWaitableCriticalSection csBestBlock;
@@ -390,6 +395,7 @@ void FinalizeNode(NodeId nodeid)
         mapBlocksInFlight.erase(entry.hash);
     EraseOrphansFor(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
+    sigVerifyPool.ForgetNode(nodeid);
 
     mapNodeState.erase(nodeid);
 }
@@ -614,6 +620,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 CCoinsViewCache* pcoinsTip = NULL;
+CCoinsViewPrefetch* pcoinsprefetch = NULL;
 CBlockTreeDB* pblocktree = NULL;
 CZerocoinDB* zerocoinDB = NULL;
 CSporkDB* pSporkDB = NULL;
@@ -914,6 +921,15 @@ int GetInputAge(CTxIn& vin)
     }
 }
 
+bool GetUTXOCoin(const COutPoint& outpoint, CTxOut& txout, int& nHeight, int& nConfirmations)
+{
+    AssertLockHeld(cs_main);
+    if (!pcoinsTip->GetUTXO(outpoint, txout, nHeight))
+        return false;
+    nConfirmations = chainActive.Height() + 1 - nHeight;
+    return true;
+}
+
 int GetInputAgeIX(uint256 nTXHash, CTxIn& vin)
 {
     int sigs = 0;
@@ -1074,7 +1090,7 @@ bool ContextualCheckZerocoinSpendNoSerialCheck(const CTransaction& tx, const Coi
     return true;
 }
 
-bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state)
+bool CheckZerocoinSpend(const CTransaction& tx, int nChainHeight, bool fVerifySignature, CValidationState& state, std::vector<CZerocoinSpendCheck>* pvSpendChecks)
 {
     //max needed non-mint outputs should be 2 - one for redemption address and a possible 2nd for change
     if (tx.vout.size() > 2) {
@@ -1105,7 +1121,7 @@ bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidati
         if (!txin.scriptSig.IsZerocoinSpend())
             continue;
 
-        CoinSpend newSpend = TxInToZerocoinSpend(txin);
+        CoinSpend newSpend = TxInToZerocoinSpend(txin, nChainHeight);
         vSpends.push_back(newSpend);
 
         //check that the denomination is valid
@@ -1129,12 +1145,16 @@ bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidati
                 return state.DoS(100, error("%s: Zerocoinspend could not find accumulator associated with checksum %s", __func__, HexStr(BEGIN(nChecksum), END(nChecksum))));
             }
 
-            Accumulator accumulator(Params().Zerocoin_Params(chainActive.Height() < Params().Zerocoin_Block_V2_Start()),
-                                    newSpend.getDenomination(), bnAccumulatorValue);
+            CZerocoinSpendCheck check(newSpend, Params().Zerocoin_Params(nChainHeight < Params().Zerocoin_Block_V2_Start()),
+                                      bnAccumulatorValue);
 
             //Check that the coin has been accumulated
-            if(!newSpend.Verify(accumulator))
-                    return state.DoS(100, error("CheckZerocoinSpend(): zerocoin spend did not verify"));
+            if (pvSpendChecks) {
+                pvSpendChecks->push_back(CZerocoinSpendCheck());
+                check.swap(pvSpendChecks->back());
+            } else if (!check()) {
+                return state.DoS(100, error("CheckZerocoinSpend(): zerocoin spend did not verify"));
+            }
         }
 
         if (serials.count(newSpend.getCoinSerialNumber()))
@@ -1154,7 +1174,21 @@ bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidati
     return fValidated;
 }
 
-bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, CValidationState& state)
+// Do not require signature verification if this is initial sync and a block over 24 hours old.
+// Block check threads must not get here, ConnectBlock holds cs_main while it waits for them.
+static bool VerifyZerocoinSpends()
+{
+    AssertLockHeld(cs_main);
+    return !IsInitialBlockDownload() && (GetTime() - chainActive.Tip()->GetBlockTime() < (60*60*24));
+}
+
+bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, CValidationState& state, std::vector<CZerocoinSpendCheck>* pvSpendChecks)
+{
+    bool fVerifySpends = fZerocoinActive && tx.IsZerocoinSpend() && VerifyZerocoinSpends();
+    return CheckTransaction(tx, fZerocoinActive, chainActive.Height(), fVerifySpends, state, pvSpendChecks);
+}
+
+bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, int nChainHeight, bool fVerifySpends, CValidationState& state, std::vector<CZerocoinSpendCheck>* pvSpendChecks)
 {
     // Basic checks that don't depend on any context
     if (tx.vin.empty())
@@ -1208,9 +1242,7 @@ bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, CValidationS
                                      error("CheckTransaction() : zerocoinspend contains inputs that are not zerocoins"));
             }
 
-            // Do not require signature verification if this is initial sync and a block over 24 hours old
-            bool fVerifySignature = !IsInitialBlockDownload() && (GetTime() - chainActive.Tip()->GetBlockTime() < (60*60*24));
-            if (!CheckZerocoinSpend(tx, fVerifySignature, state))
+            if (!CheckZerocoinSpend(tx, nChainHeight, fVerifySpends, state, pvSpendChecks))
                 return state.DoS(100, error("CheckTransaction() : invalid zerocoin spend"));
         }
     }
@@ -1229,7 +1261,7 @@ bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, CValidationS
     }
 
     if (tx.IsCoinBase()) {
-        unsigned int expectedScriptSigLength = chainActive.Height() > Params().LAST_POW_BLOCK() ? 2 : 1;
+        unsigned int expectedScriptSigLength = nChainHeight > Params().LAST_POW_BLOCK() ? 2 : 1;
         if (tx.vin[0].scriptSig.size() < expectedScriptSigLength || tx.vin[0].scriptSig.size() > 150)
             return state.DoS(100, error("CheckTransaction() : coinbase script size=%d", tx.vin[0].scriptSig.size()),
                 REJECT_INVALID, "bad-cb-length");
@@ -1848,7 +1880,7 @@ bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos)
     return true;
 }
 
-bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
+static bool ReadBlockFromDiskUnchecked(CBlock& block, const CDiskBlockPos& pos)
 {
     block.SetNull();
 
@@ -1864,6 +1896,14 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
         return error("%s : Deserialize or I/O error - %s", __func__, e.what());
     }
 
+    return true;
+}
+
+bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
+{
+    if (!ReadBlockFromDiskUnchecked(block, pos))
+        return false;
+
     // Check the header
     if (block.IsProofOfWork()) {
         if (!CheckProofOfWork(block.GetHash(), block.nBits))
@@ -1873,8 +1913,32 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
     return true;
 }
 
-bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
+/** Whether the header has the same fields as the index entry, and therefore its hash */
+static bool IsIndexedHeader(const CBlockHeader& block, const CBlockIndex* pindex)
 {
+    uint256 hashPrevBlock = pindex->pprev ? pindex->pprev->GetBlockHash() : 0;
+    return block.nVersion == pindex->nVersion &&
+           block.hashPrevBlock == hashPrevBlock &&
+           block.hashMerkleRoot == pindex->hashMerkleRoot &&
+           block.nTime == pindex->nTime &&
+           block.nBits == pindex->nBits &&
+           block.nNonce == pindex->nNonce &&
+           (block.nVersion <= 3 || block.nAccumulatorCheckpoint == pindex->nAccumulatorCheckpoint);
+}
+
+bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, bool fTrusted)
+{
+    if (fTrusted) {
+        // The index entry is keyed by the hash of these fields, and its proof of work was checked when the
+        // header was accepted and again when the index was loaded. Comparing the fields saves hashing the
+        // block again, which for old blocks is a full HashQuark.
+        if (!ReadBlockFromDiskUnchecked(block, pindex->GetBlockPos()))
+            return false;
+        if (!IsIndexedHeader(block, pindex))
+            return error("ReadBlockFromDisk(CBlock&, CBlockIndex*) : header doesn't match index %s", pindex->GetBlockHash().ToString());
+        return true;
+    }
+
     if (!ReadBlockFromDisk(block, pindex->GetBlockPos()))
         return false;
     if (block.GetHash() != pindex->GetBlockHash()) {
@@ -2513,12 +2577,24 @@ void static FlushBlockFile(bool fFinalize = false)
 
 bool FindUndoPos(CValidationState& state, int nFile, CDiskBlockPos& pos, unsigned int nAddSize);
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+static CCheckQueue<CBlockCheck> blockcheckqueue(128);
+// the checks of one block at a time, whoever holds this uses blockcheckqueue
+static CCriticalSection cs_blockcheckqueue;
 
 void ThreadScriptCheck()
 {
     RenameThread("lytix-scriptch");
-    scriptcheckqueue.Thread();
+    blockcheckqueue.Thread();
+}
+
+/** Hand a batch of checks over to the block check queue, only script checks can go before the wait */
+template <typename T>
+static void AddBlockChecks(CCheckQueueControl<CBlockCheck>& control, std::vector<T>& vChecks)
+{
+    std::vector<CBlockCheck> vBlockChecks(vChecks.size());
+    for (unsigned int i = 0; i < vChecks.size(); i++)
+        vBlockChecks[i].Set(vChecks[i]);
+    control.Add(vBlockChecks);
 }
 
 void RecalculateZPIVMinted()
@@ -2764,14 +2840,18 @@ static int64_t nTimeConnect = 0;
 static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
+//! Budget and payee checks, CheckBlock runs them without cs_main
+static std::atomic<int64_t> nTimePayeeChecks(0);
 
 bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck, bool fAlreadyChecked)
 {
     bool isGenesis = block.GetHash() == Params().HashGenesisBlock() && pindex->nHeight == 0;
 
     AssertLockHeld(cs_main);
-    // Check it again in case a previous version let a bad block in
-    if (!isGenesis && !fAlreadyChecked && !CheckBlock(block, state, !fJustCheck, !fJustCheck))
+    // Check it again in case a previous version let a bad block in. The zerocoin spend proofs
+    // are verified on the script check threads, along with the scripts.
+    std::vector<CZerocoinSpendCheck> vSpendChecks;
+    if (!isGenesis && !fAlreadyChecked && !CheckBlock(block, state, !fJustCheck, !fJustCheck, true, nScriptCheckThreads ? &vSpendChecks : NULL))
         return false;
 
     // verify that the view's current state corresponds to the previous block
@@ -2817,7 +2897,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                 REJECT_INVALID, "bad-txns-BIP30");
     }
 
-    CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
+    // a block whose transactions are being checked elsewhere has the queue for a moment only
+    LOCK(cs_blockcheckqueue);
+    CCheckQueueControl<CBlockCheck> control(nScriptCheckThreads ? &blockcheckqueue : NULL);
+    AddBlockChecks(control, vSpendChecks);
 
     int64_t nTimeStart = GetTimeMicros();
     CAmount nFees = 0;
@@ -2927,7 +3010,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG;
             if (!CheckInputs(tx, state, view, fScriptChecks, flags, false, nScriptCheckThreads ? &vChecks : NULL))
                 return false;
-            control.Add(vChecks);
+            AddBlockChecks(control, vChecks);
         }
         nValueOut += tx.GetValueOut();
 
@@ -2971,7 +3054,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         }
 
         //Check that the block does not overmint
-        if (!IsBlockValueValid(block, nExpectedMint, pindex->pprev->nMint)) {
+        int64_t nTimeValueStart = GetTimeMicros();
+        bool fValueValid = IsBlockValueValid(block, nExpectedMint, pindex->pprev->nMint);
+        int64_t nTimeValue = GetTimeMicros() - nTimeValueStart;
+        nTimePayeeChecks += nTimeValue;
+        LogPrint("bench", "      - Block value checks: %.2fms [%.2fs]\n", nTimeValue * 0.001, nTimePayeeChecks * 0.000001);
+        if (!fValueValid) {
             return state.DoS(100, error("ConnectBlock() : reward pays too much (actual=%s vs limit=%s)",
                                         FormatMoney(pindex->pprev->nMint), FormatMoney(nExpectedMint)),
                              REJECT_INVALID, "bad-cb-amount");
@@ -2985,7 +3073,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                                     block.GetHash().GetHex(), pindex->nHeight), REJECT_INVALID, "bad-acc-checkpoint");
 
     if (!control.Wait())
-        return state.DoS(100, false);
+        return state.DoS(100, error("ConnectBlock() : input scripts or zerocoin spends did not verify"));
     int64_t nTime2 = GetTimeMicros();
     nTimeVerify += nTime2 - nTimeStart;
     LogPrint("bench", "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime2 - nTimeStart), nInputs <= 1 ? 0 : 0.001 * (nTime2 - nTimeStart) / (nInputs - 1), nTimeVerify * 0.000001);
@@ -3154,6 +3242,7 @@ void FlushStateToDisk()
 void static UpdateTip(CBlockIndex* pindexNew)
 {
     chainActive.SetTip(pindexNew);
+    chainActiveHashes.SetTip(pindexNew);
 
 #ifdef ENABLE_WALLET
     // If turned on AutoZeromint will automatically convert LYTX to zLYTX
@@ -3902,8 +3991,93 @@ bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool f
     return true;
 }
 
-bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig)
+bool CTxCheck::operator()()
+{
+    fChecked = true;
+
+    // a malformed zerocoin spend throws, which mustn't escape a check thread
+    try {
+        if (!CheckTransaction(*ptx, fZerocoinActive, nChainHeight, fVerifySpends, *pstate, pvSpendChecks))
+            return false;
+
+        if (ptx->IsZerocoinSpend()) {
+            BOOST_FOREACH (const CTxIn& txin, ptx->vin) {
+                if (txin.scriptSig.IsZerocoinSpend())
+                    pvSerialHashes->push_back(GetSerialHash(TxInToZerocoinSpend(txin, nChainHeight).getCoinSerialNumber()));
+            }
+        }
+    } catch (const std::exception& e) {
+        return pstate->DoS(100, error("CheckTransaction() : %s", e.what()), REJECT_INVALID, "bad-txns-zerocoinspend");
+    }
+    return true;
+}
+
+bool CZerocoinSpendCheck::operator()()
+{
+    libzerocoin::Accumulator accumulator(params, pspend->getDenomination(), bnAccumulatorValue);
+    return pspend->Verify(accumulator);
+}
+
+/**
+ * Run the transaction checks of a block on the block check threads. The queue
+ * stops at the first transaction that fails, its state is the one returned.
+ */
+static bool CheckBlockTransactionsParallel(const CBlock& block, bool fZerocoinActive, int nChainHeight, bool fVerifySpends, CValidationState& state, std::vector<CZerocoinSpendCheck>* pvSpendChecks)
+{
+    // the zerocoin params are set up on first use, don't leave that to the workers
+    if (fZerocoinActive)
+        Params().Zerocoin_Params(false);
+
+    std::vector<CValidationState> vStates(block.vtx.size());
+    std::vector<std::vector<uint256> > vSerialHashes(block.vtx.size());
+    std::vector<std::vector<CZerocoinSpendCheck> > vSpendChecks(pvSpendChecks ? block.vtx.size() : 0);
+    std::vector<CTxCheck> vChecks;
+    vChecks.reserve(block.vtx.size());
+    for (unsigned int i = 0; i < block.vtx.size(); i++)
+        vChecks.push_back(CTxCheck(block.vtx[i], fZerocoinActive, nChainHeight, fVerifySpends, vStates[i], vSerialHashes[i], pvSpendChecks ? &vSpendChecks[i] : NULL));
+    {
+        CCheckQueueControl<CBlockCheck> control(&blockcheckqueue);
+        AddBlockChecks(control, vChecks);
+        if (!control.Wait()) {
+            // blame the earliest bad transaction, the ones before the first failure the queue skipped are checked here
+            for (unsigned int i = 0; i < vChecks.size(); i++) {
+                if (!vChecks[i].fChecked && vChecks[i]())
+                    continue;
+                if (!vStates[i].IsValid()) {
+                    state = vStates[i];
+                    return false;
+                }
+            }
+            return state.DoS(100, error("CheckBlock() : transaction check failed"));
+        }
+    }
+
+    // no zerocoin serial may be spent twice in the block
+    boost::unordered_set<uint256, CCoinsKeyHasher> setSerialHashes;
+    BOOST_FOREACH (const std::vector<uint256>& vHashes, vSerialHashes) {
+        BOOST_FOREACH (const uint256& hashSerial, vHashes) {
+            if (!setSerialHashes.insert(hashSerial).second)
+                return state.DoS(100, error("%s : Double spending of zLYTX serial hash %s in block %s", __func__,
+                                            hashSerial.GetHex(), block.GetHash().GetHex()));
+        }
+    }
+
+    for (unsigned int i = 0; i < vSpendChecks.size(); i++) {
+        BOOST_FOREACH (CZerocoinSpendCheck& check, vSpendChecks[i]) {
+            pvSpendChecks->push_back(CZerocoinSpendCheck());
+            check.swap(pvSpendChecks->back());
+        }
+    }
+    return true;
+}
+
+bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig, std::vector<CZerocoinSpendCheck>* pvSpendChecks)
 {
+    // a caller that doesn't verify the spend proofs itself has them verified on the script check threads
+    std::vector<CZerocoinSpendCheck> vSpendChecks;
+    if (!pvSpendChecks && nScriptCheckThreads)
+        pvSpendChecks = &vSpendChecks;
+
     // don't check genesis... the ledger transfer means multiple coinbases
     if (block.GetHash() == Params().HashGenesisBlock())
         return true;
@@ -4011,7 +4185,12 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         // The case also exists that the sending peer could not have enough data to see
         // that this block is invalid, so don't issue an outright ban.
         if (nHeight != 0 && !IsInitialBlockDownload()) {
-            if (!IsBlockPayeeValid(block, nHeight)) {
+            int64_t nTimeStart = GetTimeMicros();
+            bool fPayeeValid = IsBlockPayeeValid(block, nHeight);
+            int64_t nTimePayee = GetTimeMicros() - nTimeStart;
+            nTimePayeeChecks += nTimePayee;
+            LogPrint("bench", "  - Block payee checks: %.2fms [%.2fs]\n", nTimePayee * 0.001, nTimePayeeChecks * 0.000001);
+            if (!fPayeeValid) {
                 mapRejectedBlocks.insert(make_pair(block.GetHash(), GetTime()));
                 return state.DoS(0, error("CheckBlock() : Couldn't find masternode/budget payment"),
                         REJECT_INVALID, "bad-cb-payee");
@@ -4022,28 +4201,66 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         }
     }
 
-    // Check transactions
+    // The chain context of the transaction checks is fixed here, the check threads don't take
+    // cs_main, which the caller may hold while waiting for them.
     bool fZerocoinActive = block.GetBlockTime() > Params().Zerocoin_StartTime();
-    vector<CBigNum> vBlockSerials;
-    for (const CTransaction& tx : block.vtx) {
-        LogPrint("debug", "Checking Transaction %s", tx.ToString().c_str());
-        if (!CheckTransaction(tx, fZerocoinActive, state))
-            return error("CheckBlock() : CheckTransaction failed");
+    bool fVerifySpends = false;
+    int nChainHeight;
+    {
+        LOCK(cs_main);
+        nChainHeight = chainActive.Height();
+        if (fZerocoinActive) {
+            for (const CTransaction& tx : block.vtx) {
+                if (tx.IsZerocoinSpend()) {
+                    fVerifySpends = VerifyZerocoinSpends();
+                    break;
+                }
+            }
+        }
+    }
 
-        // double check that there are no double spent zPIV spends in this block
-        if (tx.IsZerocoinSpend()) {
-            for (const CTxIn txIn : tx.vin) {
-                if (txIn.scriptSig.IsZerocoinSpend()) {
-                    libzerocoin::CoinSpend spend = TxInToZerocoinSpend(txIn);
-                    if (count(vBlockSerials.begin(), vBlockSerials.end(), spend.getCoinSerialNumber()))
-                        return state.DoS(100, error("%s : Double spending of zLYTX serial %s in block\n Block: %s",
-                                                    __func__, spend.getCoinSerialNumber().GetHex(), block.ToString()));
-                    vBlockSerials.emplace_back(spend.getCoinSerialNumber());
+    // Check transactions, spread over the block check threads when there are enough of them.
+    // Another block being checked at the same time has its transactions checked right here.
+    bool fTransactionsChecked = false;
+    if (nScriptCheckThreads && block.vtx.size() >= MIN_PARALLEL_TX_CHECKS) {
+        TRY_LOCK(cs_blockcheckqueue, lockQueue);
+        if (lockQueue) {
+            if (!CheckBlockTransactionsParallel(block, fZerocoinActive, nChainHeight, fVerifySpends, state, pvSpendChecks))
+                return error("CheckBlock() : CheckTransaction failed");
+            fTransactionsChecked = true;
+        }
+    }
+
+    if (!fTransactionsChecked) {
+        boost::unordered_set<uint256, CCoinsKeyHasher> setSerialHashes;
+        for (const CTransaction& tx : block.vtx) {
+            if (LogAcceptCategory("debug"))
+                LogPrint("debug", "Checking Transaction %s", tx.ToString().c_str());
+            if (!CheckTransaction(tx, fZerocoinActive, nChainHeight, fVerifySpends, state, pvSpendChecks))
+                return error("CheckBlock() : CheckTransaction failed");
+
+            // double check that there are no double spent zPIV spends in this block
+            if (tx.IsZerocoinSpend()) {
+                for (const CTxIn txIn : tx.vin) {
+                    if (txIn.scriptSig.IsZerocoinSpend()) {
+                        libzerocoin::CoinSpend spend = TxInToZerocoinSpend(txIn, nChainHeight);
+                        if (!setSerialHashes.insert(GetSerialHash(spend.getCoinSerialNumber())).second)
+                            return state.DoS(100, error("%s : Double spending of zLYTX serial %s in block\n Block: %s",
+                                                        __func__, spend.getCoinSerialNumber().GetHex(), block.ToString()));
+                    }
                 }
             }
         }
     }
 
+    if (!vSpendChecks.empty()) {
+        LOCK(cs_blockcheckqueue);
+        CCheckQueueControl<CBlockCheck> control(&blockcheckqueue);
+        AddBlockChecks(control, vSpendChecks);
+        if (!control.Wait())
+            return state.DoS(100, error("CheckBlock() : zerocoin spend did not verify"));
+    }
+
 
     unsigned int nSigOps = 0;
     BOOST_FOREACH (const CTransaction& tx, block.vtx) {
@@ -4622,6 +4839,14 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
             mapBlockSource[pindex->GetBlockHash ()] = pfrom->GetId ();
         }
         CheckBlockIndex ();
+
+        // during initial sync blocks are downloaded from several peers and arrive ahead of the
+        // tip, read the coins they spend on the prefetch threads while the blocks before them
+        // come in and connect. The next block is connected right below, so it gets no head start.
+        if (ret && pindex && pcoinsprefetch && IsInitialBlockDownload() &&
+            pindex->nHeight > chainActive.Height() + 1 && pindex->nHeight <= chainActive.Height() + MAX_PREFETCH_BLOCKS_AHEAD)
+            pcoinsprefetch->PrefetchInputs(*pblock, pindex->nHeight, chainActive.Height());
+
         if (!ret) {
             // Check spamming
             if(pindex && pfrom && GetBoolArg("-blockspamfilter", DEFAULT_BLOCK_SPAM_FILTER)) {
@@ -4886,6 +5111,7 @@ bool static LoadBlockIndexDB(string& strError)
     if (it == mapBlockIndex.end())
         return true;
     chainActive.SetTip(it->second);
+    chainActiveHashes.SetTip(it->second);
 
     PruneBlockIndexCandidates();
 
@@ -4931,8 +5157,8 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
         if (pindex->nHeight < chainActive.Height() - nCheckDepth)
             break;
         CBlock block;
-        // check level 0: read from disk
-        if (!ReadBlockFromDisk(block, pindex))
+        // check level 0: read from disk, and hash it again
+        if (!ReadBlockFromDisk(block, pindex, false))
             return error("VerifyDB() : *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
         // check level 1: verify block validity
         if (nCheckLevel >= 1 && !CheckBlock(block, state))
@@ -4989,6 +5215,7 @@ void UnloadBlockIndex()
     mapBlockIndex.clear();
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
+    chainActiveHashes.SetTip(NULL);
     pindexBestInvalid = NULL;
 }
 
@@ -5760,6 +5987,20 @@ void static ProcessGetData(CNode* pfrom)
 }
 
 bool fRequestedSporksIDB = false;
+void static ProcessMessageExtensions(CNode* pfrom, string& strCommand, CDataStream& vRecv)
+{
+    //obfuScationPool.ProcessMessageObfuscation(pfrom, strCommand, vRecv);
+    mnodeman.ProcessMessage(pfrom, strCommand, vRecv);
+    maxnodeman.ProcessMessage(pfrom, strCommand, vRecv);
+    budget.ProcessMessage(pfrom, strCommand, vRecv);
+    masternodePayments.ProcessMessageMasternodePayments(pfrom, strCommand, vRecv);
+    maxnodePayments.ProcessMessageMaxnodePayments(pfrom, strCommand, vRecv);
+    ProcessMessageSwiftTX(pfrom, strCommand, vRecv);
+    ProcessSpork(pfrom, strCommand, vRecv);
+    masternodeSync.ProcessMessage(pfrom, strCommand, vRecv);
+    maxnodeSync.ProcessMessage(pfrom, strCommand, vRecv);
+}
+
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
 {
     RandAddSeedPerfmon();
@@ -6657,16 +6898,14 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         }
     } else {
         //probably one the extensions
-        //obfuScationPool.ProcessMessageObfuscation(pfrom, strCommand, vRecv);
-        mnodeman.ProcessMessage(pfrom, strCommand, vRecv);
-        maxnodeman.ProcessMessage(pfrom, strCommand, vRecv);
-        budget.ProcessMessage(pfrom, strCommand, vRecv);
-        masternodePayments.ProcessMessageMasternodePayments(pfrom, strCommand, vRecv);
-        maxnodePayments.ProcessMessageMaxnodePayments(pfrom, strCommand, vRecv);
-        ProcessMessageSwiftTX(pfrom, strCommand, vRecv);
-        ProcessSpork(pfrom, strCommand, vRecv);
-        masternodeSync.ProcessMessage(pfrom, strCommand, vRecv);
-        maxnodeSync.ProcessMessage(pfrom, strCommand, vRecv);
+        // the same ping is relayed by most peers, drop the copies before anything is deserialized or verified,
+        // behind the gate of the handlers so the pings they ignore while syncing aren't remembered
+        if (strCommand == "mnp" && !fLiteMode && masternodeSync.IsBlockchainSynced() && mnodeman.IsPingMessageSeen(vRecv)) return true;
+        if (strCommand == "maxp" && !fLiteMode && maxnodeSync.IsBlockchainSynced() && maxnodeman.IsPingMessageSeen(vRecv)) return true;
+
+        // signed masternode messages wait for the verification pool and are replayed from ProcessMessages
+        if (!sigVerifyPool.Defer(pfrom, strCommand, vRecv))
+            ProcessMessageExtensions(pfrom, strCommand, vRecv);
     }
 
 
@@ -6716,6 +6955,20 @@ bool ProcessMessages(CNode* pfrom)
     // this maintains the order of responses
     if (!pfrom->vRecvGetData.empty()) return fOk;
 
+    // masternode messages whose signatures the verification pool has checked
+    CSigVerifyJobRef job;
+    while (!pfrom->fDisconnect && sigVerifyPool.PopVerified(pfrom->id, job)) {
+        try {
+            ProcessMessageExtensions(pfrom, job->strCommand, job->vRecv);
+        } catch (std::exception& e) {
+            PrintExceptionContinue(&e, "ProcessMessages()");
+        }
+    }
+
+    // the peer's queue in the pool is full, leave its messages in the receive buffer until the workers catch up
+    pfrom->fPauseRecv = sigVerifyPool.IsFull(pfrom->id);
+    if (pfrom->fPauseRecv) return fOk;
+
     std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin();
     while (!pfrom->fDisconnect && it != pfrom->vRecvMsg.end()) {
         // Don't bother if send buffer is too full to respond anyway
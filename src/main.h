@@ -42,6 +42,7 @@
 
 #include "libzerocoin/CoinSpend.h"
 
+#include <boost/shared_ptr.hpp>
 #include <boost/unordered_map.hpp>
 
 class CBlockIndex;
@@ -49,8 +50,10 @@ class CBlockTreeDB;
 class CZerocoinDB;
 class CSporkDB;
 class CBloomFilter;
+class CCoinsViewPrefetch;
 class CInv;
 class CScriptCheck;
+class CZerocoinSpendCheck;
 class CValidationInterface;
 class CValidationState;
 
@@ -104,6 +107,8 @@ static const unsigned int LOCKTIME_THRESHOLD = 500000000; // Tue Nov  5 00:53:20
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Blocks with fewer transactions than this have them checked on the calling thread */
+static const unsigned int MIN_PARALLEL_TX_CHECKS = 16;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -239,7 +244,7 @@ bool ProcessMessages(CNode* pfrom);
  * @param[in]   fSendTrickle    When true send the trickled data, otherwise trickle the data until true.
  */
 bool SendMessages(CNode* pto, bool fSendTrickle);
-/** Run an instance of the script checking thread */
+/** Run an instance of the script checking thread, which also checks transactions and zerocoin spends of blocks */
 void ThreadScriptCheck();
 
 // ***TODO*** probably not the right place for these 2
@@ -285,6 +290,13 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
 
 
 int GetInputAge(CTxIn& vin);
+/**
+ * Value, height and confirmations of an unspent output of the active chain,
+ * from the UTXO set alone: no mempool, fees or transaction index involved.
+ * This is what masternode and maxnode collaterals are checked with.
+ * Requires cs_main.
+ */
+bool GetUTXOCoin(const COutPoint& outpoint, CTxOut& txout, int& nHeight, int& nConfirmations);
 int GetInputAgeIX(uint256 nTXHash, CTxIn& vin);
 bool GetCoinAge(const CTransaction& tx, unsigned int nTxTime, uint64_t& nCoinAge);
 int GetIXConfirmations(uint256 nTXHash);
@@ -375,9 +387,18 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
 void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCache& inputs, CTxUndo& txundo, int nHeight);
 
 /** Context-independent validity checks */
-bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, CValidationState& state);
+bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, CValidationState& state, std::vector<CZerocoinSpendCheck>* pvSpendChecks = NULL);
+/**
+ * CheckTransaction against the given chain height, verifying zerocoin spend proofs only if
+ * fVerifySpends. This doesn't touch cs_main or chainActive, so it can run on the check threads.
+ */
+bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, int nChainHeight, bool fVerifySpends, CValidationState& state, std::vector<CZerocoinSpendCheck>* pvSpendChecks = NULL);
 bool CheckZerocoinMint(const uint256& txHash, const CTxOut& txout, CValidationState& state, bool fCheckOnly = false);
-bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state);
+/**
+ * Context-free checks of a zerocoin spend. With pvSpendChecks, the expensive spend proofs are
+ * appended to it instead of being verified right away, as CheckInputs does with scripts.
+ */
+bool CheckZerocoinSpend(const CTransaction& tx, int nChainHeight, bool fVerifySignature, CValidationState& state, std::vector<CZerocoinSpendCheck>* pvSpendChecks = NULL);
 bool ContextualCheckZerocoinSpend(const CTransaction& tx, const libzerocoin::CoinSpend& spend, CBlockIndex* pindex, const uint256& hashBlock);
 bool ContextualCheckZerocoinSpendNoSerialCheck(const CTransaction& tx, const libzerocoin::CoinSpend& spend, CBlockIndex* pindex, const uint256& hashBlock);
 bool IsTransactionInChain(const uint256& txId, int& nHeightTx, CTransaction& tx);
@@ -461,11 +482,136 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Closure representing the context-free checks of one transaction of a block:
+ * CheckTransaction, and the hashes of the zerocoin serials it spends. The chain
+ * context is fixed by whoever creates it, the check threads don't take cs_main.
+ */
+class CTxCheck
+{
+private:
+    const CTransaction* ptx;
+    bool fZerocoinActive;
+    int nChainHeight;
+    bool fVerifySpends;
+    CValidationState* pstate;
+    std::vector<uint256>* pvSerialHashes;
+    std::vector<CZerocoinSpendCheck>* pvSpendChecks; // spend proofs left for later, verified right away if NULL
+
+public:
+    //! Set once run, the queue skips the checks left after one failed
+    bool fChecked;
+
+    CTxCheck() : ptx(0), fZerocoinActive(false), nChainHeight(0), fVerifySpends(false), pstate(0), pvSerialHashes(0), pvSpendChecks(0), fChecked(false) {}
+    CTxCheck(const CTransaction& txIn, bool fZerocoinActiveIn, int nChainHeightIn, bool fVerifySpendsIn, CValidationState& stateIn, std::vector<uint256>& vSerialHashesIn, std::vector<CZerocoinSpendCheck>* pvSpendChecksIn) : ptx(&txIn), fZerocoinActive(fZerocoinActiveIn), nChainHeight(nChainHeightIn),
+                                                                                                                                                                                                                              fVerifySpends(fVerifySpendsIn), pstate(&stateIn), pvSerialHashes(&vSerialHashesIn), pvSpendChecks(pvSpendChecksIn), fChecked(false) {}
+
+    bool operator()();
+};
+
+/**
+ * Closure representing the proofs of one zerocoin spend: the accumulator proof of
+ * knowledge and the serial number signature of knowledge, checked against the
+ * accumulator value the spend refers to.
+ */
+class CZerocoinSpendCheck
+{
+private:
+    boost::shared_ptr<const libzerocoin::CoinSpend> pspend;
+    const libzerocoin::ZerocoinParams* params;
+    CBigNum bnAccumulatorValue;
+
+public:
+    CZerocoinSpendCheck() : params(0) {}
+    CZerocoinSpendCheck(const libzerocoin::CoinSpend& spendIn, const libzerocoin::ZerocoinParams* paramsIn, const CBigNum& bnAccumulatorValueIn) : pspend(new libzerocoin::CoinSpend(spendIn)), params(paramsIn), bnAccumulatorValue(bnAccumulatorValueIn) {}
+
+    bool operator()();
+
+    void swap(CZerocoinSpendCheck& check)
+    {
+        pspend.swap(check.pspend);
+        std::swap(params, check.params);
+        std::swap(bnAccumulatorValue, check.bnAccumulatorValue);
+    }
+};
+
+/**
+ * One of the checks the -par threads run for a block: the scripts of an input,
+ * the checks of a transaction or the proofs of a zerocoin spend. The kinds share
+ * one check queue, so that a single set of threads serves all of them.
+ *
+ * Script checks, one per input and by far the most, are held by value. The other
+ * kinds are few per block and are only pointed to, they stay with whoever queued
+ * them until the queue has been waited for.
+ */
+class CBlockCheck
+{
+private:
+    enum CheckType {
+        CHECK_NONE,
+        CHECK_SCRIPT,
+        CHECK_TX,
+        CHECK_SPEND,
+    };
+
+    CheckType nType;
+    CScriptCheck scriptCheck;
+    CTxCheck* ptxCheck;
+    CZerocoinSpendCheck* pspendCheck;
+
+public:
+    CBlockCheck() : nType(CHECK_NONE), ptxCheck(0), pspendCheck(0) {}
+
+    bool operator()()
+    {
+        switch (nType) {
+        case CHECK_SCRIPT:
+            return scriptCheck();
+        case CHECK_TX:
+            return (*ptxCheck)();
+        case CHECK_SPEND:
+            return (*pspendCheck)();
+        default:
+            return true;
+        }
+    }
+
+    void swap(CBlockCheck& check)
+    {
+        std::swap(nType, check.nType);
+        scriptCheck.swap(check.scriptCheck);
+        std::swap(ptxCheck, check.ptxCheck);
+        std::swap(pspendCheck, check.pspendCheck);
+    }
+
+    //! Take over a script check
+    void Set(CScriptCheck& check)
+    {
+        scriptCheck.swap(check);
+        nType = CHECK_SCRIPT;
+    }
+
+    //! Run a transaction check that outlives the wait for the queue
+    void Set(CTxCheck& check)
+    {
+        ptxCheck = &check;
+        nType = CHECK_TX;
+    }
+
+    //! Run the proofs of a zerocoin spend that outlive the wait for the queue
+    void Set(CZerocoinSpendCheck& check)
+    {
+        pspendCheck = &check;
+        nType = CHECK_SPEND;
+    }
+};
+
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
-bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+/** Read an indexed block. Trusted reads compare the header with the index instead of hashing it again */
+bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, bool fTrusted = true);
 
 
 /** Functions for validating blocks and updating the block tree */
@@ -484,7 +630,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
 /** Context-independent validity checks */
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW = true);
-bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckSig = true);
+/**
+ * With pvSpendChecks, the zerocoin spend proofs are appended to it for the caller to verify,
+ * otherwise they are verified here, on the script check threads if there are any.
+ */
+bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckSig = true, std::vector<CZerocoinSpendCheck>* pvSpendChecks = NULL);
 bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev);
 
 /** Context-dependent validity checks */
@@ -651,9 +801,15 @@ bool ReconsiderBlock(CValidationState& state, CBlockIndex* pindex);
 /** The currently-connected chain of blocks. */
 extern CChain chainActive;
 
+/** The blocks of chainActive, readable without cs_main, follows every change of its tip */
+extern CBlockHashChain chainActiveHashes;
+
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache* pcoinsTip;
 
+/** Reads the coins of the next block ahead during initial sync, NULL if -prefetchthreads=0 */
+extern CCoinsViewPrefetch* pcoinsprefetch;
+
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB* pblocktree;
 
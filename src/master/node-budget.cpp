@@ -8,6 +8,7 @@
 #include "main.h"
 
 #include "addrman.h"
+#include "journal.h"
 #include "master/node-budget.h"
 #include "master/node-sync.h"
 #include "master/node.h"
@@ -117,33 +118,143 @@ bool IsBudgetCollateralValid(uint256 nTxCollateralHash, uint256 nExpectedHash, s
     }
 }
 
-void CBudgetManager::CheckOrphanVotes()
+// Orphan votes are keyed by their own hash and indexed by the hash they wait for and by
+// the masternode that cast them, holding only the latest vote of a masternode for each
+// proposal or budget
+typedef std::map<COutPoint, std::set<std::pair<int64_t, uint256> > > OrphanVotesByNode;
+
+template <typename T>
+static void EraseOrphanVote(std::map<uint256, T>& mapOrphans, std::map<uint256, std::set<uint256> >& mapByParent,
+    OrphanVotesByNode& mapByNode, uint256 T::*pParentHash, typename std::map<uint256, T>::iterator mi)
+{
+    const T& vote = (*mi).second;
+    std::map<uint256, std::set<uint256> >::iterator pi = mapByParent.find(vote.*pParentHash);
+    if (pi != mapByParent.end()) {
+        (*pi).second.erase((*mi).first);
+        if ((*pi).second.empty()) mapByParent.erase(pi);
+    }
+    OrphanVotesByNode::iterator ni = mapByNode.find(vote.vin.prevout);
+    if (ni != mapByNode.end()) {
+        (*ni).second.erase(std::make_pair(vote.nTime, (*mi).first));
+        if ((*ni).second.empty()) mapByNode.erase(ni);
+    }
+    mapOrphans.erase(mi);
+}
+
+template <typename T>
+static bool KeepOrphanVote(std::map<uint256, T>& mapOrphans, std::map<uint256, std::set<uint256> >& mapByParent,
+    OrphanVotesByNode& mapByNode, uint256 T::*pParentHash, T& vote, int nMaxPerNode)
+{
+    // votes from the future aren't accepted for known proposals either, they would never make room
+    if (vote.nTime > GetTime() + (60 * 60)) return false;
+
+    // replaces an older vote of the masternode for the same proposal or budget
+    typename std::map<uint256, T>::iterator miReplaced = mapOrphans.end();
+    std::map<uint256, std::set<uint256> >::iterator pi = mapByParent.find(vote.*pParentHash);
+    if (pi != mapByParent.end()) {
+        BOOST_FOREACH (const uint256& nHash, (*pi).second) {
+            typename std::map<uint256, T>::iterator mi = mapOrphans.find(nHash);
+            if (mi == mapOrphans.end() || (*mi).second.vin != vote.vin) continue;
+            if ((*mi).second.nTime >= vote.nTime) return false;
+            miReplaced = mi;
+            break;
+        }
+    }
+    if (miReplaced != mapOrphans.end()) EraseOrphanVote(mapOrphans, mapByParent, mapByNode, pParentHash, miReplaced);
+
+    // at the limit the oldest orphan vote of the masternode makes room
+    OrphanVotesByNode::iterator ni = mapByNode.find(vote.vin.prevout);
+    if (ni != mapByNode.end() && (int)(*ni).second.size() >= nMaxPerNode) {
+        if ((*(*ni).second.begin()).first >= vote.nTime) return false;
+        EraseOrphanVote(mapOrphans, mapByParent, mapByNode, pParentHash, mapOrphans.find((*(*ni).second.begin()).second));
+    }
+
+    uint256 nHash = vote.GetHash();
+    mapOrphans[nHash] = vote;
+    mapByParent[vote.*pParentHash].insert(nHash);
+    mapByNode[vote.vin.prevout].insert(std::make_pair(vote.nTime, nHash));
+    return true;
+}
+
+template <typename T>
+static void TakeOrphanVotes(std::map<uint256, T>& mapOrphans, std::map<uint256, std::set<uint256> >& mapByParent,
+    OrphanVotesByNode& mapByNode, uint256 T::*pParentHash, const uint256& nParentHash, std::vector<T>& vVotes)
+{
+    std::map<uint256, std::set<uint256> >::iterator it = mapByParent.find(nParentHash);
+    if (it == mapByParent.end()) return;
+
+    std::set<uint256> setHashes;
+    setHashes.swap((*it).second);
+    mapByParent.erase(it);
+    BOOST_FOREACH (const uint256& nHash, setHashes) {
+        typename std::map<uint256, T>::iterator mi = mapOrphans.find(nHash);
+        if (mi == mapOrphans.end()) continue;
+
+        vVotes.push_back((*mi).second);
+        EraseOrphanVote(mapOrphans, mapByParent, mapByNode, pParentHash, mi);
+    }
+}
+
+template <typename T>
+static void IndexOrphanVotes(const std::map<uint256, T>& mapOrphans, std::map<uint256, std::set<uint256> >& mapByParent,
+    OrphanVotesByNode& mapByNode, uint256 T::*pParentHash)
+{
+    for (typename std::map<uint256, T>::const_iterator it = mapOrphans.begin(); it != mapOrphans.end(); ++it) {
+        mapByParent[(*it).second.*pParentHash].insert((*it).first);
+        mapByNode[(*it).second.vin.prevout].insert(std::make_pair((*it).second.nTime, (*it).first));
+    }
+}
+
+bool CBudgetManager::AddOrphanVote(CBudgetVote& vote)
 {
     LOCK(cs);
+    return KeepOrphanVote(mapOrphanMasternodeBudgetVotes, mapOrphanBudgetVotesByProposal, mapOrphanBudgetVotesByMasternode,
+        &CBudgetVote::nProposalHash, vote, MAX_ORPHAN_BUDGET_VOTES_PER_MASTERNODE);
+}
 
+bool CBudgetManager::AddOrphanVote(CFinalizedBudgetVote& vote)
+{
+    LOCK(cs);
+    return KeepOrphanVote(mapOrphanFinalizedBudgetVotes, mapOrphanFinalizedBudgetVotesByBudget, mapOrphanFinalizedBudgetVotesByMasternode,
+        &CFinalizedBudgetVote::nBudgetHash, vote, MAX_ORPHAN_BUDGET_VOTES_PER_MASTERNODE);
+}
+
+void CBudgetManager::CheckOrphanVotes(const uint256& nHash)
+{
+    LOCK(cs);
 
     std::string strError = "";
-    std::map<uint256, CBudgetVote>::iterator it1 = mapOrphanMasternodeBudgetVotes.begin();
-    while (it1 != mapOrphanMasternodeBudgetVotes.end()) {
-        if (budget.UpdateProposal(((*it1).second), NULL, strError)) {
-            LogPrint("mnbudget","CBudgetManager::CheckOrphanVotes - Proposal/Budget is known, activating and removing orphan vote\n");
-            mapOrphanMasternodeBudgetVotes.erase(it1++);
-        } else {
-            ++it1;
+    if (mapProposals.count(nHash)) {
+        std::vector<CBudgetVote> vVotes;
+        TakeOrphanVotes(mapOrphanMasternodeBudgetVotes, mapOrphanBudgetVotesByProposal, mapOrphanBudgetVotesByMasternode, &CBudgetVote::nProposalHash, nHash, vVotes);
+        BOOST_FOREACH (CBudgetVote& vote, vVotes) {
+            if (UpdateProposal(vote, NULL, strError))
+                LogPrint("mnbudget","CBudgetManager::CheckOrphanVotes - Proposal/Budget is known, activating orphan vote\n");
         }
     }
-    std::map<uint256, CFinalizedBudgetVote>::iterator it2 = mapOrphanFinalizedBudgetVotes.begin();
-    while (it2 != mapOrphanFinalizedBudgetVotes.end()) {
-        if (budget.UpdateFinalizedBudget(((*it2).second), NULL, strError)) {
-            LogPrint("mnbudget","CBudgetManager::CheckOrphanVotes - Proposal/Budget is known, activating and removing orphan vote\n");
-            mapOrphanFinalizedBudgetVotes.erase(it2++);
-        } else {
-            ++it2;
+    if (mapFinalizedBudgets.count(nHash)) {
+        std::vector<CFinalizedBudgetVote> vVotes;
+        TakeOrphanVotes(mapOrphanFinalizedBudgetVotes, mapOrphanFinalizedBudgetVotesByBudget, mapOrphanFinalizedBudgetVotesByMasternode, &CFinalizedBudgetVote::nBudgetHash, nHash, vVotes);
+        BOOST_FOREACH (CFinalizedBudgetVote& vote, vVotes) {
+            if (UpdateFinalizedBudget(vote, NULL, strError))
+                LogPrint("mnbudget","CBudgetManager::CheckOrphanVotes - Proposal/Budget is known, activating orphan vote\n");
         }
     }
     LogPrint("mnbudget","CBudgetManager::CheckOrphanVotes - Done\n");
 }
 
+void CBudgetManager::RebuildOrphanVoteIndex()
+{
+    LOCK(cs);
+
+    mapOrphanBudgetVotesByProposal.clear();
+    mapOrphanFinalizedBudgetVotesByBudget.clear();
+    mapOrphanBudgetVotesByMasternode.clear();
+    mapOrphanFinalizedBudgetVotesByMasternode.clear();
+    IndexOrphanVotes(mapOrphanMasternodeBudgetVotes, mapOrphanBudgetVotesByProposal, mapOrphanBudgetVotesByMasternode, &CBudgetVote::nProposalHash);
+    IndexOrphanVotes(mapOrphanFinalizedBudgetVotes, mapOrphanFinalizedBudgetVotesByBudget, mapOrphanFinalizedBudgetVotesByMasternode, &CFinalizedBudgetVote::nBudgetHash);
+}
+
 void CBudgetManager::SubmitFinalBudget()
 {
     static int nSubmittedHeight = 0; // height at which final budget was submitted last time
@@ -278,6 +389,20 @@ void CBudgetManager::SubmitFinalBudget()
 // CBudgetDB
 //
 
+// budget.dat tables
+enum {
+    BUDGETDB_SEEN_PROPOSALS,
+    BUDGETDB_SEEN_PROPOSAL_VOTES,
+    BUDGETDB_SEEN_FINALIZED_BUDGETS,
+    BUDGETDB_SEEN_FINALIZED_BUDGET_VOTES,
+    BUDGETDB_ORPHAN_PROPOSAL_VOTES,
+    BUDGETDB_ORPHAN_FINALIZED_BUDGET_VOTES,
+    BUDGETDB_PROPOSALS,
+    BUDGETDB_FINALIZED_BUDGETS
+};
+
+static CFlatJournal budgetJournal("budget.dat", "MasternodeBudgetJournal");
+
 CBudgetDB::CBudgetDB()
 {
     pathDB = GetDataDir() / "budget.dat";
@@ -286,31 +411,14 @@ CBudgetDB::CBudgetDB()
 
 bool CBudgetDB::Write(const CBudgetManager& objToSave)
 {
-    LOCK(objToSave.cs);
-
     int64_t nStart = GetTimeMillis();
 
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssObj(SER_DISK, CLIENT_VERSION);
-    ssObj << strMagicMessage;                   // masternode cache file specific magic message
-    ssObj << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssObj << objToSave;
-    uint256 hash = Hash(ssObj.begin(), ssObj.end());
-    ssObj << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathDB.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssObj;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
-    }
-    fileout.fclose();
+    // only records that changed since the last write are appended
+    if (!budgetJournal.OpenForWrite())
+        return false;
+    objToSave.WriteJournal(budgetJournal);
+    if (!budgetJournal.Flush())
+        return false;
 
     LogPrint("mnbudget","Written info to budget.dat  %dms\n", GetTimeMillis() - nStart);
 
@@ -318,10 +426,45 @@ bool CBudgetDB::Write(const CBudgetManager& objToSave)
 }
 
 CBudgetDB::ReadResult CBudgetDB::Read(CBudgetManager& objToLoad, bool fDryRun)
+{
+    int64_t nStart = GetTimeMillis();
+
+    CFlatJournal::ReadResult journalResult = budgetJournal.Open();
+    if (journalResult == CFlatJournal::IncorrectMagicMessage) {
+        // files written before the journal format are converted once
+        ReadResult result = ReadLegacy(objToLoad);
+        if (result != Ok)
+            return result;
+        if (budgetJournal.Reset()) {
+            objToLoad.WriteJournal(budgetJournal);
+            budgetJournal.Flush();
+        }
+    } else if (journalResult == CFlatJournal::FileError) {
+        return FileError;
+    } else if (journalResult == CFlatJournal::IncorrectMagicNumber) {
+        return IncorrectMagicNumber;
+    } else if (journalResult != CFlatJournal::Ok) {
+        return IncorrectFormat;
+    } else {
+        objToLoad.ReadJournal(budgetJournal);
+    }
+
+    LogPrint("mnbudget","Loaded info from budget.dat  %dms\n", GetTimeMillis() - nStart);
+    LogPrint("mnbudget","  %s\n", objToLoad.ToString());
+    if (!fDryRun) {
+        LogPrint("mnbudget","Budget manager - cleaning....\n");
+        objToLoad.CheckAndRemove();
+        LogPrint("mnbudget","Budget manager - result:\n");
+        LogPrint("mnbudget","  %s\n", objToLoad.ToString());
+    }
+
+    return Ok;
+}
+
+CBudgetDB::ReadResult CBudgetDB::ReadLegacy(CBudgetManager& objToLoad)
 {
     LOCK(objToLoad.cs);
 
-    int64_t nStart = GetTimeMillis();
     // open input file, and associate with CAutoFile
     FILE* file = fopen(pathDB.string().c_str(), "rb");
     CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
@@ -390,15 +533,6 @@ CBudgetDB::ReadResult CBudgetDB::Read(CBudgetManager& objToLoad, bool fDryRun)
         return IncorrectFormat;
     }
 
-    LogPrint("mnbudget","Loaded info from budget.dat  %dms\n", GetTimeMillis() - nStart);
-    LogPrint("mnbudget","  %s\n", objToLoad.ToString());
-    if (!fDryRun) {
-        LogPrint("mnbudget","Budget manager - cleaning....\n");
-        objToLoad.CheckAndRemove();
-        LogPrint("mnbudget","Budget manager - result:\n");
-        LogPrint("mnbudget","  %s\n", objToLoad.ToString());
-    }
-
     return Ok;
 }
 
@@ -407,28 +541,43 @@ void DumpBudgets()
     int64_t nStart = GetTimeMillis();
 
     CBudgetDB budgetdb;
-    CBudgetManager tempBudget;
-
-    LogPrint("mnbudget","Verifying budget.dat format...\n");
-    CBudgetDB::ReadResult readResult = budgetdb.Read(tempBudget, true);
-    // there was an error and it was not an error on file opening => do not proceed
-    if (readResult == CBudgetDB::FileError)
-        LogPrint("mnbudget","Missing budgets file - budget.dat, will try to recreate\n");
-    else if (readResult != CBudgetDB::Ok) {
-        LogPrint("mnbudget","Error reading budget.dat: ");
-        if (readResult == CBudgetDB::IncorrectFormat)
-            LogPrint("mnbudget","magic is ok but data has invalid format, will try to recreate\n");
-        else {
-            LogPrint("mnbudget","file format is unknown or invalid, please fix it manually\n");
-            return;
-        }
-    }
     LogPrint("mnbudget","Writting info to budget.dat...\n");
     budgetdb.Write(budget);
 
     LogPrint("mnbudget","Budget dump finished  %dms\n", GetTimeMillis() - nStart);
 }
 
+void CBudgetManager::WriteJournal(CFlatJournal& journal) const
+{
+    LOCK(cs);
+
+    // seen messages aren't kept across restarts, drop what older versions stored
+    journal.EraseMissing(BUDGETDB_SEEN_PROPOSALS, std::set<uint256>());
+    journal.EraseMissing(BUDGETDB_SEEN_PROPOSAL_VOTES, std::set<uint256>());
+    journal.EraseMissing(BUDGETDB_SEEN_FINALIZED_BUDGETS, std::set<uint256>());
+    journal.EraseMissing(BUDGETDB_SEEN_FINALIZED_BUDGET_VOTES, std::set<uint256>());
+
+    // votes never change once seen, proposals and budgets collect votes
+    journal.WriteMap(BUDGETDB_ORPHAN_PROPOSAL_VOTES, mapOrphanMasternodeBudgetVotes, true);
+    journal.WriteMap(BUDGETDB_ORPHAN_FINALIZED_BUDGET_VOTES, mapOrphanFinalizedBudgetVotes, true);
+    journal.WriteMap(BUDGETDB_PROPOSALS, mapProposals, false);
+    journal.WriteMap(BUDGETDB_FINALIZED_BUDGETS, mapFinalizedBudgets, false);
+}
+
+void CBudgetManager::ReadJournal(CFlatJournal& journal)
+{
+    LOCK(cs);
+
+    Clear();
+
+    journal.ReadMap(BUDGETDB_ORPHAN_PROPOSAL_VOTES, mapOrphanMasternodeBudgetVotes);
+    journal.ReadMap(BUDGETDB_ORPHAN_FINALIZED_BUDGET_VOTES, mapOrphanFinalizedBudgetVotes);
+    journal.ReadMap(BUDGETDB_PROPOSALS, mapProposals);
+    journal.ReadMap(BUDGETDB_FINALIZED_BUDGETS, mapFinalizedBudgets);
+    RebuildFinalizedBudgetIndex();
+    RebuildOrphanVoteIndex();
+}
+
 bool CBudgetManager::AddFinalizedBudget(CFinalizedBudget& finalizedBudget)
 {
     std::string strError = "";
@@ -438,7 +587,11 @@ bool CBudgetManager::AddFinalizedBudget(CFinalizedBudget& finalizedBudget)
         return false;
     }
 
-    mapFinalizedBudgets.insert(make_pair(finalizedBudget.GetHash(), finalizedBudget));
+    std::map<uint256, CFinalizedBudget>::iterator it = mapFinalizedBudgets.insert(make_pair(finalizedBudget.GetHash(), finalizedBudget)).first;
+    IndexFinalizedBudget((*it).first, (*it).second);
+
+    // we might have votes waiting for this budget
+    CheckOrphanVotes((*it).first);
     return true;
 }
 
@@ -455,8 +608,12 @@ bool CBudgetManager::AddProposal(CBudgetProposal& budgetProposal)
         return false;
     }
 
+    InvalidateBudgetCache();
     mapProposals.insert(make_pair(budgetProposal.GetHash(), budgetProposal));
     LogPrint("mnbudget","CBudgetManager::AddProposal - proposal %s added\n", budgetProposal.GetName ().c_str ());
+
+    // we might have votes waiting for this proposal
+    CheckOrphanVotes(budgetProposal.GetHash());
     return true;
 }
 
@@ -526,6 +683,8 @@ void CBudgetManager::CheckAndRemove()
     // Remove invalid entries by overwriting complete map
     mapFinalizedBudgets.swap(tmpMapFinalizedBudgets);
     mapProposals.swap(tmpMapProposals);
+    InvalidateBudgetCache();
+    RebuildFinalizedBudgetIndex();
 
     // clang doesn't accept copy assignemnts :-/
     // mapFinalizedBudgets = tmpMapFinalizedBudgets;
@@ -639,21 +798,56 @@ CBudgetProposal* CBudgetManager::FindProposal(uint256 nHash)
     return NULL;
 }
 
-bool CBudgetManager::IsBudgetPaymentBlock(int nBlockHeight)
+void CBudgetManager::IndexFinalizedBudget(const uint256& nHash, CFinalizedBudget& finalizedBudget)
 {
-    int nHighestCount = -1;
-    int nFivePercent = mnodeman.CountEnabled(ActiveProtocol()) / 20;
+    mapFinalizedBudgetsByStart[finalizedBudget.GetBlockStart()].insert(nHash);
+    nFinalizedBudgetMaxSpan = std::max(nFinalizedBudgetMaxSpan, finalizedBudget.GetBlockEnd() - finalizedBudget.GetBlockStart() + 1);
+}
+
+void CBudgetManager::RebuildFinalizedBudgetIndex()
+{
+    LOCK(cs);
+
+    mapFinalizedBudgetsByStart.clear();
+    nFinalizedBudgetMaxSpan = 0;
 
     std::map<uint256, CFinalizedBudget>::iterator it = mapFinalizedBudgets.begin();
     while (it != mapFinalizedBudgets.end()) {
-        CFinalizedBudget* pfinalizedBudget = &((*it).second);
-        if (pfinalizedBudget->GetVoteCount() > nHighestCount &&
-            nBlockHeight >= pfinalizedBudget->GetBlockStart() &&
-            nBlockHeight <= pfinalizedBudget->GetBlockEnd()) {
-            nHighestCount = pfinalizedBudget->GetVoteCount();
+        IndexFinalizedBudget((*it).first, (*it).second);
+        ++it;
+    }
+}
+
+void CBudgetManager::GetFinalizedBudgetsAt(int nBlockHeight, std::vector<CFinalizedBudget*>& vFinalizedBudgets)
+{
+    // a budget can only pay at this height if it started at most nFinalizedBudgetMaxSpan blocks ago
+    std::map<uint256, CFinalizedBudget*> mapFound;
+    std::map<int, std::set<uint256> >::iterator it = mapFinalizedBudgetsByStart.lower_bound(nBlockHeight - nFinalizedBudgetMaxSpan + 1);
+    for (; it != mapFinalizedBudgetsByStart.end() && (*it).first <= nBlockHeight; ++it) {
+        BOOST_FOREACH (const uint256& nHash, (*it).second) {
+            std::map<uint256, CFinalizedBudget>::iterator mi = mapFinalizedBudgets.find(nHash);
+            if (mi != mapFinalizedBudgets.end() && nBlockHeight <= (*mi).second.GetBlockEnd())
+                mapFound.insert(make_pair(nHash, &((*mi).second)));
         }
+    }
 
-        ++it;
+    vFinalizedBudgets.clear();
+    for (std::map<uint256, CFinalizedBudget*>::iterator mi = mapFound.begin(); mi != mapFound.end(); ++mi)
+        vFinalizedBudgets.push_back((*mi).second);
+}
+
+bool CBudgetManager::IsBudgetPaymentBlock(int nBlockHeight)
+{
+    LOCK(cs);
+
+    int nHighestCount = -1;
+    int nFivePercent = mnodeman.CountEnabled(ActiveProtocol()) / 20;
+
+    std::vector<CFinalizedBudget*> vFinalizedBudgets;
+    GetFinalizedBudgetsAt(nBlockHeight, vFinalizedBudgets);
+    BOOST_FOREACH (CFinalizedBudget* pfinalizedBudget, vFinalizedBudgets) {
+        if (pfinalizedBudget->GetVoteCount() > nHighestCount)
+            nHighestCount = pfinalizedBudget->GetVoteCount();
     }
 
     LogPrint("mnbudget","CBudgetManager::IsBudgetPaymentBlock() - nHighestCount: %lli, 5%% of Masternodes: %lli. Number of finalized budgets: %lli\n", 
@@ -672,23 +866,16 @@ TrxValidationStatus CBudgetManager::IsTransactionValid(const CTransaction& txNew
     TrxValidationStatus transactionStatus = TrxValidationStatus::InValid;
     int nHighestCount = 0;
     int nFivePercent = mnodeman.CountEnabled(ActiveProtocol()) / 20;
-    std::vector<CFinalizedBudget*> ret;
+    std::vector<CFinalizedBudget*> vFinalizedBudgets;
+    GetFinalizedBudgetsAt(nBlockHeight, vFinalizedBudgets);
 
-    LogPrint("mnbudget","CBudgetManager::IsTransactionValid - checking %lli finalized budgets\n", mapFinalizedBudgets.size());
+    LogPrint("mnbudget","CBudgetManager::IsTransactionValid - checking %lli of %lli finalized budgets\n", vFinalizedBudgets.size(), mapFinalizedBudgets.size());
 
     // ------- Grab The Highest Count
 
-    std::map<uint256, CFinalizedBudget>::iterator it = mapFinalizedBudgets.begin();
-    while (it != mapFinalizedBudgets.end()) {
-        CFinalizedBudget* pfinalizedBudget = &((*it).second);
-
-        if (pfinalizedBudget->GetVoteCount() > nHighestCount &&
-            nBlockHeight >= pfinalizedBudget->GetBlockStart() &&
-            nBlockHeight <= pfinalizedBudget->GetBlockEnd()) {
+    BOOST_FOREACH (CFinalizedBudget* pfinalizedBudget, vFinalizedBudgets) {
+        if (pfinalizedBudget->GetVoteCount() > nHighestCount)
             nHighestCount = pfinalizedBudget->GetVoteCount();
-        }
-
-        ++it;
     }
 
     LogPrint("mnbudget","CBudgetManager::IsTransactionValid() - nHighestCount: %lli, 5%% of Masternodes: %lli mapFinalizedBudgets.size(): %ld\n", 
@@ -703,9 +890,7 @@ TrxValidationStatus CBudgetManager::IsTransactionValid(const CTransaction& txNew
     std::string strProposals = "";
     int nCountThreshold = nHighestCount - mnodeman.CountEnabled(ActiveProtocol()) / 10;
     bool fThreshold = false;
-    it = mapFinalizedBudgets.begin();
-    while (it != mapFinalizedBudgets.end()) {
-        CFinalizedBudget* pfinalizedBudget = &((*it).second);
+    BOOST_FOREACH (CFinalizedBudget* pfinalizedBudget, vFinalizedBudgets) {
         strProposals = pfinalizedBudget->GetProposals();
 
         LogPrint("mnbudget","CBudgetManager::IsTransactionValid - checking budget (%s) with blockstart %lli, blockend %lli, nBlockHeight %lli, votes %lli, nCountThreshold %lli\n",
@@ -715,23 +900,22 @@ TrxValidationStatus CBudgetManager::IsTransactionValid(const CTransaction& txNew
         if (pfinalizedBudget->GetVoteCount() > nCountThreshold) {
             fThreshold = true;
             LogPrint("mnbudget","CBudgetManager::IsTransactionValid - GetVoteCount() > nCountThreshold passed\n");
-            if (nBlockHeight >= pfinalizedBudget->GetBlockStart() && nBlockHeight <= pfinalizedBudget->GetBlockEnd()) {
-                LogPrint("mnbudget","CBudgetManager::IsTransactionValid - GetBlockStart() passed\n");
-                transactionStatus = pfinalizedBudget->IsTransactionValid(txNew, nBlockHeight);
-                if (transactionStatus == TrxValidationStatus::Valid) {
-                    LogPrint("mnbudget","CBudgetManager::IsTransactionValid - pfinalizedBudget->IsTransactionValid() passed\n");
-                    return TrxValidationStatus::Valid;
-                }
-                else {
-                    LogPrint("mnbudget","CBudgetManager::IsTransactionValid - pfinalizedBudget->IsTransactionValid() error\n");
-                }
+            transactionStatus = pfinalizedBudget->IsTransactionValid(txNew, nBlockHeight);
+            if (transactionStatus == TrxValidationStatus::Valid) {
+                LogPrint("mnbudget","CBudgetManager::IsTransactionValid - pfinalizedBudget->IsTransactionValid() passed\n");
+                return TrxValidationStatus::Valid;
             }
             else {
-                LogPrint("mnbudget","CBudgetManager::IsTransactionValid - GetBlockStart() failed, budget is outside current payment cycle and will be ignored.\n");
+                LogPrint("mnbudget","CBudgetManager::IsTransactionValid - pfinalizedBudget->IsTransactionValid() error\n");
             }
-               
         }
+    }
 
+    // budgets outside the current payment cycle still count towards the vote threshold
+    std::map<uint256, CFinalizedBudget>::iterator it = mapFinalizedBudgets.begin();
+    while (!fThreshold && it != mapFinalizedBudgets.end()) {
+        if ((*it).second.GetVoteCount() > nCountThreshold)
+            fThreshold = true;
         ++it;
     }
 
@@ -744,16 +928,32 @@ TrxValidationStatus CBudgetManager::IsTransactionValid(const CTransaction& txNew
     return transactionStatus;
 }
 
+// Check the votes of all proposals against the node list, once per block
+void CBudgetManager::CheckProposalVotes()
+{
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    if (pindexPrev != NULL && hashVotesCheckedTip == pindexPrev->GetBlockHash()) return;
+
+    std::map<uint256, CBudgetProposal>::iterator it = mapProposals.begin();
+    while (it != mapProposals.end()) {
+        (*it).second.CleanAndRemove(false);
+        ++it;
+    }
+
+    hashVotesCheckedTip = pindexPrev ? pindexPrev->GetBlockHash() : uint256();
+    InvalidateBudgetCache();
+}
+
 std::vector<CBudgetProposal*> CBudgetManager::GetAllProposals()
 {
     LOCK(cs);
 
     std::vector<CBudgetProposal*> vBudgetProposalRet;
 
+    CheckProposalVotes();
+
     std::map<uint256, CBudgetProposal>::iterator it = mapProposals.begin();
     while (it != mapProposals.end()) {
-        (*it).second.CleanAndRemove(false);
-
         CBudgetProposal* pbudgetProposal = &((*it).second);
         vBudgetProposalRet.push_back(pbudgetProposal);
 
@@ -780,13 +980,21 @@ std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
 {
     LOCK(cs);
 
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    if (pindexPrev == NULL) return std::vector<CBudgetProposal*>();
+
+    // the ranking only changes with new votes, proposals or blocks
+    if (fBudgetCacheValid && hashBudgetCacheTip == pindexPrev->GetBlockHash())
+        return vBudgetCache;
+
+    CheckProposalVotes();
+
     // ------- Sort budgets by Yes Count
 
     std::vector<std::pair<CBudgetProposal*, int> > vBudgetPorposalsSort;
 
     std::map<uint256, CBudgetProposal>::iterator it = mapProposals.begin();
     while (it != mapProposals.end()) {
-        (*it).second.CleanAndRemove(false);
         vBudgetPorposalsSort.push_back(make_pair(&((*it).second), (*it).second.GetYeas() - (*it).second.GetNays()));
         ++it;
     }
@@ -798,9 +1006,6 @@ std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
     std::vector<CBudgetProposal*> vBudgetProposalsRet;
 
     CAmount nBudgetAllocated = 0;
-    CBlockIndex* pindexPrev = chainActive.Tip();
-    if (pindexPrev == NULL) return vBudgetProposalsRet;
-
     int nBlockStart = pindexPrev->nHeight - pindexPrev->nHeight % GetBudgetPaymentCycleBlocks() + GetBudgetPaymentCycleBlocks();
     int nBlockEnd = nBlockStart + GetBudgetPaymentCycleBlocks() - 1;
     CAmount nTotalBudget = GetTotalBudget(nBlockStart);
@@ -842,6 +1047,10 @@ std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
         ++it2;
     }
 
+    vBudgetCache = vBudgetProposalsRet;
+    hashBudgetCacheTip = pindexPrev->GetBlockHash();
+    fBudgetCacheValid = true;
+
     return vBudgetProposalsRet;
 }
 
@@ -1103,9 +1312,6 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         masternodeSync.AddedBudgetItem(budgetProposalBroadcast.GetHash());
 
         LogPrint("mnbudget","mprop - new budget - %s\n", budgetProposalBroadcast.GetHash().ToString());
-
-        //We might have active votes for this proposal that are valid now
-        CheckOrphanVotes();
     }
 
     if (strCommand == "mvote") { //Masternode Vote
@@ -1178,9 +1384,6 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
             finalizedBudgetBroadcast.Relay();
         }
         masternodeSync.AddedBudgetItem(finalizedBudgetBroadcast.GetHash());
-
-        //we might have active votes for this budget that are now valid
-        CheckOrphanVotes();
     }
 
     if (strCommand == "fbvote") { //Finalized Budget Vote
@@ -1235,10 +1438,10 @@ void CBudgetManager::ResetSync()
     LOCK(cs);
 
 
-    std::map<uint256, CBudgetProposalBroadcast>::iterator it1 = mapSeenMasternodeBudgetProposals.begin();
-    while (it1 != mapSeenMasternodeBudgetProposals.end()) {
-        CBudgetProposal* pbudgetProposal = FindProposal((*it1).first);
-        if (pbudgetProposal && pbudgetProposal->fValid) {
+    std::map<uint256, CBudgetProposal>::iterator it1 = mapProposals.begin();
+    while (it1 != mapProposals.end()) {
+        CBudgetProposal* pbudgetProposal = &((*it1).second);
+        if (pbudgetProposal->fValid) {
             //mark votes
             std::map<uint256, CBudgetVote>::iterator it2 = pbudgetProposal->mapVotes.begin();
             while (it2 != pbudgetProposal->mapVotes.end()) {
@@ -1249,10 +1452,10 @@ void CBudgetManager::ResetSync()
         ++it1;
     }
 
-    std::map<uint256, CFinalizedBudgetBroadcast>::iterator it3 = mapSeenFinalizedBudgets.begin();
-    while (it3 != mapSeenFinalizedBudgets.end()) {
-        CFinalizedBudget* pfinalizedBudget = FindFinalizedBudget((*it3).first);
-        if (pfinalizedBudget && pfinalizedBudget->fValid) {
+    std::map<uint256, CFinalizedBudget>::iterator it3 = mapFinalizedBudgets.begin();
+    while (it3 != mapFinalizedBudgets.end()) {
+        CFinalizedBudget* pfinalizedBudget = &((*it3).second);
+        if (pfinalizedBudget->fValid) {
             //send votes
             std::map<uint256, CFinalizedBudgetVote>::iterator it4 = pfinalizedBudget->mapVotes.begin();
             while (it4 != pfinalizedBudget->mapVotes.end()) {
@@ -1272,10 +1475,10 @@ void CBudgetManager::MarkSynced()
         Mark that we've sent all valid items
     */
 
-    std::map<uint256, CBudgetProposalBroadcast>::iterator it1 = mapSeenMasternodeBudgetProposals.begin();
-    while (it1 != mapSeenMasternodeBudgetProposals.end()) {
-        CBudgetProposal* pbudgetProposal = FindProposal((*it1).first);
-        if (pbudgetProposal && pbudgetProposal->fValid) {
+    std::map<uint256, CBudgetProposal>::iterator it1 = mapProposals.begin();
+    while (it1 != mapProposals.end()) {
+        CBudgetProposal* pbudgetProposal = &((*it1).second);
+        if (pbudgetProposal->fValid) {
             //mark votes
             std::map<uint256, CBudgetVote>::iterator it2 = pbudgetProposal->mapVotes.begin();
             while (it2 != pbudgetProposal->mapVotes.end()) {
@@ -1287,10 +1490,10 @@ void CBudgetManager::MarkSynced()
         ++it1;
     }
 
-    std::map<uint256, CFinalizedBudgetBroadcast>::iterator it3 = mapSeenFinalizedBudgets.begin();
-    while (it3 != mapSeenFinalizedBudgets.end()) {
-        CFinalizedBudget* pfinalizedBudget = FindFinalizedBudget((*it3).first);
-        if (pfinalizedBudget && pfinalizedBudget->fValid) {
+    std::map<uint256, CFinalizedBudget>::iterator it3 = mapFinalizedBudgets.begin();
+    while (it3 != mapFinalizedBudgets.end()) {
+        CFinalizedBudget* pfinalizedBudget = &((*it3).second);
+        if (pfinalizedBudget->fValid) {
             //mark votes
             std::map<uint256, CFinalizedBudgetVote>::iterator it4 = pfinalizedBudget->mapVotes.begin();
             while (it4 != pfinalizedBudget->mapVotes.end()) {
@@ -1320,11 +1523,14 @@ void CBudgetManager::Sync(CNode* pfrom, uint256 nProp, bool fPartial)
 
     int nInvCount = 0;
 
-    std::map<uint256, CBudgetProposalBroadcast>::iterator it1 = mapSeenMasternodeBudgetProposals.begin();
-    while (it1 != mapSeenMasternodeBudgetProposals.end()) {
-        CBudgetProposal* pbudgetProposal = FindProposal((*it1).first);
-        if (pbudgetProposal && pbudgetProposal->fValid && (nProp == 0 || (*it1).first == nProp)) {
-            pfrom->PushInventory(CInv(MSG_BUDGET_PROPOSAL, (*it1).second.GetHash()));
+    std::map<uint256, CBudgetProposal>::iterator it1 = mapProposals.begin();
+    while (it1 != mapProposals.end()) {
+        CBudgetProposal* pbudgetProposal = &((*it1).second);
+        if (pbudgetProposal->fValid && (nProp == 0 || (*it1).first == nProp)) {
+            // the seen cache may have let go of it already, it has to answer the getdata
+            if (!mapSeenMasternodeBudgetProposals.count((*it1).first))
+                mapSeenMasternodeBudgetProposals.insert(make_pair((*it1).first, CBudgetProposalBroadcast(*pbudgetProposal)));
+            pfrom->PushInventory(CInv(MSG_BUDGET_PROPOSAL, (*it1).first));
             nInvCount++;
 
             //send votes
@@ -1332,7 +1538,9 @@ void CBudgetManager::Sync(CNode* pfrom, uint256 nProp, bool fPartial)
             while (it2 != pbudgetProposal->mapVotes.end()) {
                 if ((*it2).second.fValid) {
                     if ((fPartial && !(*it2).second.fSynced) || !fPartial) {
-                        pfrom->PushInventory(CInv(MSG_BUDGET_VOTE, (*it2).second.GetHash()));
+                        if (!mapSeenMasternodeBudgetVotes.count((*it2).first))
+                            mapSeenMasternodeBudgetVotes.insert(*it2);
+                        pfrom->PushInventory(CInv(MSG_BUDGET_VOTE, (*it2).first));
                         nInvCount++;
                     }
                 }
@@ -1348,11 +1556,13 @@ void CBudgetManager::Sync(CNode* pfrom, uint256 nProp, bool fPartial)
 
     nInvCount = 0;
 
-    std::map<uint256, CFinalizedBudgetBroadcast>::iterator it3 = mapSeenFinalizedBudgets.begin();
-    while (it3 != mapSeenFinalizedBudgets.end()) {
-        CFinalizedBudget* pfinalizedBudget = FindFinalizedBudget((*it3).first);
-        if (pfinalizedBudget && pfinalizedBudget->fValid && (nProp == 0 || (*it3).first == nProp)) {
-            pfrom->PushInventory(CInv(MSG_BUDGET_FINALIZED, (*it3).second.GetHash()));
+    std::map<uint256, CFinalizedBudget>::iterator it3 = mapFinalizedBudgets.begin();
+    while (it3 != mapFinalizedBudgets.end()) {
+        CFinalizedBudget* pfinalizedBudget = &((*it3).second);
+        if (pfinalizedBudget->fValid && (nProp == 0 || (*it3).first == nProp)) {
+            if (!mapSeenFinalizedBudgets.count((*it3).first))
+                mapSeenFinalizedBudgets.insert(make_pair((*it3).first, CFinalizedBudgetBroadcast(*pfinalizedBudget)));
+            pfrom->PushInventory(CInv(MSG_BUDGET_FINALIZED, (*it3).first));
             nInvCount++;
 
             //send votes
@@ -1360,7 +1570,9 @@ void CBudgetManager::Sync(CNode* pfrom, uint256 nProp, bool fPartial)
             while (it4 != pfinalizedBudget->mapVotes.end()) {
                 if ((*it4).second.fValid) {
                     if ((fPartial && !(*it4).second.fSynced) || !fPartial) {
-                        pfrom->PushInventory(CInv(MSG_BUDGET_FINALIZED_VOTE, (*it4).second.GetHash()));
+                        if (!mapSeenFinalizedBudgetVotes.count((*it4).first))
+                            mapSeenFinalizedBudgetVotes.insert(*it4);
+                        pfrom->PushInventory(CInv(MSG_BUDGET_FINALIZED_VOTE, (*it4).first));
                         nInvCount++;
                     }
                 }
@@ -1385,7 +1597,8 @@ bool CBudgetManager::UpdateProposal(CBudgetVote& vote, CNode* pfrom, std::string
             if (!masternodeSync.IsSynced()) return false;
 
             LogPrint("mnbudget","CBudgetManager::UpdateProposal - Unknown proposal %d, asking for source proposal\n", vote.nProposalHash.ToString());
-            mapOrphanMasternodeBudgetVotes[vote.nProposalHash] = vote;
+            if (!AddOrphanVote(vote))
+                LogPrint("mnbudget","CBudgetManager::UpdateProposal - orphan vote %s not kept\n", vote.GetHash().ToString());
 
             if (!askedForSourceProposalOrBudget.count(vote.nProposalHash)) {
                 pfrom->PushMessage("mnvs", vote.nProposalHash);
@@ -1398,7 +1611,11 @@ bool CBudgetManager::UpdateProposal(CBudgetVote& vote, CNode* pfrom, std::string
     }
 
 
-    return mapProposals[vote.nProposalHash].AddOrUpdateVote(vote, strError);
+    if (!mapProposals[vote.nProposalHash].AddOrUpdateVote(vote, strError))
+        return false;
+
+    InvalidateBudgetCache();
+    return true;
 }
 
 bool CBudgetManager::UpdateFinalizedBudget(CFinalizedBudgetVote& vote, CNode* pfrom, std::string& strError)
@@ -1412,7 +1629,8 @@ bool CBudgetManager::UpdateFinalizedBudget(CFinalizedBudgetVote& vote, CNode* pf
             if (!masternodeSync.IsSynced()) return false;
 
             LogPrint("mnbudget","CBudgetManager::UpdateFinalizedBudget - Unknown Finalized Proposal %s, asking for source budget\n", vote.nBudgetHash.ToString());
-            mapOrphanFinalizedBudgetVotes[vote.nBudgetHash] = vote;
+            if (!AddOrphanVote(vote))
+                LogPrint("mnbudget","CBudgetManager::UpdateFinalizedBudget - orphan vote %s not kept\n", vote.GetHash().ToString());
 
             if (!askedForSourceProposalOrBudget.count(vote.nBudgetHash)) {
                 pfrom->PushMessage("mnvs", vote.nBudgetHash);
@@ -1434,6 +1652,9 @@ CBudgetProposal::CBudgetProposal()
     nBlockEnd = 0;
     nAmount = 0;
     nTime = 0;
+    nYeas = 0;
+    nNays = 0;
+    nAbstains = 0;
     fValid = true;
 }
 
@@ -1446,6 +1667,9 @@ CBudgetProposal::CBudgetProposal(std::string strProposalNameIn, std::string strU
     address = addressIn;
     nAmount = nAmountIn;
     nFeeTXHash = nFeeTXHashIn;
+    nYeas = 0;
+    nNays = 0;
+    nAbstains = 0;
     fValid = true;
 }
 
@@ -1460,6 +1684,9 @@ CBudgetProposal::CBudgetProposal(const CBudgetProposal& other)
     nTime = other.nTime;
     nFeeTXHash = other.nFeeTXHash;
     mapVotes = other.mapVotes;
+    nYeas = other.nYeas;
+    nNays = other.nNays;
+    nAbstains = other.nAbstains;
     fValid = true;
 }
 
@@ -1567,7 +1794,10 @@ bool CBudgetProposal::AddOrUpdateVote(CBudgetVote& vote, std::string& strError)
         return false;
     }
 
+    if (mapVotes.count(hash))
+        CountVote(mapVotes[hash], -1);
     mapVotes[hash] = vote;
+    CountVote(vote, 1);
     LogPrint("mnbudget", "CBudgetProposal::AddOrUpdateVote - %s %s\n", strAction.c_str(), vote.GetHash().ToString().c_str());
 
     return true;
@@ -1576,69 +1806,53 @@ bool CBudgetProposal::AddOrUpdateVote(CBudgetVote& vote, std::string& strError)
 // If masternode voted for a proposal, but is now invalid -- remove the vote
 void CBudgetProposal::CleanAndRemove(bool fSignatureCheck)
 {
+    nYeas = nNays = nAbstains = 0;
+
     std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
 
     while (it != mapVotes.end()) {
         (*it).second.fValid = (*it).second.SignatureValid(fSignatureCheck);
+        CountVote((*it).second, 1);
         ++it;
     }
 }
 
-double CBudgetProposal::GetRatio()
+void CBudgetProposal::RecountVotes()
 {
-    int yeas = 0;
-    int nays = 0;
+    nYeas = nNays = nAbstains = 0;
 
     std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
-
     while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_YES) yeas++;
-        if ((*it).second.nVote == VOTE_NO) nays++;
+        CountVote((*it).second, 1);
         ++it;
     }
-
-    if (yeas + nays == 0) return 0.0f;
-
-    return ((double)(yeas) / (double)(yeas + nays));
 }
 
-int CBudgetProposal::GetYeas()
+void CBudgetProposal::CountVote(const CBudgetVote& vote, int nIncrement)
 {
-    int ret = 0;
-
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
-    while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_YES && (*it).second.fValid) ret++;
-        ++it;
-    }
+    if (!vote.fValid) return;
 
-    return ret;
+    if (vote.nVote == VOTE_YES) nYeas += nIncrement;
+    if (vote.nVote == VOTE_NO) nNays += nIncrement;
+    if (vote.nVote == VOTE_ABSTAIN) nAbstains += nIncrement;
 }
 
-int CBudgetProposal::GetNays()
+double CBudgetProposal::GetRatio()
 {
-    int ret = 0;
+    int yeas = 0;
+    int nays = 0;
 
     std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
-    while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_NO && (*it).second.fValid) ret++;
-        ++it;
-    }
-
-    return ret;
-}
-
-int CBudgetProposal::GetAbstains()
-{
-    int ret = 0;
 
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
     while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_ABSTAIN && (*it).second.fValid) ret++;
+        if ((*it).second.nVote == VOTE_YES) yeas++;
+        if ((*it).second.nVote == VOTE_NO) nays++;
         ++it;
     }
 
-    return ret;
+    if (yeas + nays == 0) return 0.0f;
+
+    return ((double)(yeas) / (double)(yeas + nays));
 }
 
 int CBudgetProposal::GetBlockStartCycle()
@@ -1738,6 +1952,11 @@ void CBudgetVote::Relay()
     RelayInv(inv);
 }
 
+std::string CBudgetVote::GetStrMessage() const
+{
+    return vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+}
+
 bool CBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
 {
     // Choose coins to use
@@ -1745,7 +1964,7 @@ bool CBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
     CKey keyCollateralAddress;
 
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetStrMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, vchSig, keyMasternode)) {
         LogPrint("mnbudget","CBudgetVote::Sign - Error upon calling SignMessage");
@@ -1763,7 +1982,7 @@ bool CBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
 bool CBudgetVote::SignatureValid(bool fSignatureCheck)
 {
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetStrMessage();
 
     CMasternode* pmn = mnodeman.Find(vin);
 
@@ -2243,6 +2462,11 @@ void CFinalizedBudgetVote::Relay()
     RelayInv(inv);
 }
 
+std::string CFinalizedBudgetVote::GetStrMessage() const
+{
+    return vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+}
+
 bool CFinalizedBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
 {
     // Choose coins to use
@@ -2250,7 +2474,7 @@ bool CFinalizedBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
     CKey keyCollateralAddress;
 
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetStrMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, vchSig, keyMasternode)) {
         LogPrint("mnbudget","CFinalizedBudgetVote::Sign - Error upon calling SignMessage");
@@ -2269,7 +2493,7 @@ bool CFinalizedBudgetVote::SignatureValid(bool fSignatureCheck)
 {
     std::string errorMessage;
 
-    std::string strMessage = vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetStrMessage();
 
     CMasternode* pmn = mnodeman.Find(vin);
 
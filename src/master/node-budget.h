@@ -13,6 +13,7 @@
 #include "main.h"
 #include "master/node.h"
 #include "net.h"
+#include "seencache.h"
 #include "sync.h"
 #include "util.h"
 #include <boost/lexical_cast.hpp>
@@ -22,6 +23,7 @@ using namespace std;
 extern CCriticalSection cs_budget;
 
 class CBudgetManager;
+class CFlatJournal;
 class CFinalizedBudgetBroadcast;
 class CFinalizedBudget;
 class CBudgetProposal;
@@ -43,6 +45,10 @@ static const CAmount PROPOSAL_FEE_TX = (50 * COIN);
 static const CAmount BUDGET_FEE_TX_OLD = (50 * COIN);
 static const CAmount BUDGET_FEE_TX = (5 * COIN);
 static const int64_t BUDGET_VOTE_UPDATE_MIN = 60 * 60;
+/** Seen proposals, budgets and votes are forgotten after this long without being relayed */
+static const int64_t BUDGET_SEEN_SECONDS = 24 * 60 * 60;
+/** Orphan budget votes kept per masternode, of each kind, for proposals and finalized budgets we don't know yet. The oldest make room for newer ones */
+static const int MAX_ORPHAN_BUDGET_VOTES_PER_MASTERNODE = 100;
 static map<uint256, int> mapPayment_History;
 
 extern std::vector<CBudgetProposalBroadcast> vecImmatureBudgetProposals;
@@ -77,6 +83,7 @@ public:
 
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     bool SignatureValid(bool fSignatureCheck);
+    std::string GetStrMessage() const;
     void Relay();
 
     std::string GetVoteString()
@@ -129,6 +136,7 @@ public:
 
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     bool SignatureValid(bool fSignatureCheck);
+    std::string GetStrMessage() const;
     void Relay();
 
     uint256 GetHash()
@@ -152,7 +160,7 @@ public:
     }
 };
 
-/** Save Budget Manager (budget.dat)
+/** Save Budget Manager (budget.dat), kept as a CFlatJournal
  */
 class CBudgetDB
 {
@@ -174,6 +182,10 @@ public:
     CBudgetDB();
     bool Write(const CBudgetManager& objToSave);
     ReadResult Read(CBudgetManager& objToLoad, bool fDryRun = false);
+
+private:
+    /// Files written before the journal format, serialized as a whole
+    ReadResult ReadLegacy(CBudgetManager& objToLoad);
 };
 
 
@@ -187,6 +199,30 @@ private:
     // XX42    map<uint256, CTransaction> mapCollateral;
     map<uint256, uint256> mapCollateralTxids;
 
+    //! Result of GetBudget(), kept until the tip or the proposals change
+    std::vector<CBudgetProposal*> vBudgetCache;
+    uint256 hashBudgetCacheTip;
+    bool fBudgetCacheValid;
+    //! Tip the proposal votes were last checked against the node list at
+    uint256 hashVotesCheckedTip;
+
+    //! Finalized budgets by the height of their first payment
+    std::map<int, std::set<uint256> > mapFinalizedBudgetsByStart;
+    //! Most blocks any indexed finalized budget pays for
+    int nFinalizedBudgetMaxSpan;
+
+    //! Orphan votes by the hash of the proposal or finalized budget they wait for
+    std::map<uint256, std::set<uint256> > mapOrphanBudgetVotesByProposal;
+    std::map<uint256, std::set<uint256> > mapOrphanFinalizedBudgetVotesByBudget;
+    //! Orphan votes of each masternode by time, oldest first, to bound the orphan pool
+    std::map<COutPoint, std::set<std::pair<int64_t, uint256> > > mapOrphanBudgetVotesByMasternode;
+    std::map<COutPoint, std::set<std::pair<int64_t, uint256> > > mapOrphanFinalizedBudgetVotesByMasternode;
+
+    void CheckProposalVotes();
+    void IndexFinalizedBudget(const uint256& nHash, CFinalizedBudget& finalizedBudget);
+    /// Finalized budgets paying at the height, in the order of mapFinalizedBudgets
+    void GetFinalizedBudgetsAt(int nBlockHeight, std::vector<CFinalizedBudget*>& vFinalizedBudgets);
+
 public:
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
@@ -195,17 +231,22 @@ public:
     map<uint256, CBudgetProposal> mapProposals;
     map<uint256, CFinalizedBudget> mapFinalizedBudgets;
 
-    std::map<uint256, CBudgetProposalBroadcast> mapSeenMasternodeBudgetProposals;
-    std::map<uint256, CBudgetVote> mapSeenMasternodeBudgetVotes;
+    CSeenCache<CBudgetProposalBroadcast> mapSeenMasternodeBudgetProposals;
+    CSeenCache<CBudgetVote> mapSeenMasternodeBudgetVotes;
     std::map<uint256, CBudgetVote> mapOrphanMasternodeBudgetVotes;
-    std::map<uint256, CFinalizedBudgetBroadcast> mapSeenFinalizedBudgets;
-    std::map<uint256, CFinalizedBudgetVote> mapSeenFinalizedBudgetVotes;
+    CSeenCache<CFinalizedBudgetBroadcast> mapSeenFinalizedBudgets;
+    CSeenCache<CFinalizedBudgetVote> mapSeenFinalizedBudgetVotes;
     std::map<uint256, CFinalizedBudgetVote> mapOrphanFinalizedBudgetVotes;
 
-    CBudgetManager()
+    CBudgetManager() : mapSeenMasternodeBudgetProposals(BUDGET_SEEN_SECONDS),
+                       mapSeenMasternodeBudgetVotes(BUDGET_SEEN_SECONDS),
+                       mapSeenFinalizedBudgets(BUDGET_SEEN_SECONDS),
+                       mapSeenFinalizedBudgetVotes(BUDGET_SEEN_SECONDS)
     {
         mapProposals.clear();
         mapFinalizedBudgets.clear();
+        fBudgetCacheValid = false;
+        nFinalizedBudgetMaxSpan = 0;
     }
 
     void ClearSeen()
@@ -247,7 +288,13 @@ public:
     std::string GetRequiredPaymentsString(int nBlockHeight);
     void FillBlockPayee(CMutableTransaction& txNew, CAmount nFees, bool fProofOfStake);
 
-    void CheckOrphanVotes();
+    /// Keep a vote for a proposal or finalized budget we don't know yet, false if it was dropped
+    bool AddOrphanVote(CBudgetVote& vote);
+    bool AddOrphanVote(CFinalizedBudgetVote& vote);
+    /// Apply the orphan votes waiting for a proposal or finalized budget that just arrived
+    void CheckOrphanVotes(const uint256& nHash);
+    /// Rebuild the orphan vote index after the orphan maps were replaced
+    void RebuildOrphanVoteIndex();
     void Clear()
     {
         LOCK(cs);
@@ -261,10 +308,33 @@ public:
         mapSeenFinalizedBudgetVotes.clear();
         mapOrphanMasternodeBudgetVotes.clear();
         mapOrphanFinalizedBudgetVotes.clear();
+        InvalidateBudgetCache();
+        hashVotesCheckedTip = uint256();
+        mapOrphanBudgetVotesByProposal.clear();
+        mapOrphanFinalizedBudgetVotesByBudget.clear();
+        mapOrphanBudgetVotesByMasternode.clear();
+        mapOrphanFinalizedBudgetVotesByMasternode.clear();
+        mapFinalizedBudgetsByStart.clear();
+        nFinalizedBudgetMaxSpan = 0;
     }
     void CheckAndRemove();
     std::string ToString() const;
 
+    /// Rebuild the height index of mapFinalizedBudgets after it was replaced
+    void RebuildFinalizedBudgetIndex();
+
+    /// Drop the cached GetBudget() result, called whenever proposals or their votes change
+    void InvalidateBudgetCache()
+    {
+        fBudgetCacheValid = false;
+        vBudgetCache.clear();
+    }
+
+    /// Append what changed since the last call to the cache journal
+    void WriteJournal(CFlatJournal& journal) const;
+    /// Replace the contents with the entries of the cache journal
+    void ReadJournal(CFlatJournal& journal);
+
 
     ADD_SERIALIZE_METHODS;
 
@@ -280,6 +350,10 @@ public:
 
         READWRITE(mapProposals);
         READWRITE(mapFinalizedBudgets);
+        if (ser_action.ForRead()) {
+            RebuildFinalizedBudgetIndex();
+            RebuildOrphanVoteIndex();
+        }
     }
 };
 
@@ -467,6 +541,14 @@ private:
     mutable CCriticalSection cs;
     CAmount nAlloted;
 
+protected:
+    // running tallies of the valid votes in mapVotes
+    int nYeas;
+    int nNays;
+    int nAbstains;
+
+    void CountVote(const CBudgetVote& vote, int nIncrement);
+
 public:
     bool fValid;
     std::string strProposalName;
@@ -517,14 +599,16 @@ public:
     int GetBlockCurrentCycle();
     int GetBlockEndCycle();
     double GetRatio();
-    int GetYeas();
-    int GetNays();
-    int GetAbstains();
+    int GetYeas() { return nYeas; }
+    int GetNays() { return nNays; }
+    int GetAbstains() { return nAbstains; }
     CAmount GetAmount() { return nAmount; }
     void SetAllotted(CAmount nAllotedIn) { nAlloted = nAllotedIn; }
     CAmount GetAllotted() { return nAlloted; }
 
     void CleanAndRemove(bool fSignatureCheck);
+    /// Rebuild the tallies from mapVotes, for code that changed the votes directly
+    void RecountVotes();
 
     uint256 GetHash()
     {
@@ -558,6 +642,8 @@ public:
 
         //for saving to the serialized db
         READWRITE(mapVotes);
+        if (ser_action.ForRead())
+            RecountVotes();
     }
 };
 
@@ -586,6 +672,9 @@ public:
         swap(first.nTime, second.nTime);
         swap(first.nFeeTXHash, second.nFeeTXHash);
         first.mapVotes.swap(second.mapVotes);
+        swap(first.nYeas, second.nYeas);
+        swap(first.nNays, second.nNays);
+        swap(first.nAbstains, second.nAbstains);
     }
 
     CBudgetProposalBroadcast& operator=(CBudgetProposalBroadcast from)
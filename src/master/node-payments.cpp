@@ -6,6 +6,7 @@
 
 #include "master/node-payments.h"
 #include "addrman.h"
+#include "journal.h"
 #include "master/node-budget.h"
 #include "master/node-sync.h"
 #include "master/nodeman.h"
@@ -28,6 +29,14 @@ CCriticalSection cs_mapMasternodePayeeVotes;
 // CMasternodePaymentDB
 //
 
+// mnpayments.dat tables
+enum {
+    MNPAYMENTSDB_VOTES,
+    MNPAYMENTSDB_BLOCKS
+};
+
+static CFlatJournal mnpaymentsJournal("mnpayments.dat", "MasternodePaymentsJournal");
+
 CMasternodePaymentDB::CMasternodePaymentDB()
 {
     pathDB = GetDataDir() / "mnpayments.dat";
@@ -38,27 +47,12 @@ bool CMasternodePaymentDB::Write(const CMasternodePayments& objToSave)
 {
     int64_t nStart = GetTimeMillis();
 
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssObj(SER_DISK, CLIENT_VERSION);
-    ssObj << strMagicMessage;                   // masternode cache file specific magic message
-    ssObj << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssObj << objToSave;
-    uint256 hash = Hash(ssObj.begin(), ssObj.end());
-    ssObj << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathDB.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssObj;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
-    }
-    fileout.fclose();
+    // only records that changed since the last write are appended
+    if (!mnpaymentsJournal.OpenForWrite())
+        return false;
+    objToSave.WriteJournal(mnpaymentsJournal);
+    if (!mnpaymentsJournal.Flush())
+        return false;
 
     LogPrint("masternode","Written info to mnpayments.dat  %dms\n", GetTimeMillis() - nStart);
 
@@ -68,6 +62,41 @@ bool CMasternodePaymentDB::Write(const CMasternodePayments& objToSave)
 CMasternodePaymentDB::ReadResult CMasternodePaymentDB::Read(CMasternodePayments& objToLoad, bool fDryRun)
 {
     int64_t nStart = GetTimeMillis();
+
+    CFlatJournal::ReadResult journalResult = mnpaymentsJournal.Open();
+    if (journalResult == CFlatJournal::IncorrectMagicMessage) {
+        // files written before the journal format are converted once
+        ReadResult result = ReadLegacy(objToLoad);
+        if (result != Ok)
+            return result;
+        if (mnpaymentsJournal.Reset()) {
+            objToLoad.WriteJournal(mnpaymentsJournal);
+            mnpaymentsJournal.Flush();
+        }
+    } else if (journalResult == CFlatJournal::FileError) {
+        return FileError;
+    } else if (journalResult == CFlatJournal::IncorrectMagicNumber) {
+        return IncorrectMagicNumber;
+    } else if (journalResult != CFlatJournal::Ok) {
+        return IncorrectFormat;
+    } else {
+        objToLoad.ReadJournal(mnpaymentsJournal);
+    }
+
+    LogPrint("masternode","Loaded info from mnpayments.dat  %dms\n", GetTimeMillis() - nStart);
+    LogPrint("masternode","  %s\n", objToLoad.ToString());
+    if (!fDryRun) {
+        LogPrint("masternode","Masternode payments manager - cleaning....\n");
+        objToLoad.CleanPaymentList();
+        LogPrint("masternode","Masternode payments manager - result:\n");
+        LogPrint("masternode","  %s\n", objToLoad.ToString());
+    }
+
+    return Ok;
+}
+
+CMasternodePaymentDB::ReadResult CMasternodePaymentDB::ReadLegacy(CMasternodePayments& objToLoad)
+{
     // open input file, and associate with CAutoFile
     FILE* file = fopen(pathDB.string().c_str(), "rb");
     CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
@@ -135,15 +164,6 @@ CMasternodePaymentDB::ReadResult CMasternodePaymentDB::Read(CMasternodePayments&
         return IncorrectFormat;
     }
 
-    LogPrint("masternode","Loaded info from mnpayments.dat  %dms\n", GetTimeMillis() - nStart);
-    LogPrint("masternode","  %s\n", objToLoad.ToString());
-    if (!fDryRun) {
-        LogPrint("masternode","Masternode payments manager - cleaning....\n");
-        objToLoad.CleanPaymentList();
-        LogPrint("masternode","Masternode payments manager - result:\n");
-        LogPrint("masternode","  %s\n", objToLoad.ToString());
-    }
-
     return Ok;
 }
 
@@ -152,28 +172,46 @@ void DumpMasternodePayments()
     int64_t nStart = GetTimeMillis();
 
     CMasternodePaymentDB paymentdb;
-    CMasternodePayments tempPayments;
-
-    LogPrint("masternode","Verifying mnpayments.dat format...\n");
-    CMasternodePaymentDB::ReadResult readResult = paymentdb.Read(tempPayments, true);
-    // there was an error and it was not an error on file opening => do not proceed
-    if (readResult == CMasternodePaymentDB::FileError)
-        LogPrint("masternode","Missing budgets file - mnpayments.dat, will try to recreate\n");
-    else if (readResult != CMasternodePaymentDB::Ok) {
-        LogPrint("masternode","Error reading mnpayments.dat: ");
-        if (readResult == CMasternodePaymentDB::IncorrectFormat)
-            LogPrint("masternode","magic is ok but data has invalid format, will try to recreate\n");
-        else {
-            LogPrint("masternode","file format is unknown or invalid, please fix it manually\n");
-            return;
-        }
-    }
     LogPrint("masternode","Writting info to mnpayments.dat...\n");
     paymentdb.Write(masternodePayments);
 
     LogPrint("masternode","Budget dump finished  %dms\n", GetTimeMillis() - nStart);
 }
 
+void CMasternodePayments::WriteJournal(CFlatJournal& journal) const
+{
+    LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
+
+    journal.WriteMap(MNPAYMENTSDB_VOTES, mapMasternodePayeeVotes, true);
+
+    std::set<uint256> setKeys;
+    for (std::map<int, CMasternodeBlockPayees>::const_iterator it = mapMasternodeBlocks.begin(); it != mapMasternodeBlocks.end(); ++it) {
+        uint256 key = (uint64_t)it->first;
+        journal.Write(MNPAYMENTSDB_BLOCKS, key, it->second);
+        setKeys.insert(key);
+    }
+    journal.EraseMissing(MNPAYMENTSDB_BLOCKS, setKeys);
+}
+
+void CMasternodePayments::ReadJournal(CFlatJournal& journal)
+{
+    LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
+
+    Clear();
+
+    journal.ReadMap(MNPAYMENTSDB_VOTES, mapMasternodePayeeVotes);
+
+    std::vector<uint256> vKeys;
+    journal.GetKeys(MNPAYMENTSDB_BLOCKS, vKeys);
+    BOOST_FOREACH (const uint256& key, vKeys) {
+        CMasternodeBlockPayees blockPayees;
+        if (journal.Read(MNPAYMENTSDB_BLOCKS, key, blockPayees))
+            mapMasternodeBlocks[blockPayees.nBlockHeight] = blockPayees;
+    }
+
+    RebuildPayeeIndex();
+}
+
 bool IsBlockValueValid(const CBlock& block, CAmount nExpectedValue, CAmount nMinted)
 {
     CBlockIndex* pindexPrev = chainActive.Tip();
@@ -437,14 +475,19 @@ void CMasternodePayments::ProcessMessageMasternodePayments(CNode* pfrom, std::st
     }
 }
 
+std::string CMasternodePaymentWinner::GetStrMessage() const
+{
+    return vinMasternode.prevout.ToStringShort() +
+           boost::lexical_cast<std::string>(nBlockHeight) +
+           payee.ToString();
+}
+
 bool CMasternodePaymentWinner::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
 {
     std::string errorMessage;
     std::string strMasterNodeSignMessage;
 
-    std::string strMessage = vinMasternode.prevout.ToStringShort() +
-                             boost::lexical_cast<std::string>(nBlockHeight) +
-                             payee.ToString();
+    std::string strMessage = GetStrMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, vchSig, keyMasternode)) {
         LogPrint("masternode","CMasternodePing::Sign() - Error: %s\n", errorMessage.c_str());
@@ -484,16 +527,11 @@ bool CMasternodePayments::IsScheduled(CMasternode& mn, int nNotBlockHeight)
     CScript mnpayee;
     mnpayee = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
 
-    CScript payee;
-    for (int64_t h = nHeight; h <= nHeight + 8; h++) {
-        if (h == nNotBlockHeight) continue;
-        if (mapMasternodeBlocks.count(h)) {
-            if (mapMasternodeBlocks[h].GetPayee(payee)) {
-                if (mnpayee == payee) {
-                    return true;
-                }
-            }
-        }
+    boost::unordered_map<CScript, std::set<int>, ScriptHasher>::const_iterator it = mapPayeeScheduled.find(mnpayee);
+    if (it == mapPayeeScheduled.end()) return false;
+
+    for (std::set<int>::const_iterator itHeight = it->second.lower_bound(nHeight); itHeight != it->second.end() && *itHeight <= nHeight + 8; ++itHeight) {
+        if (*itHeight != nNotBlockHeight) return true;
     }
 
     return false;
@@ -514,6 +552,7 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
         }
 
         mapMasternodePayeeVotes[winnerIn.GetHash()] = winnerIn;
+        mapVotesByHeight[winnerIn.nBlockHeight].push_back(winnerIn.GetHash());
 
         if (!mapMasternodeBlocks.count(winnerIn.nBlockHeight)) {
             CMasternodeBlockPayees blockPayees(winnerIn.nBlockHeight);
@@ -521,11 +560,100 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
         }
     }
 
-    mapMasternodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payee, 1);
+    {
+        LOCK(cs_mapMasternodeBlocks);
+        mapMasternodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payee, 1);
+        IndexBlockPayee(winnerIn.nBlockHeight, winnerIn.payee);
+        ScheduleBlockPayee(winnerIn.nBlockHeight);
+    }
 
     return true;
 }
 
+void CMasternodePayments::IndexBlockPayee(int nBlockHeight, const CScript& payee)
+{
+    if (mapMasternodeBlocks[nBlockHeight].HasPayeeWithVotes(payee, MNPAYMENTS_LASTPAID_VOTES))
+        mapPayeeHeights[payee].insert(nBlockHeight);
+}
+
+void CMasternodePayments::ScheduleBlockPayee(int nBlockHeight)
+{
+    CScript payee;
+    if (!mapMasternodeBlocks[nBlockHeight].GetPayee(payee)) return;
+
+    std::map<int, CScript>::iterator it = mapScheduledPayee.find(nBlockHeight);
+    if (it != mapScheduledPayee.end()) {
+        if (it->second == payee) return;
+
+        boost::unordered_map<CScript, std::set<int>, ScriptHasher>::iterator itHeights = mapPayeeScheduled.find(it->second);
+        if (itHeights != mapPayeeScheduled.end()) {
+            itHeights->second.erase(nBlockHeight);
+            if (itHeights->second.empty()) mapPayeeScheduled.erase(itHeights);
+        }
+    }
+
+    mapScheduledPayee[nBlockHeight] = payee;
+    mapPayeeScheduled[payee].insert(nBlockHeight);
+}
+
+void CMasternodePayments::EraseBlockPayees(int nBlockHeight)
+{
+    std::map<int, CScript>::iterator itScheduled = mapScheduledPayee.find(nBlockHeight);
+    if (itScheduled != mapScheduledPayee.end()) {
+        boost::unordered_map<CScript, std::set<int>, ScriptHasher>::iterator itHeights = mapPayeeScheduled.find(itScheduled->second);
+        if (itHeights != mapPayeeScheduled.end()) {
+            itHeights->second.erase(nBlockHeight);
+            if (itHeights->second.empty()) mapPayeeScheduled.erase(itHeights);
+        }
+        mapScheduledPayee.erase(itScheduled);
+    }
+
+    std::map<int, CMasternodeBlockPayees>::iterator it = mapMasternodeBlocks.find(nBlockHeight);
+    if (it == mapMasternodeBlocks.end()) return;
+
+    BOOST_FOREACH (CMasternodePayee& payee, it->second.vecPayments) {
+        boost::unordered_map<CScript, std::set<int>, ScriptHasher>::iterator itHeights = mapPayeeHeights.find(payee.scriptPubKey);
+        if (itHeights == mapPayeeHeights.end()) continue;
+        itHeights->second.erase(nBlockHeight);
+        if (itHeights->second.empty()) mapPayeeHeights.erase(itHeights);
+    }
+    mapMasternodeBlocks.erase(it);
+}
+
+void CMasternodePayments::RebuildPayeeIndex()
+{
+    LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
+
+    mapPayeeHeights.clear();
+    mapPayeeScheduled.clear();
+    mapScheduledPayee.clear();
+    for (std::map<int, CMasternodeBlockPayees>::iterator it = mapMasternodeBlocks.begin(); it != mapMasternodeBlocks.end(); ++it) {
+        BOOST_FOREACH (CMasternodePayee& payee, it->second.vecPayments)
+            IndexBlockPayee(it->first, payee.scriptPubKey);
+        ScheduleBlockPayee(it->first);
+    }
+
+    mapVotesByHeight.clear();
+    for (std::map<uint256, CMasternodePaymentWinner>::iterator it = mapMasternodePayeeVotes.begin(); it != mapMasternodePayeeVotes.end(); ++it)
+        mapVotesByHeight[it->second.nBlockHeight].push_back(it->first);
+}
+
+bool CMasternodePayments::GetLastPaidHeight(const CScript& payee, int nMinHeight, int nMaxHeight, int& nHeightRet)
+{
+    LOCK(cs_mapMasternodeBlocks);
+
+    boost::unordered_map<CScript, std::set<int>, ScriptHasher>::const_iterator it = mapPayeeHeights.find(payee);
+    if (it == mapPayeeHeights.end()) return false;
+
+    std::set<int>::const_iterator itHeight = it->second.upper_bound(nMaxHeight);
+    if (itHeight == it->second.begin()) return false;
+    --itHeight;
+    if (*itHeight < nMinHeight) return false;
+
+    nHeightRet = *itHeight;
+    return true;
+}
+
 bool CMasternodeBlockPayees::IsTransactionValid(const CTransaction& txNew)
 {
     LOCK(cs_vecPayments);
@@ -645,19 +773,21 @@ void CMasternodePayments::CleanPaymentList()
     //keep up to five cycles for historical sake
     int nLimit = std::max(int(mnodeman.size() * 1.25), 1000);
 
-    std::map<uint256, CMasternodePaymentWinner>::iterator it = mapMasternodePayeeVotes.begin();
-    while (it != mapMasternodePayeeVotes.end()) {
-        CMasternodePaymentWinner winner = (*it).second;
-
-        if (nHeight - winner.nBlockHeight > nLimit) {
-            LogPrint("mnpayments", "CMasternodePayments::CleanPaymentList - Removing old Masternode payment - block %d\n", winner.nBlockHeight);
-            masternodeSync.mapSeenSyncMNW.erase((*it).first);
-            mapMasternodePayeeVotes.erase(it++);
-            mapMasternodeBlocks.erase(winner.nBlockHeight);
-        } else {
-            ++it;
+    // votes are bucketed by height, so only the heights that are dropped are visited
+    while (!mapVotesByHeight.empty() && nHeight - mapVotesByHeight.begin()->first > nLimit) {
+        std::map<int, std::vector<uint256> >::iterator it = mapVotesByHeight.begin();
+        LogPrint("mnpayments", "CMasternodePayments::CleanPaymentList - Removing old Masternode payments - block %d\n", it->first);
+        BOOST_FOREACH (const uint256& hash, it->second) {
+            masternodeSync.mapSeenSyncMNW.erase(hash);
+            mapMasternodePayeeVotes.erase(hash);
         }
+        EraseBlockPayees(it->first);
+        mapVotesByHeight.erase(it);
     }
+
+    // and heights nobody voted for
+    while (!mapMasternodeBlocks.empty() && nHeight - mapMasternodeBlocks.begin()->first > nLimit)
+        EraseBlockPayees(mapMasternodeBlocks.begin()->first);
 }
 
 bool CMasternodePaymentWinner::IsValid(CNode* pnode, std::string& strError)
@@ -776,9 +906,7 @@ bool CMasternodePaymentWinner::SignatureValid()
     CMasternode* pmn = mnodeman.Find(vinMasternode);
 
     if (pmn != NULL) {
-        std::string strMessage = vinMasternode.prevout.ToStringShort() +
-                                 boost::lexical_cast<std::string>(nBlockHeight) +
-                                 payee.ToString();
+        std::string strMessage = GetStrMessage();
 
         std::string errorMessage = "";
         if (!obfuScationSigner.VerifyMessage(pmn->pubKeyMasternode, vchSig, strMessage, errorMessage)) {
@@ -806,14 +934,12 @@ void CMasternodePayments::Sync(CNode* node, int nCountNeeded)
     if (nCountNeeded > nCount) nCountNeeded = nCount;
 
     int nInvCount = 0;
-    std::map<uint256, CMasternodePaymentWinner>::iterator it = mapMasternodePayeeVotes.begin();
-    while (it != mapMasternodePayeeVotes.end()) {
-        CMasternodePaymentWinner winner = (*it).second;
-        if (winner.nBlockHeight >= nHeight - nCountNeeded && winner.nBlockHeight <= nHeight + 20) {
-            node->PushInventory(CInv(MSG_MASTERNODE_WINNER, winner.GetHash()));
+    std::map<int, std::vector<uint256> >::const_iterator it = mapVotesByHeight.lower_bound(nHeight - nCountNeeded);
+    for (; it != mapVotesByHeight.end() && it->first <= nHeight + 20; ++it) {
+        BOOST_FOREACH (const uint256& hash, it->second) {
+            node->PushInventory(CInv(MSG_MASTERNODE_WINNER, hash));
             nInvCount++;
         }
-        ++it;
     }
     node->PushMessage("ssc", MASTERNODE_SYNC_MNW, nInvCount);
 }
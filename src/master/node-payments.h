@@ -10,6 +10,7 @@
 #include "key.h"
 #include "main.h"
 #include "master/node.h"
+#include "nodeindex.h"
 #include <boost/lexical_cast.hpp>
 
 using namespace std;
@@ -19,6 +20,7 @@ extern CCriticalSection cs_mapMasternodeBlocks;
 extern CCriticalSection cs_mapMasternodePayeeVotes;
 
 class CMasternodePayments;
+class CFlatJournal;
 class CMasternodePaymentWinner;
 class CMasternodeBlockPayees;
 
@@ -26,6 +28,7 @@ extern CMasternodePayments masternodePayments;
 
 #define MNPAYMENTS_SIGNATURES_REQUIRED 6
 #define MNPAYMENTS_SIGNATURES_TOTAL 10
+#define MNPAYMENTS_LASTPAID_VOTES 2
 
 void ProcessMessageMasternodePayments(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 bool IsBlockPayeeValid(const CBlock& block, int nBlockHeight);
@@ -35,7 +38,7 @@ void FillBlockPayee(CMutableTransaction& txNew, CAmount nFees, bool fProofOfStak
 
 void DumpMasternodePayments();
 
-/** Save Masternode Payment Data (mnpayments.dat)
+/** Save Masternode Payment Data (mnpayments.dat), kept as a CFlatJournal
  */
 class CMasternodePaymentDB
 {
@@ -57,6 +60,10 @@ public:
     CMasternodePaymentDB();
     bool Write(const CMasternodePayments& objToSave);
     ReadResult Read(CMasternodePayments& objToLoad, bool fDryRun = false);
+
+private:
+    /// Files written before the journal format, serialized as a whole
+    ReadResult ReadLegacy(CMasternodePayments& objToLoad);
 };
 
 class CMasternodePayee
@@ -196,6 +203,7 @@ public:
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     bool IsValid(CNode* pnode, std::string& strError);
     bool SignatureValid();
+    std::string GetStrMessage() const;
     void Relay();
 
     void AddPayee(CScript payeeIn)
@@ -237,6 +245,21 @@ private:
     int nSyncedFromPeer;
     int nLastBlockHeight;
 
+    // payee -> heights in mapMasternodeBlocks where it has at least MNPAYMENTS_LASTPAID_VOTES votes
+    boost::unordered_map<CScript, std::set<int>, ScriptHasher> mapPayeeHeights;
+
+    // payee -> heights in mapMasternodeBlocks where it has the most votes, and the other way around
+    boost::unordered_map<CScript, std::set<int>, ScriptHasher> mapPayeeScheduled;
+    std::map<int, CScript> mapScheduledPayee;
+
+    // height -> hashes of the votes for it in mapMasternodePayeeVotes, protected by cs_mapMasternodePayeeVotes
+    std::map<int, std::vector<uint256> > mapVotesByHeight;
+
+    void IndexBlockPayee(int nBlockHeight, const CScript& payee);
+    void ScheduleBlockPayee(int nBlockHeight);
+    void EraseBlockPayees(int nBlockHeight);
+    void RebuildPayeeIndex();
+
 public:
     std::map<uint256, CMasternodePaymentWinner> mapMasternodePayeeVotes;
     std::map<int, CMasternodeBlockPayees> mapMasternodeBlocks;
@@ -253,6 +276,10 @@ public:
         LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
         mapMasternodeBlocks.clear();
         mapMasternodePayeeVotes.clear();
+        mapPayeeHeights.clear();
+        mapPayeeScheduled.clear();
+        mapScheduledPayee.clear();
+        mapVotesByHeight.clear();
     }
 
     bool AddWinningMasternode(CMasternodePaymentWinner& winner);
@@ -265,6 +292,8 @@ public:
     bool GetBlockPayee(int nBlockHeight, CScript& payee);
     bool IsTransactionValid(const CTransaction& txNew, int nBlockHeight);
     bool IsScheduled(CMasternode& mn, int nNotBlockHeight);
+    /// Most recent height in [nMinHeight, nMaxHeight] where payee was voted in
+    bool GetLastPaidHeight(const CScript& payee, int nMinHeight, int nMaxHeight, int& nHeightRet);
 
     bool CanVote(COutPoint outMasternode, int nBlockHeight)
     {
@@ -286,6 +315,11 @@ public:
     std::string GetRequiredPaymentsString(int nBlockHeight);
     void FillBlockPayee(CMutableTransaction& txNew, int64_t nFees, bool fProofOfStake, bool fZPIVStake);
     std::string ToString() const;
+
+    /// Append what changed since the last call to the cache journal
+    void WriteJournal(CFlatJournal& journal) const;
+    /// Replace the contents with the entries of the cache journal
+    void ReadJournal(CFlatJournal& journal);
     int GetOldestBlock();
     int GetNewestBlock();
 
@@ -296,6 +330,9 @@ public:
     {
         READWRITE(mapMasternodePayeeVotes);
         READWRITE(mapMasternodeBlocks);
+
+        if (ser_action.ForRead())
+            RebuildPayeeIndex();
     }
 };
 
@@ -20,7 +20,7 @@
 class CMasternodeSync;
 CMasternodeSync masternodeSync;
 
-CMasternodeSync::CMasternodeSync()
+CMasternodeSync::CMasternodeSync() : mapSeenSyncMNB(MASTERNODE_SYNC_SEEN_SECONDS), mapSeenSyncMNW(MASTERNODE_SYNC_SEEN_SECONDS), mapSeenSyncBudget(MASTERNODE_SYNC_SEEN_SECONDS)
 {
     Reset();
 }
@@ -63,6 +63,8 @@ bool CMasternodeSync::IsBlockchainSynced()
 
 void CMasternodeSync::Reset()
 {
+    LOCK(cs);
+
     lastMasternodeList = 0;
     lastMasternodeWinner = 0;
     lastBudgetItem = 0;
@@ -79,9 +81,13 @@ void CMasternodeSync::Reset()
     countMasternodeWinner = 0;
     countBudgetItemProp = 0;
     countBudgetItemFin = 0;
+    countMasternodeListDelta = 0;
     RequestedMasternodeAssets = MASTERNODE_SYNC_INITIAL;
     RequestedMasternodeAttempt = 0;
     nAssetSyncStarted = GetTime();
+    nAssetSyncStartedMillis = GetTimeMillis();
+    for (int i = 0; i <= MASTERNODE_SYNC_BUDGET; i++)
+        nStageMillis[i] = -1;
 }
 
 void CMasternodeSync::AddedMasternodeList(uint256 hash)
@@ -97,6 +103,22 @@ void CMasternodeSync::AddedMasternodeList(uint256 hash)
     }
 }
 
+void CMasternodeSync::AddedMasternodeListPage(int nCount, bool fLast)
+{
+    LOCK(cs);
+
+    if (RequestedMasternodeAssets != MASTERNODE_SYNC_LIST) return;
+
+    sumMasternodeList += nCount;
+    if (fLast) {
+        countMasternodeList++;
+        countMasternodeListDelta++;
+
+        // enough peers may have sent everything now
+        CheckAsset();
+    }
+}
+
 void CMasternodeSync::AddedMasternodeWinner(uint256 hash)
 {
     if (masternodePayments.mapMasternodePayeeVotes.count(hash)) {
@@ -136,6 +158,14 @@ bool CMasternodeSync::IsBudgetFinEmpty()
 
 void CMasternodeSync::GetNextAsset()
 {
+    LOCK(cs);
+
+    int64_t nNow = GetTimeMillis();
+    if (RequestedMasternodeAssets > MASTERNODE_SYNC_INITIAL && RequestedMasternodeAssets <= MASTERNODE_SYNC_BUDGET) {
+        nStageMillis[RequestedMasternodeAssets] = nNow - nAssetSyncStartedMillis;
+        LogPrint("masternode", "CMasternodeSync::GetNextAsset - %s took %d ms\n", GetAssetName(RequestedMasternodeAssets), nStageMillis[RequestedMasternodeAssets]);
+    }
+
     switch (RequestedMasternodeAssets) {
     case (MASTERNODE_SYNC_INITIAL):
     case (MASTERNODE_SYNC_FAILED): // should never be used here actually, use Reset() instead
@@ -158,6 +188,35 @@ void CMasternodeSync::GetNextAsset()
     }
     RequestedMasternodeAttempt = 0;
     nAssetSyncStarted = GetTime();
+    nAssetSyncStartedMillis = nNow;
+}
+
+std::string CMasternodeSync::GetAssetName(int nAsset)
+{
+    switch (nAsset) {
+    case MASTERNODE_SYNC_INITIAL:
+        return "MASTERNODE_SYNC_INITIAL";
+    case MASTERNODE_SYNC_SPORKS:
+        return "MASTERNODE_SYNC_SPORKS";
+    case MASTERNODE_SYNC_LIST:
+        return "MASTERNODE_SYNC_LIST";
+    case MASTERNODE_SYNC_MNW:
+        return "MASTERNODE_SYNC_MNW";
+    case MASTERNODE_SYNC_BUDGET:
+        return "MASTERNODE_SYNC_BUDGET";
+    case MASTERNODE_SYNC_FAILED:
+        return "MASTERNODE_SYNC_FAILED";
+    case MASTERNODE_SYNC_FINISHED:
+        return "MASTERNODE_SYNC_FINISHED";
+    }
+    return "UNKNOWN";
+}
+
+int64_t CMasternodeSync::GetStageMillis(int nAsset)
+{
+    if (nAsset < MASTERNODE_SYNC_SPORKS || nAsset > MASTERNODE_SYNC_BUDGET) return -1;
+    if (nAsset == RequestedMasternodeAssets) return GetTimeMillis() - nAssetSyncStartedMillis;
+    return nStageMillis[nAsset];
 }
 
 std::string CMasternodeSync::GetSyncStatus()
@@ -188,6 +247,7 @@ void CMasternodeSync::ProcessMessage(CNode* pfrom, std::string& strCommand, CDat
         int nCount;
         vRecv >> nItemID >> nCount;
 
+        LOCK(cs);
         if (RequestedMasternodeAssets >= MASTERNODE_SYNC_FINISHED) return;
 
         //this means we will receive no further communication
@@ -215,6 +275,9 @@ void CMasternodeSync::ProcessMessage(CNode* pfrom, std::string& strCommand, CDat
         }
 
         LogPrint("masternode", "CMasternodeSync:ProcessMessage - ssc - got inventory count %d %d\n", nItemID, nCount);
+
+        // enough peers may have sent everything now
+        CheckAsset();
     }
 }
 
@@ -234,24 +297,31 @@ void CMasternodeSync::ClearFulfilledRequest()
 void CMasternodeSync::Process()
 {
     static int tick = 0;
+    static bool fWasSynced = false;
+
+    tick++;
 
-    if (tick++ % MASTERNODE_SYNC_TIMEOUT != 0) return;
+    // the last stage can complete on a peer message, try to activate our masternode as soon as we're synced
+    bool fSynced = IsSynced();
+    if (fSynced && !fWasSynced) activeMasternode.ManageStatus();
+    fWasSynced = fSynced;
 
-    if (IsSynced()) {
-        /* 
+    if (fSynced) {
+        /*
             Resync if we lose all masternodes from sleep/wake or failure to sync originally
         */
-        if (mnodeman.CountEnabled() == 0) {
-            Reset();
-        } else
-            return;
+        if (tick % MASTERNODE_SYNC_TIMEOUT != 0 || mnodeman.CountEnabled() > 0) return;
+        Reset();
     }
 
     //try syncing again
-    if (RequestedMasternodeAssets == MASTERNODE_SYNC_FAILED && lastFailure + (1 * 60) < GetTime()) {
-        Reset();
-    } else if (RequestedMasternodeAssets == MASTERNODE_SYNC_FAILED) {
-        return;
+    {
+        LOCK(cs);
+        if (RequestedMasternodeAssets == MASTERNODE_SYNC_FAILED && lastFailure + (1 * 60) < GetTime()) {
+            Reset();
+        } else if (RequestedMasternodeAssets == MASTERNODE_SYNC_FAILED) {
+            return;
+        }
     }
 
     LogPrint("masternode", "CMasternodeSync::Process() - tick %d RequestedMasternodeAssets %d\n", tick, RequestedMasternodeAssets);
@@ -262,144 +332,143 @@ void CMasternodeSync::Process()
     if (Params().NetworkID() != CBaseChainParams::REGTEST &&
         !IsBlockchainSynced() && RequestedMasternodeAssets > MASTERNODE_SYNC_SPORKS) return;
 
+    if (Params().NetworkID() == CBaseChainParams::REGTEST) {
+        if (tick % MASTERNODE_SYNC_TIMEOUT != 0) return;
+
+        LOCK(cs);
+        TRY_LOCK(cs_vNodes, lockRecv);
+        if (!lockRecv || vNodes.empty()) return;
+
+        CNode* pnode = vNodes.front();
+        if (RequestedMasternodeAttempt <= 2) {
+            pnode->PushMessage("getsporks"); //get current network sporks
+        } else if (RequestedMasternodeAttempt < 4) {
+            mnodeman.DsegUpdate(pnode);
+        } else if (RequestedMasternodeAttempt < 6) {
+            int nMnCount = mnodeman.CountEnabled();
+            pnode->PushMessage("mnget", nMnCount); //sync payees
+            uint256 n = 0;
+            pnode->PushMessage("mnvs", n); //sync masternode votes
+        } else {
+            RequestedMasternodeAssets = MASTERNODE_SYNC_FINISHED;
+        }
+        RequestedMasternodeAttempt++;
+        return;
+    }
+
+    CheckAsset();
+    RequestAssets();
+}
+
+void CMasternodeSync::CheckAsset()
+{
+    LOCK(cs);
+
+    // nothing was asked for yet, so nothing can be late either
+    if (RequestedMasternodeAttempt == 0) return;
+
+    int64_t nNow = GetTime();
+    int64_t nLastItem = 0;
+    int nPeersDone = 0;
+    bool fNoItems = false;
+
+    switch (RequestedMasternodeAssets) {
+    case (MASTERNODE_SYNC_SPORKS):
+        // sporks are sent right away and aren't counted, give the first peers a moment to answer
+        if (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD && nNow - nAssetSyncStarted >= MASTERNODE_SYNC_TIMEOUT) GetNextAsset();
+        return;
+    case (MASTERNODE_SYNC_LIST):
+        nLastItem = lastMasternodeList;
+        nPeersDone = countMasternodeList;
+        // delta syncs only send what we're missing, on a warm restart that may be pings only
+        fNoItems = countMasternodeListDelta >= MASTERNODE_SYNC_THRESHOLD && nLastItem == 0;
+        break;
+    case (MASTERNODE_SYNC_MNW):
+        nLastItem = lastMasternodeWinner;
+        nPeersDone = countMasternodeWinner;
+        break;
+    case (MASTERNODE_SYNC_BUDGET):
+        nLastItem = lastBudgetItem;
+        nPeersDone = std::min(countBudgetItemProp, countBudgetItemFin);
+        fNoItems = sumBudgetItemProp == 0 && sumBudgetItemFin == 0;
+        break;
+    default:
+        return;
+    }
+
+    // enough peers told us they sent everything and the items they announced are in,
+    // or nothing new arrived for a while
+    bool fPeersDone = nPeersDone >= MASTERNODE_SYNC_THRESHOLD && (fNoItems || (nLastItem > 0 && nLastItem < nNow - MASTERNODE_SYNC_TIMEOUT));
+    bool fQuiet = nLastItem > 0 && nLastItem < nNow - MASTERNODE_SYNC_TIMEOUT * 2 && RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD;
+    if (fPeersDone || fQuiet) {
+        GetNextAsset();
+        return;
+    }
+
+    // timeout
+    if (nLastItem == 0 && nNow - nAssetSyncStarted > MASTERNODE_SYNC_TIMEOUT * 5) {
+        if (RequestedMasternodeAssets != MASTERNODE_SYNC_BUDGET && IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
+            LogPrintf("CMasternodeSync::Process - ERROR - Sync has failed, will retry later\n");
+            RequestedMasternodeAssets = MASTERNODE_SYNC_FAILED;
+            RequestedMasternodeAttempt = 0;
+            lastFailure = nNow;
+            nCountFailures++;
+        } else {
+            // nothing to enforce, or maybe there are no budgets at all, so just move on
+            GetNextAsset();
+        }
+    }
+}
+
+void CMasternodeSync::RequestAssets()
+{
+    LOCK(cs);
+
+    if (RequestedMasternodeAssets < MASTERNODE_SYNC_SPORKS || RequestedMasternodeAssets > MASTERNODE_SYNC_BUDGET) return;
+
+    // a batch of peers right away, then one more every MASTERNODE_SYNC_TIMEOUT seconds until the stage completes
+    int nAllowed = MASTERNODE_SYNC_PEERS;
+    if (RequestedMasternodeAttempt > 0)
+        nAllowed += (GetTime() - nAssetSyncStarted) / MASTERNODE_SYNC_TIMEOUT;
+    nAllowed = std::min(nAllowed, MASTERNODE_SYNC_THRESHOLD * 3);
+    if (RequestedMasternodeAttempt >= nAllowed) return;
+
+    int nMnCount = RequestedMasternodeAssets == MASTERNODE_SYNC_MNW ? mnodeman.CountEnabled() : 0;
+
     TRY_LOCK(cs_vNodes, lockRecv);
     if (!lockRecv) return;
 
     BOOST_FOREACH (CNode* pnode, vNodes) {
-        if (Params().NetworkID() == CBaseChainParams::REGTEST) {
-            if (RequestedMasternodeAttempt <= 2) {
-                pnode->PushMessage("getsporks"); //get current network sporks
-            } else if (RequestedMasternodeAttempt < 4) {
-                mnodeman.DsegUpdate(pnode);
-            } else if (RequestedMasternodeAttempt < 6) {
-                int nMnCount = mnodeman.CountEnabled();
-                pnode->PushMessage("mnget", nMnCount); //sync payees
-                uint256 n = 0;
-                pnode->PushMessage("mnvs", n); //sync masternode votes
-            } else {
-                RequestedMasternodeAssets = MASTERNODE_SYNC_FINISHED;
-            }
-            RequestedMasternodeAttempt++;
-            return;
-        }
+        if (RequestedMasternodeAttempt >= nAllowed) return;
 
-        //set to synced
         if (RequestedMasternodeAssets == MASTERNODE_SYNC_SPORKS) {
             if (pnode->HasFulfilledRequest("getspork")) continue;
             pnode->FulfilledRequest("getspork");
 
             pnode->PushMessage("getsporks"); //get current network sporks
-            if (RequestedMasternodeAttempt >= 2) GetNextAsset();
-            RequestedMasternodeAttempt++;
-
-            return;
-        }
-
-        if (pnode->nVersion >= masternodePayments.GetMinMasternodePaymentsProto()) {
-            if (RequestedMasternodeAssets == MASTERNODE_SYNC_LIST) {
-                LogPrint("masternode", "CMasternodeSync::Process() - lastMasternodeList %lld (GetTime() - MASTERNODE_SYNC_TIMEOUT) %lld\n", lastMasternodeList, GetTime() - MASTERNODE_SYNC_TIMEOUT);
-                if (lastMasternodeList > 0 && lastMasternodeList < GetTime() - MASTERNODE_SYNC_TIMEOUT * 2 && RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD) { //hasn't received a new item in the last five seconds, so we'll move to the
-                    GetNextAsset();
-                    return;
-                }
-
-                if (pnode->HasFulfilledRequest("mnsync")) continue;
-                pnode->FulfilledRequest("mnsync");
-
-                // timeout
-                if (lastMasternodeList == 0 &&
-                    (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3 || GetTime() - nAssetSyncStarted > MASTERNODE_SYNC_TIMEOUT * 5)) {
-                    if (IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
-                        LogPrintf("CMasternodeSync::Process - ERROR - Sync has failed, will retry later\n");
-                        RequestedMasternodeAssets = MASTERNODE_SYNC_FAILED;
-                        RequestedMasternodeAttempt = 0;
-                        lastFailure = GetTime();
-                        nCountFailures++;
-                    } else {
-                        GetNextAsset();
-                    }
-                    return;
-                }
-
-                if (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3) return;
-
-                mnodeman.DsegUpdate(pnode);
-                RequestedMasternodeAttempt++;
-                return;
-            }
-
-            if (RequestedMasternodeAssets == MASTERNODE_SYNC_MNW) {
-                if (lastMasternodeWinner > 0 && lastMasternodeWinner < GetTime() - MASTERNODE_SYNC_TIMEOUT * 2 && RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD) { //hasn't received a new item in the last five seconds, so we'll move to the
-                    GetNextAsset();
-                    return;
-                }
-
-                if (pnode->HasFulfilledRequest("mnwsync")) continue;
-                pnode->FulfilledRequest("mnwsync");
-
-                // timeout
-                if (lastMasternodeWinner == 0 &&
-                    (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3 || GetTime() - nAssetSyncStarted > MASTERNODE_SYNC_TIMEOUT * 5)) {
-                    if (IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
-                        LogPrintf("CMasternodeSync::Process - ERROR - Sync has failed, will retry later\n");
-                        RequestedMasternodeAssets = MASTERNODE_SYNC_FAILED;
-                        RequestedMasternodeAttempt = 0;
-                        lastFailure = GetTime();
-                        nCountFailures++;
-                    } else {
-                        GetNextAsset();
-                    }
-                    return;
-                }
-
-                if (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3) return;
-
-                CBlockIndex* pindexPrev = chainActive.Tip();
-                if (pindexPrev == NULL) return;
-
-                int nMnCount = mnodeman.CountEnabled();
-                pnode->PushMessage("mnget", nMnCount); //sync payees
-                RequestedMasternodeAttempt++;
-
-                return;
-            }
+        } else if (RequestedMasternodeAssets == MASTERNODE_SYNC_LIST) {
+            if (pnode->nVersion < masternodePayments.GetMinMasternodePaymentsProto()) continue;
+            if (pnode->HasFulfilledRequest("mnsync")) continue;
+            pnode->FulfilledRequest("mnsync");
+
+            mnodeman.DsegUpdate(pnode);
+        } else if (RequestedMasternodeAssets == MASTERNODE_SYNC_MNW) {
+            if (pnode->nVersion < masternodePayments.GetMinMasternodePaymentsProto()) continue;
+            if (pnode->HasFulfilledRequest("mnwsync")) continue;
+            pnode->FulfilledRequest("mnwsync");
+
+            pnode->PushMessage("mnget", nMnCount); //sync payees
+        } else {
+            if (pnode->nVersion < ActiveProtocol()) continue;
+            if (pnode->HasFulfilledRequest("busync")) continue;
+            pnode->FulfilledRequest("busync");
+
+            uint256 n = 0;
+            pnode->PushMessage("mnvs", n); //sync masternode votes
         }
 
-        if (pnode->nVersion >= ActiveProtocol()) {
-            if (RequestedMasternodeAssets == MASTERNODE_SYNC_BUDGET) {
-                
-                // We'll start rejecting votes if we accidentally get set as synced too soon
-                if (lastBudgetItem > 0 && lastBudgetItem < GetTime() - MASTERNODE_SYNC_TIMEOUT * 2 && RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD) { 
-                    
-                    // Hasn't received a new item in the last five seconds, so we'll move to the
-                    GetNextAsset();
-
-                    // Try to activate our masternode if possible
-                    activeMasternode.ManageStatus();
-
-                    return;
-                }
-
-                // timeout
-                if (lastBudgetItem == 0 &&
-                    (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3 || GetTime() - nAssetSyncStarted > MASTERNODE_SYNC_TIMEOUT * 5)) {
-                    // maybe there is no budgets at all, so just finish syncing
-                    GetNextAsset();
-                    activeMasternode.ManageStatus();
-                    return;
-                }
-
-                if (pnode->HasFulfilledRequest("busync")) continue;
-                pnode->FulfilledRequest("busync");
-
-                if (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3) return;
-
-                uint256 n = 0;
-                pnode->PushMessage("mnvs", n); //sync masternode votes
-                RequestedMasternodeAttempt++;
-
-                return;
-            }
-        }
+        // the wait for the blockchain doesn't count against the timeouts
+        if (RequestedMasternodeAttempt == 0) nAssetSyncStarted = GetTime();
+        RequestedMasternodeAttempt++;
     }
 }
@@ -7,6 +7,9 @@
 #ifndef MASTERNODE_SYNC_H
 #define MASTERNODE_SYNC_H
 
+#include "seencache.h"
+#include "sync.h"
+
 #define MASTERNODE_SYNC_INITIAL 0
 #define MASTERNODE_SYNC_SPORKS 1
 #define MASTERNODE_SYNC_LIST 2
@@ -19,6 +22,10 @@
 
 #define MASTERNODE_SYNC_TIMEOUT 5
 #define MASTERNODE_SYNC_THRESHOLD 2
+// peers an asset is requested from at once, more are asked every MASTERNODE_SYNC_TIMEOUT seconds
+#define MASTERNODE_SYNC_PEERS 4
+// seconds an item counts towards the sync of its asset
+#define MASTERNODE_SYNC_SEEN_SECONDS (60 * 60)
 
 class CMasternodeSync;
 extern CMasternodeSync masternodeSync;
@@ -30,9 +37,9 @@ extern CMasternodeSync masternodeSync;
 class CMasternodeSync
 {
 public:
-    std::map<uint256, int> mapSeenSyncMNB;
-    std::map<uint256, int> mapSeenSyncMNW;
-    std::map<uint256, int> mapSeenSyncBudget;
+    CSeenCache<int> mapSeenSyncMNB;
+    CSeenCache<int> mapSeenSyncMNW;
+    CSeenCache<int> mapSeenSyncBudget;
 
     int64_t lastMasternodeList;
     int64_t lastMasternodeWinner;
@@ -50,20 +57,33 @@ public:
     int countMasternodeWinner;
     int countBudgetItemProp;
     int countBudgetItemFin;
+    // peers that finished a delta list sync
+    int countMasternodeListDelta;
 
     // Count peers we've requested the list from
     int RequestedMasternodeAssets;
     int RequestedMasternodeAttempt;
 
-    // Time when current masternode asset sync started
+    // Time when current masternode asset sync started, or when it was first requested
     int64_t nAssetSyncStarted;
+    int64_t nAssetSyncStartedMillis;
+    // Milliseconds each finished stage took, -1 for stages that haven't run
+    int64_t nStageMillis[MASTERNODE_SYNC_BUDGET + 1];
+
+    // Stage changes are triggered by peer messages as well as by Process()
+    CCriticalSection cs;
 
     CMasternodeSync();
 
     void AddedMasternodeList(uint256 hash);
+    void AddedMasternodeListPage(int nCount, bool fLast);
     void AddedMasternodeWinner(uint256 hash);
     void AddedBudgetItem(uint256 hash);
     void GetNextAsset();
+    void CheckAsset();
+    void RequestAssets();
+    std::string GetAssetName(int nAsset);
+    int64_t GetStageMillis(int nAsset);
     std::string GetSyncStatus();
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
     bool IsBudgetFinEmpty();
@@ -28,7 +28,6 @@ using namespace std;
 class CMasternode;
 class CMasternodeBroadcast;
 class CMasternodePing;
-extern map<int64_t, uint256> mapCacheBlockHashes;
 
 bool GetBlockHash(uint256& hash, int nBlockHeight);
 
@@ -63,6 +62,7 @@ public:
     bool CheckAndUpdate(int& nDos, bool fRequireEnabled = true, bool fCheckSigTimeOnly = false);
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     bool VerifySignature(CPubKey& pubKeyMasternode, int &nDos);
+    std::string GetStrMessage() const;
     void Relay();
 
     uint256 GetHash()
@@ -192,7 +192,8 @@ public:
         return !(a.vin == b.vin);
     }
 
-    uint256 CalculateScore(int mod = 1, int64_t nBlockHeight = 0);
+    uint256 CalculateScore(int mod = 1, int64_t nBlockHeight = 0) const;
+    uint256 CalculateScore(const uint256& hashBlock, const uint256& hashBlockHashed) const;
 
     ADD_SERIALIZE_METHODS;
 
@@ -219,7 +220,7 @@ public:
         READWRITE(nLastScanningErrorBlockHeight);
     }
 
-    int64_t SecondsSincePayment();
+    int64_t SecondsSincePayment(int nEnabledCount = -1);
 
     bool UpdateFromNewBroadcast(CMasternodeBroadcast& mnb);
 
@@ -232,6 +233,9 @@ public:
 
     void Check(bool forceCheck = false);
 
+    /// Adjusted time at which Check() changes the state without a new message, 0 if never
+    int64_t GetNextStateChange() const;
+
     bool IsBroadcastedWithin(int seconds)
     {
         return (GetAdjustedTime() - sigTime) < seconds;
@@ -250,7 +254,7 @@ public:
         lastPing = CMasternodePing();
     }
 
-    bool IsEnabled()
+    bool IsEnabled() const
     {
         return activeState == MASTERNODE_ENABLED;
     }
@@ -267,9 +271,9 @@ public:
         return cacheInputAge + (chainActive.Tip()->nHeight - cacheInputAgeBlock);
     }
 
-    std::string GetStatus();
+    std::string GetStatus() const;
 
-    std::string Status()
+    std::string Status() const
     {
         std::string strStatus = "ACTIVE";
 
@@ -282,7 +286,7 @@ public:
         return strStatus;
     }
 
-    int64_t GetLastPaid();
+    int64_t GetLastPaid(int nEnabledCount = -1) const;
     bool IsValidNetAddr();
 };
 
@@ -7,6 +7,7 @@
 #include "master/nodeman.h"
 #include "master/activenode.h"
 #include "addrman.h"
+#include "journal.h"
 #include "master/node.h"
 #include "obfuscation.h"
 #include "spork.h"
@@ -14,7 +15,6 @@
 #include <boost/filesystem.hpp>
 #include <boost/lexical_cast.hpp>
 
-#define MN_WINNER_MINIMUM_AGE 8000    // Age in seconds. This should be > MASTERNODE_REMOVAL_SECONDS to avoid misconfigured new nodes in the list.
 
 /** Masternode manager */
 CMasternodeMan mnodeman;
@@ -27,26 +27,30 @@ struct CompareLastPaid {
     }
 };
 
-struct CompareScoreTxIn {
-    bool operator()(const pair<int64_t, CTxIn>& t1,
-        const pair<int64_t, CTxIn>& t2) const
-    {
-        return t1.first < t2.first;
-    }
-};
+int CMasternodeTraits::GetMinPaymentsProto()
+{
+    return masternodePayments.GetMinMasternodePaymentsProto();
+}
 
-struct CompareScoreMN {
-    bool operator()(const pair<int64_t, CMasternode>& t1,
-        const pair<int64_t, CMasternode>& t2) const
-    {
-        return t1.first < t2.first;
-    }
-};
+bool CMasternodeTraits::IsMinAgeEnforced()
+{
+    return IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT);
+}
 
 //
 // CMasternodeDB
 //
 
+// mncache.dat tables
+enum {
+    MNCACHE_STATE,
+    MNCACHE_MASTERNODES,
+    MNCACHE_SEEN_BROADCASTS,
+    MNCACHE_SEEN_PINGS
+};
+
+static CFlatJournal mncacheJournal("mncache.dat", "MasternodeCacheJournal");
+
 CMasternodeDB::CMasternodeDB()
 {
     pathMN = GetDataDir() / "mncache.dat";
@@ -57,28 +61,12 @@ bool CMasternodeDB::Write(const CMasternodeMan& mnodemanToSave)
 {
     int64_t nStart = GetTimeMillis();
 
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssMasternodes(SER_DISK, CLIENT_VERSION);
-    ssMasternodes << strMagicMessage;                   // masternode cache file specific magic message
-    ssMasternodes << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssMasternodes << mnodemanToSave;
-    uint256 hash = Hash(ssMasternodes.begin(), ssMasternodes.end());
-    ssMasternodes << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathMN.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathMN.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssMasternodes;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
-    }
-    //    FileCommit(fileout);
-    fileout.fclose();
+    // only records that changed since the last write are appended
+    if (!mncacheJournal.OpenForWrite())
+        return false;
+    mnodemanToSave.WriteJournal(mncacheJournal);
+    if (!mncacheJournal.Flush())
+        return false;
 
     LogPrint("masternode","Written info to mncache.dat  %dms\n", GetTimeMillis() - nStart);
     LogPrint("masternode","  %s\n", mnodemanToSave.ToString());
@@ -89,6 +77,41 @@ bool CMasternodeDB::Write(const CMasternodeMan& mnodemanToSave)
 CMasternodeDB::ReadResult CMasternodeDB::Read(CMasternodeMan& mnodemanToLoad, bool fDryRun)
 {
     int64_t nStart = GetTimeMillis();
+
+    CFlatJournal::ReadResult journalResult = mncacheJournal.Open();
+    if (journalResult == CFlatJournal::IncorrectMagicMessage) {
+        // files written before the journal format are converted once
+        ReadResult result = ReadLegacy(mnodemanToLoad);
+        if (result != Ok)
+            return result;
+        if (mncacheJournal.Reset()) {
+            mnodemanToLoad.WriteJournal(mncacheJournal);
+            mncacheJournal.Flush();
+        }
+    } else if (journalResult == CFlatJournal::FileError) {
+        return FileError;
+    } else if (journalResult == CFlatJournal::IncorrectMagicNumber) {
+        return IncorrectMagicNumber;
+    } else if (journalResult != CFlatJournal::Ok) {
+        return IncorrectFormat;
+    } else {
+        mnodemanToLoad.ReadJournal(mncacheJournal);
+    }
+
+    LogPrint("masternode","Loaded info from mncache.dat  %dms\n", GetTimeMillis() - nStart);
+    LogPrint("masternode","  %s\n", mnodemanToLoad.ToString());
+    if (!fDryRun) {
+        LogPrint("masternode","Masternode manager - cleaning....\n");
+        mnodemanToLoad.CheckAndRemove(true);
+        LogPrint("masternode","Masternode manager - result:\n");
+        LogPrint("masternode","  %s\n", mnodemanToLoad.ToString());
+    }
+
+    return Ok;
+}
+
+CMasternodeDB::ReadResult CMasternodeDB::ReadLegacy(CMasternodeMan& mnodemanToLoad)
+{
     // open input file, and associate with CAutoFile
     FILE* file = fopen(pathMN.string().c_str(), "rb");
     CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
@@ -155,15 +178,6 @@ CMasternodeDB::ReadResult CMasternodeDB::Read(CMasternodeMan& mnodemanToLoad, bo
         return IncorrectFormat;
     }
 
-    LogPrint("masternode","Loaded info from mncache.dat  %dms\n", GetTimeMillis() - nStart);
-    LogPrint("masternode","  %s\n", mnodemanToLoad.ToString());
-    if (!fDryRun) {
-        LogPrint("masternode","Masternode manager - cleaning....\n");
-        mnodemanToLoad.CheckAndRemove(true);
-        LogPrint("masternode","Masternode manager - result:\n");
-        LogPrint("masternode","  %s\n", mnodemanToLoad.ToString());
-    }
-
     return Ok;
 }
 
@@ -172,29 +186,62 @@ void DumpMasternodes()
     int64_t nStart = GetTimeMillis();
 
     CMasternodeDB mndb;
-    CMasternodeMan tempMnodeman;
-
-    LogPrint("masternode","Verifying mncache.dat format...\n");
-    CMasternodeDB::ReadResult readResult = mndb.Read(tempMnodeman, true);
-    // there was an error and it was not an error on file opening => do not proceed
-    if (readResult == CMasternodeDB::FileError)
-        LogPrint("masternode","Missing masternode cache file - mncache.dat, will try to recreate\n");
-    else if (readResult != CMasternodeDB::Ok) {
-        LogPrint("masternode","Error reading mncache.dat: ");
-        if (readResult == CMasternodeDB::IncorrectFormat)
-            LogPrint("masternode","magic is ok but data has invalid format, will try to recreate\n");
-        else {
-            LogPrint("masternode","file format is unknown or invalid, please fix it manually\n");
-            return;
-        }
-    }
     LogPrint("masternode","Writting info to mncache.dat...\n");
     mndb.Write(mnodeman);
 
     LogPrint("masternode","Masternode dump finished  %dms\n", GetTimeMillis() - nStart);
 }
 
-CMasternodeMan::CMasternodeMan()
+void CMasternodeMan::WriteJournal(CFlatJournal& journal) const
+{
+    LOCK(cs);
+
+    CDataStream ssState(SER_DISK, CLIENT_VERSION);
+    ssState << mAskedUsForMasternodeList << mWeAskedForMasternodeList << mWeAskedForMasternodeListEntry << nDsqCount;
+    journal.WriteRecord(MNCACHE_STATE, 0, ssState);
+
+    std::set<uint256> setKeys;
+    BOOST_FOREACH (const CMasternode& mn, vMasternodes) {
+        uint256 key = SerializeHash(mn.vin.prevout);
+        journal.Write(MNCACHE_MASTERNODES, key, mn);
+        setKeys.insert(key);
+    }
+    journal.EraseMissing(MNCACHE_MASTERNODES, setKeys);
+
+    // seen broadcasts and pings aren't kept across restarts, drop what older versions stored
+    journal.EraseMissing(MNCACHE_SEEN_BROADCASTS, std::set<uint256>());
+    journal.EraseMissing(MNCACHE_SEEN_PINGS, std::set<uint256>());
+}
+
+void CMasternodeMan::ReadJournal(CFlatJournal& journal)
+{
+    LOCK(cs);
+
+    Clear();
+
+    CDataStream ssState(SER_DISK, CLIENT_VERSION);
+    if (journal.ReadRecord(MNCACHE_STATE, 0, ssState)) {
+        try {
+            ssState >> mAskedUsForMasternodeList >> mWeAskedForMasternodeList >> mWeAskedForMasternodeListEntry >> nDsqCount;
+        } catch (std::exception& e) {
+            LogPrint("masternode", "CMasternodeMan::ReadJournal - invalid state record\n");
+        }
+    }
+
+    std::vector<uint256> vKeys;
+    journal.GetKeys(MNCACHE_MASTERNODES, vKeys);
+    BOOST_FOREACH (const uint256& key, vKeys) {
+        CMasternode mn;
+        if (journal.Read(MNCACHE_MASTERNODES, key, mn))
+            vMasternodes.push_back(mn);
+    }
+
+    tier.Rebuild(vMasternodes);
+}
+
+CMasternodeMan::CMasternodeMan() : filterPingMessages(MASTERNODE_PING_FILTER_SIZE, MASTERNODE_PING_FILTER_FP_RATE),
+                                   mapSeenMasternodeBroadcast(MASTERNODE_REMOVAL_SECONDS * 2),
+                                   mapSeenMasternodePing(MASTERNODE_REMOVAL_SECONDS * 2)
 {
     nDsqCount = 0;
 }
@@ -210,6 +257,7 @@ bool CMasternodeMan::Add(CMasternode& mn)
     if (pmn == NULL) {
         LogPrint("masternode", "CMasternodeMan: Adding new Masternode %s - %i now\n", mn.vin.prevout.hash.ToString(), size() + 1);
         vMasternodes.push_back(mn);
+        tier.Added(vMasternodes);
         return true;
     }
 
@@ -235,10 +283,20 @@ void CMasternodeMan::AskForMN(CNode* pnode, CTxIn& vin)
 void CMasternodeMan::Check()
 {
     LOCK(cs);
+    tier.CheckDue(vMasternodes);
+}
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        mn.Check();
-    }
+void CMasternodeMan::CheckMasternode(CMasternode& mn, bool forceCheck)
+{
+    LOCK(cs);
+    mn.Check(forceCheck);
+    tier.Schedule(mn);
+}
+
+void CMasternodeMan::TryCheckDue()
+{
+    TRY_LOCK(cs, lockList);
+    if (lockList) tier.CheckDue(vMasternodes);
 }
 
 void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
@@ -247,19 +305,20 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
 
     LOCK(cs);
 
-    //remove inactive and outdated
+    //remove inactive and outdated, the others move up in the same order and the indexes are rebuilt once
+    vector<CMasternode>::iterator itKept = vMasternodes.begin();
     vector<CMasternode>::iterator it = vMasternodes.begin();
     while (it != vMasternodes.end()) {
         if ((*it).activeState == CMasternode::MASTERNODE_REMOVE ||
             (*it).activeState == CMasternode::MASTERNODE_VIN_SPENT ||
             (forceExpiredRemoval && (*it).activeState == CMasternode::MASTERNODE_EXPIRED) ||
             (*it).protocolVersion < masternodePayments.GetMinMasternodePaymentsProto()) {
-            LogPrint("masternode", "CMasternodeMan: Removing inactive Masternode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
+            LogPrint("masternode", "CMasternodeMan: Removing inactive Masternode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1 - (int)(it - itKept));
 
             //erase all of the broadcasts we've seen from this vin
             // -- if we missed a few pings and the node was removed, this will allow is to get it back without them
             //    sending a brand new mnb
-            map<uint256, CMasternodeBroadcast>::iterator it3 = mapSeenMasternodeBroadcast.begin();
+            CSeenCache<CMasternodeBroadcast>::iterator it3 = mapSeenMasternodeBroadcast.begin();
             while (it3 != mapSeenMasternodeBroadcast.end()) {
                 if ((*it3).second.vin == (*it).vin) {
                     masternodeSync.mapSeenSyncMNB.erase((*it3).first);
@@ -278,11 +337,16 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
                     ++it2;
                 }
             }
-
-            it = vMasternodes.erase(it);
         } else {
-            ++it;
+            if (itKept != it) *itKept = *it;
+            ++itKept;
         }
+        ++it;
+    }
+
+    if (itKept != vMasternodes.end()) {
+        vMasternodes.erase(itKept, vMasternodes.end());
+        tier.Rebuild(vMasternodes);
     }
 
     // check who's asked for the Masternode list
@@ -305,6 +369,24 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
         }
     }
 
+    // drop delta list syncs that were abandoned halfway
+    map<CNetAddr, std::pair<int64_t, CNodeListCursor> >::iterator itDelta = mAskedUsForMasternodeListDelta.begin();
+    while (itDelta != mAskedUsForMasternodeListDelta.end()) {
+        if ((*itDelta).second.first < GetTime()) {
+            mAskedUsForMasternodeListDelta.erase(itDelta++);
+        } else {
+            ++itDelta;
+        }
+    }
+    itDelta = mWeAskedForMasternodeListDelta.begin();
+    while (itDelta != mWeAskedForMasternodeListDelta.end()) {
+        if ((*itDelta).second.first < GetTime()) {
+            mWeAskedForMasternodeListDelta.erase(itDelta++);
+        } else {
+            ++itDelta;
+        }
+    }
+
     // check which Masternodes we've asked for
     map<COutPoint, int64_t>::iterator it2 = mWeAskedForMasternodeListEntry.begin();
     while (it2 != mWeAskedForMasternodeListEntry.end()) {
@@ -315,79 +397,70 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
         }
     }
 
-    // remove expired mapSeenMasternodeBroadcast
-    map<uint256, CMasternodeBroadcast>::iterator it3 = mapSeenMasternodeBroadcast.begin();
-    while (it3 != mapSeenMasternodeBroadcast.end()) {
-        if ((*it3).second.lastPing.sigTime < GetTime() - (MASTERNODE_REMOVAL_SECONDS * 2)) {
-            mapSeenMasternodeBroadcast.erase(it3++);
-            masternodeSync.mapSeenSyncMNB.erase((*it3).second.GetHash());
-        } else {
-            ++it3;
-        }
-    }
+    // forget the broadcasts and pings that haven't been relayed for a while
+    mapSeenMasternodeBroadcast.Expire();
+    mapSeenMasternodePing.Expire();
 
-    // remove expired mapSeenMasternodePing
-    map<uint256, CMasternodePing>::iterator it4 = mapSeenMasternodePing.begin();
-    while (it4 != mapSeenMasternodePing.end()) {
-        if ((*it4).second.sigTime < GetTime() - (MASTERNODE_REMOVAL_SECONDS * 2)) {
-            mapSeenMasternodePing.erase(it4++);
-        } else {
-            ++it4;
-        }
-    }
+    // readers only publish when the list isn't busy, so keep the snapshot from lagging behind
+    if (tier.IsSnapshotStale()) tier.Publish(vMasternodes);
 }
 
 void CMasternodeMan::Clear()
 {
     LOCK(cs);
     vMasternodes.clear();
+    tier.Clear();
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
+    mAskedUsForMasternodeListDelta.clear();
+    mWeAskedForMasternodeListDelta.clear();
     mWeAskedForMasternodeListEntry.clear();
     mapSeenMasternodeBroadcast.clear();
     mapSeenMasternodePing.clear();
     nDsqCount = 0;
+
+    LOCK(cs_filterPingMessages);
+    filterPingMessages.reset();
 }
 
-int CMasternodeMan::stable_size ()
+bool CMasternodeMan::IsPingMessageSeen(const CDataStream& vRecv)
 {
-    int nStable_size = 0;
-    int nMinProtocol = ActiveProtocol();
-    int64_t nMasternode_Min_Age = MN_WINNER_MINIMUM_AGE;
-    int64_t nMasternode_Age = 0;
+    uint256 hash = Hash(vRecv.begin(), vRecv.end());
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        if (mn.protocolVersion < nMinProtocol) {
-            continue; // Skip obsolete versions
-        }
-        if (IsSporkActive (SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
-            nMasternode_Age = GetAdjustedTime() - mn.sigTime;
-            if ((nMasternode_Age) < nMasternode_Min_Age) {
-                continue; // Skip masternodes younger than (default) 8000 sec (MUST be > MASTERNODE_REMOVAL_SECONDS)
-            }
-        }
-        mn.Check ();
-        if (!mn.IsEnabled ())
-            continue; // Skip not-enabled masternodes
+    LOCK(cs_filterPingMessages);
+    if (filterPingMessages.contains(hash)) return true;
+    filterPingMessages.insert(hash);
+    return false;
+}
 
-        nStable_size++;
-    }
+bool CMasternodeMan::IsPingTooEarly(const CMasternodePing& mnp)
+{
+    TRY_LOCK(cs, lockList);
+    if (!lockList) return false;
 
-    return nStable_size;
+    CMasternode* pmn = Find(mnp.vin);
+    return pmn != NULL && pmn->IsPingedWithin(MASTERNODE_MIN_MNP_SECONDS - 60, mnp.sigTime);
 }
 
-int CMasternodeMan::CountEnabled(int protocolVersion)
+void CMasternodeMan::SporkChanged(int nSporkID, int64_t nValue)
 {
-    int i = 0;
-    protocolVersion = protocolVersion == -1 ? masternodePayments.GetMinMasternodePaymentsProto() : protocolVersion;
+    // the rankings skip young masternodes while payments are enforced
+    if (nSporkID != SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT) return;
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        mn.Check();
-        if (mn.protocolVersion < protocolVersion || !mn.IsEnabled()) continue;
-        i++;
-    }
+    LOCK(cs);
+    tier.ClearRankings();
+}
 
-    return i;
+int CMasternodeMan::stable_size ()
+{
+    TryCheckDue();
+    return tier.StableSize(vMasternodes);
+}
+
+int CMasternodeMan::CountEnabled(int protocolVersion)
+{
+    TryCheckDue();
+    return tier.CountEnabled(protocolVersion);
 }
 
 void CMasternodeMan::CountNetworks(int protocolVersion, int& ipv4, int& ipv6, int& onion)
@@ -395,7 +468,6 @@ void CMasternodeMan::CountNetworks(int protocolVersion, int& ipv4, int& ipv6, in
     protocolVersion = protocolVersion == -1 ? masternodePayments.GetMinMasternodePaymentsProto() : protocolVersion;
 
     BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        mn.Check();
         std::string strHost;
         int port;
         SplitHostPort(mn.addr.ToString(), port, strHost);
@@ -431,7 +503,20 @@ void CMasternodeMan::DsegUpdate(CNode* pnode)
         }
     }
 
-    pnode->PushMessage("dseg", CTxIn());
+    if (pnode->nVersion >= MNLIST_DELTA_VERSION) {
+        // only ask for what changed since our newest ping, leaving some slack for
+        // pings that were still on their way when we went down
+        int64_t nSince = 0;
+        BOOST_FOREACH (CMasternode& mn, vMasternodes)
+            nSince = std::max(nSince, mn.lastPing.sigTime);
+        nSince = std::max((int64_t)0, std::min(nSince, GetAdjustedTime()) - MASTERNODE_PING_SECONDS);
+
+        CNodeListCursor cursor(nSince, tier.GetListHash(vMasternodes));
+        pnode->PushMessage("dsegd", cursor);
+        mWeAskedForMasternodeListDelta[pnode->addr] = std::make_pair(GetTime() + MASTERNODES_DELTA_PAGE_SECONDS, cursor);
+    } else {
+        pnode->PushMessage("dseg", CTxIn());
+    }
     int64_t askAgain = GetTime() + MASTERNODES_DSEG_SECONDS;
     mWeAskedForMasternodeList[pnode->addr] = askAgain;
 }
@@ -439,37 +524,26 @@ void CMasternodeMan::DsegUpdate(CNode* pnode)
 CMasternode* CMasternodeMan::Find(const CScript& payee)
 {
     LOCK(cs);
-    CScript payee2;
-
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        payee2 = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
-        if (payee2 == payee)
-            return &mn;
-    }
-    return NULL;
+    return tier.Find(vMasternodes, payee);
 }
 
 CMasternode* CMasternodeMan::Find(const CTxIn& vin)
 {
     LOCK(cs);
-
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        if (mn.vin.prevout == vin.prevout)
-            return &mn;
-    }
-    return NULL;
+    return tier.Find(vMasternodes, vin.prevout);
 }
 
 
 CMasternode* CMasternodeMan::Find(const CPubKey& pubKeyMasternode)
 {
     LOCK(cs);
+    return tier.Find(vMasternodes, pubKeyMasternode);
+}
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        if (mn.pubKeyMasternode == pubKeyMasternode)
-            return &mn;
-    }
-    return NULL;
+void CMasternodeMan::ReindexMasternode(const CMasternode& mn)
+{
+    LOCK(cs);
+    tier.Updated(vMasternodes, mn);
 }
 
 //
@@ -488,7 +562,6 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight
 
     int nMnCount = CountEnabled();
     BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        mn.Check();
         if (!mn.IsEnabled()) continue;
 
         // //check protocol version
@@ -503,7 +576,7 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight
         //make sure it has as many confirmations as there are masternodes
         if (mn.GetMasternodeInputAge() < nMnCount) continue;
 
-        vecMasternodeLastPaid.push_back(make_pair(mn.SecondsSincePayment(), mn.vin));
+        vecMasternodeLastPaid.push_back(make_pair(mn.SecondsSincePayment(nMnCount), mn.vin));
     }
 
     nCount = (int)vecMasternodeLastPaid.size();
@@ -518,7 +591,7 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight
     //  -- This doesn't look at who is being paid in the +8-10 blocks, allowing for double payments very rarely
     //  -- 1/100 payments should be a double payment on mainnet - (1/(3000/10))*2
     //  -- (chance per block * chances before IsScheduled will fire)
-    int nTenthNetwork = CountEnabled() / 10;
+    int nTenthNetwork = nMnCount / 10;
     int nCountTenth = 0;
     uint256 nHigh = 0;
     BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMasternodeLastPaid) {
@@ -570,141 +643,34 @@ CMasternode* CMasternodeMan::FindRandomNotInVec(std::vector<CTxIn>& vecToExclude
 
 CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight, int minProtocol)
 {
-    int64_t score = 0;
-    CMasternode* winner = NULL;
-
-    // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        mn.Check();
-        if (mn.protocolVersion < minProtocol || !mn.IsEnabled()) continue;
-
-        // calculate the score for each Masternode
-        uint256 n = mn.CalculateScore(mod, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        // determine the winner
-        if (n2 > score) {
-            score = n2;
-            winner = &mn;
-        }
-    }
-
-    return winner;
+    LOCK(cs);
+    return tier.GetCurrent(vMasternodes, nBlockHeight, minProtocol);
 }
 
 int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
-    int64_t nMasternode_Min_Age = MN_WINNER_MINIMUM_AGE;
-    int64_t nMasternode_Age = 0;
-
-    //make sure we know about this block
-    uint256 hash = 0;
-    if (!GetBlockHash(hash, nBlockHeight)) return -1;
-
-    // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        if (mn.protocolVersion < minProtocol) {
-            LogPrint("masternode","Skipping Masternode with obsolete version %d\n", mn.protocolVersion);
-            continue;                                                       // Skip obsolete versions
-        }
-
-        if (IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
-            nMasternode_Age = GetAdjustedTime() - mn.sigTime;
-            if ((nMasternode_Age) < nMasternode_Min_Age) {
-                if (fDebug) LogPrint("masternode","Skipping just activated Masternode. Age: %ld\n", nMasternode_Age);
-                continue;                                                   // Skip masternodes younger than (default) 1 hour
-            }
-        }
-        if (fOnlyActive) {
-            mn.Check();
-            if (!mn.IsEnabled()) continue;
-        }
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(make_pair(n2, mn.vin));
-    }
-
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
-
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMasternodeScores) {
-        rank++;
-        if (s.second.prevout == vin.prevout) {
-            return rank;
-        }
-    }
-
-    return -1;
+    LOCK(cs);
+    return tier.GetRank(vMasternodes, vin, nBlockHeight, minProtocol, fOnlyActive);
 }
 
-std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t nBlockHeight, int minProtocol)
+CMasternodeSnapshotRef CMasternodeMan::GetSnapshot()
 {
-    std::vector<pair<int64_t, CMasternode> > vecMasternodeScores;
-    std::vector<pair<int, CMasternode> > vecMasternodeRanks;
-
-    //make sure we know about this block
-    uint256 hash = 0;
-    if (!GetBlockHash(hash, nBlockHeight)) return vecMasternodeRanks;
-
-    // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        mn.Check();
-
-        if (mn.protocolVersion < minProtocol) continue;
-
-        if (!mn.IsEnabled()) {
-            vecMasternodeScores.push_back(make_pair(9999, mn));
-            continue;
+    {
+        // while the list is busy readers get the previous snapshot, until there is one they wait
+        CCriticalBlock lockList(cs, "cs", __FILE__, __LINE__, tier.IsPublished());
+        if (lockList && tier.IsSnapshotStale()) {
+            Check();
+            tier.Publish(vMasternodes);
         }
-
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(make_pair(n2, mn));
-    }
-
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreMN());
-
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CMasternode) & s, vecMasternodeScores) {
-        rank++;
-        vecMasternodeRanks.push_back(make_pair(rank, s.second));
     }
 
-    return vecMasternodeRanks;
+    return tier.GetSnapshot();
 }
 
 CMasternode* CMasternodeMan::GetMasternodeByRank(int nRank, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
-
-    // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        if (mn.protocolVersion < minProtocol) continue;
-        if (fOnlyActive) {
-            mn.Check();
-            if (!mn.IsEnabled()) continue;
-        }
-
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(make_pair(n2, mn.vin));
-    }
-
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
-
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMasternodeScores) {
-        rank++;
-        if (rank == nRank) {
-            return Find(s.second);
-        }
-    }
-
-    return NULL;
+    LOCK(cs);
+    return tier.GetByRank(vMasternodes, nRank, nBlockHeight, minProtocol, fOnlyActive);
 }
 
 void CMasternodeMan::ProcessMasternodeConnections()
@@ -849,6 +815,115 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
             pfrom->PushMessage("ssc", MASTERNODE_SYNC_LIST, nInvCount);
             LogPrint("masternode", "dseg - Sent %d Masternode entries to peer %i\n", nInvCount, pfrom->GetId());
         }
+    } else if (strCommand == "dsegd") { //Get the Masternode list entries changed since a given time, one page at a time
+
+        CNodeListCursor cursor;
+        vRecv >> cursor;
+
+        LOCK(cs);
+
+        if (cursor.IsFirstPage()) {
+            //local network
+            bool isLocal = (pfrom->addr.IsRFC1918() || pfrom->addr.IsLocal());
+
+            if (!isLocal && Params().NetworkID() == CBaseChainParams::MAIN) {
+                std::map<CNetAddr, int64_t>::iterator i = mAskedUsForMasternodeList.find(pfrom->addr);
+                if (i != mAskedUsForMasternodeList.end()) {
+                    int64_t t = (*i).second;
+                    if (GetTime() < t) {
+                        LogPrintf("CMasternodeMan::ProcessMessage() : dsegd - peer already asked me for the list\n");
+                        Misbehaving(pfrom->GetId(), 34);
+                        return;
+                    }
+                }
+                int64_t askAgain = GetTime() + MASTERNODES_DSEG_SECONDS;
+                mAskedUsForMasternodeList[pfrom->addr] = askAgain;
+            }
+        } else {
+            // further pages have to continue where the last one we sent ended
+            std::map<CNetAddr, std::pair<int64_t, CNodeListCursor> >::iterator i = mAskedUsForMasternodeListDelta.find(pfrom->addr);
+            if (i == mAskedUsForMasternodeListDelta.end() || (*i).second.first < GetTime() || !((*i).second.second == cursor)) {
+                LogPrint("masternode", "dsegd - unexpected page request from peer %i\n", pfrom->GetId());
+                return;
+            }
+        }
+
+        // the peer has all of our broadcasts already, it only misses pings
+        bool fSameList = cursor.hashList == tier.GetListHash(vMasternodes);
+
+        std::vector<CMasternode*> vPage;
+        bool fMore = tier.GetChangedPage(vMasternodes, cursor, MASTERNODES_DELTA_PAGE_SIZE, vPage);
+
+        int nInvCount = 0;
+
+        BOOST_FOREACH (CMasternode* pmn, vPage) {
+            if (!fSameList && pmn->sigTime > cursor.nSince) {
+                // the broadcast carries the last ping too
+                CMasternodeBroadcast mnb = CMasternodeBroadcast(*pmn);
+                uint256 hash = mnb.GetHash();
+                pfrom->PushInventory(CInv(MSG_MASTERNODE_ANNOUNCE, hash));
+                nInvCount++;
+
+                if (!mapSeenMasternodeBroadcast.count(hash)) mapSeenMasternodeBroadcast.insert(make_pair(hash, mnb));
+                continue;
+            }
+
+            if (pmn->lastPing.sigTime > cursor.nSince) {
+                uint256 hash = pmn->lastPing.GetHash();
+                pfrom->PushInventory(CInv(MSG_MASTERNODE_PING, hash));
+                nInvCount++;
+
+                if (!mapSeenMasternodePing.count(hash)) mapSeenMasternodePing.insert(make_pair(hash, pmn->lastPing));
+            }
+        }
+
+        CNodeListCursor cursorNext = cursor;
+        if (!vPage.empty()) {
+            cursorNext.nTime = tier.GetLastChange(*vPage.back());
+            cursorNext.prevout = vPage.back()->vin.prevout;
+        }
+
+        if (fMore)
+            mAskedUsForMasternodeListDelta[pfrom->addr] = std::make_pair(GetTime() + MASTERNODES_DELTA_PAGE_SECONDS, cursorNext);
+        else
+            mAskedUsForMasternodeListDelta.erase(pfrom->addr);
+
+        pfrom->PushMessage("dsegp", cursorNext, nInvCount, fMore);
+        LogPrint("masternode", "dsegd - Sent %d Masternode entries changed since %d to peer %i%s\n", nInvCount, cursor.nSince, pfrom->GetId(), fMore ? ", more to follow" : "");
+    } else if (strCommand == "dsegp") { //Page of a delta Masternode list sync we asked for
+
+        CNodeListCursor cursor;
+        int nCount;
+        bool fMore;
+        vRecv >> cursor >> nCount >> fMore;
+
+        {
+            LOCK(cs);
+
+            std::map<CNetAddr, std::pair<int64_t, CNodeListCursor> >::iterator i = mWeAskedForMasternodeListDelta.find(pfrom->addr);
+            if (i == mWeAskedForMasternodeListDelta.end()) return;
+
+            // a page for a different request, or one that doesn't move forward
+            const CNodeListCursor& cursorSent = (*i).second.second;
+            if (cursor.nSince != cursorSent.nSince || cursor.hashList != cursorSent.hashList ||
+                (fMore && !cursorSent.IsBefore(cursor.nTime, cursor.prevout))) {
+                LogPrintf("CMasternodeMan::ProcessMessage() : dsegp - peer %i sent an invalid page\n", pfrom->GetId());
+                mWeAskedForMasternodeListDelta.erase(i);
+                Misbehaving(pfrom->GetId(), 20);
+                return;
+            }
+
+            if (fMore) {
+                pfrom->PushMessage("dsegd", cursor);
+                (*i).second = std::make_pair(GetTime() + MASTERNODES_DELTA_PAGE_SECONDS, cursor);
+            } else {
+                mWeAskedForMasternodeListDelta.erase(i);
+            }
+            LogPrint("masternode", "dsegp - got %d Masternode entries from peer %i%s\n", nCount, pfrom->GetId(), fMore ? ", asking for more" : "");
+        }
+
+        // the sync takes its own lock, which is held while it calls into us
+        masternodeSync.AddedMasternodeListPage(nCount, !fMore);
     }
     /*
      * IT'S SAFE TO REMOVE THIS IN FURTHER VERSIONS
@@ -943,6 +1018,7 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
                     LogPrint("masternode", "dsee - Got updated entry for %s\n", vin.prevout.hash.ToString());
                     if (pmn->protocolVersion < GETHEADERS_VERSION) {
                         pmn->pubKeyMasternode = pubkey2;
+                        ReindexMasternode(*pmn);
                         pmn->sigTime = sigTime;
                         pmn->sig = vchSig;
                         pmn->protocolVersion = protocolVersion;
@@ -951,7 +1027,7 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
                         pmn->lastPing = CMasternodePing(vin);
                     }
                     pmn->nLastDsee = sigTime;
-                    pmn->Check();
+                    CheckMasternode(*pmn);
                     if (pmn->IsEnabled()) {
                         TRY_LOCK(cs_vNodes, lockNodes);
                         if (!lockNodes) return;
@@ -985,42 +1061,37 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         // make sure it's still unspent
         //  - this is checked later by .check() in many places and by ThreadCheckObfuScationPool()
 
-        CValidationState state;
-        CMutableTransaction tx = CMutableTransaction();
-        CTxOut vout = CTxOut((MASTERNODE_COLLATERAL_AMOUNT(chainActive.Height()) - 0.01) * COIN, obfuScationPool.collateralPubKey);
-        tx.vin.push_back(vin);
-        tx.vout.push_back(vout);
-
+        int nDoS = 0;
         bool fAcceptable = false;
         {
             TRY_LOCK(cs_main, lockMain);
             if (!lockMain) return;
-            fAcceptable = AcceptableInputs(mempool, state, CTransaction(tx), false, NULL);
-        }
 
-        if (fAcceptable) {
-            if (GetInputAge(vin) < MASTERNODE_MIN_CONFIRMATIONS) {
+            CTxOut txout;
+            int nHeight, nConfirmations;
+            if (!GetUTXOCoin(vin.prevout, txout, nHeight, nConfirmations)) {
+                LogPrint("masternode", "dsee - Collateral %s is spent or unknown\n", vin.prevout.ToString());
+            } else if (txout.nValue < (MASTERNODE_COLLATERAL_AMOUNT(chainActive.Height()) - 0.01) * COIN) {
+                LogPrint("masternode", "dsee - Collateral %s is too small\n", vin.prevout.ToString());
+                nDoS = 100;
+            } else if (nConfirmations < MASTERNODE_MIN_CONFIRMATIONS) {
                 LogPrintf("CMasternodeMan::ProcessMessage() : dsee - Input must have least %d confirmations\n", MASTERNODE_MIN_CONFIRMATIONS);
                 Misbehaving(pfrom->GetId(), 20);
                 return;
-            }
-
-            // verify that sig time is legit in past
-            // should be at least not earlier than block when 1000 PIVX tx got MASTERNODE_MIN_CONFIRMATIONS
-            uint256 hashBlock = 0;
-            CTransaction tx2;
-            GetTransaction(vin.prevout.hash, tx2, hashBlock, true);
-            BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
-            if (mi != mapBlockIndex.end() && (*mi).second) {
-                CBlockIndex* pMNIndex = (*mi).second;                                                        // block for 10000 PIV tx -> 1 confirmation
-                CBlockIndex* pConfIndex = chainActive[pMNIndex->nHeight + MASTERNODE_MIN_CONFIRMATIONS - 1]; // block where tx got MASTERNODE_MIN_CONFIRMATIONS
+            } else {
+                // verify that sig time is legit in past
+                // should be at least not earlier than block when the collateral tx got MASTERNODE_MIN_CONFIRMATIONS
+                CBlockIndex* pConfIndex = chainActive[nHeight + MASTERNODE_MIN_CONFIRMATIONS - 1]; // block where tx got MASTERNODE_MIN_CONFIRMATIONS
                 if (pConfIndex->GetBlockTime() > sigTime) {
                     LogPrint("masternode","mnb - Bad sigTime %d for Masternode %s (%i conf block is at %d)\n",
                         sigTime, vin.prevout.hash.ToString(), MASTERNODE_MIN_CONFIRMATIONS, pConfIndex->GetBlockTime());
                     return;
                 }
+                fAcceptable = true;
             }
+        }
 
+        if (fAcceptable) {
             // use this as a peer
             addrman.Add(CAddress(addr), pfrom->addr, 2 * 60 * 60);
 
@@ -1051,13 +1122,8 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         } else {
             LogPrint("masternode","dsee - Rejected Masternode entry %s\n", vin.prevout.hash.ToString());
 
-            int nDoS = 0;
-            if (state.IsInvalid(nDoS)) {
-                LogPrint("masternode","dsee - %s from %i %s was not accepted into the memory pool\n", tx.GetHash().ToString().c_str(),
-                    pfrom->GetId(), pfrom->cleanSubVer.c_str());
-                if (nDoS > 0)
-                    Misbehaving(pfrom->GetId(), nDoS);
-            }
+            if (nDoS > 0)
+                Misbehaving(pfrom->GetId(), nDoS);
         }
     }
 
@@ -1109,7 +1175,7 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
                 // fake ping for v11 masternodes, ignore for v12
                 if (pmn->protocolVersion < GETHEADERS_VERSION) pmn->lastPing = CMasternodePing(vin);
                 pmn->nLastDseep = sigTime;
-                pmn->Check();
+                CheckMasternode(*pmn);
                 if (pmn->IsEnabled()) {
                     TRY_LOCK(cs_vNodes, lockNodes);
                     if (!lockNodes) return;
@@ -1140,7 +1206,7 @@ void CMasternodeMan::Remove(CTxIn vin)
     while (it != vMasternodes.end()) {
         if ((*it).vin == vin) {
             LogPrint("masternode", "CMasternodeMan: Removing Masternode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
-            vMasternodes.erase(it);
+            tier.Erase(vMasternodes, it - vMasternodes.begin());
             break;
         }
         ++it;
@@ -1160,7 +1226,8 @@ void CMasternodeMan::UpdateMasternodeList(CMasternodeBroadcast mnb)
         CMasternode mn(mnb);
         Add(mn);
     } else {
-    	pmn->UpdateFromNewBroadcast(mnb);
+    	if (pmn->UpdateFromNewBroadcast(mnb))
+    	    ReindexMasternode(*pmn);
     }
 }
 
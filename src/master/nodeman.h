@@ -8,24 +8,35 @@
 #define MASTERNODEMAN_H
 
 #include "base58.h"
+#include "bloom.h"
 #include "key.h"
 #include "main.h"
 #include "master/node.h"
 #include "net.h"
+#include "nodetier.h"
+#include "seencache.h"
 #include "sync.h"
 #include "util.h"
 
 #define MASTERNODES_DUMP_SECONDS (15 * 60)
 #define MASTERNODES_DSEG_SECONDS (3 * 60 * 60)
+#define MASTERNODES_RANKING_CACHE_SIZE 64
+#define MASTERNODES_SNAPSHOT_SECONDS 5
+#define MASTERNODES_DELTA_PAGE_SIZE 500
+#define MASTERNODES_DELTA_PAGE_SECONDS 60
+#define MASTERNODE_PING_FILTER_SIZE 50000 // raw ping messages remembered to drop relayed copies unread
+#define MASTERNODE_PING_FILTER_FP_RATE 0.000001
+#define MN_WINNER_MINIMUM_AGE 8000    // Age in seconds. This should be > MASTERNODE_REMOVAL_SECONDS to avoid misconfigured new nodes in the list.
 
 using namespace std;
 
 class CMasternodeMan;
+class CFlatJournal;
 
 extern CMasternodeMan mnodeman;
 void DumpMasternodes();
 
-/** Access to the MN database (mncache.dat)
+/** Access to the MN database (mncache.dat), kept as a CFlatJournal
  */
 class CMasternodeDB
 {
@@ -47,8 +58,32 @@ public:
     CMasternodeDB();
     bool Write(const CMasternodeMan& mnodemanToSave);
     ReadResult Read(CMasternodeMan& mnodemanToLoad, bool fDryRun = false);
+
+private:
+    /// Files written before the journal format, serialized as a whole
+    ReadResult ReadLegacy(CMasternodeMan& mnodemanToLoad);
+};
+
+/** Masternode parameters of the shared node tier engine, see CNodeTier */
+struct CMasternodeTraits {
+    typedef CMasternode Node;
+
+    static const CTxIn& GetVin(const CMasternode& mn) { return mn.vin; }
+    static const CPubKey& GetPubKey(const CMasternode& mn) { return mn.pubKeyMasternode; }
+    static uint256 GetBroadcastHash(const CMasternode& mn) { return CMasternodeBroadcast(mn).GetHash(); }
+    static bool GetBlockHash(uint256& hash, int nBlockHeight) { return ::GetBlockHash(hash, nBlockHeight); }
+    static int GetMinPaymentsProto();
+    static bool IsMinAgeEnforced();
+    static const char* LogCategory() { return "masternode"; }
+
+    static const int64_t nMinWinnerAge = MN_WINNER_MINIMUM_AGE;
+    static const int nCheckSeconds = MASTERNODE_CHECK_SECONDS;
+    static const size_t nRankingCacheSize = MASTERNODES_RANKING_CACHE_SIZE;
+    static const int nSnapshotSeconds = MASTERNODES_SNAPSHOT_SECONDS;
 };
 
+typedef CNodeTier<CMasternodeTraits>::SnapshotRef CMasternodeSnapshotRef;
+
 class CMasternodeMan
 {
 private:
@@ -66,12 +101,24 @@ private:
     std::map<CNetAddr, int64_t> mWeAskedForMasternodeList;
     // which Masternodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForMasternodeListEntry;
+    // delta list syncs in progress: cursor of the next page and when it expires
+    std::map<CNetAddr, std::pair<int64_t, CNodeListCursor> > mAskedUsForMasternodeListDelta;
+    std::map<CNetAddr, std::pair<int64_t, CNodeListCursor> > mWeAskedForMasternodeListDelta;
+    // lookups and rankings over vMasternodes
+    CNodeTier<CMasternodeTraits> tier;
+
+    /// Check the entries that are due, unless another thread is working on the list
+    void TryCheckDue();
+
+    // raw ping messages seen lately, the same ping is relayed by most of our peers
+    CRollingBloomFilter filterPingMessages;
+    CCriticalSection cs_filterPingMessages;
 
 public:
     // Keep track of all broadcasts I've seen
-    map<uint256, CMasternodeBroadcast> mapSeenMasternodeBroadcast;
+    CSeenCache<CMasternodeBroadcast> mapSeenMasternodeBroadcast;
     // Keep track of all pings I've seen
-    map<uint256, CMasternodePing> mapSeenMasternodePing;
+    CSeenCache<CMasternodePing> mapSeenMasternodePing;
 
     // keep track of dsq count to prevent masternodes from gaming obfuscation queue
     int64_t nDsqCount;
@@ -90,6 +137,9 @@ public:
 
         READWRITE(mapSeenMasternodeBroadcast);
         READWRITE(mapSeenMasternodePing);
+
+        if (ser_action.ForRead())
+            tier.Rebuild(vMasternodes);
     }
 
     CMasternodeMan();
@@ -101,15 +151,21 @@ public:
     /// Ask (source) node for mnb
     void AskForMN(CNode* pnode, CTxIn& vin);
 
-    /// Check all Masternodes
+    /// Check the Masternodes whose state is due to change
     void Check();
 
+    /// Check an entry after a message changed it and reschedule it
+    void CheckMasternode(CMasternode& mn, bool forceCheck = false);
+
     /// Check all Masternodes and remove inactive
     void CheckAndRemove(bool forceExpiredRemoval = false);
 
     /// Clear Masternode vector
     void Clear();
 
+    /// Drop what was decided with the old value of a spork, called by sporkManager
+    void SporkChanged(int nSporkID, int64_t nValue);
+
     int CountEnabled(int protocolVersion = -1);
 
     void CountNetworks(int protocolVersion, int& ipv4, int& ipv6, int& onion);
@@ -130,13 +186,9 @@ public:
     /// Get the current winner for this block
     CMasternode* GetCurrentMasterNode(int mod = 1, int64_t nBlockHeight = 0, int minProtocol = 0);
 
-    std::vector<CMasternode> GetFullMasternodeVector()
-    {
-        Check();
-        return vMasternodes;
-    }
+    /// Shared read-only copy of the list, doesn't wait for the list lock
+    CMasternodeSnapshotRef GetSnapshot();
 
-    std::vector<pair<int, CMasternode> > GetMasternodeRanks(int64_t nBlockHeight, int minProtocol = 0);
     int GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol = 0, bool fOnlyActive = true);
     CMasternode* GetMasternodeByRank(int nRank, int64_t nBlockHeight, int minProtocol = 0, bool fOnlyActive = true);
 
@@ -144,6 +196,13 @@ public:
 
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 
+    /// True if the ping message was seen lately, remembers it otherwise. Looks at the raw bytes only,
+    /// callers check that ProcessMessage would look at the ping first
+    bool IsPingMessageSeen(const CDataStream& vRecv);
+
+    /// True if the entry was pinged too recently for this ping to be accepted, so its signature needn't be checked
+    bool IsPingTooEarly(const CMasternodePing& mnp);
+
     /// Return the number of (unique) Masternodes
     int size() { return vMasternodes.size(); }
 
@@ -152,12 +211,20 @@ public:
 
     std::string ToString() const;
 
+    /// Append what changed since the last call to the cache journal
+    void WriteJournal(CFlatJournal& journal) const;
+    /// Replace the contents with the entries of the cache journal
+    void ReadJournal(CFlatJournal& journal);
+
     void Remove(CTxIn vin);
 
     int GetEstimatedMasternodes(int nBlock);
 
     /// Update masternode list and maps using provided CMasternodeBroadcast
     void UpdateMasternodeList(CMasternodeBroadcast mnb);
+
+    /// Re-index an entry whose payee or masternode pubkey may have changed
+    void ReindexMasternode(const CMasternode& mn);
 };
 
 #endif
@@ -37,7 +37,7 @@ void CActiveMaxnode::ManageStatus()
         CMaxnode* pmax;
         pmax = maxnodeman.Find(pubKeyMaxnode);
         if (pmax != NULL) {
-            pmax->Check();
+            maxnodeman.CheckMaxnode(*pmax);
             if (pmax->IsEnabled() && pmax->protocolVersion == PROTOCOL_VERSION) EnableHotColdMaxNode(pmax->maxvin, pmax->addr);
         }
     }
@@ -8,6 +8,7 @@
 #include "main.h"
 
 #include "addrman.h"
+#include "journal.h"
 #include "max/node-budget.h"
 #include "max/node-sync.h"
 #include "max/node.h"
@@ -117,33 +118,143 @@ bool IsMaxBudgetCollateralValid(uint256 nTxCollateralHash, uint256 nExpectedHash
     }
 }
 
-void CMAXBudgetManager::CheckOrphanVotes()
+// Orphan votes are keyed by their own hash and indexed by the hash they wait for and by
+// the maxnode that cast them, holding only the latest vote of a maxnode for each
+// proposal or budget
+typedef std::map<COutPoint, std::set<std::pair<int64_t, uint256> > > OrphanVotesByNode;
+
+template <typename T>
+static void EraseOrphanVote(std::map<uint256, T>& mapOrphans, std::map<uint256, std::set<uint256> >& mapByParent,
+    OrphanVotesByNode& mapByNode, uint256 T::*pParentHash, typename std::map<uint256, T>::iterator mi)
+{
+    const T& vote = (*mi).second;
+    std::map<uint256, std::set<uint256> >::iterator pi = mapByParent.find(vote.*pParentHash);
+    if (pi != mapByParent.end()) {
+        (*pi).second.erase((*mi).first);
+        if ((*pi).second.empty()) mapByParent.erase(pi);
+    }
+    OrphanVotesByNode::iterator ni = mapByNode.find(vote.vin.prevout);
+    if (ni != mapByNode.end()) {
+        (*ni).second.erase(std::make_pair(vote.nTime, (*mi).first));
+        if ((*ni).second.empty()) mapByNode.erase(ni);
+    }
+    mapOrphans.erase(mi);
+}
+
+template <typename T>
+static bool KeepOrphanVote(std::map<uint256, T>& mapOrphans, std::map<uint256, std::set<uint256> >& mapByParent,
+    OrphanVotesByNode& mapByNode, uint256 T::*pParentHash, T& vote, int nMaxPerNode)
+{
+    // votes from the future aren't accepted for known proposals either, they would never make room
+    if (vote.nTime > GetTime() + (60 * 60)) return false;
+
+    // replaces an older vote of the maxnode for the same proposal or budget
+    typename std::map<uint256, T>::iterator miReplaced = mapOrphans.end();
+    std::map<uint256, std::set<uint256> >::iterator pi = mapByParent.find(vote.*pParentHash);
+    if (pi != mapByParent.end()) {
+        BOOST_FOREACH (const uint256& nHash, (*pi).second) {
+            typename std::map<uint256, T>::iterator mi = mapOrphans.find(nHash);
+            if (mi == mapOrphans.end() || (*mi).second.vin != vote.vin) continue;
+            if ((*mi).second.nTime >= vote.nTime) return false;
+            miReplaced = mi;
+            break;
+        }
+    }
+    if (miReplaced != mapOrphans.end()) EraseOrphanVote(mapOrphans, mapByParent, mapByNode, pParentHash, miReplaced);
+
+    // at the limit the oldest orphan vote of the maxnode makes room
+    OrphanVotesByNode::iterator ni = mapByNode.find(vote.vin.prevout);
+    if (ni != mapByNode.end() && (int)(*ni).second.size() >= nMaxPerNode) {
+        if ((*(*ni).second.begin()).first >= vote.nTime) return false;
+        EraseOrphanVote(mapOrphans, mapByParent, mapByNode, pParentHash, mapOrphans.find((*(*ni).second.begin()).second));
+    }
+
+    uint256 nHash = vote.GetHash();
+    mapOrphans[nHash] = vote;
+    mapByParent[vote.*pParentHash].insert(nHash);
+    mapByNode[vote.vin.prevout].insert(std::make_pair(vote.nTime, nHash));
+    return true;
+}
+
+template <typename T>
+static void TakeOrphanVotes(std::map<uint256, T>& mapOrphans, std::map<uint256, std::set<uint256> >& mapByParent,
+    OrphanVotesByNode& mapByNode, uint256 T::*pParentHash, const uint256& nParentHash, std::vector<T>& vVotes)
+{
+    std::map<uint256, std::set<uint256> >::iterator it = mapByParent.find(nParentHash);
+    if (it == mapByParent.end()) return;
+
+    std::set<uint256> setHashes;
+    setHashes.swap((*it).second);
+    mapByParent.erase(it);
+    BOOST_FOREACH (const uint256& nHash, setHashes) {
+        typename std::map<uint256, T>::iterator mi = mapOrphans.find(nHash);
+        if (mi == mapOrphans.end()) continue;
+
+        vVotes.push_back((*mi).second);
+        EraseOrphanVote(mapOrphans, mapByParent, mapByNode, pParentHash, mi);
+    }
+}
+
+template <typename T>
+static void IndexOrphanVotes(const std::map<uint256, T>& mapOrphans, std::map<uint256, std::set<uint256> >& mapByParent,
+    OrphanVotesByNode& mapByNode, uint256 T::*pParentHash)
+{
+    for (typename std::map<uint256, T>::const_iterator it = mapOrphans.begin(); it != mapOrphans.end(); ++it) {
+        mapByParent[(*it).second.*pParentHash].insert((*it).first);
+        mapByNode[(*it).second.vin.prevout].insert(std::make_pair((*it).second.nTime, (*it).first));
+    }
+}
+
+bool CMAXBudgetManager::AddOrphanVote(CMAXBudgetVote& vote)
 {
     LOCK(cs);
+    return KeepOrphanVote(mapOrphanMaxnodeBudgetVotes, mapOrphanBudgetVotesByProposal, mapOrphanBudgetVotesByMaxnode,
+        &CMAXBudgetVote::nProposalHash, vote, MAX_ORPHAN_BUDGET_VOTES_PER_MAXNODE);
+}
 
+bool CMAXBudgetManager::AddOrphanVote(CMAXFinalizedBudgetVote& vote)
+{
+    LOCK(cs);
+    return KeepOrphanVote(mapOrphanFinalizedBudgetVotes, mapOrphanFinalizedBudgetVotesByBudget, mapOrphanFinalizedBudgetVotesByMaxnode,
+        &CMAXFinalizedBudgetVote::nBudgetHash, vote, MAX_ORPHAN_BUDGET_VOTES_PER_MAXNODE);
+}
+
+void CMAXBudgetManager::CheckOrphanVotes(const uint256& nHash)
+{
+    LOCK(cs);
 
     std::string strError = "";
-    std::map<uint256, CMAXBudgetVote>::iterator it1 = mapOrphanMaxnodeBudgetVotes.begin();
-    while (it1 != mapOrphanMaxnodeBudgetVotes.end()) {
-        if (maxbudget.UpdateProposal(((*it1).second), NULL, strError)) {
-            LogPrint("maxbudget","CMAXBudgetManager::CheckOrphanVotes - Proposal/Budget is known, activating and removing orphan vote\n");
-            mapOrphanMaxnodeBudgetVotes.erase(it1++);
-        } else {
-            ++it1;
+    if (mapProposals.count(nHash)) {
+        std::vector<CMAXBudgetVote> vVotes;
+        TakeOrphanVotes(mapOrphanMaxnodeBudgetVotes, mapOrphanBudgetVotesByProposal, mapOrphanBudgetVotesByMaxnode, &CMAXBudgetVote::nProposalHash, nHash, vVotes);
+        BOOST_FOREACH (CMAXBudgetVote& vote, vVotes) {
+            if (UpdateProposal(vote, NULL, strError))
+                LogPrint("maxbudget","CMAXBudgetManager::CheckOrphanVotes - Proposal/Budget is known, activating orphan vote\n");
         }
     }
-    std::map<uint256, CMAXFinalizedBudgetVote>::iterator it2 = mapOrphanFinalizedBudgetVotes.begin();
-    while (it2 != mapOrphanFinalizedBudgetVotes.end()) {
-        if (maxbudget.UpdateFinalizedBudget(((*it2).second), NULL, strError)) {
-            LogPrint("maxbudget","CMAXBudgetManager::CheckOrphanVotes - Proposal/Budget is known, activating and removing orphan vote\n");
-            mapOrphanFinalizedBudgetVotes.erase(it2++);
-        } else {
-            ++it2;
+    if (mapFinalizedBudgets.count(nHash)) {
+        std::vector<CMAXFinalizedBudgetVote> vVotes;
+        TakeOrphanVotes(mapOrphanFinalizedBudgetVotes, mapOrphanFinalizedBudgetVotesByBudget, mapOrphanFinalizedBudgetVotesByMaxnode, &CMAXFinalizedBudgetVote::nBudgetHash, nHash, vVotes);
+        BOOST_FOREACH (CMAXFinalizedBudgetVote& vote, vVotes) {
+            if (UpdateFinalizedBudget(vote, NULL, strError))
+                LogPrint("maxbudget","CMAXBudgetManager::CheckOrphanVotes - Proposal/Budget is known, activating orphan vote\n");
         }
     }
     LogPrint("maxbudget","CMAXBudgetManager::CheckOrphanVotes - Done\n");
 }
 
+void CMAXBudgetManager::RebuildOrphanVoteIndex()
+{
+    LOCK(cs);
+
+    mapOrphanBudgetVotesByProposal.clear();
+    mapOrphanFinalizedBudgetVotesByBudget.clear();
+    mapOrphanBudgetVotesByMaxnode.clear();
+    mapOrphanFinalizedBudgetVotesByMaxnode.clear();
+    IndexOrphanVotes(mapOrphanMaxnodeBudgetVotes, mapOrphanBudgetVotesByProposal, mapOrphanBudgetVotesByMaxnode, &CMAXBudgetVote::nProposalHash);
+    IndexOrphanVotes(mapOrphanFinalizedBudgetVotes, mapOrphanFinalizedBudgetVotesByBudget, mapOrphanFinalizedBudgetVotesByMaxnode, &CMAXFinalizedBudgetVote::nBudgetHash);
+}
+
 void CMAXBudgetManager::SubmitFinalBudget()
 {
     static int nSubmittedHeight = 0; // height at which final maxbudget was submitted last time
@@ -278,6 +389,20 @@ void CMAXBudgetManager::SubmitFinalBudget()
 // CMAXBudgetDB
 //
 
+// maxbudget.dat tables
+enum {
+    MAXBUDGETDB_SEEN_PROPOSALS,
+    MAXBUDGETDB_SEEN_PROPOSAL_VOTES,
+    MAXBUDGETDB_SEEN_FINALIZED_BUDGETS,
+    MAXBUDGETDB_SEEN_FINALIZED_BUDGET_VOTES,
+    MAXBUDGETDB_ORPHAN_PROPOSAL_VOTES,
+    MAXBUDGETDB_ORPHAN_FINALIZED_BUDGET_VOTES,
+    MAXBUDGETDB_PROPOSALS,
+    MAXBUDGETDB_FINALIZED_BUDGETS
+};
+
+static CFlatJournal maxbudgetJournal("maxbudget.dat", "MaxnodeBudgetJournal");
+
 CMAXBudgetDB::CMAXBudgetDB()
 {
     pathDB = GetDataDir() / "maxbudget.dat";
@@ -286,31 +411,14 @@ CMAXBudgetDB::CMAXBudgetDB()
 
 bool CMAXBudgetDB::Write(const CMAXBudgetManager& objToSave)
 {
-    LOCK(objToSave.cs);
-
     int64_t nStart = GetTimeMillis();
 
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssObj(SER_DISK, CLIENT_VERSION);
-    ssObj << strMagicMessage;                   // maxnode cache file specific magic message
-    ssObj << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssObj << objToSave;
-    uint256 hash = Hash(ssObj.begin(), ssObj.end());
-    ssObj << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathDB.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssObj;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
-    }
-    fileout.fclose();
+    // only records that changed since the last write are appended
+    if (!maxbudgetJournal.OpenForWrite())
+        return false;
+    objToSave.WriteJournal(maxbudgetJournal);
+    if (!maxbudgetJournal.Flush())
+        return false;
 
     LogPrint("maxbudget","Written info to maxbudget.dat  %dms\n", GetTimeMillis() - nStart);
 
@@ -318,10 +426,45 @@ bool CMAXBudgetDB::Write(const CMAXBudgetManager& objToSave)
 }
 
 CMAXBudgetDB::ReadResult CMAXBudgetDB::Read(CMAXBudgetManager& objToLoad, bool fDryRun)
+{
+    int64_t nStart = GetTimeMillis();
+
+    CFlatJournal::ReadResult journalResult = maxbudgetJournal.Open();
+    if (journalResult == CFlatJournal::IncorrectMagicMessage) {
+        // files written before the journal format are converted once
+        ReadResult result = ReadLegacy(objToLoad);
+        if (result != Ok)
+            return result;
+        if (maxbudgetJournal.Reset()) {
+            objToLoad.WriteJournal(maxbudgetJournal);
+            maxbudgetJournal.Flush();
+        }
+    } else if (journalResult == CFlatJournal::FileError) {
+        return FileError;
+    } else if (journalResult == CFlatJournal::IncorrectMagicNumber) {
+        return IncorrectMagicNumber;
+    } else if (journalResult != CFlatJournal::Ok) {
+        return IncorrectFormat;
+    } else {
+        objToLoad.ReadJournal(maxbudgetJournal);
+    }
+
+    LogPrint("maxbudget","Loaded info from maxbudget.dat  %dms\n", GetTimeMillis() - nStart);
+    LogPrint("maxbudget","  %s\n", objToLoad.ToString());
+    if (!fDryRun) {
+        LogPrint("maxbudget","Budget manager - cleaning....\n");
+        objToLoad.CheckAndRemove();
+        LogPrint("maxbudget","Budget manager - result:\n");
+        LogPrint("maxbudget","  %s\n", objToLoad.ToString());
+    }
+
+    return Ok;
+}
+
+CMAXBudgetDB::ReadResult CMAXBudgetDB::ReadLegacy(CMAXBudgetManager& objToLoad)
 {
     LOCK(objToLoad.cs);
 
-    int64_t nStart = GetTimeMillis();
     // open input file, and associate with CAutoFile
     FILE* file = fopen(pathDB.string().c_str(), "rb");
     CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
@@ -390,15 +533,6 @@ CMAXBudgetDB::ReadResult CMAXBudgetDB::Read(CMAXBudgetManager& objToLoad, bool f
         return IncorrectFormat;
     }
 
-    LogPrint("maxbudget","Loaded info from maxbudget.dat  %dms\n", GetTimeMillis() - nStart);
-    LogPrint("maxbudget","  %s\n", objToLoad.ToString());
-    if (!fDryRun) {
-        LogPrint("maxbudget","Budget manager - cleaning....\n");
-        objToLoad.CheckAndRemove();
-        LogPrint("maxbudget","Budget manager - result:\n");
-        LogPrint("maxbudget","  %s\n", objToLoad.ToString());
-    }
-
     return Ok;
 }
 
@@ -407,28 +541,43 @@ void DumpMaxBudgets()
     int64_t nStart = GetTimeMillis();
 
     CMAXBudgetDB maxbudgetdb;
-    CMAXBudgetManager tempBudget;
-
-    LogPrint("maxbudget","Verifying maxbudget.dat format...\n");
-    CMAXBudgetDB::ReadResult readResult = maxbudgetdb.Read(tempBudget, true);
-    // there was an error and it was not an error on file opening => do not proceed
-    if (readResult == CMAXBudgetDB::FileError)
-        LogPrint("maxbudget","Missing maxbudgets file - maxbudget.dat, will try to recreate\n");
-    else if (readResult != CMAXBudgetDB::Ok) {
-        LogPrint("maxbudget","Error reading maxbudget.dat: ");
-        if (readResult == CMAXBudgetDB::IncorrectFormat)
-            LogPrint("maxbudget","magic is ok but data has invalid format, will try to recreate\n");
-        else {
-            LogPrint("maxbudget","file format is unknown or invalid, please fix it manually\n");
-            return;
-        }
-    }
     LogPrint("maxbudget","Writting info to maxbudget.dat...\n");
     maxbudgetdb.Write(maxbudget);
 
     LogPrint("maxbudget","Budget dump finished  %dms\n", GetTimeMillis() - nStart);
 }
 
+void CMAXBudgetManager::WriteJournal(CFlatJournal& journal) const
+{
+    LOCK(cs);
+
+    // seen messages aren't kept across restarts, drop what older versions stored
+    journal.EraseMissing(MAXBUDGETDB_SEEN_PROPOSALS, std::set<uint256>());
+    journal.EraseMissing(MAXBUDGETDB_SEEN_PROPOSAL_VOTES, std::set<uint256>());
+    journal.EraseMissing(MAXBUDGETDB_SEEN_FINALIZED_BUDGETS, std::set<uint256>());
+    journal.EraseMissing(MAXBUDGETDB_SEEN_FINALIZED_BUDGET_VOTES, std::set<uint256>());
+
+    // votes never change once seen, proposals and budgets collect votes
+    journal.WriteMap(MAXBUDGETDB_ORPHAN_PROPOSAL_VOTES, mapOrphanMaxnodeBudgetVotes, true);
+    journal.WriteMap(MAXBUDGETDB_ORPHAN_FINALIZED_BUDGET_VOTES, mapOrphanFinalizedBudgetVotes, true);
+    journal.WriteMap(MAXBUDGETDB_PROPOSALS, mapProposals, false);
+    journal.WriteMap(MAXBUDGETDB_FINALIZED_BUDGETS, mapFinalizedBudgets, false);
+}
+
+void CMAXBudgetManager::ReadJournal(CFlatJournal& journal)
+{
+    LOCK(cs);
+
+    Clear();
+
+    journal.ReadMap(MAXBUDGETDB_ORPHAN_PROPOSAL_VOTES, mapOrphanMaxnodeBudgetVotes);
+    journal.ReadMap(MAXBUDGETDB_ORPHAN_FINALIZED_BUDGET_VOTES, mapOrphanFinalizedBudgetVotes);
+    journal.ReadMap(MAXBUDGETDB_PROPOSALS, mapProposals);
+    journal.ReadMap(MAXBUDGETDB_FINALIZED_BUDGETS, mapFinalizedBudgets);
+    RebuildFinalizedBudgetIndex();
+    RebuildOrphanVoteIndex();
+}
+
 bool CMAXBudgetManager::AddFinalizedBudget(CMAXFinalizedBudget& finalizedBudget)
 {
     std::string strError = "";
@@ -438,7 +587,11 @@ bool CMAXBudgetManager::AddFinalizedBudget(CMAXFinalizedBudget& finalizedBudget)
         return false;
     }
 
-    mapFinalizedBudgets.insert(make_pair(finalizedBudget.GetHash(), finalizedBudget));
+    std::map<uint256, CMAXFinalizedBudget>::iterator it = mapFinalizedBudgets.insert(make_pair(finalizedBudget.GetHash(), finalizedBudget)).first;
+    IndexFinalizedBudget((*it).first, (*it).second);
+
+    // we might have votes waiting for this maxbudget
+    CheckOrphanVotes((*it).first);
     return true;
 }
 
@@ -455,8 +608,12 @@ bool CMAXBudgetManager::AddProposal(CMAXBudgetProposal& maxbudgetProposal)
         return false;
     }
 
+    InvalidateBudgetCache();
     mapProposals.insert(make_pair(maxbudgetProposal.GetHash(), maxbudgetProposal));
     LogPrint("maxbudget","CMAXBudgetManager::AddProposal - proposal %s added\n", maxbudgetProposal.GetName ().c_str ());
+
+    // we might have votes waiting for this proposal
+    CheckOrphanVotes(maxbudgetProposal.GetHash());
     return true;
 }
 
@@ -526,6 +683,8 @@ void CMAXBudgetManager::CheckAndRemove()
     // Remove invalid entries by overwriting complete map
     mapFinalizedBudgets.swap(tmpMapFinalizedBudgets);
     mapProposals.swap(tmpMapProposals);
+    InvalidateBudgetCache();
+    RebuildFinalizedBudgetIndex();
 
     // clang doesn't accept copy assignemnts :-/
     // mapFinalizedBudgets = tmpMapFinalizedBudgets;
@@ -639,21 +798,56 @@ CMAXBudgetProposal* CMAXBudgetManager::FindMaxProposal(uint256 nHash)
     return NULL;
 }
 
-bool CMAXBudgetManager::IsBudgetPaymentBlock(int nBlockHeight)
+void CMAXBudgetManager::IndexFinalizedBudget(const uint256& nHash, CMAXFinalizedBudget& finalizedBudget)
 {
-    int nHighestCount = -1;
-    int nFivePercent = maxnodeman.CountEnabled(ActiveProtocol()) / 20;
+    mapFinalizedBudgetsByStart[finalizedBudget.GetMaxBlockStart()].insert(nHash);
+    nFinalizedBudgetMaxSpan = std::max(nFinalizedBudgetMaxSpan, finalizedBudget.GetMaxBlockEnd() - finalizedBudget.GetMaxBlockStart() + 1);
+}
+
+void CMAXBudgetManager::RebuildFinalizedBudgetIndex()
+{
+    LOCK(cs);
+
+    mapFinalizedBudgetsByStart.clear();
+    nFinalizedBudgetMaxSpan = 0;
 
     std::map<uint256, CMAXFinalizedBudget>::iterator it = mapFinalizedBudgets.begin();
     while (it != mapFinalizedBudgets.end()) {
-        CMAXFinalizedBudget* pfinalizedBudget = &((*it).second);
-        if (pfinalizedBudget->GetMaxVoteCount() > nHighestCount &&
-            nBlockHeight >= pfinalizedBudget->GetMaxBlockStart() &&
-            nBlockHeight <= pfinalizedBudget->GetMaxBlockEnd()) {
-            nHighestCount = pfinalizedBudget->GetMaxVoteCount();
+        IndexFinalizedBudget((*it).first, (*it).second);
+        ++it;
+    }
+}
+
+void CMAXBudgetManager::GetFinalizedBudgetsAt(int nBlockHeight, std::vector<CMAXFinalizedBudget*>& vFinalizedBudgets)
+{
+    // a maxbudget can only pay at this height if it started at most nFinalizedBudgetMaxSpan blocks ago
+    std::map<uint256, CMAXFinalizedBudget*> mapFound;
+    std::map<int, std::set<uint256> >::iterator it = mapFinalizedBudgetsByStart.lower_bound(nBlockHeight - nFinalizedBudgetMaxSpan + 1);
+    for (; it != mapFinalizedBudgetsByStart.end() && (*it).first <= nBlockHeight; ++it) {
+        BOOST_FOREACH (const uint256& nHash, (*it).second) {
+            std::map<uint256, CMAXFinalizedBudget>::iterator mi = mapFinalizedBudgets.find(nHash);
+            if (mi != mapFinalizedBudgets.end() && nBlockHeight <= (*mi).second.GetMaxBlockEnd())
+                mapFound.insert(make_pair(nHash, &((*mi).second)));
         }
+    }
 
-        ++it;
+    vFinalizedBudgets.clear();
+    for (std::map<uint256, CMAXFinalizedBudget*>::iterator mi = mapFound.begin(); mi != mapFound.end(); ++mi)
+        vFinalizedBudgets.push_back((*mi).second);
+}
+
+bool CMAXBudgetManager::IsBudgetPaymentBlock(int nBlockHeight)
+{
+    LOCK(cs);
+
+    int nHighestCount = -1;
+    int nFivePercent = maxnodeman.CountEnabled(ActiveProtocol()) / 20;
+
+    std::vector<CMAXFinalizedBudget*> vFinalizedBudgets;
+    GetFinalizedBudgetsAt(nBlockHeight, vFinalizedBudgets);
+    BOOST_FOREACH (CMAXFinalizedBudget* pfinalizedBudget, vFinalizedBudgets) {
+        if (pfinalizedBudget->GetMaxVoteCount() > nHighestCount)
+            nHighestCount = pfinalizedBudget->GetMaxVoteCount();
     }
 
     LogPrint("maxbudget","CMAXBudgetManager::IsBudgetPaymentBlock() - nHighestCount: %lli, 5%% of Maxnodes: %lli. Number of finalized maxbudgets: %lli\n", 
@@ -672,23 +866,16 @@ MAXTrxValidationStatus CMAXBudgetManager::IsTransactionValid(const CTransaction&
     MAXTrxValidationStatus transactionStatus = MAXTrxValidationStatus::InValid;
     int nHighestCount = 0;
     int nFivePercent = maxnodeman.CountEnabled(ActiveProtocol()) / 20;
-    std::vector<CMAXFinalizedBudget*> ret;
+    std::vector<CMAXFinalizedBudget*> vFinalizedBudgets;
+    GetFinalizedBudgetsAt(nBlockHeight, vFinalizedBudgets);
 
-    LogPrint("maxbudget","CMAXBudgetManager::IsTransactionValid - checking %lli finalized maxbudgets\n", mapFinalizedBudgets.size());
+    LogPrint("maxbudget","CMAXBudgetManager::IsTransactionValid - checking %lli of %lli finalized maxbudgets\n", vFinalizedBudgets.size(), mapFinalizedBudgets.size());
 
     // ------- Grab The Highest Count
 
-    std::map<uint256, CMAXFinalizedBudget>::iterator it = mapFinalizedBudgets.begin();
-    while (it != mapFinalizedBudgets.end()) {
-        CMAXFinalizedBudget* pfinalizedBudget = &((*it).second);
-
-        if (pfinalizedBudget->GetMaxVoteCount() > nHighestCount &&
-            nBlockHeight >= pfinalizedBudget->GetMaxBlockStart() &&
-            nBlockHeight <= pfinalizedBudget->GetMaxBlockEnd()) {
+    BOOST_FOREACH (CMAXFinalizedBudget* pfinalizedBudget, vFinalizedBudgets) {
+        if (pfinalizedBudget->GetMaxVoteCount() > nHighestCount)
             nHighestCount = pfinalizedBudget->GetMaxVoteCount();
-        }
-
-        ++it;
     }
 
     LogPrint("maxbudget","CMAXBudgetManager::IsTransactionValid() - nHighestCount: %lli, 5%% of Maxnodes: %lli mapFinalizedBudgets.size(): %ld\n", 
@@ -703,9 +890,7 @@ MAXTrxValidationStatus CMAXBudgetManager::IsTransactionValid(const CTransaction&
     std::string strProposals = "";
     int nCountThreshold = nHighestCount - maxnodeman.CountEnabled(ActiveProtocol()) / 10;
     bool fThreshold = false;
-    it = mapFinalizedBudgets.begin();
-    while (it != mapFinalizedBudgets.end()) {
-        CMAXFinalizedBudget* pfinalizedBudget = &((*it).second);
+    BOOST_FOREACH (CMAXFinalizedBudget* pfinalizedBudget, vFinalizedBudgets) {
         strProposals = pfinalizedBudget->GetMaxProposals();
 
         LogPrint("maxbudget","CMAXBudgetManager::IsTransactionValid - checking maxbudget (%s) with blockstart %lli, blockend %lli, nBlockHeight %lli, votes %lli, nCountThreshold %lli\n",
@@ -715,23 +900,22 @@ MAXTrxValidationStatus CMAXBudgetManager::IsTransactionValid(const CTransaction&
         if (pfinalizedBudget->GetMaxVoteCount() > nCountThreshold) {
             fThreshold = true;
             LogPrint("maxbudget","CMAXBudgetManager::IsTransactionValid - GetMaxVoteCount() > nCountThreshold passed\n");
-            if (nBlockHeight >= pfinalizedBudget->GetMaxBlockStart() && nBlockHeight <= pfinalizedBudget->GetMaxBlockEnd()) {
-                LogPrint("maxbudget","CMAXBudgetManager::IsTransactionValid - GetMaxBlockStart() passed\n");
-                transactionStatus = pfinalizedBudget->IsTransactionValid(txNew, nBlockHeight);
-                if (transactionStatus == MAXTrxValidationStatus::Valid) {
-                    LogPrint("maxbudget","CMAXBudgetManager::IsTransactionValid - pfinalizedBudget->IsTransactionValid() passed\n");
-                    return MAXTrxValidationStatus::Valid;
-                }
-                else {
-                    LogPrint("maxbudget","CMAXBudgetManager::IsTransactionValid - pfinalizedBudget->IsTransactionValid() error\n");
-                }
+            transactionStatus = pfinalizedBudget->IsTransactionValid(txNew, nBlockHeight);
+            if (transactionStatus == MAXTrxValidationStatus::Valid) {
+                LogPrint("maxbudget","CMAXBudgetManager::IsTransactionValid - pfinalizedBudget->IsTransactionValid() passed\n");
+                return MAXTrxValidationStatus::Valid;
             }
             else {
-                LogPrint("maxbudget","CMAXBudgetManager::IsTransactionValid - GetMaxBlockStart() failed, maxbudget is outside current payment cycle and will be ignored.\n");
+                LogPrint("maxbudget","CMAXBudgetManager::IsTransactionValid - pfinalizedBudget->IsTransactionValid() error\n");
             }
-               
         }
+    }
 
+    // maxbudgets outside the current payment cycle still count towards the vote threshold
+    std::map<uint256, CMAXFinalizedBudget>::iterator it = mapFinalizedBudgets.begin();
+    while (!fThreshold && it != mapFinalizedBudgets.end()) {
+        if ((*it).second.GetMaxVoteCount() > nCountThreshold)
+            fThreshold = true;
         ++it;
     }
 
@@ -744,16 +928,32 @@ MAXTrxValidationStatus CMAXBudgetManager::IsTransactionValid(const CTransaction&
     return transactionStatus;
 }
 
+// Check the votes of all proposals against the node list, once per block
+void CMAXBudgetManager::CheckProposalVotes()
+{
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    if (pindexPrev != NULL && hashVotesCheckedTip == pindexPrev->GetBlockHash()) return;
+
+    std::map<uint256, CMAXBudgetProposal>::iterator it = mapProposals.begin();
+    while (it != mapProposals.end()) {
+        (*it).second.CleanAndRemove(false);
+        ++it;
+    }
+
+    hashVotesCheckedTip = pindexPrev ? pindexPrev->GetBlockHash() : uint256();
+    InvalidateBudgetCache();
+}
+
 std::vector<CMAXBudgetProposal*> CMAXBudgetManager::GetAllProposals()
 {
     LOCK(cs);
 
     std::vector<CMAXBudgetProposal*> vBudgetProposalRet;
 
+    CheckProposalVotes();
+
     std::map<uint256, CMAXBudgetProposal>::iterator it = mapProposals.begin();
     while (it != mapProposals.end()) {
-        (*it).second.CleanAndRemove(false);
-
         CMAXBudgetProposal* pmaxbudgetProposal = &((*it).second);
         vBudgetProposalRet.push_back(pmaxbudgetProposal);
 
@@ -780,13 +980,21 @@ std::vector<CMAXBudgetProposal*> CMAXBudgetManager::GetBudget()
 {
     LOCK(cs);
 
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    if (pindexPrev == NULL) return std::vector<CMAXBudgetProposal*>();
+
+    // the ranking only changes with new votes, proposals or blocks
+    if (fBudgetCacheValid && hashBudgetCacheTip == pindexPrev->GetBlockHash())
+        return vBudgetCache;
+
+    CheckProposalVotes();
+
     // ------- Sort maxbudgets by Yes Count
 
     std::vector<std::pair<CMAXBudgetProposal*, int> > vBudgetPorposalsSort;
 
     std::map<uint256, CMAXBudgetProposal>::iterator it = mapProposals.begin();
     while (it != mapProposals.end()) {
-        (*it).second.CleanAndRemove(false);
         vBudgetPorposalsSort.push_back(make_pair(&((*it).second), (*it).second.GetMaxYeas() - (*it).second.GetMaxNays()));
         ++it;
     }
@@ -798,9 +1006,6 @@ std::vector<CMAXBudgetProposal*> CMAXBudgetManager::GetBudget()
     std::vector<CMAXBudgetProposal*> vBudgetProposalsRet;
 
     CAmount nBudgetAllocated = 0;
-    CBlockIndex* pindexPrev = chainActive.Tip();
-    if (pindexPrev == NULL) return vBudgetProposalsRet;
-
     int nBlockStart = pindexPrev->nHeight - pindexPrev->nHeight % GetMaxBudgetPaymentCycleBlocks() + GetMaxBudgetPaymentCycleBlocks();
     int nBlockEnd = nBlockStart + GetMaxBudgetPaymentCycleBlocks() - 1;
     CAmount nTotalBudget = GetMaxTotalBudget(nBlockStart);
@@ -842,6 +1047,10 @@ std::vector<CMAXBudgetProposal*> CMAXBudgetManager::GetBudget()
         ++it2;
     }
 
+    vBudgetCache = vBudgetProposalsRet;
+    hashBudgetCacheTip = pindexPrev->GetBlockHash();
+    fBudgetCacheValid = true;
+
     return vBudgetProposalsRet;
 }
 
@@ -1103,9 +1312,6 @@ void CMAXBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CD
         //maxnodeSync.AddedBudgetItem(maxbudgetProposalBroadcast.GetHash());
 
         LogPrint("maxbudget","mprop - new maxbudget - %s\n", maxbudgetProposalBroadcast.GetHash().ToString());
-
-        //We might have active votes for this proposal that are valid now
-        CheckOrphanVotes();
     }
 
     if (strCommand == "mvote") { //Maxnode Vote
@@ -1178,9 +1384,6 @@ void CMAXBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CD
             finalizedBudgetBroadcast.Relay();
         }
         //maxnodeSync.AddedBudgetItem(finalizedBudgetBroadcast.GetHash());
-
-        //we might have active votes for this maxbudget that are now valid
-        CheckOrphanVotes();
     }
 
     if (strCommand == "fbvote") { //Finalized Budget Vote
@@ -1235,10 +1438,10 @@ void CMAXBudgetManager::ResetSync()
     LOCK(cs);
 
 
-    std::map<uint256, CMAXBudgetProposalBroadcast>::iterator it1 = mapSeenMaxnodeBudgetProposals.begin();
-    while (it1 != mapSeenMaxnodeBudgetProposals.end()) {
-        CMAXBudgetProposal* pmaxbudgetProposal = FindMaxProposal((*it1).first);
-        if (pmaxbudgetProposal && pmaxbudgetProposal->fValid) {
+    std::map<uint256, CMAXBudgetProposal>::iterator it1 = mapProposals.begin();
+    while (it1 != mapProposals.end()) {
+        CMAXBudgetProposal* pmaxbudgetProposal = &((*it1).second);
+        if (pmaxbudgetProposal->fValid) {
             //mark votes
             std::map<uint256, CMAXBudgetVote>::iterator it2 = pmaxbudgetProposal->mapVotes.begin();
             while (it2 != pmaxbudgetProposal->mapVotes.end()) {
@@ -1249,10 +1452,10 @@ void CMAXBudgetManager::ResetSync()
         ++it1;
     }
 
-    std::map<uint256, CMAXFinalizedBudgetBroadcast>::iterator it3 = mapSeenFinalizedBudgets.begin();
-    while (it3 != mapSeenFinalizedBudgets.end()) {
-        CMAXFinalizedBudget* pfinalizedBudget = FindFinalizedBudget((*it3).first);
-        if (pfinalizedBudget && pfinalizedBudget->fValid) {
+    std::map<uint256, CMAXFinalizedBudget>::iterator it3 = mapFinalizedBudgets.begin();
+    while (it3 != mapFinalizedBudgets.end()) {
+        CMAXFinalizedBudget* pfinalizedBudget = &((*it3).second);
+        if (pfinalizedBudget->fValid) {
             //send votes
             std::map<uint256, CMAXFinalizedBudgetVote>::iterator it4 = pfinalizedBudget->mapVotes.begin();
             while (it4 != pfinalizedBudget->mapVotes.end()) {
@@ -1272,10 +1475,10 @@ void CMAXBudgetManager::MarkSynced()
         Mark that we've sent all valid items
     */
 
-    std::map<uint256, CMAXBudgetProposalBroadcast>::iterator it1 = mapSeenMaxnodeBudgetProposals.begin();
-    while (it1 != mapSeenMaxnodeBudgetProposals.end()) {
-        CMAXBudgetProposal* pmaxbudgetProposal = FindMaxProposal((*it1).first);
-        if (pmaxbudgetProposal && pmaxbudgetProposal->fValid) {
+    std::map<uint256, CMAXBudgetProposal>::iterator it1 = mapProposals.begin();
+    while (it1 != mapProposals.end()) {
+        CMAXBudgetProposal* pmaxbudgetProposal = &((*it1).second);
+        if (pmaxbudgetProposal->fValid) {
             //mark votes
             std::map<uint256, CMAXBudgetVote>::iterator it2 = pmaxbudgetProposal->mapVotes.begin();
             while (it2 != pmaxbudgetProposal->mapVotes.end()) {
@@ -1287,10 +1490,10 @@ void CMAXBudgetManager::MarkSynced()
         ++it1;
     }
 
-    std::map<uint256, CMAXFinalizedBudgetBroadcast>::iterator it3 = mapSeenFinalizedBudgets.begin();
-    while (it3 != mapSeenFinalizedBudgets.end()) {
-        CMAXFinalizedBudget* pfinalizedBudget = FindFinalizedBudget((*it3).first);
-        if (pfinalizedBudget && pfinalizedBudget->fValid) {
+    std::map<uint256, CMAXFinalizedBudget>::iterator it3 = mapFinalizedBudgets.begin();
+    while (it3 != mapFinalizedBudgets.end()) {
+        CMAXFinalizedBudget* pfinalizedBudget = &((*it3).second);
+        if (pfinalizedBudget->fValid) {
             //mark votes
             std::map<uint256, CMAXFinalizedBudgetVote>::iterator it4 = pfinalizedBudget->mapVotes.begin();
             while (it4 != pfinalizedBudget->mapVotes.end()) {
@@ -1320,11 +1523,14 @@ void CMAXBudgetManager::Sync(CNode* pfrom, uint256 nProp, bool fPartial)
 
     int nInvCount = 0;
 
-    std::map<uint256, CMAXBudgetProposalBroadcast>::iterator it1 = mapSeenMaxnodeBudgetProposals.begin();
-    while (it1 != mapSeenMaxnodeBudgetProposals.end()) {
-        CMAXBudgetProposal* pmaxbudgetProposal = FindMaxProposal((*it1).first);
-        if (pmaxbudgetProposal && pmaxbudgetProposal->fValid && (nProp == 0 || (*it1).first == nProp)) {
-            pfrom->PushInventory(CInv(MSG_MAX_BUDGET_PROPOSAL, (*it1).second.GetHash()));
+    std::map<uint256, CMAXBudgetProposal>::iterator it1 = mapProposals.begin();
+    while (it1 != mapProposals.end()) {
+        CMAXBudgetProposal* pmaxbudgetProposal = &((*it1).second);
+        if (pmaxbudgetProposal->fValid && (nProp == 0 || (*it1).first == nProp)) {
+            // the seen cache may have let go of it already, it has to answer the getdata
+            if (!mapSeenMaxnodeBudgetProposals.count((*it1).first))
+                mapSeenMaxnodeBudgetProposals.insert(make_pair((*it1).first, CMAXBudgetProposalBroadcast(*pmaxbudgetProposal)));
+            pfrom->PushInventory(CInv(MSG_MAX_BUDGET_PROPOSAL, (*it1).first));
             nInvCount++;
 
             //send votes
@@ -1332,7 +1538,9 @@ void CMAXBudgetManager::Sync(CNode* pfrom, uint256 nProp, bool fPartial)
             while (it2 != pmaxbudgetProposal->mapVotes.end()) {
                 if ((*it2).second.fValid) {
                     if ((fPartial && !(*it2).second.fSynced) || !fPartial) {
-                        pfrom->PushInventory(CInv(MSG_MAX_BUDGET_VOTE, (*it2).second.GetHash()));
+                        if (!mapSeenMaxnodeBudgetVotes.count((*it2).first))
+                            mapSeenMaxnodeBudgetVotes.insert(*it2);
+                        pfrom->PushInventory(CInv(MSG_MAX_BUDGET_VOTE, (*it2).first));
                         nInvCount++;
                     }
                 }
@@ -1348,11 +1556,13 @@ void CMAXBudgetManager::Sync(CNode* pfrom, uint256 nProp, bool fPartial)
 
     nInvCount = 0;
 
-    std::map<uint256, CMAXFinalizedBudgetBroadcast>::iterator it3 = mapSeenFinalizedBudgets.begin();
-    while (it3 != mapSeenFinalizedBudgets.end()) {
-        CMAXFinalizedBudget* pfinalizedBudget = FindFinalizedBudget((*it3).first);
-        if (pfinalizedBudget && pfinalizedBudget->fValid && (nProp == 0 || (*it3).first == nProp)) {
-            pfrom->PushInventory(CInv(MSG_MAX_BUDGET_FINALIZED, (*it3).second.GetHash()));
+    std::map<uint256, CMAXFinalizedBudget>::iterator it3 = mapFinalizedBudgets.begin();
+    while (it3 != mapFinalizedBudgets.end()) {
+        CMAXFinalizedBudget* pfinalizedBudget = &((*it3).second);
+        if (pfinalizedBudget->fValid && (nProp == 0 || (*it3).first == nProp)) {
+            if (!mapSeenFinalizedBudgets.count((*it3).first))
+                mapSeenFinalizedBudgets.insert(make_pair((*it3).first, CMAXFinalizedBudgetBroadcast(*pfinalizedBudget)));
+            pfrom->PushInventory(CInv(MSG_MAX_BUDGET_FINALIZED, (*it3).first));
             nInvCount++;
 
             //send votes
@@ -1360,7 +1570,9 @@ void CMAXBudgetManager::Sync(CNode* pfrom, uint256 nProp, bool fPartial)
             while (it4 != pfinalizedBudget->mapVotes.end()) {
                 if ((*it4).second.fValid) {
                     if ((fPartial && !(*it4).second.fSynced) || !fPartial) {
-                        pfrom->PushInventory(CInv(MSG_MAX_BUDGET_FINALIZED_VOTE, (*it4).second.GetHash()));
+                        if (!mapSeenFinalizedBudgetVotes.count((*it4).first))
+                            mapSeenFinalizedBudgetVotes.insert(*it4);
+                        pfrom->PushInventory(CInv(MSG_MAX_BUDGET_FINALIZED_VOTE, (*it4).first));
                         nInvCount++;
                     }
                 }
@@ -1385,7 +1597,8 @@ bool CMAXBudgetManager::UpdateProposal(CMAXBudgetVote& vote, CNode* pfrom, std::
             //if (!maxnodeSync.IsSynced()) return false;
 
             LogPrint("maxbudget","CMAXBudgetManager::UpdateProposal - Unknown proposal %d, asking for source proposal\n", vote.nProposalHash.ToString());
-            mapOrphanMaxnodeBudgetVotes[vote.nProposalHash] = vote;
+            if (!AddOrphanVote(vote))
+                LogPrint("maxbudget","CMAXBudgetManager::UpdateProposal - orphan vote %s not kept\n", vote.GetHash().ToString());
 
             if (!askedForMaxSourceProposalOrBudget.count(vote.nProposalHash)) {
                 pfrom->PushMessage("maxvs", vote.nProposalHash);
@@ -1398,7 +1611,11 @@ bool CMAXBudgetManager::UpdateProposal(CMAXBudgetVote& vote, CNode* pfrom, std::
     }
 
 
-    return mapProposals[vote.nProposalHash].AddOrUpdateVote(vote, strError);
+    if (!mapProposals[vote.nProposalHash].AddOrUpdateVote(vote, strError))
+        return false;
+
+    InvalidateBudgetCache();
+    return true;
 }
 
 bool CMAXBudgetManager::UpdateFinalizedBudget(CMAXFinalizedBudgetVote& vote, CNode* pfrom, std::string& strError)
@@ -1412,7 +1629,8 @@ bool CMAXBudgetManager::UpdateFinalizedBudget(CMAXFinalizedBudgetVote& vote, CNo
             //if (!maxnodeSync.IsSynced()) return false;
 
             LogPrint("maxbudget","CMAXBudgetManager::UpdateFinalizedBudget - Unknown Finalized Proposal %s, asking for source maxbudget\n", vote.nBudgetHash.ToString());
-            mapOrphanFinalizedBudgetVotes[vote.nBudgetHash] = vote;
+            if (!AddOrphanVote(vote))
+                LogPrint("maxbudget","CMAXBudgetManager::UpdateFinalizedBudget - orphan vote %s not kept\n", vote.GetHash().ToString());
 
             if (!askedForMaxSourceProposalOrBudget.count(vote.nBudgetHash)) {
                 pfrom->PushMessage("maxvs", vote.nBudgetHash);
@@ -1434,6 +1652,9 @@ CMAXBudgetProposal::CMAXBudgetProposal()
     nBlockEnd = 0;
     nAmount = 0;
     nTime = 0;
+    nYeas = 0;
+    nNays = 0;
+    nAbstains = 0;
     fValid = true;
 }
 
@@ -1446,6 +1667,9 @@ CMAXBudgetProposal::CMAXBudgetProposal(std::string strProposalNameIn, std::strin
     address = addressIn;
     nAmount = nAmountIn;
     nFeeTXHash = nFeeTXHashIn;
+    nYeas = 0;
+    nNays = 0;
+    nAbstains = 0;
     fValid = true;
 }
 
@@ -1460,6 +1684,9 @@ CMAXBudgetProposal::CMAXBudgetProposal(const CMAXBudgetProposal& other)
     nTime = other.nTime;
     nFeeTXHash = other.nFeeTXHash;
     mapVotes = other.mapVotes;
+    nYeas = other.nYeas;
+    nNays = other.nNays;
+    nAbstains = other.nAbstains;
     fValid = true;
 }
 
@@ -1567,7 +1794,10 @@ bool CMAXBudgetProposal::AddOrUpdateVote(CMAXBudgetVote& vote, std::string& strE
         return false;
     }
 
+    if (mapVotes.count(hash))
+        CountVote(mapVotes[hash], -1);
     mapVotes[hash] = vote;
+    CountVote(vote, 1);
     LogPrint("maxbudget", "CMAXBudgetProposal::AddOrUpdateVote - %s %s\n", strAction.c_str(), vote.GetHash().ToString().c_str());
 
     return true;
@@ -1576,69 +1806,53 @@ bool CMAXBudgetProposal::AddOrUpdateVote(CMAXBudgetVote& vote, std::string& strE
 // If maxnode voted for a proposal, but is now invalid -- remove the vote
 void CMAXBudgetProposal::CleanAndRemove(bool fSignatureCheck)
 {
+    nYeas = nNays = nAbstains = 0;
+
     std::map<uint256, CMAXBudgetVote>::iterator it = mapVotes.begin();
 
     while (it != mapVotes.end()) {
         (*it).second.fValid = (*it).second.SignatureValid(fSignatureCheck);
+        CountVote((*it).second, 1);
         ++it;
     }
 }
 
-double CMAXBudgetProposal::GetMaxRatio()
+void CMAXBudgetProposal::RecountVotes()
 {
-    int yeas = 0;
-    int nays = 0;
+    nYeas = nNays = nAbstains = 0;
 
     std::map<uint256, CMAXBudgetVote>::iterator it = mapVotes.begin();
-
     while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_YES) yeas++;
-        if ((*it).second.nVote == VOTE_NO) nays++;
+        CountVote((*it).second, 1);
         ++it;
     }
-
-    if (yeas + nays == 0) return 0.0f;
-
-    return ((double)(yeas) / (double)(yeas + nays));
 }
 
-int CMAXBudgetProposal::GetMaxYeas()
+void CMAXBudgetProposal::CountVote(const CMAXBudgetVote& vote, int nIncrement)
 {
-    int ret = 0;
-
-    std::map<uint256, CMAXBudgetVote>::iterator it = mapVotes.begin();
-    while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_YES && (*it).second.fValid) ret++;
-        ++it;
-    }
+    if (!vote.fValid) return;
 
-    return ret;
+    if (vote.nVote == VOTE_YES) nYeas += nIncrement;
+    if (vote.nVote == VOTE_NO) nNays += nIncrement;
+    if (vote.nVote == VOTE_ABSTAIN) nAbstains += nIncrement;
 }
 
-int CMAXBudgetProposal::GetMaxNays()
+double CMAXBudgetProposal::GetMaxRatio()
 {
-    int ret = 0;
+    int yeas = 0;
+    int nays = 0;
 
     std::map<uint256, CMAXBudgetVote>::iterator it = mapVotes.begin();
-    while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_NO && (*it).second.fValid) ret++;
-        ++it;
-    }
-
-    return ret;
-}
 
-int CMAXBudgetProposal::GetMaxAbstains()
-{
-    int ret = 0;
-
-    std::map<uint256, CMAXBudgetVote>::iterator it = mapVotes.begin();
     while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_ABSTAIN && (*it).second.fValid) ret++;
+        if ((*it).second.nVote == VOTE_YES) yeas++;
+        if ((*it).second.nVote == VOTE_NO) nays++;
         ++it;
     }
 
-    return ret;
+    if (yeas + nays == 0) return 0.0f;
+
+    return ((double)(yeas) / (double)(yeas + nays));
 }
 
 int CMAXBudgetProposal::GetMaxBlockStartCycle()
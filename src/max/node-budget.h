@@ -13,6 +13,7 @@
 #include "main.h"
 #include "max/node.h"
 #include "net.h"
+#include "seencache.h"
 #include "sync.h"
 #include "util.h"
 #include <boost/lexical_cast.hpp>
@@ -22,6 +23,7 @@ using namespace std;
 extern CCriticalSection cs_budget;
 
 class CMAXBudgetManager;
+class CFlatJournal;
 class CMAXFinalizedBudgetBroadcast;
 class CMAXFinalizedBudget;
 class CMAXBudgetProposal;
@@ -43,6 +45,10 @@ static const CAmount MAX_PROPOSAL_FEE_TX = (50 * COIN);
 static const CAmount MAX_BUDGET_FEE_TX_OLD = (50 * COIN);
 static const CAmount MAX_BUDGET_FEE_TX = (5 * COIN);
 static const int64_t MAX_BUDGET_VOTE_UPDATE_MIN = 60 * 60;
+/** Seen proposals, budgets and votes are forgotten after this long without being relayed */
+static const int64_t MAX_BUDGET_SEEN_SECONDS = 24 * 60 * 60;
+/** Orphan budget votes kept per maxnode, of each kind, for proposals and finalized budgets we don't know yet. The oldest make room for newer ones */
+static const int MAX_ORPHAN_BUDGET_VOTES_PER_MAXNODE = 100;
 static map<uint256, int> mapMaxPayment_History;
 
 extern std::vector<CMAXBudgetProposalBroadcast> vecMAXImmatureBudgetProposals;
@@ -152,7 +158,7 @@ public:
     }
 };
 
-/** Save Budget Manager (budget.dat)
+/** Save Budget Manager (maxbudget.dat), kept as a CFlatJournal
  */
 class CMAXBudgetDB
 {
@@ -174,6 +180,10 @@ public:
     CMAXBudgetDB();
     bool Write(const CMAXBudgetManager& objToSave);
     ReadResult Read(CMAXBudgetManager& objToLoad, bool fDryRun = false);
+
+private:
+    /// Files written before the journal format, serialized as a whole
+    ReadResult ReadLegacy(CMAXBudgetManager& objToLoad);
 };
 
 
@@ -187,6 +197,30 @@ private:
     // XX42    map<uint256, CTransaction> mapCollateral;
     map<uint256, uint256> mapCollateralTxids;
 
+    //! Result of GetBudget(), kept until the tip or the proposals change
+    std::vector<CMAXBudgetProposal*> vBudgetCache;
+    uint256 hashBudgetCacheTip;
+    bool fBudgetCacheValid;
+    //! Tip the proposal votes were last checked against the node list at
+    uint256 hashVotesCheckedTip;
+
+    //! Finalized budgets by the height of their first payment
+    std::map<int, std::set<uint256> > mapFinalizedBudgetsByStart;
+    //! Most blocks any indexed finalized budget pays for
+    int nFinalizedBudgetMaxSpan;
+
+    //! Orphan votes by the hash of the proposal or finalized budget they wait for
+    std::map<uint256, std::set<uint256> > mapOrphanBudgetVotesByProposal;
+    std::map<uint256, std::set<uint256> > mapOrphanFinalizedBudgetVotesByBudget;
+    //! Orphan votes of each maxnode by time, oldest first, to bound the orphan pool
+    std::map<COutPoint, std::set<std::pair<int64_t, uint256> > > mapOrphanBudgetVotesByMaxnode;
+    std::map<COutPoint, std::set<std::pair<int64_t, uint256> > > mapOrphanFinalizedBudgetVotesByMaxnode;
+
+    void CheckProposalVotes();
+    void IndexFinalizedBudget(const uint256& nHash, CMAXFinalizedBudget& finalizedBudget);
+    /// Finalized budgets paying at the height, in the order of mapFinalizedBudgets
+    void GetFinalizedBudgetsAt(int nBlockHeight, std::vector<CMAXFinalizedBudget*>& vFinalizedBudgets);
+
 public:
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
@@ -195,17 +229,22 @@ public:
     map<uint256, CMAXBudgetProposal> mapProposals;
     map<uint256, CMAXFinalizedBudget> mapFinalizedBudgets;
 
-    std::map<uint256, CMAXBudgetProposalBroadcast> mapSeenMaxnodeBudgetProposals;
-    std::map<uint256, CMAXBudgetVote> mapSeenMaxnodeBudgetVotes;
+    CSeenCache<CMAXBudgetProposalBroadcast> mapSeenMaxnodeBudgetProposals;
+    CSeenCache<CMAXBudgetVote> mapSeenMaxnodeBudgetVotes;
     std::map<uint256, CMAXBudgetVote> mapOrphanMaxnodeBudgetVotes;
-    std::map<uint256, CMAXFinalizedBudgetBroadcast> mapSeenFinalizedBudgets;
-    std::map<uint256, CMAXFinalizedBudgetVote> mapSeenFinalizedBudgetVotes;
+    CSeenCache<CMAXFinalizedBudgetBroadcast> mapSeenFinalizedBudgets;
+    CSeenCache<CMAXFinalizedBudgetVote> mapSeenFinalizedBudgetVotes;
     std::map<uint256, CMAXFinalizedBudgetVote> mapOrphanFinalizedBudgetVotes;
 
-    CMAXBudgetManager()
+    CMAXBudgetManager() : mapSeenMaxnodeBudgetProposals(MAX_BUDGET_SEEN_SECONDS),
+                       mapSeenMaxnodeBudgetVotes(MAX_BUDGET_SEEN_SECONDS),
+                       mapSeenFinalizedBudgets(MAX_BUDGET_SEEN_SECONDS),
+                       mapSeenFinalizedBudgetVotes(MAX_BUDGET_SEEN_SECONDS)
     {
         mapProposals.clear();
         mapFinalizedBudgets.clear();
+        fBudgetCacheValid = false;
+        nFinalizedBudgetMaxSpan = 0;
     }
 
     void ClearSeen()
@@ -247,7 +286,13 @@ public:
     std::string GetMaxRequiredPaymentsString(int nBlockHeight);
     void FillMaxBlockPayee(CMutableTransaction& txNew, CAmount nFees, bool fProofOfStake);
 
-    void CheckOrphanVotes();
+    /// Keep a vote for a proposal or finalized budget we don't know yet, false if it was dropped
+    bool AddOrphanVote(CMAXBudgetVote& vote);
+    bool AddOrphanVote(CMAXFinalizedBudgetVote& vote);
+    /// Apply the orphan votes waiting for a proposal or finalized budget that just arrived
+    void CheckOrphanVotes(const uint256& nHash);
+    /// Rebuild the orphan vote index after the orphan maps were replaced
+    void RebuildOrphanVoteIndex();
     void Clear()
     {
         LOCK(cs);
@@ -261,10 +306,33 @@ public:
         mapSeenFinalizedBudgetVotes.clear();
         mapOrphanMaxnodeBudgetVotes.clear();
         mapOrphanFinalizedBudgetVotes.clear();
+        InvalidateBudgetCache();
+        hashVotesCheckedTip = uint256();
+        mapOrphanBudgetVotesByProposal.clear();
+        mapOrphanFinalizedBudgetVotesByBudget.clear();
+        mapOrphanBudgetVotesByMaxnode.clear();
+        mapOrphanFinalizedBudgetVotesByMaxnode.clear();
+        mapFinalizedBudgetsByStart.clear();
+        nFinalizedBudgetMaxSpan = 0;
     }
     void CheckAndRemove();
     std::string ToString() const;
 
+    /// Rebuild the height index of mapFinalizedBudgets after it was replaced
+    void RebuildFinalizedBudgetIndex();
+
+    /// Drop the cached GetBudget() result, called whenever proposals or their votes change
+    void InvalidateBudgetCache()
+    {
+        fBudgetCacheValid = false;
+        vBudgetCache.clear();
+    }
+
+    /// Append what changed since the last call to the cache journal
+    void WriteJournal(CFlatJournal& journal) const;
+    /// Replace the contents with the entries of the cache journal
+    void ReadJournal(CFlatJournal& journal);
+
 
     ADD_SERIALIZE_METHODS;
 
@@ -280,6 +348,10 @@ public:
 
         READWRITE(mapProposals);
         READWRITE(mapFinalizedBudgets);
+        if (ser_action.ForRead()) {
+            RebuildFinalizedBudgetIndex();
+            RebuildOrphanVoteIndex();
+        }
     }
 };
 
@@ -467,6 +539,14 @@ private:
     mutable CCriticalSection cs;
     CAmount nAlloted;
 
+protected:
+    // running tallies of the valid votes in mapVotes
+    int nYeas;
+    int nNays;
+    int nAbstains;
+
+    void CountVote(const CMAXBudgetVote& vote, int nIncrement);
+
 public:
     bool fValid;
     std::string strProposalName;
@@ -517,14 +597,16 @@ public:
     int GetMaxBlockCurrentCycle();
     int GetMaxBlockEndCycle();
     double GetMaxRatio();
-    int GetMaxYeas();
-    int GetMaxNays();
-    int GetMaxAbstains();
+    int GetMaxYeas() { return nYeas; }
+    int GetMaxNays() { return nNays; }
+    int GetMaxAbstains() { return nAbstains; }
     CAmount GetAmount() { return nAmount; }
     void SetAllotted(CAmount nAllotedIn) { nAlloted = nAllotedIn; }
     CAmount GetAllotted() { return nAlloted; }
 
     void CleanAndRemove(bool fSignatureCheck);
+    /// Rebuild the tallies from mapVotes, for code that changed the votes directly
+    void RecountVotes();
 
     uint256 GetHash()
     {
@@ -558,6 +640,8 @@ public:
 
         //for saving to the serialized db
         READWRITE(mapVotes);
+        if (ser_action.ForRead())
+            RecountVotes();
     }
 };
 
@@ -586,6 +670,9 @@ public:
         swap(first.nTime, second.nTime);
         swap(first.nFeeTXHash, second.nFeeTXHash);
         first.mapVotes.swap(second.mapVotes);
+        swap(first.nYeas, second.nYeas);
+        swap(first.nNays, second.nNays);
+        swap(first.nAbstains, second.nAbstains);
     }
 
     CMAXBudgetProposalBroadcast& operator=(CMAXBudgetProposalBroadcast from)
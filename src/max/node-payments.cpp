@@ -7,6 +7,7 @@
 #include "max/node-payments.h"
 #include "master/node-payments.h"
 #include "addrman.h"
+#include "journal.h"
 #include "max/node-budget.h"
 #include "max/node-sync.h"
 #include "max/nodeman.h"
@@ -30,6 +31,14 @@ CCriticalSection cs_mapMaxnodePayeeVotes;
 // CMaxnodePaymentDB
 //
 
+// maxpayments.dat tables
+enum {
+    MAXPAYMENTSDB_VOTES,
+    MAXPAYMENTSDB_BLOCKS
+};
+
+static CFlatJournal maxpaymentsJournal("maxpayments.dat", "MaxnodePaymentsJournal");
+
 CMaxnodePaymentDB::CMaxnodePaymentDB()
 {
     pathDB = GetDataDir() / "maxpayments.dat";
@@ -40,27 +49,12 @@ bool CMaxnodePaymentDB::Write(const CMaxnodePayments& objToSave)
 {
     int64_t nStart = GetTimeMillis();
 
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssObj(SER_DISK, CLIENT_VERSION);
-    ssObj << strMagicMessage;                   // maxnode cache file specific magic message
-    ssObj << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssObj << objToSave;
-    uint256 hash = Hash(ssObj.begin(), ssObj.end());
-    ssObj << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathDB.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssObj;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
-    }
-    fileout.fclose();
+    // only records that changed since the last write are appended
+    if (!maxpaymentsJournal.OpenForWrite())
+        return false;
+    objToSave.WriteJournal(maxpaymentsJournal);
+    if (!maxpaymentsJournal.Flush())
+        return false;
 
     LogPrint("maxnode","Written info to maxpayments.dat  %dms\n", GetTimeMillis() - nStart);
 
@@ -70,6 +64,41 @@ bool CMaxnodePaymentDB::Write(const CMaxnodePayments& objToSave)
 CMaxnodePaymentDB::ReadResult CMaxnodePaymentDB::Read(CMaxnodePayments& objToLoad, bool fDryRun)
 {
     int64_t nStart = GetTimeMillis();
+
+    CFlatJournal::ReadResult journalResult = maxpaymentsJournal.Open();
+    if (journalResult == CFlatJournal::IncorrectMagicMessage) {
+        // files written before the journal format are converted once
+        ReadResult result = ReadLegacy(objToLoad);
+        if (result != Ok)
+            return result;
+        if (maxpaymentsJournal.Reset()) {
+            objToLoad.WriteJournal(maxpaymentsJournal);
+            maxpaymentsJournal.Flush();
+        }
+    } else if (journalResult == CFlatJournal::FileError) {
+        return FileError;
+    } else if (journalResult == CFlatJournal::IncorrectMagicNumber) {
+        return IncorrectMagicNumber;
+    } else if (journalResult != CFlatJournal::Ok) {
+        return IncorrectFormat;
+    } else {
+        objToLoad.ReadJournal(maxpaymentsJournal);
+    }
+
+    LogPrint("maxnode","Loaded info from maxpayments.dat  %dms\n", GetTimeMillis() - nStart);
+    LogPrint("maxnode","  %s\n", objToLoad.ToString());
+    if (!fDryRun) {
+        LogPrint("maxnode","Maxnode payments manager - cleaning....\n");
+        objToLoad.CleanPaymentList();
+        LogPrint("maxnode","Maxnode payments manager - result:\n");
+        LogPrint("maxnode","  %s\n", objToLoad.ToString());
+    }
+
+    return Ok;
+}
+
+CMaxnodePaymentDB::ReadResult CMaxnodePaymentDB::ReadLegacy(CMaxnodePayments& objToLoad)
+{
     // open input file, and associate with CAutoFile
     FILE* file = fopen(pathDB.string().c_str(), "rb");
     CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
@@ -137,15 +166,6 @@ CMaxnodePaymentDB::ReadResult CMaxnodePaymentDB::Read(CMaxnodePayments& objToLoa
         return IncorrectFormat;
     }
 
-    LogPrint("maxnode","Loaded info from maxpayments.dat  %dms\n", GetTimeMillis() - nStart);
-    LogPrint("maxnode","  %s\n", objToLoad.ToString());
-    if (!fDryRun) {
-        LogPrint("maxnode","Maxnode payments manager - cleaning....\n");
-        objToLoad.CleanPaymentList();
-        LogPrint("maxnode","Maxnode payments manager - result:\n");
-        LogPrint("maxnode","  %s\n", objToLoad.ToString());
-    }
-
     return Ok;
 }
 
@@ -154,28 +174,46 @@ void DumpMaxnodePayments()
     int64_t nStart = GetTimeMillis();
 
     CMaxnodePaymentDB paymentdb;
-    CMaxnodePayments tempPayments;
-
-    LogPrint("maxnode","Verifying maxpayments.dat format...\n");
-    CMaxnodePaymentDB::ReadResult readResult = paymentdb.Read(tempPayments, true);
-    // there was an error and it was not an error on file opening => do not proceed
-    if (readResult == CMaxnodePaymentDB::FileError)
-        LogPrint("maxnode","Missing budgets file - maxpayments.dat, will try to recreate\n");
-    else if (readResult != CMaxnodePaymentDB::Ok) {
-        LogPrint("maxnode","Error reading maxpayments.dat: ");
-        if (readResult == CMaxnodePaymentDB::IncorrectFormat)
-            LogPrint("maxnode","magic is ok but data has invalid format, will try to recreate\n");
-        else {
-            LogPrint("maxnode","file format is unknown or invalid, please fix it manually\n");
-            return;
-        }
-    }
     LogPrint("maxnode","Writting info to maxpayments.dat...\n");
     paymentdb.Write(maxnodePayments);
 
     LogPrint("maxnode","Budget dump finished  %dms\n", GetTimeMillis() - nStart);
 }
 
+void CMaxnodePayments::WriteJournal(CFlatJournal& journal) const
+{
+    LOCK2(cs_mapMaxnodeBlocks, cs_mapMaxnodePayeeVotes);
+
+    journal.WriteMap(MAXPAYMENTSDB_VOTES, mapMaxnodePayeeVotes, true);
+
+    std::set<uint256> setKeys;
+    for (std::map<int, CMaxnodeBlockPayees>::const_iterator it = mapMaxnodeBlocks.begin(); it != mapMaxnodeBlocks.end(); ++it) {
+        uint256 key = (uint64_t)it->first;
+        journal.Write(MAXPAYMENTSDB_BLOCKS, key, it->second);
+        setKeys.insert(key);
+    }
+    journal.EraseMissing(MAXPAYMENTSDB_BLOCKS, setKeys);
+}
+
+void CMaxnodePayments::ReadJournal(CFlatJournal& journal)
+{
+    LOCK2(cs_mapMaxnodeBlocks, cs_mapMaxnodePayeeVotes);
+
+    Clear();
+
+    journal.ReadMap(MAXPAYMENTSDB_VOTES, mapMaxnodePayeeVotes);
+
+    std::vector<uint256> vKeys;
+    journal.GetKeys(MAXPAYMENTSDB_BLOCKS, vKeys);
+    BOOST_FOREACH (const uint256& key, vKeys) {
+        CMaxnodeBlockPayees blockPayees;
+        if (journal.Read(MAXPAYMENTSDB_BLOCKS, key, blockPayees))
+            mapMaxnodeBlocks[blockPayees.nBlockHeight] = blockPayees;
+    }
+
+    RebuildPayeeIndex();
+}
+
 bool IsMaxBlockValueValid(const CBlock& block, CAmount nExpectedValue, CAmount nMinted)
 {
     CBlockIndex* pindexPrev = chainActive.Tip();
@@ -491,14 +529,19 @@ void CMaxnodePayments::ProcessMessageMaxnodePayments(CNode* pfrom, std::string&
     }
 }
 
+std::string CMaxnodePaymentWinner::GetStrMessage() const
+{
+    return vinMaxnode.prevout.ToStringShort() +
+           boost::lexical_cast<std::string>(nBlockHeight) +
+           payee.ToString();
+}
+
 bool CMaxnodePaymentWinner::Sign(CKey& keyMaxnode, CPubKey& pubKeyMaxnode)
 {
     std::string errorMessage;
     std::string strMaxNodeSignMessage;
 
-    std::string strMessage = vinMaxnode.prevout.ToStringShort() +
-                             boost::lexical_cast<std::string>(nBlockHeight) +
-                             payee.ToString();
+    std::string strMessage = GetStrMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, vchSig, keyMaxnode)) {
         LogPrint("maxnode","CMaxnodePing::Sign() - Error: %s\n", errorMessage.c_str());
@@ -538,16 +581,11 @@ bool CMaxnodePayments::IsScheduled(CMaxnode& max, int nNotBlockHeight)
     CScript maxpayee;
     maxpayee = GetScriptForDestination(max.pubKeyCollateralAddress.GetID());
 
-    CScript payee;
-    for (int64_t h = nHeight; h <= nHeight + 8; h++) {
-        if (h == nNotBlockHeight) continue;
-        if (mapMaxnodeBlocks.count(h)) {
-            if (mapMaxnodeBlocks[h].GetPayee(payee)) {
-                if (maxpayee == payee) {
-                    return true;
-                }
-            }
-        }
+    boost::unordered_map<CScript, std::set<int>, ScriptHasher>::const_iterator it = mapPayeeScheduled.find(maxpayee);
+    if (it == mapPayeeScheduled.end()) return false;
+
+    for (std::set<int>::const_iterator itHeight = it->second.lower_bound(nHeight); itHeight != it->second.end() && *itHeight <= nHeight + 8; ++itHeight) {
+        if (*itHeight != nNotBlockHeight) return true;
     }
 
     return false;
@@ -568,6 +606,7 @@ bool CMaxnodePayments::AddWinningMaxnode(CMaxnodePaymentWinner& winnerIn)
         }
 
         mapMaxnodePayeeVotes[winnerIn.GetHash()] = winnerIn;
+        mapVotesByHeight[winnerIn.nBlockHeight].push_back(winnerIn.GetHash());
 
         if (!mapMaxnodeBlocks.count(winnerIn.nBlockHeight)) {
             CMaxnodeBlockPayees blockPayees(winnerIn.nBlockHeight);
@@ -575,11 +614,100 @@ bool CMaxnodePayments::AddWinningMaxnode(CMaxnodePaymentWinner& winnerIn)
         }
     }
 
-    mapMaxnodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payee, 1);
+    {
+        LOCK(cs_mapMaxnodeBlocks);
+        mapMaxnodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payee, 1);
+        IndexBlockPayee(winnerIn.nBlockHeight, winnerIn.payee);
+        ScheduleBlockPayee(winnerIn.nBlockHeight);
+    }
 
     return true;
 }
 
+void CMaxnodePayments::IndexBlockPayee(int nBlockHeight, const CScript& payee)
+{
+    if (mapMaxnodeBlocks[nBlockHeight].HasPayeeWithVotes(payee, MAXPAYMENTS_LASTPAID_VOTES))
+        mapPayeeHeights[payee].insert(nBlockHeight);
+}
+
+void CMaxnodePayments::ScheduleBlockPayee(int nBlockHeight)
+{
+    CScript payee;
+    if (!mapMaxnodeBlocks[nBlockHeight].GetPayee(payee)) return;
+
+    std::map<int, CScript>::iterator it = mapScheduledPayee.find(nBlockHeight);
+    if (it != mapScheduledPayee.end()) {
+        if (it->second == payee) return;
+
+        boost::unordered_map<CScript, std::set<int>, ScriptHasher>::iterator itHeights = mapPayeeScheduled.find(it->second);
+        if (itHeights != mapPayeeScheduled.end()) {
+            itHeights->second.erase(nBlockHeight);
+            if (itHeights->second.empty()) mapPayeeScheduled.erase(itHeights);
+        }
+    }
+
+    mapScheduledPayee[nBlockHeight] = payee;
+    mapPayeeScheduled[payee].insert(nBlockHeight);
+}
+
+void CMaxnodePayments::EraseBlockPayees(int nBlockHeight)
+{
+    std::map<int, CScript>::iterator itScheduled = mapScheduledPayee.find(nBlockHeight);
+    if (itScheduled != mapScheduledPayee.end()) {
+        boost::unordered_map<CScript, std::set<int>, ScriptHasher>::iterator itHeights = mapPayeeScheduled.find(itScheduled->second);
+        if (itHeights != mapPayeeScheduled.end()) {
+            itHeights->second.erase(nBlockHeight);
+            if (itHeights->second.empty()) mapPayeeScheduled.erase(itHeights);
+        }
+        mapScheduledPayee.erase(itScheduled);
+    }
+
+    std::map<int, CMaxnodeBlockPayees>::iterator it = mapMaxnodeBlocks.find(nBlockHeight);
+    if (it == mapMaxnodeBlocks.end()) return;
+
+    BOOST_FOREACH (CMaxnodePayee& payee, it->second.vecPayments) {
+        boost::unordered_map<CScript, std::set<int>, ScriptHasher>::iterator itHeights = mapPayeeHeights.find(payee.scriptPubKey);
+        if (itHeights == mapPayeeHeights.end()) continue;
+        itHeights->second.erase(nBlockHeight);
+        if (itHeights->second.empty()) mapPayeeHeights.erase(itHeights);
+    }
+    mapMaxnodeBlocks.erase(it);
+}
+
+void CMaxnodePayments::RebuildPayeeIndex()
+{
+    LOCK2(cs_mapMaxnodeBlocks, cs_mapMaxnodePayeeVotes);
+
+    mapPayeeHeights.clear();
+    mapPayeeScheduled.clear();
+    mapScheduledPayee.clear();
+    for (std::map<int, CMaxnodeBlockPayees>::iterator it = mapMaxnodeBlocks.begin(); it != mapMaxnodeBlocks.end(); ++it) {
+        BOOST_FOREACH (CMaxnodePayee& payee, it->second.vecPayments)
+            IndexBlockPayee(it->first, payee.scriptPubKey);
+        ScheduleBlockPayee(it->first);
+    }
+
+    mapVotesByHeight.clear();
+    for (std::map<uint256, CMaxnodePaymentWinner>::iterator it = mapMaxnodePayeeVotes.begin(); it != mapMaxnodePayeeVotes.end(); ++it)
+        mapVotesByHeight[it->second.nBlockHeight].push_back(it->first);
+}
+
+bool CMaxnodePayments::GetLastPaidHeight(const CScript& payee, int nMinHeight, int nMaxHeight, int& nHeightRet)
+{
+    LOCK(cs_mapMaxnodeBlocks);
+
+    boost::unordered_map<CScript, std::set<int>, ScriptHasher>::const_iterator it = mapPayeeHeights.find(payee);
+    if (it == mapPayeeHeights.end()) return false;
+
+    std::set<int>::const_iterator itHeight = it->second.upper_bound(nMaxHeight);
+    if (itHeight == it->second.begin()) return false;
+    --itHeight;
+    if (*itHeight < nMinHeight) return false;
+
+    nHeightRet = *itHeight;
+    return true;
+}
+
 bool CMaxnodeBlockPayees::IsTransactionValid(const CTransaction& txNew)
 {
     LOCK(cs_MaxvecPayments);
@@ -699,19 +827,21 @@ void CMaxnodePayments::CleanPaymentList()
     //keep up to five cycles for historical sake
     int nLimit = std::max(int(maxnodeman.size() * 1.25), 1000);
 
-    std::map<uint256, CMaxnodePaymentWinner>::iterator it = mapMaxnodePayeeVotes.begin();
-    while (it != mapMaxnodePayeeVotes.end()) {
-        CMaxnodePaymentWinner winner = (*it).second;
-
-        if (nHeight - winner.nBlockHeight > nLimit) {
-            LogPrint("maxpayments", "CMaxnodePayments::CleanPaymentList - Removing old Maxnode payment - block %d\n", winner.nBlockHeight);
-            maxnodeSync.mapSeenSyncMAXW.erase((*it).first);
-            mapMaxnodePayeeVotes.erase(it++);
-            mapMaxnodeBlocks.erase(winner.nBlockHeight);
-        } else {
-            ++it;
+    // votes are bucketed by height, so only the heights that are dropped are visited
+    while (!mapVotesByHeight.empty() && nHeight - mapVotesByHeight.begin()->first > nLimit) {
+        std::map<int, std::vector<uint256> >::iterator it = mapVotesByHeight.begin();
+        LogPrint("maxpayments", "CMaxnodePayments::CleanPaymentList - Removing old Maxnode payments - block %d\n", it->first);
+        BOOST_FOREACH (const uint256& hash, it->second) {
+            maxnodeSync.mapSeenSyncMAXW.erase(hash);
+            mapMaxnodePayeeVotes.erase(hash);
         }
+        EraseBlockPayees(it->first);
+        mapVotesByHeight.erase(it);
     }
+
+    // and heights nobody voted for
+    while (!mapMaxnodeBlocks.empty() && nHeight - mapMaxnodeBlocks.begin()->first > nLimit)
+        EraseBlockPayees(mapMaxnodeBlocks.begin()->first);
 }
 
 bool CMaxnodePaymentWinner::IsValid(CNode* pnode, std::string& strError)
@@ -831,9 +961,7 @@ bool CMaxnodePaymentWinner::SignatureValid()
     CMaxnode* pmax = maxnodeman.Find(vinMaxnode);
 
     if (pmax != NULL) {
-        std::string strMessage = vinMaxnode.prevout.ToStringShort() +
-                                 boost::lexical_cast<std::string>(nBlockHeight) +
-                                 payee.ToString();
+        std::string strMessage = GetStrMessage();
 
         std::string errorMessage = "";
         if (!obfuScationSigner.VerifyMessage(pmax->pubKeyMaxnode, vchSig, strMessage, errorMessage)) {
@@ -861,14 +989,12 @@ void CMaxnodePayments::Sync(CNode* node, int nCountNeeded)
     if (nCountNeeded > nCount) nCountNeeded = nCount;
 
     int nInvCount = 0;
-    std::map<uint256, CMaxnodePaymentWinner>::iterator it = mapMaxnodePayeeVotes.begin();
-    while (it != mapMaxnodePayeeVotes.end()) {
-        CMaxnodePaymentWinner winner = (*it).second;
-        if (winner.nBlockHeight >= nHeight - nCountNeeded && winner.nBlockHeight <= nHeight + 20) {
-            node->PushInventory(CInv(MSG_MAXNODE_WINNER, winner.GetHash()));
+    std::map<int, std::vector<uint256> >::const_iterator it = mapVotesByHeight.lower_bound(nHeight - nCountNeeded);
+    for (; it != mapVotesByHeight.end() && it->first <= nHeight + 20; ++it) {
+        BOOST_FOREACH (const uint256& hash, it->second) {
+            node->PushInventory(CInv(MSG_MAXNODE_WINNER, hash));
             nInvCount++;
         }
-        ++it;
     }
     node->PushMessage("smaxsc", MAXNODE_SYNC_MAXW, nInvCount);
 }
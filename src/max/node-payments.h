@@ -10,6 +10,7 @@
 #include "key.h"
 #include "main.h"
 #include "max/node.h"
+#include "nodeindex.h"
 #include <boost/lexical_cast.hpp>
 
 using namespace std;
@@ -19,6 +20,7 @@ extern CCriticalSection cs_mapMaxnodeBlocks;
 extern CCriticalSection cs_mapMaxnodePayeeVotes;
 
 class CMaxnodePayments;
+class CFlatJournal;
 class CMaxnodePaymentWinner;
 class CMaxnodeBlockPayees;
 
@@ -26,6 +28,7 @@ extern CMaxnodePayments maxnodePayments;
 
 #define MAXPAYMENTS_SIGNATURES_REQUIRED 6
 #define MAXPAYMENTS_SIGNATURES_TOTAL 10
+#define MAXPAYMENTS_LASTPAID_VOTES 2
 
 void ProcessMessageMaxnodePayments(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 bool IsMaxBlockPayeeValid(const CBlock& block, int nBlockHeight);
@@ -35,7 +38,7 @@ void FillMaxBlockPayee(CMutableTransaction& txNew, CAmount nFees, bool fProofOfS
 
 void DumpMaxnodePayments();
 
-/** Save Maxnode Payment Data (maxpayments.dat)
+/** Save Maxnode Payment Data (maxpayments.dat), kept as a CFlatJournal
  */
 class CMaxnodePaymentDB
 {
@@ -57,6 +60,10 @@ public:
     CMaxnodePaymentDB();
     bool Write(const CMaxnodePayments& objToSave);
     ReadResult Read(CMaxnodePayments& objToLoad, bool fDryRun = false);
+
+private:
+    /// Files written before the journal format, serialized as a whole
+    ReadResult ReadLegacy(CMaxnodePayments& objToLoad);
 };
 
 class CMaxnodePayee
@@ -196,6 +203,7 @@ public:
     bool Sign(CKey& keyMaxnode, CPubKey& pubKeyMaxnode);
     bool IsValid(CNode* pnode, std::string& strError);
     bool SignatureValid();
+    std::string GetStrMessage() const;
     void Relay();
 
     void AddPayee(CScript payeeIn)
@@ -237,6 +245,21 @@ private:
     int nSyncedFromPeer;
     int nLastBlockHeight;
 
+    // payee -> heights in mapMaxnodeBlocks where it has at least MAXPAYMENTS_LASTPAID_VOTES votes
+    boost::unordered_map<CScript, std::set<int>, ScriptHasher> mapPayeeHeights;
+
+    // payee -> heights in mapMaxnodeBlocks where it has the most votes, and the other way around
+    boost::unordered_map<CScript, std::set<int>, ScriptHasher> mapPayeeScheduled;
+    std::map<int, CScript> mapScheduledPayee;
+
+    // height -> hashes of the votes for it in mapMaxnodePayeeVotes, protected by cs_mapMaxnodePayeeVotes
+    std::map<int, std::vector<uint256> > mapVotesByHeight;
+
+    void IndexBlockPayee(int nBlockHeight, const CScript& payee);
+    void ScheduleBlockPayee(int nBlockHeight);
+    void EraseBlockPayees(int nBlockHeight);
+    void RebuildPayeeIndex();
+
 public:
     std::map<uint256, CMaxnodePaymentWinner> mapMaxnodePayeeVotes;
     std::map<int, CMaxnodeBlockPayees> mapMaxnodeBlocks;
@@ -253,6 +276,10 @@ public:
         LOCK2(cs_mapMaxnodeBlocks, cs_mapMaxnodePayeeVotes);
         mapMaxnodeBlocks.clear();
         mapMaxnodePayeeVotes.clear();
+        mapPayeeHeights.clear();
+        mapPayeeScheduled.clear();
+        mapScheduledPayee.clear();
+        mapVotesByHeight.clear();
     }
 
     bool AddWinningMaxnode(CMaxnodePaymentWinner& winner);
@@ -265,6 +292,8 @@ public:
     bool GetBlockPayee(int nBlockHeight, CScript& payee);
     bool IsTransactionValid(const CTransaction& txNew, int nBlockHeight);
     bool IsScheduled(CMaxnode& max, int nNotBlockHeight);
+    /// Most recent height in [nMinHeight, nMaxHeight] where payee was voted in
+    bool GetLastPaidHeight(const CScript& payee, int nMinHeight, int nMaxHeight, int& nHeightRet);
 
     bool CanVote(COutPoint outMaxnode, int nBlockHeight)
     {
@@ -286,6 +315,11 @@ public:
     std::string GetMaxRequiredPaymentsString(int nBlockHeight);
     void FillMaxBlockPayee(CMutableTransaction& txNew, int64_t nFees, bool fProofOfStake, bool fZPIVStake);
     std::string ToString() const;
+
+    /// Append what changed since the last call to the cache journal
+    void WriteJournal(CFlatJournal& journal) const;
+    /// Replace the contents with the entries of the cache journal
+    void ReadJournal(CFlatJournal& journal);
     int GetOldestBlock();
     int GetNewestBlock();
 
@@ -296,6 +330,9 @@ public:
     {
         READWRITE(mapMaxnodePayeeVotes);
         READWRITE(mapMaxnodeBlocks);
+
+        if (ser_action.ForRead())
+            RebuildPayeeIndex();
     }
 };
 
@@ -20,7 +20,7 @@
 class CMaxnodeSync;
 CMaxnodeSync maxnodeSync;
 
-CMaxnodeSync::CMaxnodeSync()
+CMaxnodeSync::CMaxnodeSync() : mapSeenSyncMAXB(MAXNODE_SYNC_SEEN_SECONDS), mapSeenSyncMAXW(MAXNODE_SYNC_SEEN_SECONDS), mapSeenSyncBudget(MAXNODE_SYNC_SEEN_SECONDS)
 {
     Reset();
 }
@@ -63,6 +63,8 @@ bool CMaxnodeSync::IsBlockchainSynced()
 
 void CMaxnodeSync::Reset()
 {
+    LOCK(cs);
+
     lastMaxnodeList = 0;
     lastMaxnodeWinner = 0;
     mapSeenSyncMAXB.clear();
@@ -74,9 +76,13 @@ void CMaxnodeSync::Reset()
     sumMaxnodeWinner = 0;
     countMaxnodeList = 0;
     countMaxnodeWinner = 0;
+    countMaxnodeListDelta = 0;
     RequestedMaxnodeAssets = MAXNODE_SYNC_INITIAL;
     RequestedMaxnodeAttempt = 0;
     nAssetSyncStarted = GetTime();
+    nAssetSyncStartedMillis = GetTimeMillis();
+    for (int i = 0; i <= MAXNODE_SYNC_BUDGET; i++)
+        nStageMillis[i] = -1;
 }
 
 void CMaxnodeSync::AddedMaxnodeList(uint256 hash)
@@ -92,6 +98,22 @@ void CMaxnodeSync::AddedMaxnodeList(uint256 hash)
     }
 }
 
+void CMaxnodeSync::AddedMaxnodeListPage(int nCount, bool fLast)
+{
+    LOCK(cs);
+
+    if (RequestedMaxnodeAssets != MAXNODE_SYNC_LIST) return;
+
+    sumMaxnodeList += nCount;
+    if (fLast) {
+        countMaxnodeList++;
+        countMaxnodeListDelta++;
+
+        // enough peers may have sent everything now
+        CheckAsset();
+    }
+}
+
 void CMaxnodeSync::AddedMaxnodeWinner(uint256 hash)
 {
     if (maxnodePayments.mapMaxnodePayeeVotes.count(hash)) {
@@ -107,6 +129,14 @@ void CMaxnodeSync::AddedMaxnodeWinner(uint256 hash)
 
 void CMaxnodeSync::GetNextAsset()
 {
+    LOCK(cs);
+
+    int64_t nNow = GetTimeMillis();
+    if (RequestedMaxnodeAssets > MAXNODE_SYNC_INITIAL && RequestedMaxnodeAssets <= MAXNODE_SYNC_BUDGET) {
+        nStageMillis[RequestedMaxnodeAssets] = nNow - nAssetSyncStartedMillis;
+        LogPrint("maxnode", "CMaxnodeSync::GetNextAsset - %s took %d ms\n", GetAssetName(RequestedMaxnodeAssets), nStageMillis[RequestedMaxnodeAssets]);
+    }
+
     switch (RequestedMaxnodeAssets) {
     case (MAXNODE_SYNC_INITIAL):
     case (MAXNODE_SYNC_FAILED): // should never be used here actually, use Reset() instead
@@ -125,6 +155,35 @@ void CMaxnodeSync::GetNextAsset()
     }
     RequestedMaxnodeAttempt = 0;
     nAssetSyncStarted = GetTime();
+    nAssetSyncStartedMillis = nNow;
+}
+
+std::string CMaxnodeSync::GetAssetName(int nAsset)
+{
+    switch (nAsset) {
+    case MAXNODE_SYNC_INITIAL:
+        return "MAXNODE_SYNC_INITIAL";
+    case MAXNODE_SYNC_SPORKS:
+        return "MAXNODE_SYNC_SPORKS";
+    case MAXNODE_SYNC_LIST:
+        return "MAXNODE_SYNC_LIST";
+    case MAXNODE_SYNC_MAXW:
+        return "MAXNODE_SYNC_MAXW";
+    case MAXNODE_SYNC_BUDGET:
+        return "MAXNODE_SYNC_BUDGET";
+    case MAXNODE_SYNC_FAILED:
+        return "MAXNODE_SYNC_FAILED";
+    case MAXNODE_SYNC_FINISHED:
+        return "MAXNODE_SYNC_FINISHED";
+    }
+    return "UNKNOWN";
+}
+
+int64_t CMaxnodeSync::GetStageMillis(int nAsset)
+{
+    if (nAsset < MAXNODE_SYNC_SPORKS || nAsset > MAXNODE_SYNC_BUDGET) return -1;
+    if (nAsset == RequestedMaxnodeAssets) return GetTimeMillis() - nAssetSyncStartedMillis;
+    return nStageMillis[nAsset];
 }
 
 std::string CMaxnodeSync::GetSyncStatus()
@@ -153,6 +212,7 @@ void CMaxnodeSync::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataSt
         int nCount;
         vRecv >> nItemID >> nCount;
 
+        LOCK(cs);
         if (RequestedMaxnodeAssets >= MAXNODE_SYNC_FINISHED) return;
 
         //this means we will receive no further communication
@@ -170,6 +230,9 @@ void CMaxnodeSync::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataSt
         }
 
         LogPrint("maxnode", "CMaxnodeSync:ProcessMessage - smaxsc - got inventory count %d %d\n", nItemID, nCount);
+
+        // enough peers may have sent everything now
+        CheckAsset();
     }
 }
 
@@ -179,34 +242,41 @@ void CMaxnodeSync::ClearFulfilledRequest()
     if (!lockRecv) return;
 
     BOOST_FOREACH (CNode* pnode, vNodes) {
-        pnode->ClearFulfilledRequest("getspork");
+        pnode->ClearFulfilledRequest("getmaxspork");
         pnode->ClearFulfilledRequest("maxsync");
         pnode->ClearFulfilledRequest("maxwsync");
-        pnode->ClearFulfilledRequest("busync");
+        pnode->ClearFulfilledRequest("maxbusync");
     }
 }
 
 void CMaxnodeSync::Process()
 {
     static int tick = 0;
+    static bool fWasSynced = false;
 
-    if (tick++ % MAXNODE_SYNC_TIMEOUT != 0) return;
+    tick++;
 
-    if (IsSynced()) {
-        /* 
+    // the last stage can complete on a peer message, try to activate our maxnode as soon as we're synced
+    bool fSynced = IsSynced();
+    if (fSynced && !fWasSynced) activeMaxnode.ManageStatus();
+    fWasSynced = fSynced;
+
+    if (fSynced) {
+        /*
             Resync if we lose all maxnodes from sleep/wake or failure to sync originally
         */
-        if (maxnodeman.CountEnabled() == 0) {
-            Reset();
-        } else
-            return;
+        if (tick % MAXNODE_SYNC_TIMEOUT != 0 || maxnodeman.CountEnabled() > 0) return;
+        Reset();
     }
 
     //try syncing again
-    if (RequestedMaxnodeAssets == MAXNODE_SYNC_FAILED && lastFailure + (1 * 60) < GetTime()) {
-        Reset();
-    } else if (RequestedMaxnodeAssets == MAXNODE_SYNC_FAILED) {
-        return;
+    {
+        LOCK(cs);
+        if (RequestedMaxnodeAssets == MAXNODE_SYNC_FAILED && lastFailure + (1 * 60) < GetTime()) {
+            Reset();
+        } else if (RequestedMaxnodeAssets == MAXNODE_SYNC_FAILED) {
+            return;
+        }
     }
 
     LogPrint("maxnode", "CMaxnodeSync::Process() - tick %d RequestedMaxnodeAssets %d\n", tick, RequestedMaxnodeAssets);
@@ -217,144 +287,141 @@ void CMaxnodeSync::Process()
     if (Params().NetworkID() != CBaseChainParams::REGTEST &&
         !IsBlockchainSynced() && RequestedMaxnodeAssets > MAXNODE_SYNC_SPORKS) return;
 
+    if (Params().NetworkID() == CBaseChainParams::REGTEST) {
+        if (tick % MAXNODE_SYNC_TIMEOUT != 0) return;
+
+        LOCK(cs);
+        TRY_LOCK(cs_vNodes, lockRecv);
+        if (!lockRecv || vNodes.empty()) return;
+
+        CNode* pnode = vNodes.front();
+        if (RequestedMaxnodeAttempt <= 2) {
+            pnode->PushMessage("getsporks"); //get current network sporks
+        } else if (RequestedMaxnodeAttempt < 4) {
+            maxnodeman.DsegUpdate(pnode);
+        } else if (RequestedMaxnodeAttempt < 6) {
+            int nMnCount = maxnodeman.CountEnabled();
+            pnode->PushMessage("maxget", nMnCount); //sync payees
+            uint256 n = 0;
+            pnode->PushMessage("maxvs", n); //sync maxnode votes
+        } else {
+            RequestedMaxnodeAssets = MAXNODE_SYNC_FINISHED;
+        }
+        RequestedMaxnodeAttempt++;
+        return;
+    }
+
+    CheckAsset();
+    RequestAssets();
+}
+
+void CMaxnodeSync::CheckAsset()
+{
+    LOCK(cs);
+
+    // nothing was asked for yet, so nothing can be late either
+    if (RequestedMaxnodeAttempt == 0) return;
+
+    int64_t nNow = GetTime();
+    int64_t nLastItem = 0;
+    int nPeersDone = 0;
+    bool fNoItems = false;
+
+    switch (RequestedMaxnodeAssets) {
+    case (MAXNODE_SYNC_SPORKS):
+        // sporks are sent right away and aren't counted, give the first peers a moment to answer
+        if (RequestedMaxnodeAttempt >= MAXNODE_SYNC_THRESHOLD && nNow - nAssetSyncStarted >= MAXNODE_SYNC_TIMEOUT) GetNextAsset();
+        return;
+    case (MAXNODE_SYNC_LIST):
+        nLastItem = lastMaxnodeList;
+        nPeersDone = countMaxnodeList;
+        // delta syncs only send what we're missing, on a warm restart that may be pings only
+        fNoItems = countMaxnodeListDelta >= MAXNODE_SYNC_THRESHOLD && nLastItem == 0;
+        break;
+    case (MAXNODE_SYNC_MAXW):
+        nLastItem = lastMaxnodeWinner;
+        nPeersDone = countMaxnodeWinner;
+        break;
+    case (MAXNODE_SYNC_BUDGET):
+        // budget items aren't counted for maxnodes, the budget stage keeps asking peers
+        return;
+    default:
+        return;
+    }
+
+    // enough peers told us they sent everything and the items they announced are in,
+    // or nothing new arrived for a while
+    bool fPeersDone = nPeersDone >= MAXNODE_SYNC_THRESHOLD && (fNoItems || (nLastItem > 0 && nLastItem < nNow - MAXNODE_SYNC_TIMEOUT));
+    bool fQuiet = nLastItem > 0 && nLastItem < nNow - MAXNODE_SYNC_TIMEOUT * 2 && RequestedMaxnodeAttempt >= MAXNODE_SYNC_THRESHOLD;
+    if (fPeersDone || fQuiet) {
+        GetNextAsset();
+        return;
+    }
+
+    // timeout
+    if (nLastItem == 0 && nNow - nAssetSyncStarted > MAXNODE_SYNC_TIMEOUT * 5) {
+        if (RequestedMaxnodeAssets != MAXNODE_SYNC_BUDGET && IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
+            LogPrintf("CMaxnodeSync::Process - ERROR - Sync has failed, will retry later\n");
+            RequestedMaxnodeAssets = MAXNODE_SYNC_FAILED;
+            RequestedMaxnodeAttempt = 0;
+            lastFailure = nNow;
+            nCountFailures++;
+        } else {
+            // nothing to enforce, or maybe there are no budgets at all, so just move on
+            GetNextAsset();
+        }
+    }
+}
+
+void CMaxnodeSync::RequestAssets()
+{
+    LOCK(cs);
+
+    if (RequestedMaxnodeAssets < MAXNODE_SYNC_SPORKS || RequestedMaxnodeAssets > MAXNODE_SYNC_BUDGET) return;
+
+    // a batch of peers right away, then one more every MAXNODE_SYNC_TIMEOUT seconds until the stage completes
+    int nAllowed = MAXNODE_SYNC_PEERS;
+    if (RequestedMaxnodeAttempt > 0)
+        nAllowed += (GetTime() - nAssetSyncStarted) / MAXNODE_SYNC_TIMEOUT;
+    nAllowed = std::min(nAllowed, MAXNODE_SYNC_THRESHOLD * 3);
+    if (RequestedMaxnodeAttempt >= nAllowed) return;
+
+    int nMnCount = RequestedMaxnodeAssets == MAXNODE_SYNC_MAXW ? maxnodeman.CountEnabled() : 0;
+
     TRY_LOCK(cs_vNodes, lockRecv);
     if (!lockRecv) return;
 
     BOOST_FOREACH (CNode* pnode, vNodes) {
-        if (Params().NetworkID() == CBaseChainParams::REGTEST) {
-            if (RequestedMaxnodeAttempt <= 2) {
-                pnode->PushMessage("getsporks"); //get current network sporks
-            } else if (RequestedMaxnodeAttempt < 4) {
-                maxnodeman.DsegUpdate(pnode);
-            } else if (RequestedMaxnodeAttempt < 6) {
-                int nMnCount = maxnodeman.CountEnabled();
-                pnode->PushMessage("maxget", nMnCount); //sync payees
-                uint256 n = 0;
-                pnode->PushMessage("maxvs", n); //sync maxnode votes
-            } else {
-                RequestedMaxnodeAssets = MAXNODE_SYNC_FINISHED;
-            }
-            RequestedMaxnodeAttempt++;
-            return;
-        }
+        if (RequestedMaxnodeAttempt >= nAllowed) return;
 
-        //set to synced
         if (RequestedMaxnodeAssets == MAXNODE_SYNC_SPORKS) {
-            if (pnode->HasFulfilledRequest("getspork")) continue;
-            pnode->FulfilledRequest("getspork");
+            if (pnode->HasFulfilledRequest("getmaxspork")) continue;
+            pnode->FulfilledRequest("getmaxspork");
 
             pnode->PushMessage("getsporks"); //get current network sporks
-            if (RequestedMaxnodeAttempt >= 2) GetNextAsset();
-            RequestedMaxnodeAttempt++;
-
-            return;
-        }
-
-        if (pnode->nVersion >= maxnodePayments.GetMinMaxnodePaymentsProto()) {
-            if (RequestedMaxnodeAssets == MAXNODE_SYNC_LIST) {
-                LogPrint("maxnode", "CMaxnodeSync::Process() - lastMaxnodeList %lld (GetTime() - MAXNODE_SYNC_TIMEOUT) %lld\n", lastMaxnodeList, GetTime() - MAXNODE_SYNC_TIMEOUT);
-                if (lastMaxnodeList > 0 && lastMaxnodeList < GetTime() - MAXNODE_SYNC_TIMEOUT * 2 && RequestedMaxnodeAttempt >= MAXNODE_SYNC_THRESHOLD) { //hasn't received a new item in the last five seconds, so we'll move to the
-                    GetNextAsset();
-                    return;
-                }
-
-                if (pnode->HasFulfilledRequest("maxsync")) continue;
-                pnode->FulfilledRequest("maxsync");
-
-                // timeout
-                if (lastMaxnodeList == 0 &&
-                    (RequestedMaxnodeAttempt >= MAXNODE_SYNC_THRESHOLD * 3 || GetTime() - nAssetSyncStarted > MAXNODE_SYNC_TIMEOUT * 5)) {
-                    if (IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
-                        LogPrintf("CMaxnodeSync::Process - ERROR - Sync has failed, will retry later\n");
-                        RequestedMaxnodeAssets = MAXNODE_SYNC_FAILED;
-                        RequestedMaxnodeAttempt = 0;
-                        lastFailure = GetTime();
-                        nCountFailures++;
-                    } else {
-                        GetNextAsset();
-                    }
-                    return;
-                }
-
-                if (RequestedMaxnodeAttempt >= MAXNODE_SYNC_THRESHOLD * 3) return;
-
-                maxnodeman.DsegUpdate(pnode);
-                RequestedMaxnodeAttempt++;
-                return;
-            }
-
-            if (RequestedMaxnodeAssets == MAXNODE_SYNC_MAXW) {
-                if (lastMaxnodeWinner > 0 && lastMaxnodeWinner < GetTime() - MAXNODE_SYNC_TIMEOUT * 2 && RequestedMaxnodeAttempt >= MAXNODE_SYNC_THRESHOLD) { //hasn't received a new item in the last five seconds, so we'll move to the
-                    GetNextAsset();
-                    return;
-                }
-
-                if (pnode->HasFulfilledRequest("maxwsync")) continue;
-                pnode->FulfilledRequest("maxwsync");
-
-                // timeout
-                if (lastMaxnodeWinner == 0 &&
-                    (RequestedMaxnodeAttempt >= MAXNODE_SYNC_THRESHOLD * 3 || GetTime() - nAssetSyncStarted > MAXNODE_SYNC_TIMEOUT * 5)) {
-                    if (IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
-                        LogPrintf("CMaxnodeSync::Process - ERROR - Sync has failed, will retry later\n");
-                        RequestedMaxnodeAssets = MAXNODE_SYNC_FAILED;
-                        RequestedMaxnodeAttempt = 0;
-                        lastFailure = GetTime();
-                        nCountFailures++;
-                    } else {
-                        GetNextAsset();
-                    }
-                    return;
-                }
-
-                if (RequestedMaxnodeAttempt >= MAXNODE_SYNC_THRESHOLD * 3) return;
-
-                CBlockIndex* pindexPrev = chainActive.Tip();
-                if (pindexPrev == NULL) return;
-
-                int nMnCount = maxnodeman.CountEnabled();
-                pnode->PushMessage("maxget", nMnCount); //sync payees
-                RequestedMaxnodeAttempt++;
-
-                return;
-            }
+        } else if (RequestedMaxnodeAssets == MAXNODE_SYNC_LIST) {
+            if (pnode->nVersion < maxnodePayments.GetMinMaxnodePaymentsProto()) continue;
+            if (pnode->HasFulfilledRequest("maxsync")) continue;
+            pnode->FulfilledRequest("maxsync");
+
+            maxnodeman.DsegUpdate(pnode);
+        } else if (RequestedMaxnodeAssets == MAXNODE_SYNC_MAXW) {
+            if (pnode->nVersion < maxnodePayments.GetMinMaxnodePaymentsProto()) continue;
+            if (pnode->HasFulfilledRequest("maxwsync")) continue;
+            pnode->FulfilledRequest("maxwsync");
+
+            pnode->PushMessage("maxget", nMnCount); //sync payees
+        } else {
+            if (pnode->nVersion < ActiveProtocol()) continue;
+            if (pnode->HasFulfilledRequest("maxbusync")) continue;
+            pnode->FulfilledRequest("maxbusync");
+
+            uint256 n = 0;
+            pnode->PushMessage("maxvs", n); //sync maxnode votes
         }
 
-        if (pnode->nVersion >= ActiveProtocol()) {
-            if (RequestedMaxnodeAssets == MAXNODE_SYNC_BUDGET) {
-                
-                // We'll start rejecting votes if we accidentally get set as synced too soon
-                /**if (lastBudgetItem > 0 && lastBudgetItem < GetTime() - MAXNODE_SYNC_TIMEOUT * 2 && RequestedMaxnodeAttempt >= MAXNODE_SYNC_THRESHOLD) { 
-                    
-                    // Hasn't received a new item in the last five seconds, so we'll move to the
-                    GetNextAsset();
-
-                    // Try to activate our maxnode if possible
-                    activeMaxnode.ManageStatus();
-
-                    return;
-                }
-
-                // timeout
-                if (lastBudgetItem == 0 &&
-                    (RequestedMaxnodeAttempt >= MAXNODE_SYNC_THRESHOLD * 3 || GetTime() - nAssetSyncStarted > MAXNODE_SYNC_TIMEOUT * 5)) {
-                    // maybe there is no budgets at all, so just finish syncing
-                    GetNextAsset();
-                    activeMaxnode.ManageStatus();
-                    return;
-                }**/
-
-                if (pnode->HasFulfilledRequest("busync")) continue;
-                pnode->FulfilledRequest("busync");
-
-                if (RequestedMaxnodeAttempt >= MAXNODE_SYNC_THRESHOLD * 3) return;
-
-                uint256 n = 0;
-                pnode->PushMessage("maxvs", n); //sync maxnode votes
-                RequestedMaxnodeAttempt++;
-
-                return;
-            }
-        }
+        // the wait for the blockchain doesn't count against the timeouts
+        if (RequestedMaxnodeAttempt == 0) nAssetSyncStarted = GetTime();
+        RequestedMaxnodeAttempt++;
     }
 }
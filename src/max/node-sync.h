@@ -7,6 +7,9 @@
 #ifndef MAXNODE_SYNC_H
 #define MAXNODE_SYNC_H
 
+#include "seencache.h"
+#include "sync.h"
+
 #define MAXNODE_SYNC_INITIAL 0
 #define MAXNODE_SYNC_SPORKS 1
 #define MAXNODE_SYNC_LIST 2
@@ -19,6 +22,10 @@
 
 #define MAXNODE_SYNC_TIMEOUT 5
 #define MAXNODE_SYNC_THRESHOLD 2
+// peers an asset is requested from at once, more are asked every MAXNODE_SYNC_TIMEOUT seconds
+#define MAXNODE_SYNC_PEERS 4
+// seconds an item counts towards the sync of its asset
+#define MAXNODE_SYNC_SEEN_SECONDS (60 * 60)
 
 class CMaxnodeSync;
 extern CMaxnodeSync maxnodeSync;
@@ -30,9 +37,9 @@ extern CMaxnodeSync maxnodeSync;
 class CMaxnodeSync
 {
 public:
-    std::map<uint256, int> mapSeenSyncMAXB;
-    std::map<uint256, int> mapSeenSyncMAXW;
-    std::map<uint256, int> mapSeenSyncBudget;
+    CSeenCache<int> mapSeenSyncMAXB;
+    CSeenCache<int> mapSeenSyncMAXW;
+    CSeenCache<int> mapSeenSyncBudget;
 
     int64_t lastMaxnodeList;
     int64_t lastMaxnodeWinner;
@@ -45,19 +52,32 @@ public:
     // peers that reported counts
     int countMaxnodeList;
     int countMaxnodeWinner;
+    // peers that finished a delta list sync
+    int countMaxnodeListDelta;
 
     // Count peers we've requested the list from
     int RequestedMaxnodeAssets;
     int RequestedMaxnodeAttempt;
 
-    // Time when current maxnode asset sync started
+    // Time when current maxnode asset sync started, or when it was first requested
     int64_t nAssetSyncStarted;
+    int64_t nAssetSyncStartedMillis;
+    // Milliseconds each finished stage took, -1 for stages that haven't run
+    int64_t nStageMillis[MAXNODE_SYNC_BUDGET + 1];
+
+    // Stage changes are triggered by peer messages as well as by Process()
+    CCriticalSection cs;
 
     CMaxnodeSync();
 
     void AddedMaxnodeList(uint256 hash);
+    void AddedMaxnodeListPage(int nCount, bool fLast);
     void AddedMaxnodeWinner(uint256 hash);
     void GetNextAsset();
+    void CheckAsset();
+    void RequestAssets();
+    std::string GetAssetName(int nAsset);
+    int64_t GetStageMillis(int nAsset);
     std::string GetSyncStatus();
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 
@@ -17,48 +17,22 @@
 
 // keep track of the scanning errors I've seen
 map<uint256, int> mapSeenMaxnodeScanningErrors;
-// cache block hashes as we calculate them
-std::map<int64_t, uint256> mapMaxCacheBlockHashes;
-
-//Get the last hash that matches the modulus given. Processed in reverse order
+// Get the hash of the block before nBlockHeight on the active chain, of the tip for heights below 0.
 bool GetMaxBlockHash(uint256& hash, int nBlockHeight)
 {
-    if (chainActive.Tip() == NULL) return false;
+    int nTipHeight = chainActiveHashes.Height();
+    if (nTipHeight <= 0) return false;
 
     if (nBlockHeight == 0)
-        nBlockHeight = chainActive.Tip()->nHeight;
-
-    if (mapMaxCacheBlockHashes.count(nBlockHeight)) {
-        hash = mapMaxCacheBlockHashes[nBlockHeight];
-        return true;
-    }
+        nBlockHeight = nTipHeight;
+    if (nBlockHeight > nTipHeight + 1) return false;
 
-    const CBlockIndex* BlockLastSolved = chainActive.Tip();
-    const CBlockIndex* BlockReading = chainActive.Tip();
+    // the genesis block is never used
+    int nHeight = nBlockHeight > 0 ? nBlockHeight - 1 : nTipHeight;
+    if (nHeight <= 0) return false;
 
-    if (BlockLastSolved == NULL || BlockLastSolved->nHeight == 0 || chainActive.Tip()->nHeight + 1 < nBlockHeight) return false;
-
-    int nBlocksAgo = 0;
-    if (nBlockHeight > 0) nBlocksAgo = (chainActive.Tip()->nHeight + 1) - nBlockHeight;
-    assert(nBlocksAgo >= 0);
-
-    int n = 0;
-    for (unsigned int i = 1; BlockReading && BlockReading->nHeight > 0; i++) {
-        if (n >= nBlocksAgo) {
-            hash = BlockReading->GetMaxBlockHash();
-            mapMaxCacheBlockHashes[nBlockHeight] = hash;
-            return true;
-        }
-        n++;
-
-        if (BlockReading->pprev == NULL) {
-            assert(BlockReading);
-            break;
-        }
-        BlockReading = BlockReading->pprev;
-    }
-
-    return false;
+    // callers may hold the node manager lock, which is taken after cs_main elsewhere
+    return chainActiveHashes.Get(nHeight, hash);
 }
 
 CMaxnode::CMaxnode()
@@ -164,12 +138,11 @@ bool CMaxnode::UpdateFromNewBroadcast(CMaxnodeBroadcast& maxb)
 // the proof of work for that block. The further away they are the better, the furthest will win the election
 // and get paid this block
 //
-uint256 CMaxnode::CalculateScore(int mod, int64_t nBlockHeight)
+uint256 CMaxnode::CalculateScore(int mod, int64_t nBlockHeight) const
 {
     if (chainActive.Tip() == NULL) return 0;
 
     uint256 hash = 0;
-    uint256 aux = maxvin.prevout.hash + maxvin.prevout.n;
 
     if (!GetMaxBlockHash(hash, nBlockHeight)) {
         LogPrint("maxnode","CalculateScore ERROR - nHeight %d - Returned 0\n", nBlockHeight);
@@ -180,12 +153,23 @@ uint256 CMaxnode::CalculateScore(int mod, int64_t nBlockHeight)
     ss << hash;
     uint256 hash2 = ss.GetHash();
 
+    return CalculateScore(hash, hash2);
+}
+
+//
+// Same as above for a known block hash and its hash, which only depend on the height and
+// can be computed once when scoring the whole list
+//
+uint256 CMaxnode::CalculateScore(const uint256& hashBlock, const uint256& hashBlockHashed) const
+{
+    uint256 aux = maxvin.prevout.hash + maxvin.prevout.n;
+
     CHashWriter ss2(SER_GETHASH, PROTOCOL_VERSION);
-    ss2 << hash;
+    ss2 << hashBlock;
     ss2 << aux;
     uint256 hash3 = ss2.GetHash();
 
-    uint256 r = (hash3 > hash2 ? hash3 - hash2 : hash2 - hash3);
+    uint256 r = (hash3 > hashBlockHashed ? hash3 - hashBlockHashed : hashBlockHashed - hash3);
 
     return r;
 }
@@ -218,33 +202,40 @@ void CMaxnode::Check(bool forceCheck)
     }
 
     if (!unitTest) {
-        CValidationState state;
-        CMutableTransaction tx = CMutableTransaction();
-        //CTxOut vout = CTxOut((((MAXNODE_T1_COLLATERAL_AMOUNT - 0.01) || (MAXNODE_T2_COLLATERAL_AMOUNT - 0.01) || (MAXNODE_T3_COLLATERAL_AMOUNT - 0.01)) * COIN), obfuScationPool.collateralPubKey);
-        CTxOut vout = CTxOut((MAXNODE_COLLATERAL_AMOUNT - 0.01) * COIN, obfuScationPool.collateralPubKey);
-        tx.vin.push_back(maxvin);
-        tx.vout.push_back(vout);
-
-        {
-            TRY_LOCK(cs_main, lockMain);
-            if (!lockMain) return;
-
-            if (!AcceptableInputs(mempool, state, CTransaction(tx), false, NULL)) {
-                activeState = MAXNODE_VIN_SPENT;
-                return;
-            }
+        TRY_LOCK(cs_main, lockMain);
+        if (!lockMain) return;
+
+        CTxOut txout;
+        int nHeight, nConfirmations;
+        if (!GetUTXOCoin(maxvin.prevout, txout, nHeight, nConfirmations) ||
+            txout.nValue < (MAXNODE_COLLATERAL_AMOUNT - 0.01) * COIN) {
+            activeState = MAXNODE_VIN_SPENT;
+            return;
         }
     }
 
     activeState = MAXNODE_ENABLED; // OK
 }
 
-int64_t CMaxnode::SecondsSincePayment()
+int64_t CMaxnode::GetNextStateChange() const
 {
-    CScript pubkeyScript;
-    pubkeyScript = GetScriptForDestination(pubKeyCollateralAddress.GetID());
+    // once spent, the state never changes again
+    if (activeState == MAXNODE_VIN_SPENT || lastPing == CMaxnodePing()) return 0;
+
+    int64_t now = GetAdjustedTime();
+    if (now < lastPing.sigTime + MAXNODE_EXPIRATION_SECONDS) {
+        // a recent ping but not enabled means Check() couldn't get cs_main, try again soon
+        if (activeState != MAXNODE_ENABLED && activeState != MAXNODE_PRE_ENABLED) return now + MAXNODE_CHECK_SECONDS;
+        return lastPing.sigTime + MAXNODE_EXPIRATION_SECONDS;
+    }
+    if (now < lastPing.sigTime + MAXNODE_REMOVAL_SECONDS) return lastPing.sigTime + MAXNODE_REMOVAL_SECONDS;
+
+    return 0;
+}
 
-    int64_t sec = (GetAdjustedTime() - GetLastPaid());
+int64_t CMaxnode::SecondsSincePayment(int nEnabledCount)
+{
+    int64_t sec = (GetAdjustedTime() - GetLastPaid(nEnabledCount));
     int64_t month = 60 * 60 * 24 * 30;
     if (sec < month) return sec; //if it's less than 30 days, give seconds
 
@@ -257,7 +248,7 @@ int64_t CMaxnode::SecondsSincePayment()
     return month + hash.GetCompact(false);
 }
 
-int64_t CMaxnode::GetLastPaid()
+int64_t CMaxnode::GetLastPaid(int nEnabledCount) const
 {
     CBlockIndex* pindexPrev = chainActive.Tip();
     if (pindexPrev == NULL) return false;
@@ -273,39 +264,21 @@ int64_t CMaxnode::GetLastPaid()
     // use a deterministic offset to break a tie -- 2.5 minutes
     int64_t nOffset = hash.GetCompact(false) % 150;
 
-    if (chainActive.Tip() == NULL) return false;
+    if (nEnabledCount == -1) nEnabledCount = maxnodeman.CountEnabled();
+    int nMnCount = nEnabledCount * 1.25;
 
-    const CBlockIndex* BlockReading = chainActive.Tip();
+    /*
+        Search the last nMnCount blocks for this payee, with at least 2 votes. This will aid in consensus allowing
+        the network to converge on the same payees quickly, then keep the same schedule.
+    */
+    int nPaidHeight;
+    int nMinHeight = std::max(1, pindexPrev->nHeight - nMnCount + 1);
+    if (!maxnodePayments.GetLastPaidHeight(maxpayee, nMinHeight, pindexPrev->nHeight, nPaidHeight)) return 0;
 
-    int nMnCount = maxnodeman.CountEnabled() * 1.25;
-    int n = 0;
-    for (unsigned int i = 1; BlockReading && BlockReading->nHeight > 0; i++) {
-        if (n >= nMnCount) {
-            return 0;
-        }
-        n++;
-
-        if (maxnodePayments.mapMaxnodeBlocks.count(BlockReading->nHeight)) {
-            /*
-                Search for this payee, with at least 2 votes. This will aid in consensus allowing the network
-                to converge on the same payees quickly, then keep the same schedule.
-            */
-            if (maxnodePayments.mapMaxnodeBlocks[BlockReading->nHeight].HasPayeeWithVotes(maxpayee, 2)) {
-                return BlockReading->nTime + nOffset;
-            }
-        }
-
-        if (BlockReading->pprev == NULL) {
-            assert(BlockReading);
-            break;
-        }
-        BlockReading = BlockReading->pprev;
-    }
-
-    return 0;
+    return chainActive[nPaidHeight]->nTime + nOffset;
 }
 
-std::string CMaxnode::GetStatus()
+std::string CMaxnode::GetStatus() const
 {
     switch (nActiveState) {
     case CMaxnode::MAXNODE_PRE_ENABLED:
@@ -559,7 +532,8 @@ bool CMaxnodeBroadcast::CheckAndUpdate(int& nDos)
         //take the newest entry
         LogPrint("maxnode","maxb - Got updated entry for %s\n", maxvin.prevout.hash.ToString());
         if (pmax->UpdateFromNewBroadcast((*this))) {
-            pmax->Check();
+            maxnodeman.ReindexMaxnode(*pmax);
+            maxnodeman.CheckMaxnode(*pmax);
             if (pmax->IsEnabled()) Relay();
         }
         maxnodeSync.AddedMaxnodeList(GetHash());
@@ -590,13 +564,6 @@ bool CMaxnodeBroadcast::CheckInputsAndAdd(int& nDoS)
             maxnodeman.Remove(pmax->maxvin);
     }
 
-    CValidationState state;
-    CMutableTransaction tx = CMutableTransaction();
-    //CTxOut vout = CTxOut((((MAXNODE_T1_COLLATERAL_AMOUNT - 0.01) || (MAXNODE_T2_COLLATERAL_AMOUNT - 0.01) || (MAXNODE_T3_COLLATERAL_AMOUNT - 0.01)) * COIN), obfuScationPool.collateralPubKey);
-    CTxOut vout = CTxOut((MAXNODE_COLLATERAL_AMOUNT - 0.01) * COIN, obfuScationPool.collateralPubKey);
-    tx.vin.push_back(maxvin);
-    tx.vout.push_back(vout);
-
     {
         TRY_LOCK(cs_main, lockMain);
         if (!lockMain) {
@@ -606,32 +573,32 @@ bool CMaxnodeBroadcast::CheckInputsAndAdd(int& nDoS)
             return false;
         }
 
-        if (!AcceptableInputs(mempool, state, CTransaction(tx), false, NULL)) {
-            //set nDos
-            state.IsInvalid(nDoS);
+        // a single lookup in the UTXO set, the mempool has no say over a collateral
+        CTxOut txout;
+        int nHeight, nConfirmations;
+        if (!GetUTXOCoin(maxvin.prevout, txout, nHeight, nConfirmations)) {
+            LogPrint("maxnode", "maxb - Collateral %s is spent or unknown\n", maxvin.prevout.ToString());
+            return false;
+        }
+        if (txout.nValue < (MAXNODE_COLLATERAL_AMOUNT - 0.01) * COIN) {
+            LogPrint("maxnode", "maxb - Collateral %s is too small\n", maxvin.prevout.ToString());
+            nDoS = 100;
             return false;
         }
-    }
 
-    LogPrint("maxnode", "maxb - Accepted Maxnode entry\n");
+        LogPrint("maxnode", "maxb - Accepted Maxnode entry\n");
 
-    if (GetInputAge(maxvin) < MAXNODE_MIN_CONFIRMATIONS) {
-        LogPrint("maxnode","maxb - Input must have at least %d confirmations\n", MAXNODE_MIN_CONFIRMATIONS);
-        // maybe we miss few blocks, let this maxb to be checked again later
-        maxnodeman.mapSeenMaxnodeBroadcast.erase(GetHash());
-        maxnodeSync.mapSeenSyncMAXB.erase(GetHash());
-        return false;
-    }
+        if (nConfirmations < MAXNODE_MIN_CONFIRMATIONS) {
+            LogPrint("maxnode","maxb - Input must have at least %d confirmations\n", MAXNODE_MIN_CONFIRMATIONS);
+            // maybe we miss few blocks, let this maxb to be checked again later
+            maxnodeman.mapSeenMaxnodeBroadcast.erase(GetHash());
+            maxnodeSync.mapSeenSyncMAXB.erase(GetHash());
+            return false;
+        }
 
-    // verify that sig time is legit in past
-    // should be at least not earlier than block when 1000 LYTX tx got MAXNODE_MIN_CONFIRMATIONS
-    uint256 hashBlock = 0;
-    CTransaction tx2;
-    GetTransaction(maxvin.prevout.hash, tx2, hashBlock, true);
-    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
-    if (mi != mapBlockIndex.end() && (*mi).second) {
-        CBlockIndex* pMNIndex = (*mi).second;                                                        // block for 1000 LYTX tx -> 1 confirmation
-        CBlockIndex* pConfIndex = chainActive[pMNIndex->nHeight + MAXNODE_MIN_CONFIRMATIONS - 1]; // block where tx got MAXNODE_MIN_CONFIRMATIONS
+        // verify that sig time is legit in past
+        // should be at least not earlier than block when 1000 LYTX tx got MAXNODE_MIN_CONFIRMATIONS
+        CBlockIndex* pConfIndex = chainActive[nHeight + MAXNODE_MIN_CONFIRMATIONS - 1]; // block where tx got MAXNODE_MIN_CONFIRMATIONS
         if (pConfIndex->GetBlockTime() > sigTime) {
             LogPrint("maxnode","maxb - Bad sigTime %d for Maxnode %s (%i conf block is at %d)\n",
                 sigTime, maxvin.prevout.hash.ToString(), MAXNODE_MIN_CONFIRMATIONS, pConfIndex->GetBlockTime());
@@ -731,13 +698,18 @@ CMaxnodePing::CMaxnodePing(CTxIn& newVin)
 }
 
 
+std::string CMaxnodePing::GetStrMessage() const
+{
+    return maxvin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+}
+
 bool CMaxnodePing::Sign(CKey& keyMaxnode, CPubKey& pubKeyMaxnode)
 {
     std::string errorMessage;
     std::string strMaxNodeSignMessage;
 
     sigTime = GetAdjustedTime();
-    std::string strMessage = maxvin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+    std::string strMessage = GetStrMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, vchSig, keyMaxnode)) {
         LogPrint("maxnode","CMaxnodePing::Sign() - Error: %s\n", errorMessage);
@@ -753,7 +725,7 @@ bool CMaxnodePing::Sign(CKey& keyMaxnode, CPubKey& pubKeyMaxnode)
 }
 
 bool CMaxnodePing::VerifySignature(CPubKey& pubKeyMaxnode, int &nDos) {
-	std::string strMessage = maxvin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+	std::string strMessage = GetStrMessage();
 	std::string errorMessage = "";
 
 	if(!obfuScationSigner.VerifyMessage(pubKeyMaxnode, vchSig, strMessage, errorMessage)){
@@ -823,7 +795,7 @@ bool CMaxnodePing::CheckAndUpdate(int& nDos, bool fRequireEnabled, bool fCheckSi
                 maxnodeman.mapSeenMaxnodeBroadcast[hash].lastPing = *this;
             }
 
-            pmax->Check(true);
+            maxnodeman.CheckMaxnode(*pmax, true);
             if (!pmax->IsEnabled()) return false;
 
             LogPrint("maxnode", "CMaxnodePing::CheckAndUpdate - Maxnode ping accepted, maxvin: %s\n", maxvin.prevout.hash.ToString());
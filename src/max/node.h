@@ -31,7 +31,6 @@ class CMaxnodeT2;
 class CMaxnodeT3;
 class CMaxnodeBroadcast;
 class CMaxnodePing;
-extern map<int64_t, uint256> mapMaxCacheBlockHashes;
 
 bool GetMaxBlockHash(uint256& hash, int nBlockHeight);
 
@@ -66,6 +65,7 @@ public:
     bool CheckAndUpdate(int& nDos, bool fRequireEnabled = true, bool fCheckSigTimeOnly = false);
     bool Sign(CKey& keyMaxnode, CPubKey& pubKeyMaxnode);
     bool VerifySignature(CPubKey& pubKeyMaxnode, int &nDos);
+    std::string GetStrMessage() const;
     void Relay();
 
     uint256 GetHash()
@@ -195,7 +195,8 @@ public:
         return !(a.maxvin == b.maxvin);
     }
 
-    uint256 CalculateScore(int mod = 1, int64_t nBlockHeight = 0);
+    uint256 CalculateScore(int mod = 1, int64_t nBlockHeight = 0) const;
+    uint256 CalculateScore(const uint256& hashBlock, const uint256& hashBlockHashed) const;
 
     ADD_SERIALIZE_METHODS;
 
@@ -222,7 +223,7 @@ public:
         READWRITE(nLastScanningErrorBlockHeight);
     }
 
-    int64_t SecondsSincePayment();
+    int64_t SecondsSincePayment(int nEnabledCount = -1);
 
     bool UpdateFromNewBroadcast(CMaxnodeBroadcast& maxb);
 
@@ -235,6 +236,9 @@ public:
 
     void Check(bool forceCheck = false);
 
+    /// Adjusted time at which Check() changes the state without a new message, 0 if never
+    int64_t GetNextStateChange() const;
+
     bool IsBroadcastedWithin(int seconds)
     {
         return (GetAdjustedTime() - sigTime) < seconds;
@@ -253,7 +257,7 @@ public:
         lastPing = CMaxnodePing();
     }
 
-    bool IsEnabled()
+    bool IsEnabled() const
     {
         return activeState == MAXNODE_ENABLED;
     }
@@ -270,9 +274,9 @@ public:
         return cacheInputAge + (chainActive.Tip()->nHeight - cacheInputAgeBlock);
     }
 
-    std::string GetStatus();
+    std::string GetStatus() const;
 
-    std::string Status()
+    std::string Status() const
     {
         std::string strStatus = "ACTIVE";
 
@@ -285,7 +289,7 @@ public:
         return strStatus;
     }
 
-    int64_t GetLastPaid();
+    int64_t GetLastPaid(int nEnabledCount = -1) const;
     bool IsValidNetAddr();
 };
 
@@ -7,6 +7,7 @@
 #include "max/nodeman.h"
 #include "max/activenode.h"
 #include "addrman.h"
+#include "journal.h"
 #include "max/node.h"
 #include "obfuscation.h"
 #include "spork.h"
@@ -14,7 +15,6 @@
 #include <boost/filesystem.hpp>
 #include <boost/lexical_cast.hpp>
 
-#define MAX_WINNER_MINIMUM_AGE 8000    // Age in seconds. This should be > MAXNODE_REMOVAL_SECONDS to avoid misconfigured new nodes in the list.
 
 /** Maxnode manager */
 CMaxnodeMan maxnodeman;
@@ -27,26 +27,30 @@ struct CompareLastPaid {
     }
 };
 
-struct CompareScoreTxIn {
-    bool operator()(const pair<int64_t, CTxIn>& t1,
-        const pair<int64_t, CTxIn>& t2) const
-    {
-        return t1.first < t2.first;
-    }
-};
+int CMaxnodeTraits::GetMinPaymentsProto()
+{
+    return maxnodePayments.GetMinMaxnodePaymentsProto();
+}
 
-struct CompareScoreMAX {
-    bool operator()(const pair<int64_t, CMaxnode>& t1,
-        const pair<int64_t, CMaxnode>& t2) const
-    {
-        return t1.first < t2.first;
-    }
-};
+bool CMaxnodeTraits::IsMinAgeEnforced()
+{
+    return IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT);
+}
 
 //
 // CMaxnodeDB
 //
 
+// maxcache.dat tables
+enum {
+    MAXCACHE_STATE,
+    MAXCACHE_MAXNODES,
+    MAXCACHE_SEEN_BROADCASTS,
+    MAXCACHE_SEEN_PINGS
+};
+
+static CFlatJournal maxcacheJournal("maxcache.dat", "MaxnodeCacheJournal");
+
 CMaxnodeDB::CMaxnodeDB()
 {
     pathMAX = GetDataDir() / "maxcache.dat";
@@ -57,28 +61,12 @@ bool CMaxnodeDB::Write(const CMaxnodeMan& maxnodemanToSave)
 {
     int64_t nStart = GetTimeMillis();
 
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssMaxnodes(SER_DISK, CLIENT_VERSION);
-    ssMaxnodes << strMagicMessage;                   // maxnode cache file specific magic message
-    ssMaxnodes << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssMaxnodes << maxnodemanToSave;
-    uint256 hash = Hash(ssMaxnodes.begin(), ssMaxnodes.end());
-    ssMaxnodes << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathMAX.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathMAX.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssMaxnodes;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
-    }
-    //    FileCommit(fileout);
-    fileout.fclose();
+    // only records that changed since the last write are appended
+    if (!maxcacheJournal.OpenForWrite())
+        return false;
+    maxnodemanToSave.WriteJournal(maxcacheJournal);
+    if (!maxcacheJournal.Flush())
+        return false;
 
     LogPrint("maxnode","Written info to maxcache.dat  %dms\n", GetTimeMillis() - nStart);
     LogPrint("maxnode","  %s\n", maxnodemanToSave.ToString());
@@ -89,6 +77,41 @@ bool CMaxnodeDB::Write(const CMaxnodeMan& maxnodemanToSave)
 CMaxnodeDB::ReadResult CMaxnodeDB::Read(CMaxnodeMan& maxnodemanToLoad, bool fDryRun)
 {
     int64_t nStart = GetTimeMillis();
+
+    CFlatJournal::ReadResult journalResult = maxcacheJournal.Open();
+    if (journalResult == CFlatJournal::IncorrectMagicMessage) {
+        // files written before the journal format are converted once
+        ReadResult result = ReadLegacy(maxnodemanToLoad);
+        if (result != Ok)
+            return result;
+        if (maxcacheJournal.Reset()) {
+            maxnodemanToLoad.WriteJournal(maxcacheJournal);
+            maxcacheJournal.Flush();
+        }
+    } else if (journalResult == CFlatJournal::FileError) {
+        return FileError;
+    } else if (journalResult == CFlatJournal::IncorrectMagicNumber) {
+        return IncorrectMagicNumber;
+    } else if (journalResult != CFlatJournal::Ok) {
+        return IncorrectFormat;
+    } else {
+        maxnodemanToLoad.ReadJournal(maxcacheJournal);
+    }
+
+    LogPrint("maxnode","Loaded info from maxcache.dat  %dms\n", GetTimeMillis() - nStart);
+    LogPrint("maxnode","  %s\n", maxnodemanToLoad.ToString());
+    if (!fDryRun) {
+        LogPrint("maxnode","Maxnode manager - cleaning....\n");
+        maxnodemanToLoad.CheckAndRemove(true);
+        LogPrint("maxnode","Maxnode manager - result:\n");
+        LogPrint("maxnode","  %s\n", maxnodemanToLoad.ToString());
+    }
+
+    return Ok;
+}
+
+CMaxnodeDB::ReadResult CMaxnodeDB::ReadLegacy(CMaxnodeMan& maxnodemanToLoad)
+{
     // open input file, and associate with CAutoFile
     FILE* file = fopen(pathMAX.string().c_str(), "rb");
     CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
@@ -155,15 +178,6 @@ CMaxnodeDB::ReadResult CMaxnodeDB::Read(CMaxnodeMan& maxnodemanToLoad, bool fDry
         return IncorrectFormat;
     }
 
-    LogPrint("maxnode","Loaded info from maxcache.dat  %dms\n", GetTimeMillis() - nStart);
-    LogPrint("maxnode","  %s\n", maxnodemanToLoad.ToString());
-    if (!fDryRun) {
-        LogPrint("maxnode","Maxnode manager - cleaning....\n");
-        maxnodemanToLoad.CheckAndRemove(true);
-        LogPrint("maxnode","Maxnode manager - result:\n");
-        LogPrint("maxnode","  %s\n", maxnodemanToLoad.ToString());
-    }
-
     return Ok;
 }
 
@@ -172,29 +186,62 @@ void DumpMaxnodes()
     int64_t nStart = GetTimeMillis();
 
     CMaxnodeDB maxdb;
-    CMaxnodeMan tempMnodeman;
-
-    LogPrint("maxnode","Verifying maxcache.dat format...\n");
-    CMaxnodeDB::ReadResult readResult = maxdb.Read(tempMnodeman, true);
-    // there was an error and it was not an error on file opening => do not proceed
-    if (readResult == CMaxnodeDB::FileError)
-        LogPrint("maxnode","Missing maxnode cache file - maxcache.dat, will try to recreate\n");
-    else if (readResult != CMaxnodeDB::Ok) {
-        LogPrint("maxnode","Error reading maxcache.dat: ");
-        if (readResult == CMaxnodeDB::IncorrectFormat)
-            LogPrint("maxnode","magic is ok but data has invalid format, will try to recreate\n");
-        else {
-            LogPrint("maxnode","file format is unknown or invalid, please fix it manually\n");
-            return;
-        }
-    }
     LogPrint("maxnode","Writting info to maxcache.dat...\n");
     maxdb.Write(maxnodeman);
 
     LogPrint("maxnode","Maxnode dump finished  %dms\n", GetTimeMillis() - nStart);
 }
 
-CMaxnodeMan::CMaxnodeMan()
+void CMaxnodeMan::WriteJournal(CFlatJournal& journal) const
+{
+    LOCK(cs);
+
+    CDataStream ssState(SER_DISK, CLIENT_VERSION);
+    ssState << mAskedUsForMaxnodeList << mWeAskedForMaxnodeList << mWeAskedForMaxnodeListEntry << nDsqCount;
+    journal.WriteRecord(MAXCACHE_STATE, 0, ssState);
+
+    std::set<uint256> setKeys;
+    BOOST_FOREACH (const CMaxnode& max, vMaxnodes) {
+        uint256 key = SerializeHash(max.maxvin.prevout);
+        journal.Write(MAXCACHE_MAXNODES, key, max);
+        setKeys.insert(key);
+    }
+    journal.EraseMissing(MAXCACHE_MAXNODES, setKeys);
+
+    // seen broadcasts and pings aren't kept across restarts, drop what older versions stored
+    journal.EraseMissing(MAXCACHE_SEEN_BROADCASTS, std::set<uint256>());
+    journal.EraseMissing(MAXCACHE_SEEN_PINGS, std::set<uint256>());
+}
+
+void CMaxnodeMan::ReadJournal(CFlatJournal& journal)
+{
+    LOCK(cs);
+
+    Clear();
+
+    CDataStream ssState(SER_DISK, CLIENT_VERSION);
+    if (journal.ReadRecord(MAXCACHE_STATE, 0, ssState)) {
+        try {
+            ssState >> mAskedUsForMaxnodeList >> mWeAskedForMaxnodeList >> mWeAskedForMaxnodeListEntry >> nDsqCount;
+        } catch (std::exception& e) {
+            LogPrint("maxnode", "CMaxnodeMan::ReadJournal - invalid state record\n");
+        }
+    }
+
+    std::vector<uint256> vKeys;
+    journal.GetKeys(MAXCACHE_MAXNODES, vKeys);
+    BOOST_FOREACH (const uint256& key, vKeys) {
+        CMaxnode max;
+        if (journal.Read(MAXCACHE_MAXNODES, key, max))
+            vMaxnodes.push_back(max);
+    }
+
+    tier.Rebuild(vMaxnodes);
+}
+
+CMaxnodeMan::CMaxnodeMan() : filterPingMessages(MAXNODE_PING_FILTER_SIZE, MAXNODE_PING_FILTER_FP_RATE),
+                             mapSeenMaxnodeBroadcast(MAXNODE_REMOVAL_SECONDS * 2),
+                             mapSeenMaxnodePing(MAXNODE_REMOVAL_SECONDS * 2)
 {
     nDsqCount = 0;
 }
@@ -210,6 +257,7 @@ bool CMaxnodeMan::Add(CMaxnode& max)
     if (pmax == NULL) {
         LogPrint("maxnode", "CMaxnodeMan: Adding new Maxnode %s - %i now\n", max.maxvin.prevout.hash.ToString(), size() + 1);
         vMaxnodes.push_back(max);
+        tier.Added(vMaxnodes);
         return true;
     }
 
@@ -235,10 +283,20 @@ void CMaxnodeMan::AskForMAX(CNode* pnode, CTxIn& maxvin)
 void CMaxnodeMan::Check()
 {
     LOCK(cs);
+    tier.CheckDue(vMaxnodes);
+}
 
-    BOOST_FOREACH (CMaxnode& max, vMaxnodes) {
-        max.Check();
-    }
+void CMaxnodeMan::CheckMaxnode(CMaxnode& max, bool forceCheck)
+{
+    LOCK(cs);
+    max.Check(forceCheck);
+    tier.Schedule(max);
+}
+
+void CMaxnodeMan::TryCheckDue()
+{
+    TRY_LOCK(cs, lockList);
+    if (lockList) tier.CheckDue(vMaxnodes);
 }
 
 void CMaxnodeMan::CheckAndRemove(bool forceExpiredRemoval)
@@ -247,19 +305,20 @@ void CMaxnodeMan::CheckAndRemove(bool forceExpiredRemoval)
 
     LOCK(cs);
 
-    //remove inactive and outdated
+    //remove inactive and outdated, the others move up in the same order and the indexes are rebuilt once
+    vector<CMaxnode>::iterator itKept = vMaxnodes.begin();
     vector<CMaxnode>::iterator it = vMaxnodes.begin();
     while (it != vMaxnodes.end()) {
         if ((*it).activeState == CMaxnode::MAXNODE_REMOVE ||
             (*it).activeState == CMaxnode::MAXNODE_VIN_SPENT ||
             (forceExpiredRemoval && (*it).activeState == CMaxnode::MAXNODE_EXPIRED) ||
             (*it).protocolVersion < maxnodePayments.GetMinMaxnodePaymentsProto()) {
-            LogPrint("maxnode", "CMaxnodeMan: Removing inactive Maxnode %s - %i now\n", (*it).maxvin.prevout.hash.ToString(), size() - 1);
+            LogPrint("maxnode", "CMaxnodeMan: Removing inactive Maxnode %s - %i now\n", (*it).maxvin.prevout.hash.ToString(), size() - 1 - (int)(it - itKept));
 
             //erase all of the broadcasts we've seen from this maxvin
             // -- if we missed a few pings and the node was removed, this will allow is to get it back without them
             //    sending a brand new maxb
-            map<uint256, CMaxnodeBroadcast>::iterator it3 = mapSeenMaxnodeBroadcast.begin();
+            CSeenCache<CMaxnodeBroadcast>::iterator it3 = mapSeenMaxnodeBroadcast.begin();
             while (it3 != mapSeenMaxnodeBroadcast.end()) {
                 if ((*it3).second.maxvin == (*it).maxvin) {
                     maxnodeSync.mapSeenSyncMAXB.erase((*it3).first);
@@ -278,11 +337,16 @@ void CMaxnodeMan::CheckAndRemove(bool forceExpiredRemoval)
                     ++it2;
                 }
             }
-
-            it = vMaxnodes.erase(it);
         } else {
-            ++it;
+            if (itKept != it) *itKept = *it;
+            ++itKept;
         }
+        ++it;
+    }
+
+    if (itKept != vMaxnodes.end()) {
+        vMaxnodes.erase(itKept, vMaxnodes.end());
+        tier.Rebuild(vMaxnodes);
     }
 
     // check who's asked for the Maxnode list
@@ -305,6 +369,24 @@ void CMaxnodeMan::CheckAndRemove(bool forceExpiredRemoval)
         }
     }
 
+    // drop delta list syncs that were abandoned halfway
+    map<CNetAddr, std::pair<int64_t, CNodeListCursor> >::iterator itDelta = mAskedUsForMaxnodeListDelta.begin();
+    while (itDelta != mAskedUsForMaxnodeListDelta.end()) {
+        if ((*itDelta).second.first < GetTime()) {
+            mAskedUsForMaxnodeListDelta.erase(itDelta++);
+        } else {
+            ++itDelta;
+        }
+    }
+    itDelta = mWeAskedForMaxnodeListDelta.begin();
+    while (itDelta != mWeAskedForMaxnodeListDelta.end()) {
+        if ((*itDelta).second.first < GetTime()) {
+            mWeAskedForMaxnodeListDelta.erase(itDelta++);
+        } else {
+            ++itDelta;
+        }
+    }
+
     // check which Maxnodes we've asked for
     map<COutPoint, int64_t>::iterator it2 = mWeAskedForMaxnodeListEntry.begin();
     while (it2 != mWeAskedForMaxnodeListEntry.end()) {
@@ -315,79 +397,70 @@ void CMaxnodeMan::CheckAndRemove(bool forceExpiredRemoval)
         }
     }
 
-    // remove expired mapSeenMaxnodeBroadcast
-    map<uint256, CMaxnodeBroadcast>::iterator it3 = mapSeenMaxnodeBroadcast.begin();
-    while (it3 != mapSeenMaxnodeBroadcast.end()) {
-        if ((*it3).second.lastPing.sigTime < GetTime() - (MAXNODE_REMOVAL_SECONDS * 2)) {
-            mapSeenMaxnodeBroadcast.erase(it3++);
-            maxnodeSync.mapSeenSyncMAXB.erase((*it3).second.GetHash());
-        } else {
-            ++it3;
-        }
-    }
+    // forget the broadcasts and pings that haven't been relayed for a while
+    mapSeenMaxnodeBroadcast.Expire();
+    mapSeenMaxnodePing.Expire();
 
-    // remove expired mapSeenMaxnodePing
-    map<uint256, CMaxnodePing>::iterator it4 = mapSeenMaxnodePing.begin();
-    while (it4 != mapSeenMaxnodePing.end()) {
-        if ((*it4).second.sigTime < GetTime() - (MAXNODE_REMOVAL_SECONDS * 2)) {
-            mapSeenMaxnodePing.erase(it4++);
-        } else {
-            ++it4;
-        }
-    }
+    // readers only publish when the list isn't busy, so keep the snapshot from lagging behind
+    if (tier.IsSnapshotStale()) tier.Publish(vMaxnodes);
 }
 
 void CMaxnodeMan::Clear()
 {
     LOCK(cs);
     vMaxnodes.clear();
+    tier.Clear();
     mAskedUsForMaxnodeList.clear();
     mWeAskedForMaxnodeList.clear();
+    mAskedUsForMaxnodeListDelta.clear();
+    mWeAskedForMaxnodeListDelta.clear();
     mWeAskedForMaxnodeListEntry.clear();
     mapSeenMaxnodeBroadcast.clear();
     mapSeenMaxnodePing.clear();
     nDsqCount = 0;
+
+    LOCK(cs_filterPingMessages);
+    filterPingMessages.reset();
 }
 
-int CMaxnodeMan::stable_size ()
+bool CMaxnodeMan::IsPingMessageSeen(const CDataStream& vRecv)
 {
-    int nStable_size = 0;
-    int nMinProtocol = ActiveProtocol();
-    int64_t nMaxnode_Min_Age = MAX_WINNER_MINIMUM_AGE;
-    int64_t nMaxnode_Age = 0;
+    uint256 hash = Hash(vRecv.begin(), vRecv.end());
 
-    BOOST_FOREACH (CMaxnode& max, vMaxnodes) {
-        if (max.protocolVersion < nMinProtocol) {
-            continue; // Skip obsolete versions
-        }
-        if (IsSporkActive (SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
-            nMaxnode_Age = GetAdjustedTime() - max.sigTime;
-            if ((nMaxnode_Age) < nMaxnode_Min_Age) {
-                continue; // Skip maxnodes younger than (default) 8000 sec (MUST be > MAXNODE_REMOVAL_SECONDS)
-            }
-        }
-        max.Check ();
-        if (!max.IsEnabled ())
-            continue; // Skip not-enabled maxnodes
+    LOCK(cs_filterPingMessages);
+    if (filterPingMessages.contains(hash)) return true;
+    filterPingMessages.insert(hash);
+    return false;
+}
 
-        nStable_size++;
-    }
+bool CMaxnodeMan::IsPingTooEarly(const CMaxnodePing& maxp)
+{
+    TRY_LOCK(cs, lockList);
+    if (!lockList) return false;
 
-    return nStable_size;
+    CMaxnode* pmax = Find(maxp.maxvin);
+    return pmax != NULL && pmax->IsPingedWithin(MAXNODE_MIN_MAXP_SECONDS - 60, maxp.sigTime);
 }
 
-int CMaxnodeMan::CountEnabled(int protocolVersion)
+void CMaxnodeMan::SporkChanged(int nSporkID, int64_t nValue)
 {
-    int i = 0;
-    protocolVersion = protocolVersion == -1 ? maxnodePayments.GetMinMaxnodePaymentsProto() : protocolVersion;
+    // the rankings skip young maxnodes while payments are enforced
+    if (nSporkID != SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT) return;
 
-    BOOST_FOREACH (CMaxnode& max, vMaxnodes) {
-        max.Check();
-        if (max.protocolVersion < protocolVersion || !max.IsEnabled()) continue;
-        i++;
-    }
+    LOCK(cs);
+    tier.ClearRankings();
+}
 
-    return i;
+int CMaxnodeMan::stable_size ()
+{
+    TryCheckDue();
+    return tier.StableSize(vMaxnodes);
+}
+
+int CMaxnodeMan::CountEnabled(int protocolVersion)
+{
+    TryCheckDue();
+    return tier.CountEnabled(protocolVersion);
 }
 
 void CMaxnodeMan::CountNetworks(int protocolVersion, int& ipv4, int& ipv6, int& onion)
@@ -395,7 +468,6 @@ void CMaxnodeMan::CountNetworks(int protocolVersion, int& ipv4, int& ipv6, int&
     protocolVersion = protocolVersion == -1 ? maxnodePayments.GetMinMaxnodePaymentsProto() : protocolVersion;
 
     BOOST_FOREACH (CMaxnode& max, vMaxnodes) {
-        max.Check();
         std::string strHost;
         int port;
         SplitHostPort(max.addr.ToString(), port, strHost);
@@ -431,7 +503,20 @@ void CMaxnodeMan::DsegUpdate(CNode* pnode)
         }
     }
 
-    pnode->PushMessage("dmaxseg", CTxIn());
+    if (pnode->nVersion >= MNLIST_DELTA_VERSION) {
+        // only ask for what changed since our newest ping, leaving some slack for
+        // pings that were still on their way when we went down
+        int64_t nSince = 0;
+        BOOST_FOREACH (CMaxnode& max, vMaxnodes)
+            nSince = std::max(nSince, max.lastPing.sigTime);
+        nSince = std::max((int64_t)0, std::min(nSince, GetAdjustedTime()) - MAXNODE_PING_SECONDS);
+
+        CNodeListCursor cursor(nSince, tier.GetListHash(vMaxnodes));
+        pnode->PushMessage("dmaxsegd", cursor);
+        mWeAskedForMaxnodeListDelta[pnode->addr] = std::make_pair(GetTime() + MAXNODES_DELTA_PAGE_SECONDS, cursor);
+    } else {
+        pnode->PushMessage("dmaxseg", CTxIn());
+    }
     int64_t askAgain = GetTime() + MAXNODES_DSEG_SECONDS;
     mWeAskedForMaxnodeList[pnode->addr] = askAgain;
 }
@@ -439,37 +524,26 @@ void CMaxnodeMan::DsegUpdate(CNode* pnode)
 CMaxnode* CMaxnodeMan::Find(const CScript& payee)
 {
     LOCK(cs);
-    CScript payee2;
-
-    BOOST_FOREACH (CMaxnode& max, vMaxnodes) {
-        payee2 = GetScriptForDestination(max.pubKeyCollateralAddress.GetID());
-        if (payee2 == payee)
-            return &max;
-    }
-    return NULL;
+    return tier.Find(vMaxnodes, payee);
 }
 
 CMaxnode* CMaxnodeMan::Find(const CTxIn& maxvin)
 {
     LOCK(cs);
-
-    BOOST_FOREACH (CMaxnode& max, vMaxnodes) {
-        if (max.maxvin.prevout == maxvin.prevout)
-            return &max;
-    }
-    return NULL;
+    return tier.Find(vMaxnodes, maxvin.prevout);
 }
 
 
 CMaxnode* CMaxnodeMan::Find(const CPubKey& pubKeyMaxnode)
 {
     LOCK(cs);
+    return tier.Find(vMaxnodes, pubKeyMaxnode);
+}
 
-    BOOST_FOREACH (CMaxnode& max, vMaxnodes) {
-        if (max.pubKeyMaxnode == pubKeyMaxnode)
-            return &max;
-    }
-    return NULL;
+void CMaxnodeMan::ReindexMaxnode(const CMaxnode& max)
+{
+    LOCK(cs);
+    tier.Updated(vMaxnodes, max);
 }
 
 //
@@ -488,7 +562,6 @@ CMaxnode* CMaxnodeMan::GetNextMaxnodeInQueueForPayment(int nBlockHeight, bool fF
 
     int nMnCount = CountEnabled();
     BOOST_FOREACH (CMaxnode& max, vMaxnodes) {
-        max.Check();
         if (!max.IsEnabled()) continue;
 
         // //check protocol version
@@ -503,7 +576,7 @@ CMaxnode* CMaxnodeMan::GetNextMaxnodeInQueueForPayment(int nBlockHeight, bool fF
         //make sure it has as many confirmations as there are maxnodes
         if (max.GetMaxnodeInputAge() < nMnCount) continue;
 
-        vecMaxnodeLastPaid.push_back(make_pair(max.SecondsSincePayment(), max.maxvin));
+        vecMaxnodeLastPaid.push_back(make_pair(max.SecondsSincePayment(nMnCount), max.maxvin));
     }
 
     nCount = (int)vecMaxnodeLastPaid.size();
@@ -518,7 +591,7 @@ CMaxnode* CMaxnodeMan::GetNextMaxnodeInQueueForPayment(int nBlockHeight, bool fF
     //  -- This doesn't look at who is being paid in the +8-10 blocks, allowing for double payments very rarely
     //  -- 1/100 payments should be a double payment on mainnet - (1/(3000/10))*2
     //  -- (chance per block * chances before IsScheduled will fire)
-    int nTenthNetwork = CountEnabled() / 10;
+    int nTenthNetwork = nMnCount / 10;
     int nCountTenth = 0;
     uint256 nHigh = 0;
     BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMaxnodeLastPaid) {
@@ -570,141 +643,34 @@ CMaxnode* CMaxnodeMan::FindRandomNotInVec(std::vector<CTxIn>& vecToExclude, int
 
 CMaxnode* CMaxnodeMan::GetCurrentMaxNode(int mod, int64_t nBlockHeight, int minProtocol)
 {
-    int64_t score = 0;
-    CMaxnode* winner = NULL;
-
-    // scan for winner
-    BOOST_FOREACH (CMaxnode& max, vMaxnodes) {
-        max.Check();
-        if (max.protocolVersion < minProtocol || !max.IsEnabled()) continue;
-
-        // calculate the score for each Maxnode
-        uint256 n = max.CalculateScore(mod, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        // determine the winner
-        if (n2 > score) {
-            score = n2;
-            winner = &max;
-        }
-    }
-
-    return winner;
+    LOCK(cs);
+    return tier.GetCurrent(vMaxnodes, nBlockHeight, minProtocol);
 }
 
 int CMaxnodeMan::GetMaxnodeRank(const CTxIn& maxvin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<pair<int64_t, CTxIn> > vecMaxnodeScores;
-    int64_t nMaxnode_Min_Age = MAX_WINNER_MINIMUM_AGE;
-    int64_t nMaxnode_Age = 0;
-
-    //make sure we know about this block
-    uint256 hash = 0;
-    if (!GetBlockHash(hash, nBlockHeight)) return -1;
-
-    // scan for winner
-    BOOST_FOREACH (CMaxnode& max, vMaxnodes) {
-        if (max.protocolVersion < minProtocol) {
-            LogPrint("maxnode","Skipping Maxnode with obsolete version %d\n", max.protocolVersion);
-            continue;                                                       // Skip obsolete versions
-        }
-
-        if (IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
-            nMaxnode_Age = GetAdjustedTime() - max.sigTime;
-            if ((nMaxnode_Age) < nMaxnode_Min_Age) {
-                if (fDebug) LogPrint("maxnode","Skipping just activated Maxnode. Age: %ld\n", nMaxnode_Age);
-                continue;                                                   // Skip maxnodes younger than (default) 1 hour
-            }
-        }
-        if (fOnlyActive) {
-            max.Check();
-            if (!max.IsEnabled()) continue;
-        }
-        uint256 n = max.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMaxnodeScores.push_back(make_pair(n2, max.maxvin));
-    }
-
-    sort(vecMaxnodeScores.rbegin(), vecMaxnodeScores.rend(), CompareScoreTxIn());
-
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMaxnodeScores) {
-        rank++;
-        if (s.second.prevout == maxvin.prevout) {
-            return rank;
-        }
-    }
-
-    return -1;
+    LOCK(cs);
+    return tier.GetRank(vMaxnodes, maxvin, nBlockHeight, minProtocol, fOnlyActive);
 }
 
-std::vector<pair<int, CMaxnode> > CMaxnodeMan::GetMaxnodeRanks(int64_t nBlockHeight, int minProtocol)
+CMaxnodeSnapshotRef CMaxnodeMan::GetSnapshot()
 {
-    std::vector<pair<int64_t, CMaxnode> > vecMaxnodeScores;
-    std::vector<pair<int, CMaxnode> > vecMaxnodeRanks;
-
-    //make sure we know about this block
-    uint256 hash = 0;
-    if (!GetBlockHash(hash, nBlockHeight)) return vecMaxnodeRanks;
-
-    // scan for winner
-    BOOST_FOREACH (CMaxnode& max, vMaxnodes) {
-        max.Check();
-
-        if (max.protocolVersion < minProtocol) continue;
-
-        if (!max.IsEnabled()) {
-            vecMaxnodeScores.push_back(make_pair(9999, max));
-            continue;
+    {
+        // while the list is busy readers get the previous snapshot, until there is one they wait
+        CCriticalBlock lockList(cs, "cs", __FILE__, __LINE__, tier.IsPublished());
+        if (lockList && tier.IsSnapshotStale()) {
+            Check();
+            tier.Publish(vMaxnodes);
         }
-
-        uint256 n = max.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMaxnodeScores.push_back(make_pair(n2, max));
     }
 
-    sort(vecMaxnodeScores.rbegin(), vecMaxnodeScores.rend(), CompareScoreMAX());
-
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CMaxnode) & s, vecMaxnodeScores) {
-        rank++;
-        vecMaxnodeRanks.push_back(make_pair(rank, s.second));
-    }
-
-    return vecMaxnodeRanks;
+    return tier.GetSnapshot();
 }
 
 CMaxnode* CMaxnodeMan::GetMaxnodeByRank(int nRank, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<pair<int64_t, CTxIn> > vecMaxnodeScores;
-
-    // scan for winner
-    BOOST_FOREACH (CMaxnode& max, vMaxnodes) {
-        if (max.protocolVersion < minProtocol) continue;
-        if (fOnlyActive) {
-            max.Check();
-            if (!max.IsEnabled()) continue;
-        }
-
-        uint256 n = max.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMaxnodeScores.push_back(make_pair(n2, max.maxvin));
-    }
-
-    sort(vecMaxnodeScores.rbegin(), vecMaxnodeScores.rend(), CompareScoreTxIn());
-
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMaxnodeScores) {
-        rank++;
-        if (rank == nRank) {
-            return Find(s.second);
-        }
-    }
-
-    return NULL;
+    LOCK(cs);
+    return tier.GetByRank(vMaxnodes, nRank, nBlockHeight, minProtocol, fOnlyActive);
 }
 
 void CMaxnodeMan::ProcessMaxnodeConnections()
@@ -849,6 +815,115 @@ void CMaxnodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStr
             pfrom->PushMessage("smaxsc", MAXNODE_SYNC_LIST, nInvCount);
             LogPrint("maxnode", "dmaxseg - Sent %d Maxnode entries to peer %i\n", nInvCount, pfrom->GetId());
         }
+    } else if (strCommand == "dmaxsegd") { //Get the Maxnode list entries changed since a given time, one page at a time
+
+        CNodeListCursor cursor;
+        vRecv >> cursor;
+
+        LOCK(cs);
+
+        if (cursor.IsFirstPage()) {
+            //local network
+            bool isLocal = (pfrom->addr.IsRFC1918() || pfrom->addr.IsLocal());
+
+            if (!isLocal && Params().NetworkID() == CBaseChainParams::MAIN) {
+                std::map<CNetAddr, int64_t>::iterator i = mAskedUsForMaxnodeList.find(pfrom->addr);
+                if (i != mAskedUsForMaxnodeList.end()) {
+                    int64_t t = (*i).second;
+                    if (GetTime() < t) {
+                        LogPrintf("CMaxnodeMan::ProcessMessage() : dmaxsegd - peer already asked me for the list\n");
+                        Misbehaving(pfrom->GetId(), 34);
+                        return;
+                    }
+                }
+                int64_t askAgain = GetTime() + MAXNODES_DSEG_SECONDS;
+                mAskedUsForMaxnodeList[pfrom->addr] = askAgain;
+            }
+        } else {
+            // further pages have to continue where the last one we sent ended
+            std::map<CNetAddr, std::pair<int64_t, CNodeListCursor> >::iterator i = mAskedUsForMaxnodeListDelta.find(pfrom->addr);
+            if (i == mAskedUsForMaxnodeListDelta.end() || (*i).second.first < GetTime() || !((*i).second.second == cursor)) {
+                LogPrint("maxnode", "dmaxsegd - unexpected page request from peer %i\n", pfrom->GetId());
+                return;
+            }
+        }
+
+        // the peer has all of our broadcasts already, it only misses pings
+        bool fSameList = cursor.hashList == tier.GetListHash(vMaxnodes);
+
+        std::vector<CMaxnode*> vPage;
+        bool fMore = tier.GetChangedPage(vMaxnodes, cursor, MAXNODES_DELTA_PAGE_SIZE, vPage);
+
+        int nInvCount = 0;
+
+        BOOST_FOREACH (CMaxnode* pmax, vPage) {
+            if (!fSameList && pmax->sigTime > cursor.nSince) {
+                // the broadcast carries the last ping too
+                CMaxnodeBroadcast maxb = CMaxnodeBroadcast(*pmax);
+                uint256 hash = maxb.GetHash();
+                pfrom->PushInventory(CInv(MSG_MAXNODE_ANNOUNCE, hash));
+                nInvCount++;
+
+                if (!mapSeenMaxnodeBroadcast.count(hash)) mapSeenMaxnodeBroadcast.insert(make_pair(hash, maxb));
+                continue;
+            }
+
+            if (pmax->lastPing.sigTime > cursor.nSince) {
+                uint256 hash = pmax->lastPing.GetHash();
+                pfrom->PushInventory(CInv(MSG_MAXNODE_PING, hash));
+                nInvCount++;
+
+                if (!mapSeenMaxnodePing.count(hash)) mapSeenMaxnodePing.insert(make_pair(hash, pmax->lastPing));
+            }
+        }
+
+        CNodeListCursor cursorNext = cursor;
+        if (!vPage.empty()) {
+            cursorNext.nTime = tier.GetLastChange(*vPage.back());
+            cursorNext.prevout = vPage.back()->maxvin.prevout;
+        }
+
+        if (fMore)
+            mAskedUsForMaxnodeListDelta[pfrom->addr] = std::make_pair(GetTime() + MAXNODES_DELTA_PAGE_SECONDS, cursorNext);
+        else
+            mAskedUsForMaxnodeListDelta.erase(pfrom->addr);
+
+        pfrom->PushMessage("dmaxsegp", cursorNext, nInvCount, fMore);
+        LogPrint("maxnode", "dmaxsegd - Sent %d Maxnode entries changed since %d to peer %i%s\n", nInvCount, cursor.nSince, pfrom->GetId(), fMore ? ", more to follow" : "");
+    } else if (strCommand == "dmaxsegp") { //Page of a delta Maxnode list sync we asked for
+
+        CNodeListCursor cursor;
+        int nCount;
+        bool fMore;
+        vRecv >> cursor >> nCount >> fMore;
+
+        {
+            LOCK(cs);
+
+            std::map<CNetAddr, std::pair<int64_t, CNodeListCursor> >::iterator i = mWeAskedForMaxnodeListDelta.find(pfrom->addr);
+            if (i == mWeAskedForMaxnodeListDelta.end()) return;
+
+            // a page for a different request, or one that doesn't move forward
+            const CNodeListCursor& cursorSent = (*i).second.second;
+            if (cursor.nSince != cursorSent.nSince || cursor.hashList != cursorSent.hashList ||
+                (fMore && !cursorSent.IsBefore(cursor.nTime, cursor.prevout))) {
+                LogPrintf("CMaxnodeMan::ProcessMessage() : dmaxsegp - peer %i sent an invalid page\n", pfrom->GetId());
+                mWeAskedForMaxnodeListDelta.erase(i);
+                Misbehaving(pfrom->GetId(), 20);
+                return;
+            }
+
+            if (fMore) {
+                pfrom->PushMessage("dmaxsegd", cursor);
+                (*i).second = std::make_pair(GetTime() + MAXNODES_DELTA_PAGE_SECONDS, cursor);
+            } else {
+                mWeAskedForMaxnodeListDelta.erase(i);
+            }
+            LogPrint("maxnode", "dmaxsegp - got %d Maxnode entries from peer %i%s\n", nCount, pfrom->GetId(), fMore ? ", asking for more" : "");
+        }
+
+        // the sync takes its own lock, which is held while it calls into us
+        maxnodeSync.AddedMaxnodeListPage(nCount, !fMore);
     }
     /*
      * IT'S SAFE TO REMOVE THIS IN FURTHER VERSIONS
@@ -943,6 +1018,7 @@ void CMaxnodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStr
                     LogPrint("maxnode", "dmaxsee - Got updated entry for %s\n", maxvin.prevout.hash.ToString());
                     if (pmax->protocolVersion < GETHEADERS_VERSION) {
                         pmax->pubKeyMaxnode = pubkey2;
+                        ReindexMaxnode(*pmax);
                         pmax->sigTime = sigTime;
                         pmax->sig = vchSig;
                         pmax->protocolVersion = protocolVersion;
@@ -951,7 +1027,7 @@ void CMaxnodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStr
                         pmax->lastPing = CMaxnodePing(maxvin);
                     }
                     pmax->nLastDsee = sigTime;
-                    pmax->Check();
+                    CheckMaxnode(*pmax);
                     if (pmax->IsEnabled()) {
                         TRY_LOCK(cs_vNodes, lockNodes);
                         if (!lockNodes) return;
@@ -985,45 +1061,37 @@ void CMaxnodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStr
         // make sure it's still unspent
         //  - this is checked later by .check() in many places and by ThreadCheckObfuScationPool()
 
-        CValidationState state;
-        CMutableTransaction tx = CMutableTransaction();
-
-	//CTxOut vout = CTxOut(((MAXNODE_T1_COLLATERAL_AMOUNT - 0.01) * COIN) || ((MAXNODE_T2_COLLATERAL_AMOUNT - 0.01) * COIN) || ((MAXNODE_T3_COLLATERAL_AMOUNT - 0.01) * COIN), obfuScationPool.collateralPubKey);
-	CTxOut vout = CTxOut((MAXNODE_COLLATERAL_AMOUNT - 0.01) * COIN, obfuScationPool.collateralPubKey);
-
-        tx.vin.push_back(maxvin);
-        tx.vout.push_back(vout);
-
+        int nDoS = 0;
         bool fAcceptable = false;
         {
             TRY_LOCK(cs_main, lockMain);
             if (!lockMain) return;
-            fAcceptable = AcceptableInputs(mempool, state, CTransaction(tx), false, NULL);
-        }
 
-        if (fAcceptable) {
-            if (GetInputAge(maxvin) < MAXNODE_MIN_CONFIRMATIONS) {
+            CTxOut txout;
+            int nHeight, nConfirmations;
+            if (!GetUTXOCoin(maxvin.prevout, txout, nHeight, nConfirmations)) {
+                LogPrint("maxnode", "dmaxsee - Collateral %s is spent or unknown\n", maxvin.prevout.ToString());
+            } else if (txout.nValue < (MAXNODE_COLLATERAL_AMOUNT - 0.01) * COIN) {
+                LogPrint("maxnode", "dmaxsee - Collateral %s is too small\n", maxvin.prevout.ToString());
+                nDoS = 100;
+            } else if (nConfirmations < MAXNODE_MIN_CONFIRMATIONS) {
                 LogPrintf("CMaxnodeMan::ProcessMessage() : dmaxsee - Input must have least %d confirmations\n", MAXNODE_MIN_CONFIRMATIONS);
                 Misbehaving(pfrom->GetId(), 20);
                 return;
-            }
-
-            // verify that sig time is legit in past
-            // should be at least not earlier than block when 1000 PIVX tx got MAXNODE_MIN_CONFIRMATIONS
-            uint256 hashBlock = 0;
-            CTransaction tx2;
-            GetTransaction(maxvin.prevout.hash, tx2, hashBlock, true);
-            BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
-            if (mi != mapBlockIndex.end() && (*mi).second) {
-                CBlockIndex* pMAXIndex = (*mi).second;                                                        // block for 10000 PIV tx -> 1 confirmation
-                CBlockIndex* pConfIndex = chainActive[pMAXIndex->nHeight + MAXNODE_MIN_CONFIRMATIONS - 1]; // block where tx got MAXNODE_MIN_CONFIRMATIONS
+            } else {
+                // verify that sig time is legit in past
+                // should be at least not earlier than block when the collateral tx got MAXNODE_MIN_CONFIRMATIONS
+                CBlockIndex* pConfIndex = chainActive[nHeight + MAXNODE_MIN_CONFIRMATIONS - 1]; // block where tx got MAXNODE_MIN_CONFIRMATIONS
                 if (pConfIndex->GetBlockTime() > sigTime) {
                     LogPrint("maxnode","maxb - Bad sigTime %d for Maxnode %s (%i conf block is at %d)\n",
                         sigTime, maxvin.prevout.hash.ToString(), MAXNODE_MIN_CONFIRMATIONS, pConfIndex->GetBlockTime());
                     return;
                 }
+                fAcceptable = true;
             }
+        }
 
+        if (fAcceptable) {
             // use this as a peer
             addrman.Add(CAddress(addr), pfrom->addr, 2 * 60 * 60);
 
@@ -1054,13 +1122,8 @@ void CMaxnodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStr
         } else {
             LogPrint("maxnode","dmaxsee - Rejected Maxnode entry %s\n", maxvin.prevout.hash.ToString());
 
-            int nDoS = 0;
-            if (state.IsInvalid(nDoS)) {
-                LogPrint("maxnode","dmaxsee - %s from %i %s was not accepted into the memory pool\n", tx.GetHash().ToString().c_str(),
-                    pfrom->GetId(), pfrom->cleanSubVer.c_str());
-                if (nDoS > 0)
-                    Misbehaving(pfrom->GetId(), nDoS);
-            }
+            if (nDoS > 0)
+                Misbehaving(pfrom->GetId(), nDoS);
         }
     }
 
@@ -1112,7 +1175,7 @@ void CMaxnodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStr
                 // fake ping for v11 maxnodes, ignore for v12
                 if (pmax->protocolVersion < GETHEADERS_VERSION) pmax->lastPing = CMaxnodePing(maxvin);
                 pmax->nLastDseep = sigTime;
-                pmax->Check();
+                CheckMaxnode(*pmax);
                 if (pmax->IsEnabled()) {
                     TRY_LOCK(cs_vNodes, lockNodes);
                     if (!lockNodes) return;
@@ -1143,7 +1206,7 @@ void CMaxnodeMan::Remove(CTxIn maxvin)
     while (it != vMaxnodes.end()) {
         if ((*it).maxvin == maxvin) {
             LogPrint("maxnode", "CMaxnodeMan: Removing Maxnode %s - %i now\n", (*it).maxvin.prevout.hash.ToString(), size() - 1);
-            vMaxnodes.erase(it);
+            tier.Erase(vMaxnodes, it - vMaxnodes.begin());
             break;
         }
         ++it;
@@ -1163,7 +1226,8 @@ void CMaxnodeMan::UpdateMaxnodeList(CMaxnodeBroadcast maxb)
         CMaxnode max(maxb);
         Add(max);
     } else {
-    	pmax->UpdateFromNewBroadcast(maxb);
+    	if (pmax->UpdateFromNewBroadcast(maxb))
+    	    ReindexMaxnode(*pmax);
     }
 }
 
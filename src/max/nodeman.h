@@ -8,24 +8,35 @@
 #define MAXNODEMAN_H
 
 #include "base58.h"
+#include "bloom.h"
 #include "key.h"
 #include "main.h"
 #include "max/node.h"
 #include "net.h"
+#include "nodetier.h"
+#include "seencache.h"
 #include "sync.h"
 #include "util.h"
 
 #define MAXNODES_DUMP_SECONDS (15 * 60)
 #define MAXNODES_DSEG_SECONDS (3 * 60 * 60)
+#define MAXNODES_RANKING_CACHE_SIZE 64
+#define MAXNODES_SNAPSHOT_SECONDS 5
+#define MAXNODES_DELTA_PAGE_SIZE 500
+#define MAXNODES_DELTA_PAGE_SECONDS 60
+#define MAXNODE_PING_FILTER_SIZE 50000 // raw ping messages remembered to drop relayed copies unread
+#define MAXNODE_PING_FILTER_FP_RATE 0.000001
+#define MAX_WINNER_MINIMUM_AGE 8000    // Age in seconds. This should be > MAXNODE_REMOVAL_SECONDS to avoid misconfigured new nodes in the list.
 
 using namespace std;
 
 class CMaxnodeMan;
+class CFlatJournal;
 
 extern CMaxnodeMan maxnodeman;
 void DumpMaxnodes();
 
-/** Access to the Max database (maxcache.dat)
+/** Access to the Max database (maxcache.dat), kept as a CFlatJournal
  */
 class CMaxnodeDB
 {
@@ -47,8 +58,32 @@ public:
     CMaxnodeDB();
     bool Write(const CMaxnodeMan& maxnodemanToSave);
     ReadResult Read(CMaxnodeMan& maxnodemanToLoad, bool fDryRun = false);
+
+private:
+    /// Files written before the journal format, serialized as a whole
+    ReadResult ReadLegacy(CMaxnodeMan& maxnodemanToLoad);
+};
+
+/** Maxnode parameters of the shared node tier engine, see CNodeTier */
+struct CMaxnodeTraits {
+    typedef CMaxnode Node;
+
+    static const CTxIn& GetVin(const CMaxnode& max) { return max.maxvin; }
+    static const CPubKey& GetPubKey(const CMaxnode& max) { return max.pubKeyMaxnode; }
+    static uint256 GetBroadcastHash(const CMaxnode& max) { return CMaxnodeBroadcast(max).GetHash(); }
+    static bool GetBlockHash(uint256& hash, int nBlockHeight) { return ::GetMaxBlockHash(hash, nBlockHeight); }
+    static int GetMinPaymentsProto();
+    static bool IsMinAgeEnforced();
+    static const char* LogCategory() { return "maxnode"; }
+
+    static const int64_t nMinWinnerAge = MAX_WINNER_MINIMUM_AGE;
+    static const int nCheckSeconds = MAXNODE_CHECK_SECONDS;
+    static const size_t nRankingCacheSize = MAXNODES_RANKING_CACHE_SIZE;
+    static const int nSnapshotSeconds = MAXNODES_SNAPSHOT_SECONDS;
 };
 
+typedef CNodeTier<CMaxnodeTraits>::SnapshotRef CMaxnodeSnapshotRef;
+
 class CMaxnodeMan
 {
 private:
@@ -66,12 +101,24 @@ private:
     std::map<CNetAddr, int64_t> mWeAskedForMaxnodeList;
     // which Maxnodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForMaxnodeListEntry;
+    // delta list syncs in progress: cursor of the next page and when it expires
+    std::map<CNetAddr, std::pair<int64_t, CNodeListCursor> > mAskedUsForMaxnodeListDelta;
+    std::map<CNetAddr, std::pair<int64_t, CNodeListCursor> > mWeAskedForMaxnodeListDelta;
+    // lookups and rankings over vMaxnodes
+    CNodeTier<CMaxnodeTraits> tier;
+
+    /// Check the entries that are due, unless another thread is working on the list
+    void TryCheckDue();
+
+    // raw ping messages seen lately, the same ping is relayed by most of our peers
+    CRollingBloomFilter filterPingMessages;
+    CCriticalSection cs_filterPingMessages;
 
 public:
     // Keep track of all broadcasts I've seen
-    map<uint256, CMaxnodeBroadcast> mapSeenMaxnodeBroadcast;
+    CSeenCache<CMaxnodeBroadcast> mapSeenMaxnodeBroadcast;
     // Keep track of all pings I've seen
-    map<uint256, CMaxnodePing> mapSeenMaxnodePing;
+    CSeenCache<CMaxnodePing> mapSeenMaxnodePing;
 
     // keep track of dsq count to prevent maxnodes from gaming obfuscation queue
     int64_t nDsqCount;
@@ -90,6 +137,9 @@ public:
 
         READWRITE(mapSeenMaxnodeBroadcast);
         READWRITE(mapSeenMaxnodePing);
+
+        if (ser_action.ForRead())
+            tier.Rebuild(vMaxnodes);
     }
 
     CMaxnodeMan();
@@ -101,15 +151,21 @@ public:
     /// Ask (source) node for maxb
     void AskForMAX(CNode* pnode, CTxIn& vin);
 
-    /// Check all Maxnodes
+    /// Check the Maxnodes whose state is due to change
     void Check();
 
+    /// Check an entry after a message changed it and reschedule it
+    void CheckMaxnode(CMaxnode& max, bool forceCheck = false);
+
     /// Check all Maxnodes and remove inactive
     void CheckAndRemove(bool forceExpiredRemoval = false);
 
     /// Clear Maxnode vector
     void Clear();
 
+    /// Drop what was decided with the old value of a spork, called by sporkManager
+    void SporkChanged(int nSporkID, int64_t nValue);
+
     int CountEnabled(int protocolVersion = -1);
 
     void CountNetworks(int protocolVersion, int& ipv4, int& ipv6, int& onion);
@@ -130,13 +186,9 @@ public:
     /// Get the current winner for this block
     CMaxnode* GetCurrentMaxNode(int mod = 1, int64_t nBlockHeight = 0, int minProtocol = 0);
 
-    std::vector<CMaxnode> GetFullMaxnodeVector()
-    {
-        Check();
-        return vMaxnodes;
-    }
+    /// Shared read-only copy of the list, doesn't wait for the list lock
+    CMaxnodeSnapshotRef GetSnapshot();
 
-    std::vector<pair<int, CMaxnode> > GetMaxnodeRanks(int64_t nBlockHeight, int minProtocol = 0);
     int GetMaxnodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol = 0, bool fOnlyActive = true);
     CMaxnode* GetMaxnodeByRank(int nRank, int64_t nBlockHeight, int minProtocol = 0, bool fOnlyActive = true);
 
@@ -144,6 +196,13 @@ public:
 
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 
+    /// True if the ping message was seen lately, remembers it otherwise. Looks at the raw bytes only,
+    /// callers check that ProcessMessage would look at the ping first
+    bool IsPingMessageSeen(const CDataStream& vRecv);
+
+    /// True if the entry was pinged too recently for this ping to be accepted, so its signature needn't be checked
+    bool IsPingTooEarly(const CMaxnodePing& maxp);
+
     /// Return the number of (unique) Maxnodes
     int size() { return vMaxnodes.size(); }
 
@@ -152,12 +211,20 @@ public:
 
     std::string ToString() const;
 
+    /// Append what changed since the last call to the cache journal
+    void WriteJournal(CFlatJournal& journal) const;
+    /// Replace the contents with the entries of the cache journal
+    void ReadJournal(CFlatJournal& journal);
+
     void Remove(CTxIn vin);
 
     int GetEstimatedMaxnodes(int nBlock);
 
     /// Update maxnode list and maps using provided CMaxnodeBroadcast
     void UpdateMaxnodeList(CMaxnodeBroadcast maxb);
+
+    /// Re-index an entry whose payee or maxnode pubkey may have changed
+    void ReindexMaxnode(const CMaxnode& max);
 };
 
 #endif
@@ -79,6 +79,8 @@ unsigned short GetListenPort();
 bool BindListenPort(const CService& bindAddr, std::string& strError, bool fWhitelisted = false);
 void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler);
 bool StopNode();
+/** Wake the message handler thread up before its next poll */
+void WakeMessageHandler();
 void SocketSendData(CNode* pnode);
 
 typedef int NodeId;
@@ -293,6 +295,8 @@ public:
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
     CCriticalSection cs_vRecvMsg;
+    // vRecvMsg is left alone while the peer's masternode messages wait for verification
+    bool fPauseRecv;
     uint64_t nRecvBytes;
     int nRecvVersion;
 
@@ -0,0 +1,166 @@
+// Copyright (c) 2019 The Lytix developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef NODEINDEX_H
+#define NODEINDEX_H
+
+#include "primitives/transaction.h"
+#include "pubkey.h"
+#include "script/script.h"
+
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <map>
+#include <set>
+#include <vector>
+
+struct OutPointHasher {
+    size_t operator()(const COutPoint& outpoint) const
+    {
+        size_t seed = outpoint.hash.GetLow64();
+        boost::hash_combine(seed, outpoint.n);
+        return seed;
+    }
+};
+
+struct ScriptHasher {
+    size_t operator()(const CScript& script) const { return boost::hash_range(script.begin(), script.end()); }
+};
+
+struct PubKeyHasher {
+    size_t operator()(const CPubKey& pubkey) const { return boost::hash_range(pubkey.begin(), pubkey.end()); }
+};
+
+/** Secondary hash indexes over a node manager's vector of nodes.
+ *
+ * Nodes are keyed by their collateral outpoint, which maps to the node's
+ * position in the owning vector. The payee script and the operator pubkey map
+ * to the collateral outpoints of all nodes carrying them, as several nodes may
+ * share a payee. Entries are only hints: the owner must check that the node it
+ * resolves still carries the key it was looked up by, and call Insert again
+ * whenever a node's keys change, SetPos when a node moves in the vector.
+ */
+class CNodeIndex
+{
+private:
+    boost::unordered_map<COutPoint, size_t, OutPointHasher> mapPosByOutPoint;
+    boost::unordered_map<CScript, std::set<COutPoint>, ScriptHasher> mapOutPointsByPayee;
+    boost::unordered_map<CPubKey, std::set<COutPoint>, PubKeyHasher> mapOutPointsByPubKey;
+
+    template <typename Key, typename Hasher>
+    static void EraseKey(boost::unordered_map<Key, std::set<COutPoint>, Hasher>& mapOutPoints, const Key& key, const COutPoint& outpoint)
+    {
+        typename boost::unordered_map<Key, std::set<COutPoint>, Hasher>::iterator it = mapOutPoints.find(key);
+        if (it == mapOutPoints.end()) return;
+        it->second.erase(outpoint);
+        if (it->second.empty()) mapOutPoints.erase(it);
+    }
+
+public:
+    void Insert(const COutPoint& outpoint, const CScript& payee, const CPubKey& pubKeyNode, size_t nPos)
+    {
+        mapPosByOutPoint[outpoint] = nPos;
+        mapOutPointsByPayee[payee].insert(outpoint);
+        mapOutPointsByPubKey[pubKeyNode].insert(outpoint);
+    }
+
+    void SetPos(const COutPoint& outpoint, size_t nPos) { mapPosByOutPoint[outpoint] = nPos; }
+
+    bool GetPos(const COutPoint& outpoint, size_t& nPosRet) const
+    {
+        boost::unordered_map<COutPoint, size_t, OutPointHasher>::const_iterator it = mapPosByOutPoint.find(outpoint);
+        if (it == mapPosByOutPoint.end()) return false;
+        nPosRet = it->second;
+        return true;
+    }
+
+    bool GetOutPoints(const CScript& payee, std::vector<COutPoint>& vOutPointsRet) const
+    {
+        boost::unordered_map<CScript, std::set<COutPoint>, ScriptHasher>::const_iterator it = mapOutPointsByPayee.find(payee);
+        if (it == mapOutPointsByPayee.end()) return false;
+        vOutPointsRet.assign(it->second.begin(), it->second.end());
+        return true;
+    }
+
+    bool GetOutPoints(const CPubKey& pubKeyNode, std::vector<COutPoint>& vOutPointsRet) const
+    {
+        boost::unordered_map<CPubKey, std::set<COutPoint>, PubKeyHasher>::const_iterator it = mapOutPointsByPubKey.find(pubKeyNode);
+        if (it == mapOutPointsByPubKey.end()) return false;
+        vOutPointsRet.assign(it->second.begin(), it->second.end());
+        return true;
+    }
+
+    /// Drop a stale entry found during lookup
+    void Erase(const COutPoint& outpoint) { mapPosByOutPoint.erase(outpoint); }
+    void Erase(const CScript& payee, const COutPoint& outpoint) { EraseKey(mapOutPointsByPayee, payee, outpoint); }
+    void Erase(const CPubKey& pubKeyNode, const COutPoint& outpoint) { EraseKey(mapOutPointsByPubKey, pubKeyNode, outpoint); }
+
+    void Clear()
+    {
+        mapPosByOutPoint.clear();
+        mapOutPointsByPayee.clear();
+        mapOutPointsByPubKey.clear();
+    }
+
+    size_t size() const { return mapPosByOutPoint.size(); }
+};
+
+/** Scores of a node list at one block height, sorted high to low.
+ *
+ * Built once by the node manager and shared by all rank queries for the same
+ * height and filters until the tip or the list changes.
+ */
+class CNodeRanking
+{
+private:
+    std::vector<std::pair<int64_t, CTxIn> > vecScores;
+    boost::unordered_map<COutPoint, int, OutPointHasher> mapRanks;
+
+public:
+    int64_t nTimeCreated;
+
+    CNodeRanking() : nTimeCreated(0) {}
+
+    /// Take ownership of the scores, which must already be sorted high to low
+    void Set(std::vector<std::pair<int64_t, CTxIn> >& vecScoresIn, int64_t nTime)
+    {
+        vecScores.swap(vecScoresIn);
+        mapRanks.clear();
+        for (size_t i = 0; i < vecScores.size(); i++)
+            mapRanks.insert(std::make_pair(vecScores[i].second.prevout, (int)i + 1));
+        nTimeCreated = nTime;
+    }
+
+    /// 1-based rank of the node, -1 if it is not ranked
+    int GetRank(const COutPoint& outpoint) const
+    {
+        boost::unordered_map<COutPoint, int, OutPointHasher>::const_iterator it = mapRanks.find(outpoint);
+        return it == mapRanks.end() ? -1 : it->second;
+    }
+
+    const std::vector<std::pair<int64_t, CTxIn> >& GetScores() const { return vecScores; }
+};
+
+struct CNodeRankingKey {
+    int64_t nBlockHeight;
+    int nMinProtocol;
+    bool fOnlyActive;
+    bool fMinAge;
+
+    CNodeRankingKey(int64_t nBlockHeightIn, int nMinProtocolIn, bool fOnlyActiveIn, bool fMinAgeIn)
+        : nBlockHeight(nBlockHeightIn), nMinProtocol(nMinProtocolIn), fOnlyActive(fOnlyActiveIn), fMinAge(fMinAgeIn) {}
+
+    friend bool operator<(const CNodeRankingKey& a, const CNodeRankingKey& b)
+    {
+        if (a.nBlockHeight != b.nBlockHeight) return a.nBlockHeight < b.nBlockHeight;
+        if (a.nMinProtocol != b.nMinProtocol) return a.nMinProtocol < b.nMinProtocol;
+        if (a.fOnlyActive != b.fOnlyActive) return a.fOnlyActive < b.fOnlyActive;
+        return a.fMinAge < b.fMinAge;
+    }
+};
+
+typedef std::map<CNodeRankingKey, CNodeRanking> NodeRankingMap;
+
+#endif // NODEINDEX_H
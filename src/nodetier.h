@@ -0,0 +1,607 @@
+// Copyright (c) 2019 The Lytix developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef NODETIER_H
+#define NODETIER_H
+
+#include "hash.h"
+#include "main.h"
+#include "nodeindex.h"
+#include "serialize.h"
+#include "sync.h"
+#include "timedata.h"
+#include "util.h"
+
+#include <algorithm>
+#include <set>
+
+#include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
+
+struct CompareScoreTxIn {
+    bool operator()(const std::pair<int64_t, CTxIn>& t1,
+        const std::pair<int64_t, CTxIn>& t2) const
+    {
+        return t1.first < t2.first;
+    }
+};
+
+/** Position in a paged delta list sync ("dsegd" and "dmaxsegd" requests).
+ *
+ * The requester asks for the enabled nodes that changed after nSince, the newer of
+ * broadcast and ping signature time counting as the change. hashList is the
+ * requester's list hash (see CNodeTier::GetListHash): if it matches, only pings
+ * are sent. Pages are ordered by change time, then collateral, and nTime/prevout
+ * point at the last entry sent, so the next page continues right after it.
+ */
+class CNodeListCursor
+{
+public:
+    int64_t nSince;
+    uint256 hashList;
+    int64_t nTime;
+    COutPoint prevout;
+
+    CNodeListCursor() : nSince(0), hashList(0), nTime(0) {}
+    CNodeListCursor(int64_t nSinceIn, const uint256& hashListIn) : nSince(nSinceIn), hashList(hashListIn), nTime(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nSince);
+        READWRITE(hashList);
+        READWRITE(nTime);
+        READWRITE(prevout);
+    }
+
+    bool IsFirstPage() const { return nTime == 0 && prevout.IsNull(); }
+
+    /// Whether an entry with this change time and collateral comes after the cursor
+    bool IsBefore(int64_t nTimeIn, const COutPoint& prevoutIn) const
+    {
+        return nTime < nTimeIn || (nTime == nTimeIn && prevout < prevoutIn);
+    }
+
+    friend bool operator==(const CNodeListCursor& a, const CNodeListCursor& b)
+    {
+        return a.nSince == b.nSince && a.hashList == b.hashList && a.nTime == b.nTime && a.prevout == b.prevout;
+    }
+};
+
+/** Immutable copy of the node list of one tier.
+ *
+ * Shared through a reference counted pointer, so RPC and GUI readers can walk the
+ * list without the manager lock and without copying it. Node states are the ones
+ * of the last Check() before the snapshot was taken.
+ */
+template <typename Traits>
+class CNodeListSnapshot
+{
+public:
+    typedef typename Traits::Node Node;
+
+private:
+    std::vector<Node> vNodes;
+    boost::unordered_map<COutPoint, size_t, OutPointHasher> mapPos;
+
+    struct CompareScoreIndex {
+        bool operator()(const std::pair<int64_t, size_t>& t1, const std::pair<int64_t, size_t>& t2) const
+        {
+            return t1.first < t2.first;
+        }
+    };
+
+public:
+    const int64_t nTimeCreated;
+
+    CNodeListSnapshot(const std::vector<Node>& vNodesIn, int64_t nTime) : vNodes(vNodesIn), nTimeCreated(nTime)
+    {
+        for (size_t i = 0; i < vNodes.size(); i++)
+            mapPos.insert(std::make_pair(Traits::GetVin(vNodes[i]).prevout, i));
+    }
+
+    const std::vector<Node>& GetNodes() const { return vNodes; }
+    int size() const { return vNodes.size(); }
+
+    const Node* Find(const COutPoint& outpoint) const
+    {
+        typename boost::unordered_map<COutPoint, size_t, OutPointHasher>::const_iterator it = mapPos.find(outpoint);
+        return it == mapPos.end() ? NULL : &vNodes[it->second];
+    }
+
+    /// All nodes of at least minProtocol by score, the ones that are not enabled score 9999 and come last
+    std::vector<std::pair<int, const Node*> > GetRanks(int64_t nBlockHeight, int minProtocol) const
+    {
+        std::vector<std::pair<int, const Node*> > vecRanks;
+
+        uint256 hash = 0;
+        if (!Traits::GetBlockHash(hash, nBlockHeight)) return vecRanks;
+
+        CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+        ss << hash;
+        uint256 hash2 = ss.GetHash();
+
+        std::vector<std::pair<int64_t, size_t> > vecScores;
+        for (size_t i = 0; i < vNodes.size(); i++) {
+            if (vNodes[i].protocolVersion < minProtocol) continue;
+            if (!vNodes[i].IsEnabled()) {
+                vecScores.push_back(std::make_pair(9999, i));
+                continue;
+            }
+            vecScores.push_back(std::make_pair(vNodes[i].CalculateScore(hash, hash2).GetCompact(false), i));
+        }
+        std::sort(vecScores.rbegin(), vecScores.rend(), CompareScoreIndex());
+
+        for (size_t i = 0; i < vecScores.size(); i++)
+            vecRanks.push_back(std::make_pair((int)i + 1, &vNodes[vecScores[i].second]));
+
+        return vecRanks;
+    }
+};
+
+/** Lookup and ranking engine over the node list of one tier (masternodes, maxnodes).
+ *
+ * The list itself stays in the tier's manager, which passes it in and holds its own
+ * lock around every call. Everything that differs between tiers comes from the
+ * Traits type at compile time:
+ *
+ *   typedef ... Node;                                   node class of the tier
+ *   static const CTxIn& GetVin(const Node&);            collateral input
+ *   static const CPubKey& GetPubKey(const Node&);       node (operator) pubkey
+ *   static uint256 GetBroadcastHash(const Node&);       hash of the node's broadcast
+ *   static bool GetBlockHash(uint256&, int);            block hash used for scoring
+ *   static int GetMinPaymentsProto();                   default protocol filter
+ *   static bool IsMinAgeEnforced();                     skip young nodes in rankings (spork)
+ *   static const char* LogCategory();                   debug category
+ *   static const int64_t nMinWinnerAge;                 age before a node gets ranked, in seconds
+ *   static const int nCheckSeconds;                     how long a node's state stays valid
+ *   static const size_t nRankingCacheSize;              rankings kept at once
+ *   static const int nSnapshotSeconds;                  how long a list snapshot may lag behind
+ *
+ * Node states only change with time (pings getting too old) or with a new message
+ * or block. The tier keeps an expiry schedule of when each node's state will change
+ * next (see GetNextStateChange() of the node classes), so CheckDue() only checks the
+ * nodes that are due, and a count of enabled nodes per protocol version that is
+ * updated whenever a node is (re)scheduled.
+ */
+template <typename Traits>
+class CNodeTier
+{
+public:
+    typedef typename Traits::Node Node;
+    typedef std::vector<Node> NodeVector;
+    typedef CNodeListSnapshot<Traits> Snapshot;
+    typedef boost::shared_ptr<const Snapshot> SnapshotRef;
+
+private:
+    // hash indexes over the list by collateral outpoint, payee script and node pubkey
+    CNodeIndex index;
+
+    // rankings by block height and filters, dropped when the tip or the list changes
+    NodeRankingMap mapRankings;
+    uint256 hashRankingTip;
+
+    // last published copy of the list, readers only need cs_snapshot to pick it up
+    CCriticalSection cs_snapshot;
+    SnapshotRef snapshot;
+    bool fSnapshotDirty;
+    bool fSnapshotPublished;
+
+    // state of each node when it was last scheduled, and when it changes next
+    struct CScheduleEntry {
+        int64_t nTimeDue; // adjusted time, 0 if the state only changes with a new message
+        bool fEnabled;
+        int nProtocol;
+    };
+    std::map<COutPoint, CScheduleEntry> mapSchedule;
+    std::set<std::pair<int64_t, COutPoint> > setDue;
+    // collateral can only be spent by a new block, enabled nodes are checked again on a new tip
+    uint256 hashCheckedTip;
+
+    // enabled nodes by protocol version, only needs cs_count so it can be read without the manager lock
+    mutable CCriticalSection cs_count;
+    std::map<int, int> mapEnabled;
+
+    static bool HasKey(const Node& node, const CScript& payee) { return GetScriptForDestination(node.pubKeyCollateralAddress.GetID()) == payee; }
+    static bool HasKey(const Node& node, const CPubKey& pubKeyNode) { return Traits::GetPubKey(node) == pubKeyNode; }
+
+    // several nodes may share a key, the one found is the first of them in the list
+    template <typename Key>
+    Node* FindByKey(NodeVector& vNodeList, const Key& key)
+    {
+        std::vector<COutPoint> vOutPoints;
+        if (!index.GetOutPoints(key, vOutPoints)) return NULL;
+
+        Node* pnodeFound = NULL;
+        BOOST_FOREACH (const COutPoint& outpoint, vOutPoints) {
+            Node* pnode = Find(vNodeList, outpoint);
+            if (pnode == NULL || !HasKey(*pnode, key)) {
+                index.Erase(key, outpoint);
+                continue;
+            }
+            if (pnodeFound == NULL || pnode < pnodeFound) pnodeFound = pnode;
+        }
+        return pnodeFound;
+    }
+
+    void IndexNode(const NodeVector& vNodeList, size_t nPos)
+    {
+        const Node& node = vNodeList[nPos];
+        index.Insert(Traits::GetVin(node).prevout, GetScriptForDestination(node.pubKeyCollateralAddress.GetID()), Traits::GetPubKey(node), nPos);
+    }
+
+    void Unschedule(const COutPoint& outpoint)
+    {
+        typename std::map<COutPoint, CScheduleEntry>::iterator it = mapSchedule.find(outpoint);
+        if (it == mapSchedule.end()) return;
+
+        if (it->second.nTimeDue) setDue.erase(std::make_pair(it->second.nTimeDue, outpoint));
+        if (it->second.fEnabled) {
+            LOCK(cs_count);
+            if (--mapEnabled[it->second.nProtocol] == 0) mapEnabled.erase(it->second.nProtocol);
+        }
+        mapSchedule.erase(it);
+    }
+
+    void ClearSchedule()
+    {
+        mapSchedule.clear();
+        setDue.clear();
+        hashCheckedTip = 0;
+        LOCK(cs_count);
+        mapEnabled.clear();
+    }
+
+public:
+    CNodeTier() : hashRankingTip(0), snapshot(new Snapshot(NodeVector(), 0)), fSnapshotDirty(true), fSnapshotPublished(false), hashCheckedTip(0) {}
+
+    Node* Find(NodeVector& vNodeList, const COutPoint& outpoint)
+    {
+        size_t nPos;
+        if (!index.GetPos(outpoint, nPos)) return NULL;
+        if (nPos >= vNodeList.size() || Traits::GetVin(vNodeList[nPos]).prevout != outpoint) return NULL;
+        return &vNodeList[nPos];
+    }
+
+    Node* Find(NodeVector& vNodeList, const CScript& payee)
+    {
+        return FindByKey(vNodeList, payee);
+    }
+
+    Node* Find(NodeVector& vNodeList, const CPubKey& pubKeyNode)
+    {
+        return FindByKey(vNodeList, pubKeyNode);
+    }
+
+    /// Index the entry that was just appended to the list
+    void Added(const NodeVector& vNodeList)
+    {
+        IndexNode(vNodeList, vNodeList.size() - 1);
+        Schedule(vNodeList.back());
+        mapRankings.clear();
+        fSnapshotDirty = true;
+    }
+
+    /// Re-index an entry whose payee or node pubkey may have changed
+    void Updated(const NodeVector& vNodeList, const Node& node)
+    {
+        size_t nPos;
+        const COutPoint& outpoint = Traits::GetVin(node).prevout;
+        if (index.GetPos(outpoint, nPos) && nPos < vNodeList.size() && Traits::GetVin(vNodeList[nPos]).prevout == outpoint) {
+            IndexNode(vNodeList, nPos);
+            Schedule(vNodeList[nPos]);
+        }
+        mapRankings.clear();
+        fSnapshotDirty = true;
+    }
+
+    /// Remove the entry at nPos from the list, keeping the order of the others
+    void Erase(NodeVector& vNodeList, size_t nPos)
+    {
+        const Node& node = vNodeList[nPos];
+        COutPoint outpoint = Traits::GetVin(node).prevout;
+        index.Erase(outpoint);
+        index.Erase(GetScriptForDestination(node.pubKeyCollateralAddress.GetID()), outpoint);
+        index.Erase(Traits::GetPubKey(node), outpoint);
+        Unschedule(outpoint);
+
+        vNodeList.erase(vNodeList.begin() + nPos);
+        for (size_t i = nPos; i < vNodeList.size(); i++)
+            index.SetPos(Traits::GetVin(vNodeList[i]).prevout, i);
+        mapRankings.clear();
+        fSnapshotDirty = true;
+    }
+
+    /// Recompute the indexes from scratch, after several entries were removed or the list was replaced
+    void Rebuild(const NodeVector& vNodeList)
+    {
+        mapRankings.clear();
+        index.Clear();
+        ClearSchedule();
+        for (size_t i = 0; i < vNodeList.size(); i++) {
+            IndexNode(vNodeList, i);
+            Schedule(vNodeList[i]);
+        }
+        fSnapshotDirty = true;
+    }
+
+    /// Forget the cached rankings, after something they depend on besides the list changed
+    void ClearRankings()
+    {
+        mapRankings.clear();
+    }
+
+    void Clear()
+    {
+        index.Clear();
+        mapRankings.clear();
+        ClearSchedule();
+        fSnapshotDirty = true;
+    }
+
+    /// Record the current state of a node after it was checked, requires the manager lock
+    void Schedule(const Node& node)
+    {
+        const COutPoint& outpoint = Traits::GetVin(node).prevout;
+        typename std::map<COutPoint, CScheduleEntry>::const_iterator it = mapSchedule.find(outpoint);
+        bool fChanged = it == mapSchedule.end() || it->second.fEnabled != node.IsEnabled() || it->second.nProtocol != node.protocolVersion;
+        Unschedule(outpoint);
+
+        CScheduleEntry& entry = mapSchedule[outpoint];
+        entry.nTimeDue = node.GetNextStateChange();
+        entry.fEnabled = node.IsEnabled();
+        entry.nProtocol = node.protocolVersion;
+        if (entry.nTimeDue) setDue.insert(std::make_pair(entry.nTimeDue, outpoint));
+        if (entry.fEnabled) {
+            LOCK(cs_count);
+            mapEnabled[entry.nProtocol]++;
+        }
+
+        if (fChanged) {
+            mapRankings.clear();
+            fSnapshotDirty = true;
+        }
+    }
+
+    /**
+     * Check the nodes whose state is due to change, and every enabled node once the
+     * tip changed. Requires the manager lock, returns the number of nodes checked.
+     */
+    int CheckDue(NodeVector& vNodeList)
+    {
+        int nChecked = 0;
+
+        uint256 hashTip = 0;
+        if (chainActive.Tip() != NULL) hashTip = chainActive.Tip()->GetBlockHash();
+        if (hashTip != hashCheckedTip) {
+            hashCheckedTip = hashTip;
+            BOOST_FOREACH (Node& node, vNodeList) {
+                if (!node.IsEnabled()) continue;
+                node.Check(true);
+                Schedule(node);
+                nChecked++;
+            }
+        }
+
+        // due times are strictly in the future once a node is checked, so this ends
+        int64_t nNow = GetAdjustedTime();
+        while (!setDue.empty() && setDue.begin()->first <= nNow) {
+            COutPoint outpoint = setDue.begin()->second;
+            Node* pnode = Find(vNodeList, outpoint);
+            if (pnode == NULL) {
+                Unschedule(outpoint);
+                continue;
+            }
+            pnode->Check(true);
+            Schedule(*pnode);
+            nChecked++;
+        }
+
+        if (nChecked > 0) LogPrint(Traits::LogCategory(), "CNodeTier::CheckDue - checked %d of %d nodes\n", nChecked, (int)vNodeList.size());
+        return nChecked;
+    }
+
+    /// Whether the published snapshot lags behind the list, requires the manager lock
+    bool IsSnapshotStale() const
+    {
+        // node states also change in place (pings, checks), so refresh periodically too
+        return fSnapshotDirty || GetTime() - snapshot->nTimeCreated >= Traits::nSnapshotSeconds;
+    }
+
+    /// Replace the published snapshot with a copy of the list, requires the manager lock
+    void Publish(const NodeVector& vNodeList)
+    {
+        SnapshotRef snapshotNew(new Snapshot(vNodeList, GetTime()));
+        LOCK(cs_snapshot);
+        snapshot.swap(snapshotNew);
+        fSnapshotDirty = false;
+        fSnapshotPublished = true;
+    }
+
+    /// Whether a copy of the list was published yet, before that the snapshot is empty
+    bool IsPublished()
+    {
+        LOCK(cs_snapshot);
+        return fSnapshotPublished;
+    }
+
+    SnapshotRef GetSnapshot()
+    {
+        LOCK(cs_snapshot);
+        return snapshot;
+    }
+
+    /// Enabled nodes of at least protocolVersion as of their last check, doesn't need the manager lock
+    int CountEnabled(int protocolVersion) const
+    {
+        int i = 0;
+        protocolVersion = protocolVersion == -1 ? Traits::GetMinPaymentsProto() : protocolVersion;
+
+        LOCK(cs_count);
+        for (std::map<int, int>::const_iterator it = mapEnabled.lower_bound(protocolVersion); it != mapEnabled.end(); ++it)
+            i += it->second;
+
+        return i;
+    }
+
+    /// Last change of a node, the newer of its broadcast and its last ping
+    static int64_t GetLastChange(const Node& node)
+    {
+        return std::max(node.sigTime, node.lastPing.sigTime);
+    }
+
+    /// Hash over the broadcasts of the enabled nodes, equal for equal lists
+    uint256 GetListHash(const NodeVector& vNodeList) const
+    {
+        std::vector<uint256> vHashes;
+        BOOST_FOREACH (const Node& node, vNodeList) {
+            if (node.addr.IsRFC1918() || !node.IsEnabled()) continue;
+            vHashes.push_back(Traits::GetBroadcastHash(node));
+        }
+        std::sort(vHashes.begin(), vHashes.end());
+
+        CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+        ss << vHashes;
+        return ss.GetHash();
+    }
+
+    /**
+     * Next page of a delta list sync: up to nMax enabled nodes changed after
+     * cursor.nSince that come after the cursor position, in cursor order.
+     * Returns whether more nodes are left after the page.
+     */
+    bool GetChangedPage(NodeVector& vNodeList, const CNodeListCursor& cursor, size_t nMax, std::vector<Node*>& vPage) const
+    {
+        std::vector<std::pair<std::pair<int64_t, COutPoint>, size_t> > vChanged;
+        for (size_t i = 0; i < vNodeList.size(); i++) {
+            const Node& node = vNodeList[i];
+            if (node.addr.IsRFC1918() || !node.IsEnabled()) continue;
+
+            int64_t nChange = GetLastChange(node);
+            const COutPoint& outpoint = Traits::GetVin(node).prevout;
+            if (nChange <= cursor.nSince || !cursor.IsBefore(nChange, outpoint)) continue;
+            vChanged.push_back(std::make_pair(std::make_pair(nChange, outpoint), i));
+        }
+
+        bool fMore = vChanged.size() > nMax;
+        if (fMore) {
+            std::partial_sort(vChanged.begin(), vChanged.begin() + nMax, vChanged.end());
+            vChanged.resize(nMax);
+        } else {
+            std::sort(vChanged.begin(), vChanged.end());
+        }
+
+        vPage.clear();
+        for (size_t i = 0; i < vChanged.size(); i++)
+            vPage.push_back(&vNodeList[vChanged[i].second]);
+        return fMore;
+    }
+
+    /// Number of enabled nodes old enough to be ranked
+    int StableSize(NodeVector& vNodeList)
+    {
+        int nStable_size = 0;
+        int nMinProtocol = ActiveProtocol();
+        bool fFilterAge = Traits::IsMinAgeEnforced();
+
+        BOOST_FOREACH (Node& node, vNodeList) {
+            if (node.protocolVersion < nMinProtocol) {
+                continue; // Skip obsolete versions
+            }
+            if (fFilterAge && GetAdjustedTime() - node.sigTime < Traits::nMinWinnerAge) {
+                continue; // Skip nodes younger than (default) 8000 sec
+            }
+            if (!node.IsEnabled())
+                continue; // Skip not-enabled nodes
+
+            nStable_size++;
+        }
+
+        return nStable_size;
+    }
+
+    /// Get the (cached) ranking of the list against the hash of block nBlockHeight
+    const CNodeRanking& GetRanking(NodeVector& vNodeList, int64_t nBlockHeight, int minProtocol, bool fOnlyActive, bool fMinAge)
+    {
+        uint256 hashTip = 0;
+        if (chainActive.Tip() != NULL) hashTip = chainActive.Tip()->GetBlockHash();
+        if (hashTip != hashRankingTip) {
+            mapRankings.clear();
+            hashRankingTip = hashTip;
+        }
+        CheckDue(vNodeList);
+
+        // the enabled state and the age filter depend on the time, so don't keep a ranking longer than a check cycle
+        CNodeRankingKey key(nBlockHeight, minProtocol, fOnlyActive, fMinAge);
+        NodeRankingMap::iterator it = mapRankings.find(key);
+        if (it != mapRankings.end() && GetTime() - it->second.nTimeCreated < Traits::nCheckSeconds)
+            return it->second;
+
+        if (mapRankings.size() >= Traits::nRankingCacheSize) mapRankings.clear();
+
+        std::vector<std::pair<int64_t, CTxIn> > vecScores;
+        int64_t nAge = 0;
+        bool fFilterAge = fMinAge && Traits::IsMinAgeEnforced();
+
+        //make sure we know about this block
+        uint256 hash = 0;
+        if (Traits::GetBlockHash(hash, nBlockHeight)) {
+            CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+            ss << hash;
+            uint256 hash2 = ss.GetHash();
+
+            BOOST_FOREACH (Node& node, vNodeList) {
+                if (node.protocolVersion < minProtocol) {
+                    LogPrint(Traits::LogCategory(), "Skipping node with obsolete version %d\n", node.protocolVersion);
+                    continue; // Skip obsolete versions
+                }
+
+                if (fFilterAge) {
+                    nAge = GetAdjustedTime() - node.sigTime;
+                    if (nAge < Traits::nMinWinnerAge) {
+                        if (fDebug) LogPrint(Traits::LogCategory(), "Skipping just activated node. Age: %ld\n", nAge);
+                        continue; // Skip nodes younger than (default) 8000 sec
+                    }
+                }
+                if (fOnlyActive && !node.IsEnabled()) continue;
+                uint256 n = node.CalculateScore(hash, hash2);
+                int64_t n2 = n.GetCompact(false);
+
+                vecScores.push_back(std::make_pair(n2, Traits::GetVin(node)));
+            }
+
+            std::sort(vecScores.rbegin(), vecScores.rend(), CompareScoreTxIn());
+        }
+
+        CNodeRanking& ranking = mapRankings[key];
+        ranking.Set(vecScores, GetTime());
+        return ranking;
+    }
+
+    /// The enabled node with the highest score
+    Node* GetCurrent(NodeVector& vNodeList, int64_t nBlockHeight, int minProtocol)
+    {
+        const CNodeRanking& ranking = GetRanking(vNodeList, nBlockHeight, minProtocol, true, false);
+        if (ranking.GetScores().empty() || ranking.GetScores()[0].first <= 0) return NULL;
+
+        return Find(vNodeList, ranking.GetScores()[0].second.prevout);
+    }
+
+    int GetRank(NodeVector& vNodeList, const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+    {
+        return GetRanking(vNodeList, nBlockHeight, minProtocol, fOnlyActive, true).GetRank(vin.prevout);
+    }
+
+    Node* GetByRank(NodeVector& vNodeList, int nRank, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+    {
+        const std::vector<std::pair<int64_t, CTxIn> >& vecScores = GetRanking(vNodeList, nBlockHeight, minProtocol, fOnlyActive, false).GetScores();
+        if (nRank < 1 || nRank > (int)vecScores.size()) return NULL;
+
+        return Find(vNodeList, vecScores[nRank - 1].second.prevout);
+    }
+};
+
+#endif // NODETIER_H
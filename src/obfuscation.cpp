@@ -12,6 +12,7 @@
 #include "master/nodeman.h"
 #include "max/nodeman.h"
 #include "script/sign.h"
+#include "sigverify.h"
 #include "swifttx.h"
 #include "ui_interface.h"
 #include "util.h"
@@ -2334,8 +2335,15 @@ bool CObfuScationSigner::VerifyMessage(CPubKey pubkey, vector<unsigned char>& vc
     ss << strMessageMagic;
     ss << strMessage;
 
+    // the same messages are relayed by many peers, so recover each key only once
     CPubKey pubkey2;
-    if (!pubkey2.RecoverCompact(ss.GetHash(), vchSig)) {
+    uint256 hash = ss.GetHash();
+    if (!sigRecoveryCache.Get(hash, vchSig, pubkey2)) {
+        if (!pubkey2.RecoverCompact(hash, vchSig))
+            pubkey2 = CPubKey();
+        sigRecoveryCache.Set(hash, vchSig, pubkey2);
+    }
+    if (!pubkey2.IsValid()) {
         errorMessage = _("Error recovering public key.");
         return false;
     }
@@ -165,7 +165,7 @@ void MaxnodeList::StartAll(std::string strCommand)
     updateMyNodeList(true);
 }
 
-void MaxnodeList::updateMyMaxnodeInfo(QString strMaxAlias, QString strAddr, CMaxnode* pmax)
+void MaxnodeList::updateMyMaxnodeInfo(QString strMaxAlias, QString strAddr, const CMaxnode* pmax)
 {
     LOCK(cs_maxlistupdate);
     bool fOldRowFound = false;
@@ -213,6 +213,7 @@ void MaxnodeList::updateMyNodeList(bool fForce)
     if (nSecondsTillUpdate > 0 && !fForce) return;
     nTimeMyListUpdated = GetTime();
 
+    CMaxnodeSnapshotRef snapshot = maxnodeman.GetSnapshot();
     ui->tableWidgetMyMaxnodes->setSortingEnabled(false);
     BOOST_FOREACH (CMaxnodeConfig::CMaxnodeEntry maxe, maxnodeConfig.getEntries()) {
         int nIndex;
@@ -220,7 +221,7 @@ void MaxnodeList::updateMyNodeList(bool fForce)
             continue;
 
         CTxIn txin = CTxIn(uint256S(maxe.getTxHash()), uint32_t(nIndex));
-        CMaxnode* pmax = maxnodeman.Find(txin);
+        const CMaxnode* pmax = snapshot->Find(txin.prevout);
         updateMyMaxnodeInfo(QString::fromStdString(maxe.getAlias()), QString::fromStdString(maxe.getIp()), pmax);
     }
     ui->tableWidgetMyMaxnodes->setSortingEnabled(true);
@@ -52,7 +52,7 @@ private:
     bool fFilterUpdated;
 
 public Q_SLOTS:
-    void updateMyMaxnodeInfo(QString strMaxAlias, QString strAddr, CMaxnode* pmax);
+    void updateMyMaxnodeInfo(QString strMaxAlias, QString strAddr, const CMaxnode* pmax);
     void updateMyNodeList(bool fForce = false);
 
 Q_SIGNALS:
@@ -13,6 +13,7 @@
 #include "master/nodeconfig.h"
 #include "master/nodeman.h"
 #include "rpc/server.h"
+#include "sigverify.h"
 #include "utilmoneystr.h"
 
 #include <univalue.h>
@@ -228,40 +229,39 @@ UniValue listmasternodes(const UniValue& params, bool fHelp)
         if(!pindex) return 0;
         nHeight = pindex->nHeight;
     }
-    std::vector<pair<int, CMasternode> > vMasternodeRanks = mnodeman.GetMasternodeRanks(nHeight);
-    BOOST_FOREACH (PAIRTYPE(int, CMasternode) & s, vMasternodeRanks) {
+    CMasternodeSnapshotRef snapshot = mnodeman.GetSnapshot();
+    int nEnabled = mnodeman.CountEnabled();
+    std::vector<pair<int, const CMasternode*> > vMasternodeRanks = snapshot->GetRanks(nHeight, 0);
+    BOOST_FOREACH (PAIRTYPE(int, const CMasternode*) & s, vMasternodeRanks) {
         UniValue obj(UniValue::VOBJ);
-        std::string strVin = s.second.vin.prevout.ToStringShort();
-        std::string strTxHash = s.second.vin.prevout.hash.ToString();
-        uint32_t oIdx = s.second.vin.prevout.n;
-
-        CMasternode* mn = mnodeman.Find(s.second.vin);
-
-        if (mn != NULL) {
-            if (strFilter != "" && strTxHash.find(strFilter) == string::npos &&
-                mn->Status().find(strFilter) == string::npos &&
-                CBitcoinAddress(mn->pubKeyCollateralAddress.GetID()).ToString().find(strFilter) == string::npos) continue;
-
-            std::string strStatus = mn->Status();
-            std::string strHost;
-            int port;
-            SplitHostPort(mn->addr.ToString(), port, strHost);
-            CNetAddr node = CNetAddr(strHost, false);
-            std::string strNetwork = GetNetworkName(node.GetNetwork());
-
-            obj.push_back(Pair("rank", (strStatus == "ENABLED" ? s.first : 0)));
-            obj.push_back(Pair("network", strNetwork));
-            obj.push_back(Pair("txhash", strTxHash));
-            obj.push_back(Pair("outidx", (uint64_t)oIdx));
-            obj.push_back(Pair("status", strStatus));
-            obj.push_back(Pair("addr", CBitcoinAddress(mn->pubKeyCollateralAddress.GetID()).ToString()));
-            obj.push_back(Pair("version", mn->protocolVersion));
-            obj.push_back(Pair("lastseen", (int64_t)mn->lastPing.sigTime));
-            obj.push_back(Pair("activetime", (int64_t)(mn->lastPing.sigTime - mn->sigTime)));
-            obj.push_back(Pair("lastpaid", (int64_t)mn->GetLastPaid()));
+        const CMasternode* mn = s.second;
+        std::string strVin = mn->vin.prevout.ToStringShort();
+        std::string strTxHash = mn->vin.prevout.hash.ToString();
+        uint32_t oIdx = mn->vin.prevout.n;
+
+        if (strFilter != "" && strTxHash.find(strFilter) == string::npos &&
+            mn->Status().find(strFilter) == string::npos &&
+            CBitcoinAddress(mn->pubKeyCollateralAddress.GetID()).ToString().find(strFilter) == string::npos) continue;
+
+        std::string strStatus = mn->Status();
+        std::string strHost;
+        int port;
+        SplitHostPort(mn->addr.ToString(), port, strHost);
+        CNetAddr node = CNetAddr(strHost, false);
+        std::string strNetwork = GetNetworkName(node.GetNetwork());
+
+        obj.push_back(Pair("rank", (strStatus == "ENABLED" ? s.first : 0)));
+        obj.push_back(Pair("network", strNetwork));
+        obj.push_back(Pair("txhash", strTxHash));
+        obj.push_back(Pair("outidx", (uint64_t)oIdx));
+        obj.push_back(Pair("status", strStatus));
+        obj.push_back(Pair("addr", CBitcoinAddress(mn->pubKeyCollateralAddress.GetID()).ToString()));
+        obj.push_back(Pair("version", mn->protocolVersion));
+        obj.push_back(Pair("lastseen", (int64_t)mn->lastPing.sigTime));
+        obj.push_back(Pair("activetime", (int64_t)(mn->lastPing.sigTime - mn->sigTime)));
+        obj.push_back(Pair("lastpaid", (int64_t)mn->GetLastPaid(nEnabled)));
 
-            ret.push_back(obj);
-        }
+        ret.push_back(obj);
     }
 
     return ret;
@@ -847,11 +847,11 @@ UniValue getmasternodescores (const UniValue& params, bool fHelp)
     }
     UniValue obj(UniValue::VOBJ);
 
-    std::vector<CMasternode> vMasternodes = mnodeman.GetFullMasternodeVector();
+    CMasternodeSnapshotRef snapshot = mnodeman.GetSnapshot();
     for (int nHeight = chainActive.Tip()->nHeight - nLast; nHeight < chainActive.Tip()->nHeight + 20; nHeight++) {
         uint256 nHigh = 0;
-        CMasternode* pBestMasternode = NULL;
-        BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+        const CMasternode* pBestMasternode = NULL;
+        BOOST_FOREACH (const CMasternode& mn, snapshot->GetNodes()) {
             uint256 n = mn.CalculateScore(1, nHeight - 100);
             if (n > nHigh) {
                 nHigh = n;
@@ -865,6 +865,75 @@ UniValue getmasternodescores (const UniValue& params, bool fHelp)
     return obj;
 }
 
+UniValue getsigverifyinfo (const UniValue& params, bool fHelp)
+{
+    if (fHelp || (params.size() != 0))
+        throw runtime_error(
+            "getsigverifyinfo\n"
+            "\nGet the state of the masternode message signature verification pool\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"threads\": n,             (numeric) Verification threads running\n"
+            "  \"queued\": n,              (numeric) Messages waiting for a thread\n"
+            "  \"pending\": n,             (numeric) Messages waiting for a thread or to be processed\n"
+            "  \"deferred\": n,            (numeric) Messages handed to the pool since startup\n"
+            "  \"inline\": n,              (numeric) Messages verified on the message handler because the pool was full\n"
+            "  \"dropped\": n,             (numeric) Messages dropped because their peer disconnected\n"
+            "  \"processed\": n,           (numeric) Messages processed after verification\n"
+            "  \"signatures\": n,          (numeric) Signatures checked\n"
+            "  \"signaturesfailed\": n,    (numeric) Signatures no key could be recovered from\n"
+            "  \"batches\": n,             (numeric) Batches run by the threads\n"
+            "  \"verifylatency\": n,       (numeric) Average time from arrival to verification, in microseconds\n"
+            "  \"verifylatencymax\": n,    (numeric) Maximum time from arrival to verification, in microseconds\n"
+            "  \"processlatency\": n,      (numeric) Average time from arrival to processing, in microseconds\n"
+            "  \"processlatencymax\": n,   (numeric) Maximum time from arrival to processing, in microseconds\n"
+            "  \"cache\": {                (json object) Cache of recovered signature keys\n"
+            "    \"size\": n,              (numeric) Keys cached\n"
+            "    \"hits\": n,              (numeric) Lookups answered from the cache\n"
+            "    \"misses\": n,            (numeric) Lookups that needed a key recovery\n"
+            "    \"hitrate\": x.xxx,       (numeric) Share of lookups answered from the cache\n"
+            "    \"evictions\": n          (numeric) Keys evicted to stay within -maxmsgsigcachesize\n"
+            "  }\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getsigverifyinfo", "") + HelpExampleRpc("getsigverifyinfo", ""));
+
+    CSigVerifyStats stats;
+    sigVerifyPool.GetStats(stats);
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("threads", stats.nWorkers));
+    obj.push_back(Pair("queued", (uint64_t)stats.nQueued));
+    obj.push_back(Pair("pending", (uint64_t)stats.nPending));
+    obj.push_back(Pair("deferred", stats.nMessagesDeferred));
+    obj.push_back(Pair("inline", stats.nMessagesInline));
+    obj.push_back(Pair("dropped", stats.nMessagesDropped));
+    obj.push_back(Pair("processed", stats.nMessagesReplayed));
+    obj.push_back(Pair("signatures", stats.nSignaturesChecked));
+    obj.push_back(Pair("signaturesfailed", stats.nSignaturesFailed));
+    obj.push_back(Pair("batches", stats.nBatches));
+    obj.push_back(Pair("verifylatency", stats.nVerifyLatencyAvg));
+    obj.push_back(Pair("verifylatencymax", stats.nVerifyLatencyMax));
+    obj.push_back(Pair("processlatency", stats.nReplayLatencyAvg));
+    obj.push_back(Pair("processlatencymax", stats.nReplayLatencyMax));
+
+    CSigRecoveryCacheStats cacheStats;
+    sigRecoveryCache.GetStats(cacheStats);
+    uint64_t nLookups = cacheStats.nHits + cacheStats.nMisses;
+
+    UniValue cache(UniValue::VOBJ);
+    cache.push_back(Pair("size", (uint64_t)cacheStats.nSize));
+    cache.push_back(Pair("hits", cacheStats.nHits));
+    cache.push_back(Pair("misses", cacheStats.nMisses));
+    cache.push_back(Pair("hitrate", nLookups ? (double)cacheStats.nHits / nLookups : 0.0));
+    cache.push_back(Pair("evictions", cacheStats.nEvictions));
+    obj.push_back(Pair("cache", cache));
+
+    return obj;
+}
+
 bool DecodeHexMnb(CMasternodeBroadcast& mnb, std::string strHexMnb) {
 
     if (!IsHex(strHexMnb))
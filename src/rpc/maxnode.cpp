@@ -228,40 +228,39 @@ UniValue listmaxnodes(const UniValue& params, bool fHelp)
         if(!pindex) return 0;
         nHeight = pindex->nHeight;
     }
-    std::vector<pair<int, CMaxnode> > vMaxnodeRanks = maxnodeman.GetMaxnodeRanks(nHeight);
-    BOOST_FOREACH (PAIRTYPE(int, CMaxnode) & s, vMaxnodeRanks) {
+    CMaxnodeSnapshotRef snapshot = maxnodeman.GetSnapshot();
+    int nEnabled = maxnodeman.CountEnabled();
+    std::vector<pair<int, const CMaxnode*> > vMaxnodeRanks = snapshot->GetRanks(nHeight, 0);
+    BOOST_FOREACH (PAIRTYPE(int, const CMaxnode*) & s, vMaxnodeRanks) {
         UniValue obj(UniValue::VOBJ);
-        std::string strVin = s.second.maxvin.prevout.ToStringShort();
-        std::string strTxHash = s.second.maxvin.prevout.hash.ToString();
-        uint32_t oIdx = s.second.maxvin.prevout.n;
-
-        CMaxnode* max = maxnodeman.Find(s.second.maxvin);
-
-        if (max != NULL) {
-            if (strFilter != "" && strTxHash.find(strFilter) == string::npos &&
-                max->Status().find(strFilter) == string::npos &&
-                CBitcoinAddress(max->pubKeyCollateralAddress.GetID()).ToString().find(strFilter) == string::npos) continue;
-
-            std::string strStatus = max->Status();
-            std::string strHost;
-            int port;
-            SplitHostPort(max->addr.ToString(), port, strHost);
-            CNetAddr node = CNetAddr(strHost, false);
-            std::string strNetwork = GetNetworkName(node.GetNetwork());
-
-            obj.push_back(Pair("rank", (strStatus == "ENABLED" ? s.first : 0)));
-            obj.push_back(Pair("network", strNetwork));
-            obj.push_back(Pair("txhash", strTxHash));
-            obj.push_back(Pair("outidx", (uint64_t)oIdx));
-            obj.push_back(Pair("status", strStatus));
-            obj.push_back(Pair("addr", CBitcoinAddress(max->pubKeyCollateralAddress.GetID()).ToString()));
-            obj.push_back(Pair("version", max->protocolVersion));
-            obj.push_back(Pair("lastseen", (int64_t)max->lastPing.sigTime));
-            obj.push_back(Pair("activetime", (int64_t)(max->lastPing.sigTime - max->sigTime)));
-            obj.push_back(Pair("lastpaid", (int64_t)max->GetLastPaid()));
+        const CMaxnode* max = s.second;
+        std::string strVin = max->maxvin.prevout.ToStringShort();
+        std::string strTxHash = max->maxvin.prevout.hash.ToString();
+        uint32_t oIdx = max->maxvin.prevout.n;
+
+        if (strFilter != "" && strTxHash.find(strFilter) == string::npos &&
+            max->Status().find(strFilter) == string::npos &&
+            CBitcoinAddress(max->pubKeyCollateralAddress.GetID()).ToString().find(strFilter) == string::npos) continue;
+
+        std::string strStatus = max->Status();
+        std::string strHost;
+        int port;
+        SplitHostPort(max->addr.ToString(), port, strHost);
+        CNetAddr node = CNetAddr(strHost, false);
+        std::string strNetwork = GetNetworkName(node.GetNetwork());
+
+        obj.push_back(Pair("rank", (strStatus == "ENABLED" ? s.first : 0)));
+        obj.push_back(Pair("network", strNetwork));
+        obj.push_back(Pair("txhash", strTxHash));
+        obj.push_back(Pair("outidx", (uint64_t)oIdx));
+        obj.push_back(Pair("status", strStatus));
+        obj.push_back(Pair("addr", CBitcoinAddress(max->pubKeyCollateralAddress.GetID()).ToString()));
+        obj.push_back(Pair("version", max->protocolVersion));
+        obj.push_back(Pair("lastseen", (int64_t)max->lastPing.sigTime));
+        obj.push_back(Pair("activetime", (int64_t)(max->lastPing.sigTime - max->sigTime)));
+        obj.push_back(Pair("lastpaid", (int64_t)max->GetLastPaid(nEnabled)));
 
-            ret.push_back(obj);
-        }
+        ret.push_back(obj);
     }
 
     return ret;
@@ -849,11 +848,11 @@ UniValue getmaxnodescores (const UniValue& params, bool fHelp)
     }
     UniValue obj(UniValue::VOBJ);
 
-    std::vector<CMaxnode> vMaxnodes = maxnodeman.GetFullMaxnodeVector();
+    CMaxnodeSnapshotRef snapshot = maxnodeman.GetSnapshot();
     for (int nHeight = chainActive.Tip()->nHeight - nLast; nHeight < chainActive.Tip()->nHeight + 20; nHeight++) {
         uint256 nHigh = 0;
-        CMaxnode* pBestMaxnode = NULL;
-        BOOST_FOREACH (CMaxnode& max, vMaxnodes) {
+        const CMaxnode* pBestMaxnode = NULL;
+        BOOST_FOREACH (const CMaxnode& max, snapshot->GetNodes()) {
             uint256 n = max.CalculateScore(1, nHeight - 100);
             if (n > nHigh) {
                 nHigh = n;
@@ -184,6 +184,10 @@ UniValue mnsync(const UniValue& params, bool fHelp)
             "  \"countBudgetItemFin\": n,       (numeric) Number of MN budget finalization messages (local)\n"
             "  \"RequestedMasternodeAssets\": n, (numeric) Status code of last sync phase\n"
             "  \"RequestedMasternodeAttempt\": n, (numeric) Status code of last sync attempt\n"
+            "  \"stageMillis\": {                (object) Milliseconds each stage took, the running one so far\n"
+            "    \"MASTERNODE_SYNC_SPORKS\": n,\n"
+            "    ...\n"
+            "  }\n"
             "}\n"
 
             "\nResult ('reset' mode):\n"
@@ -213,6 +217,14 @@ UniValue mnsync(const UniValue& params, bool fHelp)
         obj.push_back(Pair("RequestedMasternodeAssets", masternodeSync.RequestedMasternodeAssets));
         obj.push_back(Pair("RequestedMasternodeAttempt", masternodeSync.RequestedMasternodeAttempt));
 
+        UniValue stageMillis(UniValue::VOBJ);
+        for (int nAsset = MASTERNODE_SYNC_SPORKS; nAsset <= MASTERNODE_SYNC_BUDGET; nAsset++) {
+            int64_t nMillis = masternodeSync.GetStageMillis(nAsset);
+            if (nMillis >= 0)
+                stageMillis.push_back(Pair(masternodeSync.GetAssetName(nAsset), nMillis));
+        }
+        obj.push_back(Pair("stageMillis", stageMillis));
+
         return obj;
     }
 
@@ -251,6 +263,10 @@ UniValue maxsync(const UniValue& params, bool fHelp)
             "  \"countMaxnodeWinner\": n,    (numeric) Number of MAX winner messages (local)\n"
             "  \"RequestedMaxnodeAssets\": n, (numeric) Status code of last sync phase\n"
             "  \"RequestedMaxnodeAttempt\": n, (numeric) Status code of last sync attempt\n"
+            "  \"stageMillis\": {                (object) Milliseconds each stage took, the running one so far\n"
+            "    \"MAXNODE_SYNC_SPORKS\": n,\n"
+            "    ...\n"
+            "  }\n"
             "}\n"
 
             "\nResult ('reset' mode):\n"
@@ -275,6 +291,14 @@ UniValue maxsync(const UniValue& params, bool fHelp)
         obj.push_back(Pair("RequestedMaxnodeAssets", maxnodeSync.RequestedMaxnodeAssets));
         obj.push_back(Pair("RequestedMaxnodeAttempt", maxnodeSync.RequestedMaxnodeAttempt));
 
+        UniValue stageMillis(UniValue::VOBJ);
+        for (int nAsset = MAXNODE_SYNC_SPORKS; nAsset <= MAXNODE_SYNC_BUDGET; nAsset++) {
+            int64_t nMillis = maxnodeSync.GetStageMillis(nAsset);
+            if (nMillis >= 0)
+                stageMillis.push_back(Pair(maxnodeSync.GetAssetName(nAsset), nMillis));
+        }
+        obj.push_back(Pair("stageMillis", stageMillis));
+
         return obj;
     }
 
@@ -370,6 +370,7 @@ static const CRPCCommand vRPCCommands[] =
         {"lytix", "getmasternodestatus", &getmasternodestatus, true, true, false},
         {"lytix", "getmasternodewinners", &getmasternodewinners, true, true, false},
         {"lytix", "getmasternodescores", &getmasternodescores, true, true, false},
+        {"lytix", "getsigverifyinfo", &getsigverifyinfo, true, true, false},
 	{"lytix", "maxnode", &maxnode, true, true, false},
         {"lytix", "listmaxnodes", &listmaxnodes, true, true, false},
         {"lytix", "getmaxnodecount", &getmaxnodecount, true, true, false},
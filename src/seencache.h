@@ -0,0 +1,184 @@
+// Copyright (c) 2019 The Lytix developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SEENCACHE_H
+#define SEENCACHE_H
+
+#include "serialize.h"
+#include "uint256.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <utility>
+
+#include <boost/unordered_map.hpp>
+
+/** -maxseencachesize default (entries in each cache of seen masternode, maxnode and budget messages) */
+static const unsigned int DEFAULT_MAX_SEEN_CACHE_SIZE = 100000;
+
+struct SeenCacheHasher {
+    size_t operator()(const uint256& hash) const { return hash.GetLow64(); }
+};
+
+/**
+ * Messages seen on the network, keyed by their hash.
+ *
+ * The managers keep broadcasts, pings and votes around to skip duplicates and
+ * to answer getdata requests. Entries are dropped once they haven't been
+ * inserted or looked up with operator[] for nMaxAge seconds, and the least
+ * recently used ones go first when the cache grows past -maxseencachesize, so
+ * memory stays flat no matter how much the network relays.
+ *
+ * Use times are queued oldest first; a later use of the same entry leaves the
+ * earlier record in the queue, which is skipped when it comes up and dropped
+ * for good once stale records make up half of the queue.
+ *
+ * The contents are relay state that isn't kept across restarts: the cache
+ * serializes as an empty map and discards what it reads, so the old cache
+ * file formats still load.
+ */
+template <typename V>
+class CSeenCache
+{
+public:
+    typedef boost::unordered_map<uint256, V, SeenCacheHasher> map_type;
+    typedef typename map_type::value_type value_type;
+    typedef typename map_type::iterator iterator;
+    typedef typename map_type::const_iterator const_iterator;
+
+private:
+    map_type mapEntries;
+    boost::unordered_map<uint256, int64_t, SeenCacheHasher> mapLastUse;
+    std::deque<std::pair<int64_t, uint256> > queueUse;
+    int64_t nMaxAge;
+
+    void Touch(const uint256& hash)
+    {
+        int64_t nNow = GetTime();
+        int64_t& nLastUse = mapLastUse[hash];
+        if (nLastUse == nNow)
+            return;
+        nLastUse = nNow;
+        queueUse.push_back(std::make_pair(nNow, hash));
+    }
+
+    void EraseUse(const uint256& hash)
+    {
+        mapLastUse.erase(hash);
+        if (queueUse.size() > 2 * mapLastUse.size() + 64) {
+            std::deque<std::pair<int64_t, uint256> > queueLive;
+            for (size_t i = 0; i < queueUse.size(); i++) {
+                boost::unordered_map<uint256, int64_t, SeenCacheHasher>::const_iterator it = mapLastUse.find(queueUse[i].second);
+                if (it != mapLastUse.end() && it->second == queueUse[i].first)
+                    queueLive.push_back(queueUse[i]);
+            }
+            queueUse.swap(queueLive);
+        }
+    }
+
+    /// Drop expired entries, and the least recently used ones until nRoom more fit
+    void Evict(size_t nRoom)
+    {
+        int64_t nMaxSize = std::max(GetArg("-maxseencachesize", DEFAULT_MAX_SEEN_CACHE_SIZE), (int64_t)1);
+        int64_t nExpired = nMaxAge > 0 ? GetTime() - nMaxAge : 0;
+        while (!queueUse.empty()) {
+            const std::pair<int64_t, uint256>& use = queueUse.front();
+            boost::unordered_map<uint256, int64_t, SeenCacheHasher>::iterator it = mapLastUse.find(use.second);
+            if (it != mapLastUse.end() && it->second == use.first) {
+                if (use.first >= nExpired && static_cast<int64_t>(mapEntries.size() + nRoom) <= nMaxSize)
+                    break;
+                mapEntries.erase(use.second);
+                mapLastUse.erase(it);
+            }
+            queueUse.pop_front();
+        }
+    }
+
+public:
+    /// Entries unused for nMaxAgeIn seconds expire, 0 keeps them until the cache is full
+    explicit CSeenCache(int64_t nMaxAgeIn) : nMaxAge(nMaxAgeIn) {}
+
+    size_t count(const uint256& hash) const { return mapEntries.count(hash); }
+    size_t size() const { return mapEntries.size(); }
+    bool empty() const { return mapEntries.empty(); }
+
+    iterator begin() { return mapEntries.begin(); }
+    iterator end() { return mapEntries.end(); }
+    const_iterator begin() const { return mapEntries.begin(); }
+    const_iterator end() const { return mapEntries.end(); }
+
+    iterator find(const uint256& hash) { return mapEntries.find(hash); }
+    const_iterator find(const uint256& hash) const { return mapEntries.find(hash); }
+
+    /// Add an entry unless the hash is already there, like std::map::insert
+    std::pair<iterator, bool> insert(const value_type& value)
+    {
+        iterator it = mapEntries.find(value.first);
+        if (it != mapEntries.end())
+            return std::make_pair(it, false);
+        Evict(1);
+        Touch(value.first);
+        return mapEntries.insert(value);
+    }
+
+    /// Entry of the hash, default constructed if it's new, and mark it as used
+    V& operator[](const uint256& hash)
+    {
+        if (!mapEntries.count(hash))
+            Evict(1);
+        Touch(hash);
+        return mapEntries[hash];
+    }
+
+    size_t erase(const uint256& hash)
+    {
+        if (!mapEntries.erase(hash))
+            return 0;
+        EraseUse(hash);
+        return 1;
+    }
+
+    void erase(iterator it)
+    {
+        uint256 hash = it->first;
+        mapEntries.erase(it);
+        EraseUse(hash);
+    }
+
+    /// Drop the entries that expired since the last insert
+    void Expire()
+    {
+        Evict(0);
+    }
+
+    void clear()
+    {
+        mapEntries.clear();
+        mapLastUse.clear();
+        queueUse.clear();
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return GetSizeOfCompactSize(0);
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        WriteCompactSize(s, 0);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        std::map<uint256, V> mapUnused;
+        ::Unserialize(s, mapUnused, nType, nVersion);
+    }
+};
+
+#endif // SEENCACHE_H
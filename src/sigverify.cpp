@@ -0,0 +1,367 @@
+// Copyright (c) 2019 The Lytix developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "sigverify.h"
+
+#include "hash.h"
+#include "main.h"
+#include "master/node-budget.h"
+#include "master/node-payments.h"
+#include "master/nodeman.h"
+#include "max/node-payments.h"
+#include "max/nodeman.h"
+#include "random.h"
+#include "swifttx.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <boost/foreach.hpp>
+
+CSigRecoveryCache sigRecoveryCache;
+CSigVerifyPool sigVerifyPool;
+
+CSigRecoveryCache::CSigRecoveryCache() : nSalt(0),
+                                         nHits(0),
+                                         nMisses(0),
+                                         nEvictions(0)
+{
+}
+
+// requires mutex
+uint256 CSigRecoveryCache::GetEntryHash(const uint256& hash, const std::vector<unsigned char>& vchSig)
+{
+    // salted, so that peers can't predict which entries collide or get evicted
+    if (nSalt == 0) nSalt = GetRandHash();
+    return Hash(nSalt.begin(), nSalt.end(), hash.begin(), hash.end(), vchSig.begin(), vchSig.end());
+}
+
+bool CSigRecoveryCache::Get(const uint256& hash, const std::vector<unsigned char>& vchSig, CPubKey& pubkeyRet)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+
+    std::map<uint256, CPubKey>::const_iterator it = mapKeys.find(GetEntryHash(hash, vchSig));
+    if (it == mapKeys.end()) {
+        nMisses++;
+        return false;
+    }
+
+    nHits++;
+    pubkeyRet = it->second;
+    return true;
+}
+
+void CSigRecoveryCache::Set(const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey)
+{
+    // ~150 bytes per entry
+    int64_t nMaxCacheSize = GetArg("-maxmsgsigcachesize", DEFAULT_MAX_MSGSIGCACHE_SIZE);
+    if (nMaxCacheSize <= 0) return;
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+
+    while (static_cast<int64_t>(mapKeys.size()) >= nMaxCacheSize) {
+        // Evict a random entry, the keys are salted hashes so any position is as good as any other
+        std::map<uint256, CPubKey>::iterator it = mapKeys.lower_bound(GetRandHash());
+        if (it == mapKeys.end())
+            it = mapKeys.begin();
+        mapKeys.erase(it);
+        nEvictions++;
+    }
+
+    mapKeys[GetEntryHash(hash, vchSig)] = pubkey;
+}
+
+void CSigRecoveryCache::GetStats(CSigRecoveryCacheStats& stats)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+
+    stats.nSize = mapKeys.size();
+    stats.nHits = nHits;
+    stats.nMisses = nMisses;
+    stats.nEvictions = nEvictions;
+}
+
+CSigCheck::CSigCheck(const std::string& strMessage, const std::vector<unsigned char>& vchSigIn) : vchSig(vchSigIn)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << strMessageMagic;
+    ss << strMessage;
+    hash = ss.GetHash();
+}
+
+void CSigCheck::operator()()
+{
+    if (sigRecoveryCache.Get(hash, vchSig, pubkeyRecovered)) return;
+
+    if (!pubkeyRecovered.RecoverCompact(hash, vchSig))
+        pubkeyRecovered = CPubKey();
+    sigRecoveryCache.Set(hash, vchSig, pubkeyRecovered);
+}
+
+CSigVerifyJob::CSigVerifyJob(NodeId nodeIdIn, const std::string& strCommandIn, const CDataStream& vRecvIn) : nodeId(nodeIdIn),
+                                                                                                                strCommand(strCommandIn),
+                                                                                                                vRecv(vRecvIn),
+                                                                                                                nTimeQueued(GetTimeMicros()),
+                                                                                                                fDone(false)
+{
+}
+
+/**
+ * Collect the signatures carried by a masternode or maxnode message. Messages
+ * the handlers have already seen are left alone, they are dropped cheaply when
+ * processed right away. The seen maps are read the same way the handlers
+ * themselves read them on this thread.
+ */
+static bool GetSignatureChecks(const std::string& strCommand, CDataStream vRecv, std::vector<CSigCheck>& vChecks)
+{
+    if (strCommand == "mnb") {
+        CMasternodeBroadcast mnb;
+        vRecv >> mnb;
+        if (mnodeman.mapSeenMasternodeBroadcast.count(mnb.GetHash())) return false;
+        vChecks.push_back(CSigCheck(mnb.GetNewStrMessage(), mnb.sig));
+        vChecks.push_back(CSigCheck(mnb.GetOldStrMessage(), mnb.sig));
+        vChecks.push_back(CSigCheck(mnb.lastPing.GetStrMessage(), mnb.lastPing.vchSig));
+    } else if (strCommand == "mnp") {
+        CMasternodePing mnp;
+        vRecv >> mnp;
+        if (mnodeman.mapSeenMasternodePing.count(mnp.GetHash())) return false;
+        // a ping that comes too soon after the last one is rejected before its signature is looked at
+        if (mnodeman.IsPingTooEarly(mnp)) return false;
+        vChecks.push_back(CSigCheck(mnp.GetStrMessage(), mnp.vchSig));
+    } else if (strCommand == "mnw") {
+        CMasternodePaymentWinner winner;
+        vRecv >> winner;
+        if (masternodePayments.mapMasternodePayeeVotes.count(winner.GetHash())) return false;
+        vChecks.push_back(CSigCheck(winner.GetStrMessage(), winner.vchSig));
+    } else if (strCommand == "maxb") {
+        CMaxnodeBroadcast maxb;
+        vRecv >> maxb;
+        if (maxnodeman.mapSeenMaxnodeBroadcast.count(maxb.GetHash())) return false;
+        vChecks.push_back(CSigCheck(maxb.GetNewStrMessage(), maxb.sig));
+        vChecks.push_back(CSigCheck(maxb.GetOldStrMessage(), maxb.sig));
+        vChecks.push_back(CSigCheck(maxb.lastPing.GetStrMessage(), maxb.lastPing.vchSig));
+    } else if (strCommand == "maxp") {
+        CMaxnodePing maxp;
+        vRecv >> maxp;
+        if (maxnodeman.mapSeenMaxnodePing.count(maxp.GetHash())) return false;
+        if (maxnodeman.IsPingTooEarly(maxp)) return false;
+        vChecks.push_back(CSigCheck(maxp.GetStrMessage(), maxp.vchSig));
+    } else if (strCommand == "maxw") {
+        CMaxnodePaymentWinner winner;
+        vRecv >> winner;
+        if (maxnodePayments.mapMaxnodePayeeVotes.count(winner.GetHash())) return false;
+        vChecks.push_back(CSigCheck(winner.GetStrMessage(), winner.vchSig));
+    } else if (strCommand == "mvote") {
+        CBudgetVote vote;
+        vRecv >> vote;
+        {
+            TRY_LOCK(cs_budget, lockBudget);
+            if (lockBudget && budget.mapSeenMasternodeBudgetVotes.count(vote.GetHash())) return false;
+        }
+        vChecks.push_back(CSigCheck(vote.GetStrMessage(), vote.vchSig));
+    } else if (strCommand == "fbvote") {
+        CFinalizedBudgetVote vote;
+        vRecv >> vote;
+        {
+            TRY_LOCK(cs_budget, lockBudget);
+            if (lockBudget && budget.mapSeenFinalizedBudgetVotes.count(vote.GetHash())) return false;
+        }
+        vChecks.push_back(CSigCheck(vote.GetStrMessage(), vote.vchSig));
+    } else if (strCommand == "txlvote") {
+        CConsensusVote ctx;
+        vRecv >> ctx;
+        if (mapTxLockVote.count(ctx.GetHash())) return false;
+        vChecks.push_back(CSigCheck(ctx.GetStrMessage(), ctx.vchMasterNodeSignature));
+    }
+
+    return !vChecks.empty();
+}
+
+CSigVerifyPool::CSigVerifyPool() : nWorkers(0),
+                                   nPending(0),
+                                   nMessagesDeferred(0),
+                                   nMessagesInline(0),
+                                   nMessagesDropped(0),
+                                   nMessagesVerified(0),
+                                   nMessagesReplayed(0),
+                                   nSignaturesChecked(0),
+                                   nSignaturesFailed(0),
+                                   nBatches(0),
+                                   nVerifyLatencyTotal(0),
+                                   nVerifyLatencyMax(0),
+                                   nReplayLatencyTotal(0),
+                                   nReplayLatencyMax(0)
+{
+}
+
+bool CSigVerifyPool::Defer(CNode* pfrom, const std::string& strCommand, const CDataStream& vRecv)
+{
+    if (fLiteMode) return false;
+
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (nWorkers == 0) return false;
+    }
+
+    CSigVerifyJobRef job(new CSigVerifyJob(pfrom->GetId(), strCommand, vRecv));
+    bool fChecks;
+    try {
+        fChecks = GetSignatureChecks(strCommand, vRecv, job->vChecks);
+    } catch (std::exception&) {
+        // malformed, leave it to the regular handler
+        fChecks = false;
+    }
+
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (!fChecks || nPending >= MAX_SIGVERIFY_QUEUE) {
+            if (!mapPending.count(job->nodeId)) {
+                if (fChecks) nMessagesInline++;
+                return false;
+            }
+
+            // the peer's earlier messages are still waiting, this one is replayed after them as it is,
+            // nothing more is read from the peer until they are (IsFull)
+            if (fChecks) nMessagesInline++;
+            job->vChecks.clear();
+            job->fDone = true;
+            mapPending[job->nodeId].push_back(job);
+            nPending++;
+            return true;
+        }
+
+        queue.push_back(job);
+        mapPending[job->nodeId].push_back(job);
+        nPending++;
+        nMessagesDeferred++;
+    }
+    condWorker.notify_one();
+
+    return true;
+}
+
+bool CSigVerifyPool::PopVerified(NodeId nodeId, CSigVerifyJobRef& job)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+
+    std::map<NodeId, std::deque<CSigVerifyJobRef> >::iterator it = mapPending.find(nodeId);
+    if (it == mapPending.end() || !it->second.front()->fDone) return false;
+
+    job = it->second.front();
+    it->second.pop_front();
+    if (it->second.empty()) mapPending.erase(it);
+    nPending--;
+
+    int64_t nLatency = GetTimeMicros() - job->nTimeQueued;
+    nMessagesReplayed++;
+    nReplayLatencyTotal += nLatency;
+    nReplayLatencyMax = std::max(nReplayLatencyMax, nLatency);
+
+    return true;
+}
+
+bool CSigVerifyPool::IsFull(NodeId nodeId)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+
+    std::map<NodeId, std::deque<CSigVerifyJobRef> >::const_iterator it = mapPending.find(nodeId);
+    if (it == mapPending.end()) return false;
+    return it->second.size() >= MAX_SIGVERIFY_PEER_QUEUE || nPending >= MAX_SIGVERIFY_QUEUE;
+}
+
+void CSigVerifyPool::ForgetNode(NodeId nodeId)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+
+    std::map<NodeId, std::deque<CSigVerifyJobRef> >::iterator it = mapPending.find(nodeId);
+    if (it == mapPending.end()) return;
+
+    // jobs a worker is busy with just finish unnoticed
+    std::deque<CSigVerifyJobRef>::iterator itQueue = queue.begin();
+    while (itQueue != queue.end()) {
+        if ((*itQueue)->nodeId == nodeId)
+            itQueue = queue.erase(itQueue);
+        else
+            ++itQueue;
+    }
+
+    nPending -= it->second.size();
+    nMessagesDropped += it->second.size();
+    mapPending.erase(it);
+}
+
+void CSigVerifyPool::Thread()
+{
+    std::vector<CSigVerifyJobRef> vBatch;
+    vBatch.reserve(SIGVERIFY_BATCH_SIZE);
+
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nWorkers++;
+    }
+
+    while (true) {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (queue.empty())
+                condWorker.wait(lock); // interruption point
+
+            // share the queue between the workers, in batches of at most SIGVERIFY_BATCH_SIZE
+            unsigned int nTake = std::max(1U, std::min(SIGVERIFY_BATCH_SIZE, (unsigned int)queue.size() / nWorkers));
+            while (nTake-- > 0 && !queue.empty()) {
+                vBatch.push_back(queue.front());
+                queue.pop_front();
+            }
+        }
+
+        BOOST_FOREACH (CSigVerifyJobRef& job, vBatch)
+            BOOST_FOREACH (CSigCheck& check, job->vChecks)
+                check();
+
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            int64_t nNow = GetTimeMicros();
+            BOOST_FOREACH (CSigVerifyJobRef& job, vBatch) {
+                job->fDone = true;
+                nMessagesVerified++;
+                nVerifyLatencyTotal += nNow - job->nTimeQueued;
+                nVerifyLatencyMax = std::max(nVerifyLatencyMax, nNow - job->nTimeQueued);
+                BOOST_FOREACH (const CSigCheck& check, job->vChecks) {
+                    nSignaturesChecked++;
+                    if (!check.pubkeyRecovered.IsValid()) nSignaturesFailed++;
+                }
+            }
+            nBatches++;
+        }
+        vBatch.clear();
+
+        // let the message handler replay the verified messages
+        WakeMessageHandler();
+    }
+}
+
+void CSigVerifyPool::GetStats(CSigVerifyStats& stats)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+
+    stats.nWorkers = nWorkers;
+    stats.nQueued = queue.size();
+    stats.nPending = nPending;
+    stats.nMessagesDeferred = nMessagesDeferred;
+    stats.nMessagesInline = nMessagesInline;
+    stats.nMessagesDropped = nMessagesDropped;
+    stats.nMessagesReplayed = nMessagesReplayed;
+    stats.nSignaturesChecked = nSignaturesChecked;
+    stats.nSignaturesFailed = nSignaturesFailed;
+    stats.nBatches = nBatches;
+    stats.nVerifyLatencyAvg = nMessagesVerified ? nVerifyLatencyTotal / (int64_t)nMessagesVerified : 0;
+    stats.nVerifyLatencyMax = nVerifyLatencyMax;
+    stats.nReplayLatencyAvg = nMessagesReplayed ? nReplayLatencyTotal / (int64_t)nMessagesReplayed : 0;
+    stats.nReplayLatencyMax = nReplayLatencyMax;
+}
+
+void ThreadSigVerify()
+{
+    RenameThread("lytix-sigverify");
+    sigVerifyPool.Thread();
+}
@@ -0,0 +1,195 @@
+// Copyright (c) 2019 The Lytix developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SIGVERIFY_H
+#define SIGVERIFY_H
+
+#include "net.h"
+#include "pubkey.h"
+#include "streams.h"
+#include "uint256.h"
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+/** -sigverifythreads default (number of masternode message verification threads, 0 = verify inline) */
+static const int DEFAULT_SIGVERIFY_THREADS = 2;
+/** Maximum number of masternode message verification threads */
+static const int MAX_SIGVERIFY_THREADS = 16;
+/** Messages waiting for verification or replay before new ones are verified inline again */
+static const unsigned int MAX_SIGVERIFY_QUEUE = 20000;
+/** Messages of one peer waiting for verification or replay before nothing more is read from it */
+static const unsigned int MAX_SIGVERIFY_PEER_QUEUE = 1000;
+/** Messages a worker takes from the queue at once */
+static const unsigned int SIGVERIFY_BATCH_SIZE = 32;
+/** -maxmsgsigcachesize default (keys recovered from masternode message signatures) */
+static const unsigned int DEFAULT_MAX_MSGSIGCACHE_SIZE = 50000;
+
+struct CSigRecoveryCacheStats {
+    size_t nSize;
+    uint64_t nHits;
+    uint64_t nMisses;
+    uint64_t nEvictions;
+};
+
+/**
+ * Keys recovered from compact signatures of masternode messages.
+ *
+ * The same pings, winners and votes arrive from many peers, and broadcasts are
+ * checked against two message formats, so most key recoveries repeat one already
+ * done. Entries are keyed by a salted hash of message hash and signature, and the
+ * size is bounded by evicting random entries, like the script signature cache.
+ * Failed recoveries are kept as an invalid key, so a message replayed by the
+ * verification pool never needs a second recovery.
+ */
+class CSigRecoveryCache
+{
+private:
+    boost::mutex mutex;
+    uint256 nSalt;
+    std::map<uint256, CPubKey> mapKeys;
+
+    uint64_t nHits;
+    uint64_t nMisses;
+    uint64_t nEvictions;
+
+    uint256 GetEntryHash(const uint256& hash, const std::vector<unsigned char>& vchSig);
+
+public:
+    CSigRecoveryCache();
+
+    bool Get(const uint256& hash, const std::vector<unsigned char>& vchSig, CPubKey& pubkeyRet);
+    void Set(const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey);
+
+    void GetStats(CSigRecoveryCacheStats& stats);
+};
+
+extern CSigRecoveryCache sigRecoveryCache;
+
+/** A compact signature over a signed message, and the key recovered from it */
+class CSigCheck
+{
+public:
+    uint256 hash;
+    std::vector<unsigned char> vchSig;
+    CPubKey pubkeyRecovered;
+
+    CSigCheck(const std::string& strMessage, const std::vector<unsigned char>& vchSigIn);
+
+    /// Recover the signing key into the recovery cache, pubkeyRecovered stays invalid if that fails
+    void operator()();
+};
+
+/** A network message held back until the signatures it carries have been checked */
+class CSigVerifyJob
+{
+public:
+    NodeId nodeId;
+    std::string strCommand;
+    CDataStream vRecv;
+    std::vector<CSigCheck> vChecks;
+    int64_t nTimeQueued;
+    bool fDone;
+
+    CSigVerifyJob(NodeId nodeIdIn, const std::string& strCommandIn, const CDataStream& vRecvIn);
+};
+
+typedef boost::shared_ptr<CSigVerifyJob> CSigVerifyJobRef;
+
+struct CSigVerifyStats {
+    int nWorkers;
+    unsigned int nQueued;  // waiting for a worker
+    unsigned int nPending; // waiting for a worker or for replay
+    uint64_t nMessagesDeferred;
+    uint64_t nMessagesInline;
+    uint64_t nMessagesDropped;
+    uint64_t nMessagesReplayed;
+    uint64_t nSignaturesChecked;
+    uint64_t nSignaturesFailed;
+    uint64_t nBatches;
+    int64_t nVerifyLatencyAvg; // queued to verified, in microseconds
+    int64_t nVerifyLatencyMax;
+    int64_t nReplayLatencyAvg; // queued to replayed, in microseconds
+    int64_t nReplayLatencyMax;
+};
+
+/**
+ * Worker pool for the signatures of masternode and maxnode network messages.
+ *
+ * The message handler thread hands signed messages (mnb, mnp, mnw, votes...) to
+ * Defer() instead of processing them. Worker threads recover the signing keys in
+ * batches into sigRecoveryCache, and the handler thread replays each message with
+ * PopVerified() once its keys are known, in the order it was received from that
+ * peer. While a peer has messages waiting, all its other masternode messages are
+ * queued behind them, also those with nothing to verify. A peer that reached its
+ * share of the queue, or has messages waiting while the queue is full, is not read
+ * from until they are replayed, so its receive buffer fills up and -maxreceivebuffer
+ * holds it back. CObfuScationSigner::VerifyMessage finds the keys in the cache, so the
+ * managers process the replayed message exactly as before, still on the handler
+ * thread, without the expensive key recovery.
+ */
+class CSigVerifyPool
+{
+private:
+    boost::mutex mutex;
+
+    //! Workers block on this when out of work
+    boost::condition_variable condWorker;
+
+    //! Jobs not picked up by a worker yet
+    std::deque<CSigVerifyJobRef> queue;
+
+    //! All jobs not replayed yet, per peer in the order they were received
+    std::map<NodeId, std::deque<CSigVerifyJobRef> > mapPending;
+
+    int nWorkers;
+    unsigned int nPending;
+
+    // statistics
+    uint64_t nMessagesDeferred;
+    uint64_t nMessagesInline;
+    uint64_t nMessagesDropped;
+    uint64_t nMessagesVerified;
+    uint64_t nMessagesReplayed;
+    uint64_t nSignaturesChecked;
+    uint64_t nSignaturesFailed;
+    uint64_t nBatches;
+    int64_t nVerifyLatencyTotal;
+    int64_t nVerifyLatencyMax;
+    int64_t nReplayLatencyTotal;
+    int64_t nReplayLatencyMax;
+
+public:
+    CSigVerifyPool();
+
+    /// Queue a signed message for verification, or any message behind the ones of its peer
+    /// still waiting; false means it must be processed right away
+    bool Defer(CNode* pfrom, const std::string& strCommand, const CDataStream& vRecv);
+
+    /// Next verified message of the peer
+    bool PopVerified(NodeId nodeId, CSigVerifyJobRef& job);
+
+    /// The peer has too many messages waiting, or some while the pool is full; read nothing more from it until they are replayed
+    bool IsFull(NodeId nodeId);
+
+    /// Drop everything queued for a disconnected peer
+    void ForgetNode(NodeId nodeId);
+
+    /// Worker thread loop, never returns
+    void Thread();
+
+    void GetStats(CSigVerifyStats& stats);
+};
+
+extern CSigVerifyPool sigVerifyPool;
+
+void ThreadSigVerify();
+
+#endif // SIGVERIFY_H
@@ -16,6 +16,8 @@
 #include "util.h"
 #include <boost/lexical_cast.hpp>
 
+#include <atomic>
+
 using namespace std;
 using namespace boost;
 
@@ -27,6 +29,48 @@ CSporkManager sporkManager;
 std::map<uint256, CSporkMessage> mapSporks;
 std::map<int, CSporkMessage> mapSporksActive;
 
+// Values used until a spork message is seen, indexed by spork ID - SPORK_START. -1 for unused IDs.
+static const int64_t sporkDefaults[SPORK_COUNT] = {
+    SPORK_2_SWIFTTX_DEFAULT,
+    SPORK_3_SWIFTTX_BLOCK_FILTERING_DEFAULT,
+    -1,
+    SPORK_5_MAX_VALUE_DEFAULT,
+    -1,
+    SPORK_7_MASTERNODE_SCANNING_DEFAULT,
+    SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT_DEFAULT,
+    SPORK_9_MASTERNODE_BUDGET_ENFORCEMENT_DEFAULT,
+    SPORK_10_MASTERNODE_PAY_UPDATED_NODES_DEFAULT,
+    -1, // SPORK_11_LOCK_INVALID_UTXO
+    -1, // SPORK_12_RECONSIDER_BLOCKS
+    SPORK_13_ENABLE_SUPERBLOCKS_DEFAULT,
+    SPORK_14_NEW_PROTOCOL_ENFORCEMENT_DEFAULT,
+    SPORK_15_NEW_PROTOCOL_ENFORCEMENT_2_DEFAULT,
+    SPORK_16_ZEROCOIN_MAINTENANCE_MODE_DEFAULT,
+    SPORK_17_NEW_PROTOCOL_ENFORCEMENT_3_DEFAULT,
+    SPORK_18_MASTERNODE_REWARDS_CHANGE_DEFAULT,
+    SPORK_19_MAXNODE_ACTIVATION_DEFAULT,
+    SPORK_20_DEVFEE_DEFAULT};
+
+// Values of the active spork messages, read without a lock from the validation and
+// masternode code. A slot is published by setting its flag after its first value.
+static std::atomic<int64_t> sporkValues[SPORK_COUNT];
+static std::atomic<bool> sporkValueSet[SPORK_COUNT];
+
+// make a spork message the active one for its ID, and tell the listeners if its value changed
+static void SetSporkActive(const CSporkMessage& spork)
+{
+    mapSporksActive[spork.nSporkID] = spork;
+
+    if (spork.nSporkID < SPORK_START || spork.nSporkID > SPORK_END) return;
+    int nIndex = spork.nSporkID - SPORK_START;
+    int64_t nValueOld = GetSporkValue(spork.nSporkID);
+    sporkValues[nIndex].store(spork.nValue, std::memory_order_relaxed);
+    sporkValueSet[nIndex].store(true, std::memory_order_release);
+
+    if (spork.nValue != nValueOld)
+        sporkManager.NotifySporkChanged(spork.nSporkID, spork.nValue);
+}
+
 // PIVX: on startup load spork values from previous session if they exist in the sporkDB
 void LoadSporksFromDB()
 {
@@ -44,7 +88,7 @@ void LoadSporksFromDB()
 
         // add spork to memory
         mapSporks[spork.GetHash()] = spork;
-        mapSporksActive[spork.nSporkID] = spork;
+        SetSporkActive(spork);
         std::time_t result = spork.nValue;
         // If SPORK Value is greater than 1,000,000 assume it's actually a Date and then convert to a more readable format
         if (spork.nValue > 1000000) {
@@ -101,7 +145,7 @@ void ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
         }
 
         mapSporks[hash] = spork;
-        mapSporksActive[spork.nSporkID] = spork;
+        SetSporkActive(spork);
         sporkManager.Relay(spork);
 
         // PIVX: add to spork database.
@@ -123,28 +167,15 @@ int64_t GetSporkValue(int nSporkID)
 {
     int64_t r = -1;
 
-    if (mapSporksActive.count(nSporkID)) {
-        r = mapSporksActive[nSporkID].nValue;
-    } else {
-        if (nSporkID == SPORK_2_SWIFTTX) r = SPORK_2_SWIFTTX_DEFAULT;
-        if (nSporkID == SPORK_3_SWIFTTX_BLOCK_FILTERING) r = SPORK_3_SWIFTTX_BLOCK_FILTERING_DEFAULT;
-        if (nSporkID == SPORK_5_MAX_VALUE) r = SPORK_5_MAX_VALUE_DEFAULT;
-        if (nSporkID == SPORK_7_MASTERNODE_SCANNING) r = SPORK_7_MASTERNODE_SCANNING_DEFAULT;
-        if (nSporkID == SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT) r = SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT_DEFAULT;
-        if (nSporkID == SPORK_9_MASTERNODE_BUDGET_ENFORCEMENT) r = SPORK_9_MASTERNODE_BUDGET_ENFORCEMENT_DEFAULT;
-        if (nSporkID == SPORK_10_MASTERNODE_PAY_UPDATED_NODES) r = SPORK_10_MASTERNODE_PAY_UPDATED_NODES_DEFAULT;
-        if (nSporkID == SPORK_13_ENABLE_SUPERBLOCKS) r = SPORK_13_ENABLE_SUPERBLOCKS_DEFAULT;
-        if (nSporkID == SPORK_14_NEW_PROTOCOL_ENFORCEMENT) r = SPORK_14_NEW_PROTOCOL_ENFORCEMENT_DEFAULT;
-        if (nSporkID == SPORK_15_NEW_PROTOCOL_ENFORCEMENT_2) r = SPORK_15_NEW_PROTOCOL_ENFORCEMENT_2_DEFAULT;
-        if (nSporkID == SPORK_16_ZEROCOIN_MAINTENANCE_MODE) r = SPORK_16_ZEROCOIN_MAINTENANCE_MODE_DEFAULT;
-        if (nSporkID == SPORK_17_NEW_PROTOCOL_ENFORCEMENT_3) r = SPORK_17_NEW_PROTOCOL_ENFORCEMENT_3_DEFAULT;
-        if (nSporkID == SPORK_18_MASTERNODE_REWARDS_CHANGE) r = SPORK_18_MASTERNODE_REWARDS_CHANGE_DEFAULT;
-        if (nSporkID == SPORK_19_MAXNODE_ACTIVATION) r = SPORK_19_MAXNODE_ACTIVATION_DEFAULT;
-        if (nSporkID == SPORK_20_DEVFEE) r = SPORK_20_DEVFEE_DEFAULT;
-
-        if (r == -1) LogPrintf("%s : Unknown Spork %d\n", __func__, nSporkID);
+    if (nSporkID >= SPORK_START && nSporkID <= SPORK_END) {
+        int nIndex = nSporkID - SPORK_START;
+        if (sporkValueSet[nIndex].load(std::memory_order_acquire))
+            return sporkValues[nIndex].load(std::memory_order_relaxed);
+        r = sporkDefaults[nIndex];
     }
 
+    if (r == -1) LogPrintf("%s : Unknown Spork %d\n", __func__, nSporkID);
+
     return r;
 }
 
@@ -245,7 +276,7 @@ bool CSporkManager::UpdateSpork(int nSporkID, int64_t nValue)
     if (Sign(msg)) {
         Relay(msg);
         mapSporks[msg.GetHash()] = msg;
-        mapSporksActive[nSporkID] = msg;
+        SetSporkActive(msg);
         return true;
     }
 
@@ -17,6 +17,7 @@
 #include "obfuscation.h"
 #include "protocol.h"
 #include <boost/lexical_cast.hpp>
+#include <boost/signals2/signal.hpp>
 
 using namespace std;
 using namespace boost;
@@ -29,6 +30,7 @@ using namespace boost;
 */
 #define SPORK_START 10001
 #define SPORK_END 10019
+#define SPORK_COUNT (SPORK_END - SPORK_START + 1)
 
 #define SPORK_2_SWIFTTX 10001
 #define SPORK_3_SWIFTTX_BLOCK_FILTERING 10002
@@ -117,6 +119,9 @@ private:
     std::string strMasterPrivKey;
 
 public:
+    /** Called with the spork ID and the new value whenever the value of a spork changes */
+    boost::signals2::signal<void(int nSporkID, int64_t nValue)> NotifySporkChanged;
+
     CSporkManager()
     {
     }
@@ -3,7 +3,10 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "master/node-budget.h"
+#include "master/nodeman.h"
+#include "random.h"
 #include "tinyformat.h"
+#include "utiltime.h"
 #include "utilmoneystr.h"
 
 #include <boost/test/unit_test.hpp>
@@ -29,4 +32,135 @@ BOOST_AUTO_TEST_CASE(budget_value)
     CheckBudgetValue(nHeightTest, "mainnet", 3110.40*COIN);
 }
 
+// the full scan the height index replaced, as a reference and a baseline
+static bool IsBudgetPaymentBlockScan(CBudgetManager& budgetManager, int nBlockHeight)
+{
+    int nHighestCount = -1;
+    std::map<uint256, CFinalizedBudget>::iterator it = budgetManager.mapFinalizedBudgets.begin();
+    for (; it != budgetManager.mapFinalizedBudgets.end(); ++it) {
+        CFinalizedBudget& finalizedBudget = (*it).second;
+        if (finalizedBudget.GetVoteCount() > nHighestCount &&
+            nBlockHeight >= finalizedBudget.GetBlockStart() && nBlockHeight <= finalizedBudget.GetBlockEnd())
+            nHighestCount = finalizedBudget.GetVoteCount();
+    }
+    return nHighestCount > mnodeman.CountEnabled(ActiveProtocol()) / 20;
+}
+
+BOOST_AUTO_TEST_CASE(budget_superblock_index)
+{
+    const int nCycles = 400;
+    const int nCycleBlocks = 1000;
+    const int nPayments = 10;
+
+    // five competing finalized budgets per cycle, every fourth cycle without votes
+    CBudgetManager budgetManager;
+    for (int nCycle = 0; nCycle < nCycles; nCycle++) {
+        for (int i = 0; i < 5; i++) {
+            CFinalizedBudget finalizedBudget;
+            finalizedBudget.strBudgetName = "main";
+            finalizedBudget.nBlockStart = nCycle * nCycleBlocks;
+            for (int n = 0; n < nPayments; n++) {
+                CTxBudgetPayment payment;
+                payment.nProposalHash = GetRandHash();
+                payment.nAmount = (n + 1) * COIN;
+                finalizedBudget.vecBudgetPayments.push_back(payment);
+            }
+            for (int n = 0; nCycle % 4 != 0 && n < i + 1; n++)
+                finalizedBudget.mapVotes[GetRandHash()] = CFinalizedBudgetVote();
+            budgetManager.mapFinalizedBudgets.insert(make_pair(finalizedBudget.GetHash(), finalizedBudget));
+        }
+    }
+    budgetManager.RebuildFinalizedBudgetIndex();
+
+    std::vector<int> vHeights;
+    for (int nCycle = 0; nCycle < nCycles; nCycle++)
+        for (int n = -1; n <= nPayments; n++)
+            vHeights.push_back(nCycle * nCycleBlocks + n);
+
+    int64_t nTimeScan = 0;
+    int64_t nTimeIndex = 0;
+    BOOST_FOREACH (int nHeight, vHeights) {
+        int64_t nTimeStart = GetTimeMicros();
+        bool fScan = IsBudgetPaymentBlockScan(budgetManager, nHeight);
+        int64_t nTimeMid = GetTimeMicros();
+        bool fIndex = budgetManager.IsBudgetPaymentBlock(nHeight);
+        nTimeScan += nTimeMid - nTimeStart;
+        nTimeIndex += GetTimeMicros() - nTimeMid;
+
+        BOOST_CHECK_EQUAL(fIndex, fScan);
+        int nOffset = nHeight % nCycleBlocks;
+        BOOST_CHECK_EQUAL(fIndex, nHeight >= 0 && nOffset < nPayments && (nHeight / nCycleBlocks) % 4 != 0);
+    }
+
+    BOOST_TEST_MESSAGE(strprintf("%u superblock checks over %u finalized budgets: scan %.3fms, index %.3fms",
+        vHeights.size(), budgetManager.mapFinalizedBudgets.size(), nTimeScan * 0.001, nTimeIndex * 0.001));
+}
+
+static CBudgetVote OrphanVote(const CTxIn& vin, const uint256& nProposalHash, int64_t nTime)
+{
+    CBudgetVote vote(vin, nProposalHash, VOTE_YES);
+    vote.nTime = nTime;
+    return vote;
+}
+
+BOOST_AUTO_TEST_CASE(budget_orphan_votes)
+{
+    const int64_t nNow = 1500000000;
+    SetMockTime(nNow);
+
+    CBudgetManager budgetManager;
+    CTxIn vin(COutPoint(GetRandHash(), 0));
+    CTxIn vinOther(COutPoint(GetRandHash(), 0));
+
+    // a full set of orphan votes of one masternode, each waiting for another proposal
+    std::vector<uint256> vProposalHashes;
+    for (int i = 0; i < MAX_ORPHAN_BUDGET_VOTES_PER_MASTERNODE; i++) {
+        vProposalHashes.push_back(GetRandHash());
+        CBudgetVote vote = OrphanVote(vin, vProposalHashes.back(), nNow - MAX_ORPHAN_BUDGET_VOTES_PER_MASTERNODE + i);
+        BOOST_CHECK(budgetManager.AddOrphanVote(vote));
+    }
+    BOOST_CHECK_EQUAL(budgetManager.mapOrphanMasternodeBudgetVotes.size(), (unsigned int)MAX_ORPHAN_BUDGET_VOTES_PER_MASTERNODE);
+
+    // a vote older than all of them doesn't make it in, a newer one takes the place of the oldest
+    CBudgetVote voteOld = OrphanVote(vin, GetRandHash(), nNow - 2 * MAX_ORPHAN_BUDGET_VOTES_PER_MASTERNODE);
+    BOOST_CHECK(!budgetManager.AddOrphanVote(voteOld));
+    CBudgetVote voteOldest = OrphanVote(vin, vProposalHashes[0], nNow - MAX_ORPHAN_BUDGET_VOTES_PER_MASTERNODE);
+    CBudgetVote voteNew = OrphanVote(vin, GetRandHash(), nNow);
+    BOOST_CHECK(budgetManager.AddOrphanVote(voteNew));
+    BOOST_CHECK_EQUAL(budgetManager.mapOrphanMasternodeBudgetVotes.size(), (unsigned int)MAX_ORPHAN_BUDGET_VOTES_PER_MASTERNODE);
+    BOOST_CHECK(!budgetManager.mapOrphanMasternodeBudgetVotes.count(voteOldest.GetHash()));
+    BOOST_CHECK(budgetManager.mapOrphanMasternodeBudgetVotes.count(voteNew.GetHash()));
+
+    // another masternode has room of its own, but not for votes from the future
+    CBudgetVote voteFuture = OrphanVote(vinOther, vProposalHashes[1], nNow + 2 * 60 * 60);
+    BOOST_CHECK(!budgetManager.AddOrphanVote(voteFuture));
+    CBudgetVote voteOther = OrphanVote(vinOther, vProposalHashes[1], nNow);
+    BOOST_CHECK(budgetManager.AddOrphanVote(voteOther));
+
+    // a later vote of a masternode for the same proposal replaces its earlier one
+    CBudgetVote voteReplaced = OrphanVote(vin, vProposalHashes[1], nNow - MAX_ORPHAN_BUDGET_VOTES_PER_MASTERNODE + 1);
+    CBudgetVote voteUpdate = OrphanVote(vin, vProposalHashes[1], nNow);
+    BOOST_CHECK(budgetManager.AddOrphanVote(voteUpdate));
+    BOOST_CHECK(!budgetManager.mapOrphanMasternodeBudgetVotes.count(voteReplaced.GetHash()));
+    BOOST_CHECK(!budgetManager.AddOrphanVote(voteReplaced));
+    BOOST_CHECK_EQUAL(budgetManager.mapOrphanMasternodeBudgetVotes.size(), (unsigned int)MAX_ORPHAN_BUDGET_VOTES_PER_MASTERNODE + 1);
+
+    // once the proposal is known, the votes waiting for it are applied
+    budgetManager.mapProposals.insert(make_pair(vProposalHashes[1], CBudgetProposal()));
+    budgetManager.CheckOrphanVotes(vProposalHashes[1]);
+    CBudgetProposal& proposal = budgetManager.mapProposals[vProposalHashes[1]];
+    BOOST_CHECK_EQUAL(proposal.mapVotes.size(), 2U);
+    BOOST_CHECK(proposal.mapVotes[vin.prevout.GetHash()].GetHash() == voteUpdate.GetHash());
+    BOOST_CHECK(proposal.mapVotes[vinOther.prevout.GetHash()].GetHash() == voteOther.GetHash());
+    BOOST_CHECK_EQUAL(budgetManager.mapOrphanMasternodeBudgetVotes.size(), (unsigned int)MAX_ORPHAN_BUDGET_VOTES_PER_MASTERNODE - 1);
+
+    // the applied votes no longer count against the limit of their masternode
+    CBudgetVote voteMore = OrphanVote(vin, GetRandHash(), nNow);
+    BOOST_CHECK(budgetManager.AddOrphanVote(voteMore));
+    BOOST_CHECK(budgetManager.mapOrphanMasternodeBudgetVotes.count(OrphanVote(vin, vProposalHashes[2], nNow - MAX_ORPHAN_BUDGET_VOTES_PER_MASTERNODE + 2).GetHash()));
+    BOOST_CHECK_EQUAL(budgetManager.mapOrphanMasternodeBudgetVotes.size(), (unsigned int)MAX_ORPHAN_BUDGET_VOTES_PER_MASTERNODE);
+
+    SetMockTime(0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -10,6 +10,9 @@
 
 #include "clientversion.h"
 #include "main.h"
+#include "random.h"
+#include "script/script.h"
+#include "timedata.h"
 #include "utiltime.h"
 
 #include <cstdio>
@@ -66,4 +69,96 @@ BOOST_AUTO_TEST_CASE(May15)
     SetMockTime(0);
 }
 
+static CBlock ManyTransactionsBlock()
+{
+    CBlock block;
+    block.nTime = GetAdjustedTime();
+    block.nVersion = block.GetBlockTime() > Params().Zerocoin_StartTime() ? Params().Zerocoin_HeaderVersion() : 1;
+    block.hashPrevBlock = GetRandHash();
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << OP_0 << OP_0;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 1;
+    coinbase.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    block.vtx.push_back(coinbase);
+
+    for (int i = 0; i < 100; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(2);
+        tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        tx.vin[1].prevout = COutPoint(GetRandHash(), 1);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1;
+        tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        block.vtx.push_back(tx);
+    }
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(CheckBlock_transactions)
+{
+    // enough transactions to be checked on the transaction check threads
+    CBlock block = ManyTransactionsBlock();
+    BOOST_REQUIRE(block.vtx.size() >= MIN_PARALLEL_TX_CHECKS);
+
+    CValidationState state;
+    BOOST_CHECK(CheckBlock(block, state, false, false));
+
+    // the first bad transaction is the one reported
+    CMutableTransaction txDuplicate(block.vtx[70]);
+    txDuplicate.vin[1].prevout = txDuplicate.vin[0].prevout;
+    block.vtx[70] = txDuplicate;
+    BOOST_CHECK(!CheckBlock(block, state, false, false));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-txns-inputs-duplicate");
+
+    CMutableTransaction txEmpty(block.vtx[30]);
+    txEmpty.vout.clear();
+    block.vtx[30] = txEmpty;
+    CValidationState stateEmpty;
+    BOOST_CHECK(!CheckBlock(block, stateEmpty, false, false));
+    BOOST_CHECK_EQUAL(stateEmpty.GetRejectReason(), "bad-txns-vout-empty");
+}
+
+BOOST_AUTO_TEST_CASE(CheckBlock_transactions_cs_main)
+{
+    // zerocoin spends are only looked at once zerocoin is active
+    SetMockTime(Params().Zerocoin_StartTime() + 60);
+    CBlock block = ManyTransactionsBlock();
+
+    // validation holds cs_main while it waits for the check threads, which mustn't need it
+    LOCK(cs_main);
+    CValidationState state;
+    BOOST_CHECK(CheckBlock(block, state, false, false));
+
+    // a zerocoin spend with three outputs, rejected before its proofs are parsed
+    CMutableTransaction txSpend;
+    txSpend.vin.resize(1);
+    txSpend.vin[0].scriptSig = CScript() << OP_ZEROCOINSPEND << std::vector<unsigned char>(32, 0);
+    txSpend.vin[0].nSequence = 1;
+    txSpend.vout.resize(3);
+    for (unsigned int i = 0; i < txSpend.vout.size(); i++) {
+        txSpend.vout[i].nValue = 1;
+        txSpend.vout[i].scriptPubKey = CScript() << OP_TRUE;
+    }
+    block.vtx[50] = txSpend;
+
+    CValidationState stateSpend;
+    int nDoS = 0;
+    BOOST_CHECK(!CheckBlock(block, stateSpend, false, false));
+    BOOST_CHECK(stateSpend.IsInvalid(nDoS) && nDoS == 100);
+
+    // with one output its proof is parsed on a check thread and found malformed
+    txSpend.vout.resize(1);
+    block.vtx[50] = txSpend;
+    CValidationState stateProof;
+    nDoS = 0;
+    BOOST_CHECK(!CheckBlock(block, stateProof, false, false));
+    BOOST_CHECK(stateProof.IsInvalid(nDoS) && nDoS == 100);
+
+    SetMockTime(0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
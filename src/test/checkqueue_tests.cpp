@@ -0,0 +1,144 @@
+// Copyright (c) 2019 The Lytix developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+#include "hash.h"
+#include "utiltime.h"
+
+#include <atomic>
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(checkqueue_tests)
+
+/** Hashes nWork times and counts itself */
+class CCountCheck
+{
+private:
+    std::atomic<int>* pnCount;
+    int nWork;
+    bool fOk;
+
+public:
+    CCountCheck() : pnCount(NULL), nWork(0), fOk(true) {}
+    CCountCheck(std::atomic<int>& nCountIn, int nWorkIn, bool fOkIn) : pnCount(&nCountIn), nWork(nWorkIn), fOk(fOkIn) {}
+
+    bool operator()()
+    {
+        uint256 hash;
+        for (int i = 0; i < nWork; i++)
+            hash = Hash(hash.begin(), hash.end());
+        (*pnCount)++;
+        return fOk;
+    }
+
+    void swap(CCountCheck& check)
+    {
+        std::swap(pnCount, check.pnCount);
+        std::swap(nWork, check.nWork);
+        std::swap(fOk, check.fOk);
+    }
+};
+
+static void AddChecks(CCheckQueueControl<CCountCheck>& control, std::atomic<int>& nCount, int nChecks, int nPerAdd, int nWork, int nFail = -1)
+{
+    for (int i = 0; i < nChecks; i += nPerAdd) {
+        std::vector<CCountCheck> vChecks;
+        for (int j = i; j < std::min(nChecks, i + nPerAdd); j++)
+            vChecks.push_back(CCountCheck(nCount, nWork, j != nFail));
+        control.Add(vChecks);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_all_run)
+{
+    CCheckQueue<CCountCheck> queue(128);
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 3; i++)
+        threadGroup.create_thread(boost::bind(&CCheckQueue<CCountCheck>::Thread, &queue));
+
+    // single checks, small batches and large ones all get done, and only once
+    int nSizes[] = {1, 3, 7, 100, 5000};
+    BOOST_FOREACH (int nPerAdd, nSizes) {
+        std::atomic<int> nCount(0);
+        {
+            CCheckQueueControl<CCountCheck> control(&queue);
+            AddChecks(control, nCount, 10000, nPerAdd, 0);
+            BOOST_CHECK(control.Wait());
+        }
+        BOOST_CHECK_EQUAL(nCount, 10000);
+        BOOST_CHECK(queue.IsIdle());
+    }
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_failure)
+{
+    CCheckQueue<CCountCheck> queue(128);
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 3; i++)
+        threadGroup.create_thread(boost::bind(&CCheckQueue<CCountCheck>::Thread, &queue));
+
+    for (int nFail = 0; nFail < 1000; nFail += 99) {
+        std::atomic<int> nCount(0);
+        CCheckQueueControl<CCountCheck> control(&queue);
+        AddChecks(control, nCount, 1000, 10, 10, nFail);
+        BOOST_CHECK(!control.Wait());
+        BOOST_CHECK(nCount <= 1000);
+    }
+
+    // the failure doesn't stick to the next round
+    std::atomic<int> nCount(0);
+    {
+        CCheckQueueControl<CCountCheck> control(&queue);
+        AddChecks(control, nCount, 1000, 10, 0);
+        BOOST_CHECK(control.Wait());
+    }
+    BOOST_CHECK_EQUAL(nCount, 1000);
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+/**
+ * Throughput with a growing number of workers, for checks that are cheap next
+ * to the cost of queueing them and for expensive ones, added one at a time as
+ * ConnectBlock does for single input transactions. Run test_lytix with
+ * --log_level=message to see the timings.
+ */
+BOOST_AUTO_TEST_CASE(checkqueue_contention)
+{
+    static const int nChecks = 20000;
+    int nWorkers[] = {0, 1, 3, 7};
+    int nWorks[] = {1, 100};
+    BOOST_FOREACH (int nWork, nWorks) {
+        BOOST_FOREACH (int nThreads, nWorkers) {
+            CCheckQueue<CCountCheck> queue(128);
+            boost::thread_group threadGroup;
+            for (int i = 0; i < nThreads; i++)
+                threadGroup.create_thread(boost::bind(&CCheckQueue<CCountCheck>::Thread, &queue));
+
+            std::atomic<int> nCount(0);
+            int64_t nStart = GetTimeMicros();
+            for (int nBlock = 0; nBlock < 10; nBlock++) {
+                CCheckQueueControl<CCountCheck> control(&queue);
+                AddChecks(control, nCount, nChecks / 10, 1, nWork);
+                BOOST_CHECK(control.Wait());
+            }
+            int64_t nTime = GetTimeMicros() - nStart;
+            BOOST_CHECK_EQUAL(nCount, nChecks);
+            BOOST_TEST_MESSAGE("checkqueue: " << nThreads + 1 << " threads, " << nWork << " hashes per check: "
+                                              << nTime / 1000 << "ms, " << (double)nTime / nChecks << "us/check");
+
+            threadGroup.interrupt_all();
+            threadGroup.join_all();
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -3,13 +3,19 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "coins.h"
+#include "coinsprefetch.h"
+#include "primitives/block.h"
 #include "random.h"
+#include "txdb.h"
 #include "uint256.h"
+#include "utiltime.h"
 
 #include <vector>
 #include <map>
 
+#include <boost/foreach.hpp>
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 namespace
 {
@@ -58,6 +64,89 @@ public:
 
     bool GetStats(CCoinsStats& stats) const { return false; }
 };
+
+//! Thread safe view that counts its reads
+class CCoinsViewCounting : public CCoinsView
+{
+    mutable boost::mutex mutex;
+    std::map<uint256, CCoins> map_;
+
+public:
+    mutable int nReads;
+
+    CCoinsViewCounting() : nReads(0) {}
+
+    bool GetCoins(const uint256& txid, CCoins& coins) const
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nReads++;
+        std::map<uint256, CCoins>::const_iterator it = map_.find(txid);
+        if (it == map_.end())
+            return false;
+        coins = it->second;
+        return true;
+    }
+
+    bool HaveCoins(const uint256& txid) const
+    {
+        CCoins coins;
+        return GetCoins(txid, coins);
+    }
+
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ++it) {
+            if (!(it->second.flags & CCoinsCacheEntry::DIRTY))
+                continue;
+            if (it->second.coins.IsPruned())
+                map_.erase(it->first);
+            else
+                map_[it->first] = it->second.coins;
+        }
+        mapCoins.clear();
+        return true;
+    }
+};
+
+//! Counts the reads made by the thread that created it
+class CCoinsViewThreadReads : public CCoinsViewBacked
+{
+    boost::thread::id id;
+
+public:
+    mutable int nReads;
+
+    CCoinsViewThreadReads(CCoinsView* viewIn) : CCoinsViewBacked(viewIn), id(boost::this_thread::get_id()), nReads(0) {}
+
+    bool GetCoins(const uint256& txid, CCoins& coins) const
+    {
+        if (boost::this_thread::get_id() == id)
+            nReads++;
+        return base->GetCoins(txid, coins);
+    }
+};
+
+//! A block spending output 0 of each of the given transactions
+CBlock SpendingBlock(const std::vector<uint256>& vSpent)
+{
+    CBlock block;
+    for (unsigned int i = 0; i < vSpent.size(); i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(vSpent[i], 0);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = i + 1;
+        block.vtx.push_back(CTransaction(tx));
+    }
+    return block;
+}
+
+void WaitForPrefetch(CCoinsViewPrefetch& prefetch, size_t nExpected)
+{
+    for (int i = 0; i < 1000 && prefetch.GetPrefetchedSize() < nExpected; i++)
+        MilliSleep(5);
+}
 }
 
 BOOST_AUTO_TEST_SUITE(coins_tests)
@@ -175,4 +264,163 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(missed_an_entry);
 }
 
+BOOST_AUTO_TEST_CASE(coins_getutxo_test)
+{
+    CCoinsViewTest base;
+    CCoinsViewCache cache(&base);
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(2);
+    tx.vout[0].nValue = 5000;
+    tx.vout[1].nValue = 7000;
+    uint256 txid = tx.GetHash();
+    cache.ModifyCoins(txid)->FromTx(CTransaction(tx), 100);
+
+    CTxOut txout;
+    int nHeight = 0;
+    BOOST_CHECK(cache.GetUTXO(COutPoint(txid, 1), txout, nHeight));
+    BOOST_CHECK_EQUAL(txout.nValue, 7000);
+    BOOST_CHECK_EQUAL(nHeight, 100);
+
+    // spent, out of range and unknown outputs are not found
+    CTxInUndo undo;
+    BOOST_CHECK(cache.ModifyCoins(txid)->Spend(COutPoint(txid, 1), undo));
+    BOOST_CHECK(!cache.GetUTXO(COutPoint(txid, 1), txout, nHeight));
+    BOOST_CHECK(!cache.GetUTXO(COutPoint(txid, 2), txout, nHeight));
+    BOOST_CHECK(!cache.GetUTXO(COutPoint(GetRandHash(), 0), txout, nHeight));
+    BOOST_CHECK(cache.GetUTXO(COutPoint(txid, 0), txout, nHeight));
+    BOOST_CHECK_EQUAL(txout.nValue, 5000);
+}
+
+BOOST_AUTO_TEST_CASE(coins_prefetch_test)
+{
+    CCoinsViewCounting base;
+    std::vector<uint256> vSpent;
+    {
+        CCoinsViewCache cache(&base);
+        for (int i = 0; i < 50; i++) {
+            vSpent.push_back(GetRandHash());
+            cache.ModifyCoins(vSpent.back())->vout.assign(1, CTxOut(1000, CScript()));
+        }
+        // not in the base view
+        vSpent.push_back(GetRandHash());
+        BOOST_CHECK(cache.Flush());
+    }
+
+    CCoinsViewPrefetch prefetch(&base, 3);
+    CBlock block = SpendingBlock(vSpent);
+
+    // blocks the tip already passed aren't read
+    prefetch.PrefetchInputs(block, 10, 10);
+    MilliSleep(20);
+    BOOST_CHECK_EQUAL(prefetch.GetPrefetchedSize(), 0U);
+
+    prefetch.PrefetchInputs(block, 12, 10);
+    WaitForPrefetch(prefetch, 50);
+    BOOST_CHECK_EQUAL(prefetch.GetPrefetchedSize(), 50U);
+
+    // the inputs are served without going to the base view again
+    int nReads = base.nReads;
+    {
+        CCoinsViewCache cache(&prefetch);
+        for (int i = 0; i < 50; i++)
+            BOOST_CHECK(cache.AccessCoins(vSpent[i])->IsAvailable(0));
+        BOOST_CHECK_EQUAL(base.nReads, nReads);
+        BOOST_CHECK(!cache.HaveCoins(vSpent.back()));
+        BOOST_CHECK_EQUAL(prefetch.GetPrefetchedSize(), 0U);
+    }
+
+    // a write drops what it changes and keeps the rest
+    prefetch.PrefetchInputs(block, 12, 10);
+    WaitForPrefetch(prefetch, 50);
+    CCoinsMap mapWrite;
+    mapWrite[vSpent[1]].coins.vout.assign(1, CTxOut(3000, CScript()));
+    mapWrite[vSpent[1]].flags = CCoinsCacheEntry::DIRTY;
+    BOOST_CHECK(prefetch.BatchWrite(mapWrite, uint256()));
+    BOOST_CHECK_EQUAL(prefetch.GetPrefetchedSize(), 49U);
+    {
+        CCoinsViewCache cache(&prefetch);
+        BOOST_CHECK_EQUAL(cache.AccessCoins(vSpent[1])->vout[0].nValue, 3000);
+        BOOST_CHECK_EQUAL(cache.AccessCoins(vSpent[2])->vout[0].nValue, 1000);
+    }
+
+    // what wasn't asked for once the tip passed its block is dropped
+    BOOST_CHECK_EQUAL(prefetch.GetPrefetchedSize(), 48U);
+    prefetch.PrefetchInputs(CBlock(), 13, 12);
+    BOOST_CHECK_EQUAL(prefetch.GetPrefetchedSize(), 0U);
+}
+
+/**
+ * Replays blocks on top of a coins database on disk whose cache is much
+ * smaller than the coins, once reading every input on the validation thread
+ * and once with the coins of the blocks that arrived ahead of the tip read in
+ * the background. The gain is in the reads taken off the validation thread,
+ * the wall time only drops when a spare core or the disk can overlap them.
+ * Run test_lytix with --log_level=message to see the timings.
+ */
+BOOST_AUTO_TEST_CASE(coins_prefetch_replay)
+{
+    static const int nBlocks = 100;
+    static const int nTxPerBlock = 100;
+    static const int nUnspentPerBlock = 400;
+    static const int nBlocksAhead = 16;
+
+    CCoinsViewDB db(1 << 20, false, true);
+    std::vector<CBlock> vBlocks;
+    {
+        CCoinsViewCache cache(&db);
+        for (int i = 0; i < nBlocks; i++) {
+            std::vector<uint256> vSpent;
+            for (int j = 0; j < nTxPerBlock; j++) {
+                vSpent.push_back(GetRandHash());
+                cache.ModifyCoins(vSpent.back())->vout.assign(2, CTxOut(1000, CScript() << OP_TRUE));
+            }
+            for (int j = 0; j < nUnspentPerBlock; j++)
+                cache.ModifyCoins(GetRandHash())->vout.assign(2, CTxOut(1000, CScript() << OP_TRUE));
+            vBlocks.push_back(SpendingBlock(vSpent));
+        }
+        BOOST_CHECK(cache.Flush());
+    }
+
+    // read everything once, so that neither run finds the files colder than the other
+    {
+        CCoinsViewCache cache(&db);
+        BOOST_FOREACH (const CBlock& block, vBlocks)
+            BOOST_FOREACH (const CTransaction& tx, block.vtx)
+                BOOST_CHECK(cache.HaveCoins(tx.vin[0].prevout.hash));
+    }
+
+    int nThreads[] = {0, DEFAULT_PREFETCH_THREADS};
+    BOOST_FOREACH (int nPrefetchThreads, nThreads) {
+        CCoinsViewThreadReads reads(&db);
+        CCoinsViewPrefetch prefetch(&reads, nPrefetchThreads);
+        // a small cache, flushed every few blocks
+        CCoinsViewCache tip(&prefetch);
+
+        int64_t nStart = GetTimeMicros();
+        for (int i = 0; i < nBlocks; i++) {
+            // block i is at height i + 1, the blocks up to nBlocksAhead above the tip have arrived
+            for (int j = i == 0 ? 1 : nBlocksAhead; nPrefetchThreads && j <= nBlocksAhead && i + j < nBlocks; j++)
+                prefetch.PrefetchInputs(vBlocks[i + j], i + j + 1, i);
+
+            CCoinsViewCache view(&tip);
+            BOOST_FOREACH (const CTransaction& tx, vBlocks[i].vtx) {
+                const COutPoint& prevout = tx.vin[0].prevout;
+                const CCoins* coins = view.AccessCoins(prevout.hash);
+                BOOST_CHECK(coins && coins->IsAvailable(prevout.n));
+            }
+            BOOST_CHECK(view.Flush());
+            if (i % 10 == 9)
+                BOOST_CHECK(tip.Flush());
+        }
+        int64_t nTime = GetTimeMicros() - nStart;
+        BOOST_TEST_MESSAGE("coins replay: " << nPrefetchThreads << " prefetch threads: " << nTime / 1000 << "ms, "
+                                            << (double)nTime / (nBlocks * nTxPerBlock) << "us/input, "
+                                            << reads.nReads << " of " << nBlocks * nTxPerBlock << " inputs read on the validation thread");
+        if (nPrefetchThreads)
+            BOOST_CHECK(reads.nReads < nBlocks * nTxPerBlock);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
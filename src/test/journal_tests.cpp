@@ -0,0 +1,145 @@
+// Copyright (c) 2019 The Lytix developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "journal.h"
+#include "random.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(journal_tests)
+
+static void CheckContents(CFlatJournal& journal, const std::map<uint256, std::string>& mapExpected)
+{
+    BOOST_CHECK_EQUAL(journal.size(), mapExpected.size());
+    for (std::map<uint256, std::string>::const_iterator it = mapExpected.begin(); it != mapExpected.end(); ++it) {
+        std::string str;
+        BOOST_CHECK(journal.Read(1, it->first, str));
+        BOOST_CHECK_EQUAL(str, it->second);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(journal_roundtrip)
+{
+    std::map<uint256, std::string> mapExpected;
+    {
+        CFlatJournal journal("journal_test.dat", "JournalTest");
+        BOOST_CHECK(journal.Open() == CFlatJournal::FileError);
+        BOOST_CHECK(journal.Reset());
+
+        for (int i = 0; i < 100; i++) {
+            uint256 key = GetRandHash();
+            mapExpected[key] = key.ToString();
+        }
+        journal.WriteMap(1, mapExpected, false);
+        BOOST_CHECK(journal.Flush());
+
+        // unchanged entries are not written again
+        uint64_t nFileSize = journal.GetFileSize();
+        journal.WriteMap(1, mapExpected, false);
+        BOOST_CHECK_EQUAL(journal.GetFileSize(), nFileSize);
+
+        // updates and removals are appended
+        std::map<uint256, std::string>::iterator it = mapExpected.begin();
+        for (int i = 0; i < 10; i++, ++it)
+            it->second = "changed";
+        for (int i = 0; i < 10; i++)
+            mapExpected.erase(it++);
+        journal.WriteMap(1, mapExpected, false);
+        BOOST_CHECK(journal.GetFileSize() > nFileSize);
+        CheckContents(journal, mapExpected);
+        BOOST_CHECK(journal.Flush());
+    }
+
+    CFlatJournal journal("journal_test.dat", "JournalTest");
+    BOOST_CHECK(journal.Open() == CFlatJournal::Ok);
+    CheckContents(journal, mapExpected);
+
+    std::map<uint256, std::string> mapLoaded;
+    journal.ReadMap(1, mapLoaded);
+    BOOST_CHECK(mapLoaded == mapExpected);
+
+    // a different file type is not mistaken for this one
+    CFlatJournal journalOther("journal_test.dat", "OtherJournal");
+    BOOST_CHECK(journalOther.Open() == CFlatJournal::IncorrectMagicMessage);
+}
+
+BOOST_AUTO_TEST_CASE(journal_damaged_records)
+{
+    boost::filesystem::path path = GetDataDir() / "journal_damaged.dat";
+    std::map<uint256, std::string> mapExpected;
+    uint256 keyDamaged;
+    {
+        CFlatJournal journal("journal_damaged.dat", "JournalTest");
+        BOOST_CHECK(journal.Reset());
+        for (int i = 0; i < 20; i++) {
+            uint256 key = GetRandHash();
+            mapExpected[key] = key.ToString();
+        }
+        journal.WriteMap(1, mapExpected, true);
+        BOOST_CHECK(journal.Flush());
+
+        std::vector<uint256> vKeys;
+        journal.GetKeys(1, vKeys);
+        BOOST_CHECK_EQUAL(vKeys.size(), 20U);
+        keyDamaged = vKeys[0];
+    }
+    uint64_t nFileSize = boost::filesystem::file_size(path);
+
+    // a torn record at the end, as left behind by a crash
+    FILE* file = fopen(path.string().c_str(), "ab");
+    BOOST_REQUIRE(file);
+    fwrite("\x01\x01partial", 1, 9, file);
+    fclose(file);
+
+    // flip a payload byte of the first record
+    file = fopen(path.string().c_str(), "r+b");
+    BOOST_REQUIRE(file);
+    CDataStream ssHeader(SER_DISK, CLIENT_VERSION);
+    ssHeader << std::string("JournalTest") << FLATDATA(Params().MessageStart()) << JOURNAL_VERSION;
+    fseek(file, ssHeader.size() + 1 + 1 + 32 + 4 + 3, SEEK_SET);
+    fputc('x', file);
+    fclose(file);
+
+    CFlatJournal journal("journal_damaged.dat", "JournalTest");
+    BOOST_CHECK(journal.Open() == CFlatJournal::Ok);
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(path), nFileSize);
+    BOOST_CHECK_EQUAL(journal.size(), 20U);
+
+    std::map<uint256, std::string> mapLoaded;
+    journal.ReadMap(1, mapLoaded);
+    mapExpected.erase(keyDamaged);
+    BOOST_CHECK(mapLoaded == mapExpected);
+}
+
+BOOST_AUTO_TEST_CASE(journal_compaction)
+{
+    CFlatJournal journal("journal_compact.dat", "JournalTest");
+    BOOST_CHECK(journal.Reset());
+
+    std::map<uint256, std::string> mapExpected;
+    for (int i = 0; i < 16; i++)
+        mapExpected[GetRandHash()] = "";
+
+    // rewrite the same keys until superseded records trigger a compaction
+    uint64_t nFileSizeMax = 0;
+    for (int nRound = 0; nRound < 40; nRound++) {
+        for (std::map<uint256, std::string>::iterator it = mapExpected.begin(); it != mapExpected.end(); ++it)
+            it->second = std::string(4096, 'a' + nRound % 26);
+        journal.WriteMap(1, mapExpected, false);
+        nFileSizeMax = std::max(nFileSizeMax, journal.GetFileSize());
+        BOOST_CHECK(journal.Flush());
+    }
+    BOOST_CHECK(nFileSizeMax >= JOURNAL_COMPACT_MIN_SIZE);
+    BOOST_CHECK(journal.GetFileSize() < JOURNAL_COMPACT_MIN_SIZE);
+    CheckContents(journal, mapExpected);
+
+    CFlatJournal journalReopened("journal_compact.dat", "JournalTest");
+    BOOST_CHECK(journalReopened.Open() == CFlatJournal::Ok);
+    CheckContents(journalReopened, mapExpected);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -49,4 +49,22 @@ BOOST_AUTO_TEST_CASE(subsidy_limit_test)
     //BOOST_CHECK(nSum == 4109975100000000ULL);
 }
 
+BOOST_AUTO_TEST_CASE(ReadBlockFromDisk_trusted)
+{
+    LOCK(cs_main);
+    CBlockIndex* pindex = chainActive.Genesis();
+    BOOST_REQUIRE(pindex);
+
+    CBlock block, blockChecked;
+    BOOST_CHECK(ReadBlockFromDisk(block, pindex));
+    BOOST_CHECK(ReadBlockFromDisk(blockChecked, pindex, false));
+    BOOST_CHECK(block.GetHash() == pindex->GetBlockHash());
+    BOOST_CHECK(blockChecked.GetHash() == block.GetHash());
+
+    // an index entry that doesn't describe the block on disk
+    CBlockIndex indexOther(*pindex);
+    indexOther.nNonce++;
+    BOOST_CHECK(!ReadBlockFromDisk(block, &indexOther));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
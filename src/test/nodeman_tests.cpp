@@ -0,0 +1,271 @@
+// Copyright (c) 2019 The Lytix developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "clientversion.h"
+#include "master/nodeman.h"
+#include "random.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(nodeman_tests)
+
+static CPubKey RandomPubKey()
+{
+    CKey key;
+    key.MakeNewKey(true);
+    return key.GetPubKey();
+}
+
+static CMasternode RandomMasternode()
+{
+    CMasternode mn;
+    mn.vin = CTxIn(COutPoint(GetRandHash(), insecure_rand() % 4));
+    mn.pubKeyCollateralAddress = RandomPubKey();
+    mn.pubKeyMasternode = RandomPubKey();
+    return mn;
+}
+
+// the first entry of the list with the payee, as the full scan the index replaced found it
+static const CMasternode* ScanPayee(const std::vector<CMasternode>& vNodes, const CScript& payee)
+{
+    BOOST_FOREACH (const CMasternode& mn, vNodes) {
+        if (GetScriptForDestination(mn.pubKeyCollateralAddress.GetID()) == payee)
+            return &mn;
+    }
+    return NULL;
+}
+
+static const CMasternode* ScanPubKey(const std::vector<CMasternode>& vNodes, const CPubKey& pubKeyMasternode)
+{
+    BOOST_FOREACH (const CMasternode& mn, vNodes) {
+        if (mn.pubKeyMasternode == pubKeyMasternode)
+            return &mn;
+    }
+    return NULL;
+}
+
+static void CheckFound(const CMasternode* pmn, const CMasternode* pmnScan)
+{
+    BOOST_CHECK((pmn == NULL) == (pmnScan == NULL));
+    if (pmn != NULL && pmnScan != NULL)
+        BOOST_CHECK(pmn->vin == pmnScan->vin);
+}
+
+// Every entry of the vector must be reachable through each index, and each
+// lookup must resolve to the first entry that actually carries the key.
+static void CheckIndexes(CMasternodeMan& man, const std::vector<CMasternode>& vRemoved)
+{
+    CMasternodeSnapshotRef snapshot = man.GetSnapshot();
+    BOOST_CHECK_EQUAL(snapshot->size(), man.size());
+    const std::vector<CMasternode>& vNodes = snapshot->GetNodes();
+
+    BOOST_FOREACH (const CMasternode& mn, vNodes) {
+        CScript payee = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
+
+        BOOST_CHECK(snapshot->Find(mn.vin.prevout) == &mn);
+
+        CMasternode* pmn = man.Find(mn.vin);
+        BOOST_REQUIRE(pmn != NULL);
+        BOOST_CHECK(pmn->vin == mn.vin);
+
+        CheckFound(man.Find(payee), ScanPayee(vNodes, payee));
+        CheckFound(man.Find(mn.pubKeyMasternode), ScanPubKey(vNodes, mn.pubKeyMasternode));
+    }
+
+    // the keys of removed entries may still be carried by others
+    BOOST_FOREACH (const CMasternode& mn, vRemoved) {
+        CScript payee = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
+
+        BOOST_CHECK(man.Find(mn.vin) == NULL);
+        BOOST_CHECK(snapshot->Find(mn.vin.prevout) == NULL);
+        CheckFound(man.Find(payee), ScanPayee(vNodes, payee));
+        CheckFound(man.Find(mn.pubKeyMasternode), ScanPubKey(vNodes, mn.pubKeyMasternode));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(nodeman_index_consistency)
+{
+    CMasternodeMan man;
+    std::vector<CMasternode> vAdded;
+    std::vector<CMasternode> vRemoved;
+
+    // one in four entries shares its payee with an earlier one, one in eight its pubkey too
+    for (int i = 0; i < 64; i++) {
+        CMasternode mn = RandomMasternode();
+        if (i >= 4 && i % 4 == 0) {
+            const CMasternode& mnShared = vAdded[insecure_rand() % vAdded.size()];
+            mn.pubKeyCollateralAddress = mnShared.pubKeyCollateralAddress;
+            if (i % 8 == 0) mn.pubKeyMasternode = mnShared.pubKeyMasternode;
+        }
+        BOOST_CHECK(man.Add(mn));
+        vAdded.push_back(mn);
+    }
+    // duplicates are rejected
+    BOOST_CHECK(!man.Add(vAdded[0]));
+    CheckIndexes(man, vRemoved);
+
+    // removing entries shifts positions in the vector
+    for (int i = 0; i < 16; i++) {
+        int nPos = insecure_rand() % vAdded.size();
+        man.Remove(vAdded[nPos].vin);
+        vRemoved.push_back(vAdded[nPos]);
+        vAdded.erase(vAdded.begin() + nPos);
+    }
+    BOOST_CHECK_EQUAL(man.size(), 48);
+    CheckIndexes(man, vRemoved);
+
+    // a newer broadcast re-keys an existing entry
+    for (int i = 0; i < 8; i++) {
+        CMasternode& mn = vAdded[i];
+        CMasternode mnOld = mn;
+        CMasternodeBroadcast mnb(mn);
+        mnb.pubKeyMasternode = RandomPubKey();
+        mnb.sigTime = mn.sigTime + 1;
+        man.UpdateMasternodeList(mnb);
+
+        CMasternode* pmn = man.Find(mnb.pubKeyMasternode);
+        BOOST_REQUIRE(pmn != NULL);
+        BOOST_CHECK(pmn->vin == mn.vin);
+        mn.pubKeyMasternode = mnb.pubKeyMasternode;
+        CheckFound(man.Find(mnOld.pubKeyMasternode), ScanPubKey(man.GetSnapshot()->GetNodes(), mnOld.pubKeyMasternode));
+    }
+    CheckIndexes(man, vRemoved);
+
+    // a payee shared by a new entry stays reachable while the entries before it go
+    CMasternode mnFirst = vAdded[0];
+    CScript payeeShared = GetScriptForDestination(mnFirst.pubKeyCollateralAddress.GetID());
+    std::vector<CMasternode> vShared;
+    for (int i = 0; i < 3; i++) {
+        CMasternode mn = RandomMasternode();
+        mn.pubKeyCollateralAddress = mnFirst.pubKeyCollateralAddress;
+        BOOST_CHECK(man.Add(mn));
+        vShared.push_back(mn);
+    }
+    std::vector<CMasternode> vRemovedShared(1, mnFirst);
+    vRemovedShared.insert(vRemovedShared.end(), vShared.begin(), vShared.begin() + 2);
+    BOOST_FOREACH (const CMasternode& mn, vRemovedShared) {
+        BOOST_CHECK(man.Find(payeeShared) != NULL);
+        man.Remove(mn.vin);
+        vRemoved.push_back(mn);
+        CheckIndexes(man, vRemoved);
+    }
+    vAdded.erase(vAdded.begin());
+    vAdded.push_back(vShared.back());
+    CMasternode* pmnShared = man.Find(payeeShared);
+    BOOST_REQUIRE(pmnShared != NULL);
+
+    // indexes are rebuilt when the list is loaded from disk
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << man;
+    CMasternodeMan manLoaded;
+    ss >> manLoaded;
+    BOOST_CHECK_EQUAL(manLoaded.size(), man.size());
+    CheckIndexes(manLoaded, vRemoved);
+
+    // a snapshot handed out earlier is not affected by later changes
+    CMasternodeSnapshotRef snapshot = man.GetSnapshot();
+    man.Clear();
+    BOOST_CHECK_EQUAL(man.size(), 0);
+    BOOST_CHECK_EQUAL(snapshot->size(), 48);
+    CheckIndexes(man, vAdded);
+}
+
+BOOST_AUTO_TEST_CASE(nodeman_delta_pages)
+{
+    CNodeTier<CMasternodeTraits> tier;
+    std::vector<CMasternode> vNodes;
+    for (int i = 0; i < 50; i++) {
+        CMasternode mn = RandomMasternode();
+        mn.sigTime = 1000 + insecure_rand() % 100;
+        // a few share their change time, the collateral breaks the tie
+        mn.lastPing.sigTime = i % 5 == 0 ? 1500 : mn.sigTime + insecure_rand() % 1000;
+        vNodes.push_back(mn);
+    }
+    vNodes[0].activeState = CMasternode::MASTERNODE_EXPIRED;
+
+    CNodeListCursor cursor(1200, tier.GetListHash(vNodes));
+    std::set<COutPoint> setExpected;
+    BOOST_FOREACH (const CMasternode& mn, vNodes)
+        if (mn.IsEnabled() && tier.GetLastChange(mn) > cursor.nSince) setExpected.insert(mn.vin.prevout);
+
+    // every changed entry shows up exactly once, in cursor order
+    std::set<COutPoint> setSent;
+    bool fMore = true;
+    while (fMore) {
+        std::vector<CMasternode*> vPage;
+        fMore = tier.GetChangedPage(vNodes, cursor, 7, vPage);
+        BOOST_CHECK(vPage.size() <= 7);
+        BOOST_CHECK(!fMore || vPage.size() == 7);
+        BOOST_FOREACH (CMasternode* pmn, vPage) {
+            BOOST_CHECK(cursor.IsBefore(tier.GetLastChange(*pmn), pmn->vin.prevout));
+            BOOST_CHECK(setSent.insert(pmn->vin.prevout).second);
+            cursor.nTime = tier.GetLastChange(*pmn);
+            cursor.prevout = pmn->vin.prevout;
+        }
+    }
+    BOOST_CHECK(setSent == setExpected);
+
+    // the list hash only depends on the enabled entries, not on their order
+    uint256 hashList = tier.GetListHash(vNodes);
+    std::reverse(vNodes.begin(), vNodes.end());
+    BOOST_CHECK(tier.GetListHash(vNodes) == hashList);
+    vNodes.back().activeState = CMasternode::MASTERNODE_ENABLED;
+    BOOST_CHECK(tier.GetListHash(vNodes) != hashList);
+}
+
+BOOST_AUTO_TEST_CASE(nodeman_expiry_schedule)
+{
+    int64_t nTimeStart = GetTime();
+    SetMockTime(nTimeStart);
+
+    CMasternodeMan man;
+    for (int i = 0; i < 20; i++) {
+        CMasternode mn = RandomMasternode();
+        mn.unitTest = true;
+        mn.protocolVersion = PROTOCOL_VERSION;
+        mn.sigTime = GetAdjustedTime() - 60 * 60;
+        mn.lastPing.vin = mn.vin;
+        mn.lastPing.sigTime = GetAdjustedTime() - i * 60;
+        mn.Check(true);
+        BOOST_CHECK(man.Add(mn));
+    }
+    BOOST_CHECK_EQUAL(man.CountEnabled(PROTOCOL_VERSION), 20);
+    BOOST_CHECK_EQUAL(man.CountEnabled(PROTOCOL_VERSION + 1), 0);
+
+    // pings get too old one after the other
+    SetMockTime(nTimeStart + MASTERNODE_EXPIRATION_SECONDS - 5 * 60 + 1);
+    BOOST_CHECK_EQUAL(man.CountEnabled(PROTOCOL_VERSION), 5);
+    man.CheckAndRemove();
+    BOOST_CHECK_EQUAL(man.size(), 20);
+
+    // a new ping brings an expired node back
+    CMasternode* pmn = man.Find(man.GetSnapshot()->GetNodes()[10].vin);
+    BOOST_REQUIRE(pmn != NULL);
+    pmn->lastPing.sigTime = GetAdjustedTime();
+    man.CheckMasternode(*pmn, true);
+    BOOST_CHECK_EQUAL(man.CountEnabled(PROTOCOL_VERSION), 6);
+
+    // and the expired ones are removed once they reach the removal time
+    SetMockTime(nTimeStart + MASTERNODE_REMOVAL_SECONDS - 5 * 60 + 1);
+    BOOST_CHECK_EQUAL(man.CountEnabled(PROTOCOL_VERSION), 1);
+    std::vector<CTxIn> vBefore;
+    BOOST_FOREACH (const CMasternode& mn, man.GetSnapshot()->GetNodes())
+        vBefore.push_back(mn.vin);
+    man.CheckAndRemove();
+    BOOST_CHECK_EQUAL(man.size(), 6);
+    BOOST_CHECK_EQUAL(man.CountEnabled(PROTOCOL_VERSION), 1);
+
+    // the nodes that are left keep their order
+    size_t nBefore = 0;
+    BOOST_FOREACH (const CMasternode& mn, man.GetSnapshot()->GetNodes()) {
+        while (nBefore < vBefore.size() && vBefore[nBefore] != mn.vin)
+            nBefore++;
+        BOOST_CHECK(nBefore < vBefore.size());
+    }
+    CheckIndexes(man, std::vector<CMasternode>());
+
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
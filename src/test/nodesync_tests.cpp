@@ -0,0 +1,190 @@
+// Copyright (c) 2019 The Lytix developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+#include "master/node-sync.h"
+#include "max/node-sync.h"
+#include "utiltime.h"
+#include "version.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(nodesync_tests)
+
+static void SyncStatusCount(CMasternodeSync& sync, int nItemID, int nCount)
+{
+    std::string strCommand = "ssc";
+    CDataStream vRecv(SER_NETWORK, PROTOCOL_VERSION);
+    vRecv << nItemID << nCount;
+    sync.ProcessMessage(NULL, strCommand, vRecv);
+}
+
+static void SyncStatusCount(CMaxnodeSync& sync, int nItemID, int nCount)
+{
+    std::string strCommand = "smaxsc";
+    CDataStream vRecv(SER_NETWORK, PROTOCOL_VERSION);
+    vRecv << nItemID << nCount;
+    sync.ProcessMessage(NULL, strCommand, vRecv);
+}
+
+BOOST_AUTO_TEST_CASE(masternode_sync_stages)
+{
+    int64_t nNow = 1500000000;
+    SetMockTime(nNow);
+
+    CMasternodeSync sync;
+    sync.GetNextAsset();
+    BOOST_CHECK_EQUAL(sync.RequestedMasternodeAssets, MASTERNODE_SYNC_SPORKS);
+
+    // nothing is late before anything was asked for
+    SetMockTime(nNow + MASTERNODE_SYNC_TIMEOUT * 10);
+    sync.CheckAsset();
+    BOOST_CHECK_EQUAL(sync.RequestedMasternodeAssets, MASTERNODE_SYNC_SPORKS);
+
+    // sporks complete once enough peers were asked and had a moment to answer
+    sync.nAssetSyncStarted = nNow;
+    sync.RequestedMasternodeAttempt = MASTERNODE_SYNC_THRESHOLD;
+    SetMockTime(nNow + MASTERNODE_SYNC_TIMEOUT - 1);
+    sync.CheckAsset();
+    BOOST_CHECK_EQUAL(sync.RequestedMasternodeAssets, MASTERNODE_SYNC_SPORKS);
+    nNow += MASTERNODE_SYNC_TIMEOUT;
+    SetMockTime(nNow);
+    sync.CheckAsset();
+    BOOST_CHECK_EQUAL(sync.RequestedMasternodeAssets, MASTERNODE_SYNC_LIST);
+    BOOST_CHECK_EQUAL(sync.RequestedMasternodeAttempt, 0);
+    BOOST_CHECK(sync.GetStageMillis(MASTERNODE_SYNC_SPORKS) >= 0);
+
+    // the list completes when enough peers reported their counts and the last item is settled
+    sync.RequestedMasternodeAttempt = 1;
+    sync.lastMasternodeList = nNow;
+    SyncStatusCount(sync, MASTERNODE_SYNC_MNW, 10);
+    SyncStatusCount(sync, MASTERNODE_SYNC_LIST, 10);
+    BOOST_CHECK_EQUAL(sync.countMasternodeList, 1);
+    BOOST_CHECK_EQUAL(sync.countMasternodeWinner, 0);
+    SetMockTime(nNow + MASTERNODE_SYNC_TIMEOUT + 1);
+    sync.CheckAsset();
+    BOOST_CHECK_EQUAL(sync.RequestedMasternodeAssets, MASTERNODE_SYNC_LIST);
+    SyncStatusCount(sync, MASTERNODE_SYNC_LIST, 12);
+    BOOST_CHECK_EQUAL(sync.sumMasternodeList, 22);
+    BOOST_CHECK_EQUAL(sync.RequestedMasternodeAssets, MASTERNODE_SYNC_MNW);
+    nNow += MASTERNODE_SYNC_TIMEOUT + 1;
+
+    // winners complete without counts after a quiet spell, but only once enough peers were asked
+    sync.RequestedMasternodeAttempt = 1;
+    sync.lastMasternodeWinner = nNow;
+    SetMockTime(nNow + MASTERNODE_SYNC_TIMEOUT * 2 + 1);
+    sync.CheckAsset();
+    BOOST_CHECK_EQUAL(sync.RequestedMasternodeAssets, MASTERNODE_SYNC_MNW);
+    sync.RequestedMasternodeAttempt = MASTERNODE_SYNC_THRESHOLD;
+    sync.CheckAsset();
+    BOOST_CHECK_EQUAL(sync.RequestedMasternodeAssets, MASTERNODE_SYNC_BUDGET);
+    nNow += MASTERNODE_SYNC_TIMEOUT * 2 + 1;
+
+    // an empty budget completes as soon as enough peers reported both kinds of items
+    sync.RequestedMasternodeAttempt = 1;
+    SyncStatusCount(sync, MASTERNODE_SYNC_BUDGET_PROP, 0);
+    SyncStatusCount(sync, MASTERNODE_SYNC_BUDGET_FIN, 0);
+    SyncStatusCount(sync, MASTERNODE_SYNC_BUDGET_PROP, 0);
+    BOOST_CHECK_EQUAL(sync.RequestedMasternodeAssets, MASTERNODE_SYNC_BUDGET);
+    BOOST_CHECK(sync.IsBudgetPropEmpty() && sync.IsBudgetFinEmpty());
+    SyncStatusCount(sync, MASTERNODE_SYNC_BUDGET_FIN, 0);
+    BOOST_CHECK(sync.IsSynced());
+
+    // counts arriving after the sync are ignored
+    SyncStatusCount(sync, MASTERNODE_SYNC_BUDGET_PROP, 5);
+    BOOST_CHECK_EQUAL(sync.sumBudgetItemProp, 0);
+
+    // a budget stage nobody answers moves on after the timeout
+    sync.Reset();
+    BOOST_CHECK_EQUAL(sync.RequestedMasternodeAssets, MASTERNODE_SYNC_INITIAL);
+    BOOST_CHECK_EQUAL(sync.countBudgetItemProp, 0);
+    sync.RequestedMasternodeAssets = MASTERNODE_SYNC_BUDGET;
+    sync.RequestedMasternodeAttempt = 1;
+    SetMockTime(nNow + MASTERNODE_SYNC_TIMEOUT * 5);
+    sync.CheckAsset();
+    BOOST_CHECK_EQUAL(sync.RequestedMasternodeAssets, MASTERNODE_SYNC_BUDGET);
+    SetMockTime(nNow + MASTERNODE_SYNC_TIMEOUT * 5 + 1);
+    sync.CheckAsset();
+    BOOST_CHECK(sync.IsSynced());
+
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_CASE(masternode_sync_delta_list)
+{
+    int64_t nNow = 1500000000;
+    SetMockTime(nNow);
+
+    CMasternodeSync sync;
+    sync.RequestedMasternodeAssets = MASTERNODE_SYNC_LIST;
+    sync.RequestedMasternodeAttempt = MASTERNODE_SYNC_THRESHOLD;
+
+    // a warm restart, the peers' lists match ours and they only announce pings
+    sync.AddedMasternodeListPage(500, false);
+    sync.AddedMasternodeListPage(20, true);
+    BOOST_CHECK_EQUAL(sync.RequestedMasternodeAssets, MASTERNODE_SYNC_LIST);
+    sync.AddedMasternodeListPage(30, true);
+    BOOST_CHECK_EQUAL(sync.sumMasternodeList, 550);
+    BOOST_CHECK_EQUAL(sync.lastMasternodeList, 0);
+    BOOST_CHECK_EQUAL(sync.RequestedMasternodeAssets, MASTERNODE_SYNC_MNW);
+
+    // pages of a stage that is over don't count
+    sync.AddedMasternodeListPage(10, true);
+    BOOST_CHECK_EQUAL(sync.countMasternodeListDelta, 2);
+
+    // broadcasts that did come in have to settle first
+    sync.Reset();
+    sync.RequestedMasternodeAssets = MASTERNODE_SYNC_LIST;
+    sync.RequestedMasternodeAttempt = MASTERNODE_SYNC_THRESHOLD;
+    sync.lastMasternodeList = nNow;
+    sync.AddedMasternodeListPage(3, true);
+    sync.AddedMasternodeListPage(3, true);
+    BOOST_CHECK_EQUAL(sync.RequestedMasternodeAssets, MASTERNODE_SYNC_LIST);
+    SetMockTime(nNow + MASTERNODE_SYNC_TIMEOUT + 1);
+    sync.CheckAsset();
+    BOOST_CHECK_EQUAL(sync.RequestedMasternodeAssets, MASTERNODE_SYNC_MNW);
+
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_CASE(maxnode_sync_stages)
+{
+    int64_t nNow = 1500000000;
+    SetMockTime(nNow);
+
+    CMaxnodeSync sync;
+    sync.RequestedMaxnodeAssets = MAXNODE_SYNC_LIST;
+    sync.RequestedMaxnodeAttempt = 1;
+    sync.lastMaxnodeList = nNow;
+
+    // one peer done isn't enough, neither is a last item that may still have company on the way
+    SyncStatusCount(sync, MAXNODE_SYNC_LIST, 3);
+    SetMockTime(nNow + MAXNODE_SYNC_TIMEOUT);
+    SyncStatusCount(sync, MAXNODE_SYNC_LIST, 4);
+    BOOST_CHECK_EQUAL(sync.RequestedMaxnodeAssets, MAXNODE_SYNC_LIST);
+    SetMockTime(nNow + MAXNODE_SYNC_TIMEOUT + 1);
+    sync.CheckAsset();
+    BOOST_CHECK_EQUAL(sync.RequestedMaxnodeAssets, MAXNODE_SYNC_MAXW);
+
+    // delta syncs that only announced pings complete the list right away
+    sync.Reset();
+    sync.RequestedMaxnodeAssets = MAXNODE_SYNC_LIST;
+    sync.RequestedMaxnodeAttempt = 1;
+    sync.AddedMaxnodeListPage(8, true);
+    BOOST_CHECK_EQUAL(sync.RequestedMaxnodeAssets, MAXNODE_SYNC_LIST);
+    sync.AddedMaxnodeListPage(8, true);
+    BOOST_CHECK_EQUAL(sync.RequestedMaxnodeAssets, MAXNODE_SYNC_MAXW);
+
+    // the budget stage isn't counted for maxnodes, peers reporting counts don't end it
+    sync.RequestedMaxnodeAssets = MAXNODE_SYNC_BUDGET;
+    sync.RequestedMaxnodeAttempt = MAXNODE_SYNC_THRESHOLD;
+    sync.nAssetSyncStarted = nNow;
+    SyncStatusCount(sync, MAXNODE_SYNC_BUDGET_PROP, 0);
+    SyncStatusCount(sync, MAXNODE_SYNC_BUDGET_FIN, 0);
+    BOOST_CHECK_EQUAL(sync.RequestedMaxnodeAssets, MAXNODE_SYNC_BUDGET);
+
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,190 @@
+// Copyright (c) 2019 The Lytix developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "clientversion.h"
+#include "main.h"
+#include "master/node-payments.h"
+#include "master/nodeman.h"
+#include "max/node-payments.h"
+#include "max/nodeman.h"
+#include "random.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(payments_tests)
+
+static void SetChainTip(CBlockIndex* pindex)
+{
+    chainActive.SetTip(pindex);
+    chainActiveHashes.SetTip(pindex);
+}
+
+static CPubKey RandomPubKey()
+{
+    CKey key;
+    key.MakeNewKey(true);
+    return key.GetPubKey();
+}
+
+// a chain to vote on, votes need the hash of the block 100 below them
+struct PaymentsChain
+{
+    std::vector<uint256> vHashes;
+    std::vector<CBlockIndex> vBlocks;
+    CBlockIndex* pindexGenesis;
+
+    PaymentsChain() : vHashes(3000), vBlocks(3000)
+    {
+        for (unsigned int i = 0; i < vBlocks.size(); i++) {
+            vHashes[i] = i;
+            vBlocks[i].nHeight = i;
+            vBlocks[i].pprev = i ? &vBlocks[i - 1] : NULL;
+            vBlocks[i].phashBlock = &vHashes[i];
+        }
+        pindexGenesis = chainActive.Genesis();
+        SetChainTip(&vBlocks.back());
+    }
+
+    ~PaymentsChain()
+    {
+        SetChainTip(pindexGenesis);
+    }
+};
+
+static std::set<uint256> SyncedVotes(CNode& node)
+{
+    std::set<uint256> setHashes;
+    BOOST_FOREACH (const CInv& inv, node.vInventoryToSend)
+        setHashes.insert(inv.hash);
+    return setHashes;
+}
+
+// the look ahead over the next blocks and the walk over all votes the indexes replaced
+template <typename BlockPayees>
+static bool IsScheduledScan(std::map<int, BlockPayees>& mapBlocks, const CPubKey& pubKeyCollateralAddress, int nNotBlockHeight)
+{
+    int nHeight = chainActive.Tip()->nHeight;
+    CScript nodepayee = GetScriptForDestination(pubKeyCollateralAddress.GetID());
+    CScript payee;
+    for (int64_t h = nHeight; h <= nHeight + 8; h++) {
+        if (h == nNotBlockHeight) continue;
+        if (mapBlocks.count(h) && mapBlocks[h].GetPayee(payee) && nodepayee == payee)
+            return true;
+    }
+    return false;
+}
+
+template <typename Winner>
+static std::set<uint256> SyncScan(const std::map<uint256, Winner>& mapVotes, int nCountNeeded, int nEnabled)
+{
+    int nHeight = chainActive.Tip()->nHeight;
+    nCountNeeded = std::min(nCountNeeded, (int)(nEnabled * 1.25));
+    std::set<uint256> setHashes;
+    typename std::map<uint256, Winner>::const_iterator it = mapVotes.begin();
+    for (; it != mapVotes.end(); ++it) {
+        if (it->second.nBlockHeight >= nHeight - nCountNeeded && it->second.nBlockHeight <= nHeight + 20)
+            setHashes.insert(it->first);
+    }
+    return setHashes;
+}
+
+template <typename Payments, typename BlockPayees, typename Winner, typename Node>
+static int CheckPayments(Payments& payments, std::map<int, BlockPayees>& mapBlocks, const std::map<uint256, Winner>& mapVotes, int nEnabled, std::vector<Node>& vNodes)
+{
+    int nScheduled = 0;
+    int nHeight = chainActive.Tip()->nHeight;
+    BOOST_FOREACH (Node& node, vNodes) {
+        for (int nNotBlockHeight = nHeight - 1; nNotBlockHeight <= nHeight + 9; nNotBlockHeight++) {
+            bool fScheduled = payments.IsScheduled(node, nNotBlockHeight);
+            BOOST_CHECK_EQUAL(fScheduled, IsScheduledScan(mapBlocks, node.pubKeyCollateralAddress, nNotBlockHeight));
+            nScheduled += fScheduled;
+        }
+    }
+
+    CNode node(INVALID_SOCKET, CAddress(), "", true);
+    payments.Sync(&node, 1000);
+    BOOST_CHECK(SyncedVotes(node) == SyncScan(mapVotes, 1000, nEnabled));
+    return nScheduled;
+}
+
+static int CheckMasternodePayments(CMasternodePayments& payments, std::vector<CMasternode>& vMasternodes)
+{
+    return CheckPayments(payments, payments.mapMasternodeBlocks, payments.mapMasternodePayeeVotes, mnodeman.CountEnabled(), vMasternodes);
+}
+
+static int CheckMaxnodePayments(CMaxnodePayments& payments, std::vector<CMaxnode>& vMaxnodes)
+{
+    return CheckPayments(payments, payments.mapMaxnodeBlocks, payments.mapMaxnodePayeeVotes, maxnodeman.CountEnabled(), vMaxnodes);
+}
+
+BOOST_FIXTURE_TEST_CASE(masternode_payments_index, PaymentsChain)
+{
+    std::vector<CMasternode> vMasternodes(10);
+    BOOST_FOREACH (CMasternode& mn, vMasternodes)
+        mn.pubKeyCollateralAddress = RandomPubKey();
+
+    // three votes for each height, often split so the winner changes as they come in
+    CMasternodePayments payments;
+    for (int nHeight = 1000; nHeight <= 3010; nHeight++) {
+        for (int i = 0; i < 3; i++) {
+            CMasternodePaymentWinner winner(CTxIn(COutPoint(GetRandHash(), 0)));
+            winner.nBlockHeight = nHeight;
+            winner.AddPayee(GetScriptForDestination(vMasternodes[insecure_rand() % vMasternodes.size()].pubKeyCollateralAddress.GetID()));
+            BOOST_CHECK(payments.AddWinningMasternode(winner));
+            BOOST_CHECK(!payments.AddWinningMasternode(winner));
+        }
+    }
+    BOOST_CHECK_EQUAL(payments.mapMasternodePayeeVotes.size(), 2011U * 3);
+
+    BOOST_CHECK(CheckMasternodePayments(payments, vMasternodes) > 0);
+    SetChainTip(&vBlocks[1500]);
+    BOOST_CHECK(CheckMasternodePayments(payments, vMasternodes) > 0);
+
+    // pruning from the tip drops the votes and blocks more than 1000 below it, and their index entries
+    SetChainTip(&vBlocks.back());
+    payments.CleanPaymentList();
+    BOOST_CHECK_EQUAL(payments.mapMasternodePayeeVotes.size(), 1012U * 3);
+    BOOST_CHECK_EQUAL(payments.mapMasternodeBlocks.begin()->first, 1999);
+    BOOST_CHECK(CheckMasternodePayments(payments, vMasternodes) > 0);
+    SetChainTip(&vBlocks[1500]);
+    BOOST_CHECK_EQUAL(CheckMasternodePayments(payments, vMasternodes), 0);
+
+    // the indexes are rebuilt the same way when the payments are loaded
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << payments;
+    CMasternodePayments paymentsLoaded;
+    ss >> paymentsLoaded;
+    SetChainTip(&vBlocks[2500]);
+    BOOST_CHECK(CheckMasternodePayments(paymentsLoaded, vMasternodes) > 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(maxnode_payments_index, PaymentsChain)
+{
+    std::vector<CMaxnode> vMaxnodes(10);
+    BOOST_FOREACH (CMaxnode& max, vMaxnodes)
+        max.pubKeyCollateralAddress = RandomPubKey();
+
+    CMaxnodePayments payments;
+    for (int nHeight = 1000; nHeight <= 3010; nHeight++) {
+        for (int i = 0; i < 3; i++) {
+            CMaxnodePaymentWinner winner(CTxIn(COutPoint(GetRandHash(), 0)));
+            winner.nBlockHeight = nHeight;
+            winner.AddPayee(GetScriptForDestination(vMaxnodes[insecure_rand() % vMaxnodes.size()].pubKeyCollateralAddress.GetID()));
+            BOOST_CHECK(payments.AddWinningMaxnode(winner));
+        }
+    }
+
+    BOOST_CHECK(CheckMaxnodePayments(payments, vMaxnodes) > 0);
+    SetChainTip(&vBlocks[1500]);
+    BOOST_CHECK(CheckMaxnodePayments(payments, vMaxnodes) > 0);
+
+    SetChainTip(&vBlocks.back());
+    payments.CleanPaymentList();
+    BOOST_CHECK_EQUAL(payments.mapMaxnodePayeeVotes.size(), 1012U * 3);
+    BOOST_CHECK(CheckMaxnodePayments(payments, vMaxnodes) > 0);
+    SetChainTip(&vBlocks[1500]);
+    BOOST_CHECK_EQUAL(CheckMaxnodePayments(payments, vMaxnodes), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
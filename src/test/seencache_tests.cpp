@@ -0,0 +1,88 @@
+// Copyright (c) 2019 The Lytix developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "clientversion.h"
+#include "random.h"
+#include "seencache.h"
+#include "streams.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(seencache_tests)
+
+BOOST_AUTO_TEST_CASE(seencache_size_limit)
+{
+    mapArgs["-maxseencachesize"] = "10";
+    SetMockTime(1000);
+
+    CSeenCache<int> cache(0);
+    std::vector<uint256> vHashes;
+    for (int i = 0; i < 20; i++) {
+        vHashes.push_back(GetRandHash());
+        BOOST_CHECK(cache.insert(std::make_pair(vHashes.back(), i)).second);
+        BOOST_CHECK(!cache.insert(std::make_pair(vHashes.back(), -1)).second);
+        SetMockTime(1001 + i);
+
+        // keep the first entry in use, it outlives the ones inserted after it
+        cache[vHashes[0]] = 0;
+    }
+    BOOST_CHECK_EQUAL(cache.size(), 10U);
+    BOOST_CHECK(cache.count(vHashes[0]));
+    for (int i = 1; i < 11; i++)
+        BOOST_CHECK(!cache.count(vHashes[i]));
+    for (int i = 11; i < 20; i++)
+        BOOST_CHECK_EQUAL(cache[vHashes[i]], i);
+
+    // erasing through an iterator leaves the rest alone
+    CSeenCache<int>::iterator it = cache.begin();
+    while (it != cache.end()) {
+        if ((*it).second % 2)
+            cache.erase(it++);
+        else
+            ++it;
+    }
+    BOOST_CHECK_EQUAL(cache.size(), 5U);
+
+    SetMockTime(0);
+    mapArgs.erase("-maxseencachesize");
+}
+
+BOOST_AUTO_TEST_CASE(seencache_expiry)
+{
+    SetMockTime(1000);
+
+    CSeenCache<int> cache(60);
+    uint256 hashOld = GetRandHash();
+    uint256 hashUsed = GetRandHash();
+    cache.insert(std::make_pair(hashOld, 1));
+    cache.insert(std::make_pair(hashUsed, 2));
+
+    SetMockTime(1050);
+    cache[hashUsed]++;
+    SetMockTime(1070);
+    cache.Expire();
+    BOOST_CHECK(!cache.count(hashOld));
+    BOOST_CHECK_EQUAL(cache[hashUsed], 3);
+
+    SetMockTime(1200);
+    cache.Expire();
+    BOOST_CHECK(cache.empty());
+
+    // nothing is persisted, old files with entries still load
+    std::map<uint256, int> mapOld;
+    mapOld[hashOld] = 1;
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << mapOld << cache;
+    cache.insert(std::make_pair(hashUsed, 4));
+    ss << cache;
+    ss >> cache >> cache >> cache;
+    BOOST_CHECK(ss.empty());
+    BOOST_CHECK_EQUAL(cache.size(), 1U);
+
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,288 @@
+// Copyright (c) 2019 The Lytix developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "master/node.h"
+#include "master/nodeman.h"
+#include "obfuscation.h"
+#include "random.h"
+#include "sigverify.h"
+#include "utiltime.h"
+
+#include <map>
+#include <set>
+
+#include <boost/foreach.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(sigverify_tests)
+
+static CDataStream SignedPing(CKey& key, bool fCorrupt)
+{
+    CMasternodePing mnp;
+    mnp.vin = CTxIn(COutPoint(GetRandHash(), 0));
+    mnp.blockHash = GetRandHash();
+    CPubKey pubkey = key.GetPubKey();
+    mnp.Sign(key, pubkey);
+    if (fCorrupt) mnp.vchSig[10] ^= 1;
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << mnp;
+    return ss;
+}
+
+BOOST_AUTO_TEST_CASE(sigverify_replay_order)
+{
+    CSigVerifyPool pool;
+    CAddress addr;
+    CNode dummyNode(INVALID_SOCKET, addr, "", true);
+
+    // no workers yet, everything is processed right away
+    CKey key;
+    key.MakeNewKey(true);
+    BOOST_CHECK(!pool.Defer(&dummyNode, "mnp", SignedPing(key, false)));
+
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 3; i++)
+        threadGroup.create_thread(boost::bind(&CSigVerifyPool::Thread, &pool));
+    CSigVerifyStats stats;
+    do {
+        MilliSleep(10);
+        pool.GetStats(stats);
+    } while (stats.nWorkers < 3);
+
+    // messages without signatures are not held back
+    BOOST_CHECK(!pool.Defer(&dummyNode, "dseg", CDataStream(SER_NETWORK, PROTOCOL_VERSION)));
+
+    std::vector<CDataStream> vMessages;
+    for (int i = 0; i < 20; i++) {
+        vMessages.push_back(SignedPing(key, i % 5 == 0));
+        BOOST_CHECK(pool.Defer(&dummyNode, "mnp", vMessages.back()));
+    }
+
+    // but they wait behind the signed messages of the same peer, as do malformed ones
+    CDataStream ssDseg(SER_NETWORK, PROTOCOL_VERSION);
+    ssDseg << CTxIn();
+    BOOST_CHECK(pool.Defer(&dummyNode, "dseg", ssDseg));
+    BOOST_CHECK(pool.Defer(&dummyNode, "mnp", CDataStream(SER_NETWORK, PROTOCOL_VERSION)));
+
+    // replayed in the order received, with the keys recovered by the workers
+    for (int i = 0; i < 22; i++) {
+        CSigVerifyJobRef job;
+        while (!pool.PopVerified(dummyNode.GetId(), job))
+            MilliSleep(1);
+        if (i == 20) {
+            BOOST_CHECK_EQUAL(job->strCommand, "dseg");
+            BOOST_CHECK(job->vRecv.str() == ssDseg.str());
+            continue;
+        }
+        if (i == 21) {
+            BOOST_CHECK_EQUAL(job->strCommand, "mnp");
+            BOOST_CHECK(job->vRecv.empty());
+            continue;
+        }
+        BOOST_CHECK(job->vRecv.str() == vMessages[i].str());
+
+        CMasternodePing mnp;
+        job->vRecv >> mnp;
+        CSigCheck check(mnp.GetStrMessage(), mnp.vchSig);
+        CPubKey pubkey;
+        BOOST_CHECK(sigRecoveryCache.Get(check.hash, check.vchSig, pubkey));
+        BOOST_CHECK_EQUAL(pubkey == key.GetPubKey(), i % 5 != 0);
+    }
+
+    // with nothing waiting anymore, unsigned messages are processed right away again
+    BOOST_CHECK(!pool.Defer(&dummyNode, "dseg", ssDseg));
+
+    // nothing is left behind for a peer that went away
+    for (int i = 0; i < 5; i++)
+        BOOST_CHECK(pool.Defer(&dummyNode, "mnp", SignedPing(key, false)));
+    pool.ForgetNode(dummyNode.GetId());
+    pool.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.nPending, 0U);
+    BOOST_CHECK_EQUAL(stats.nMessagesReplayed, 22U);
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(sigverify_peer_cap)
+{
+    CSigVerifyPool pool;
+    CAddress addr;
+    CNode dummyNode(INVALID_SOCKET, addr, "", true);
+    CNode otherNode(INVALID_SOCKET, addr, "", true);
+
+    boost::thread_group threadGroup;
+    threadGroup.create_thread(boost::bind(&CSigVerifyPool::Thread, &pool));
+    CSigVerifyStats stats;
+    do {
+        MilliSleep(10);
+        pool.GetStats(stats);
+    } while (stats.nWorkers < 1);
+
+    // a peer is not read from anymore once its share of the queue is taken, the others still are
+    CKey key;
+    key.MakeNewKey(true);
+    for (unsigned int i = 0; i < MAX_SIGVERIFY_PEER_QUEUE; i++) {
+        BOOST_CHECK(!pool.IsFull(dummyNode.GetId()));
+        BOOST_CHECK(pool.Defer(&dummyNode, "mnp", SignedPing(key, false)));
+    }
+    BOOST_CHECK(pool.IsFull(dummyNode.GetId()));
+    BOOST_CHECK(!pool.IsFull(otherNode.GetId()));
+    BOOST_CHECK(pool.Defer(&otherNode, "mnp", SignedPing(key, false)));
+    BOOST_CHECK(!pool.IsFull(otherNode.GetId()));
+
+    // until its messages are replayed
+    CSigVerifyJobRef job;
+    while (!pool.PopVerified(dummyNode.GetId(), job))
+        MilliSleep(1);
+    BOOST_CHECK(!pool.IsFull(dummyNode.GetId()));
+
+    pool.ForgetNode(dummyNode.GetId());
+    pool.ForgetNode(otherNode.GetId());
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(sigverify_recovery_cache)
+{
+    CSigRecoveryCache cache;
+    CKey key;
+    key.MakeNewKey(true);
+
+    mapArgs["-maxmsgsigcachesize"] = "10";
+
+    std::vector<CSigCheck> vChecks;
+    for (int i = 0; i < 20; i++) {
+        std::vector<unsigned char> vchSig;
+        std::string strMessage = GetRandHash().ToString();
+        std::string strError;
+        BOOST_CHECK(obfuScationSigner.SignMessage(strMessage, strError, vchSig, key));
+        vChecks.push_back(CSigCheck(strMessage, vchSig));
+
+        CPubKey pubkey;
+        BOOST_CHECK(!cache.Get(vChecks.back().hash, vchSig, pubkey));
+        cache.Set(vChecks.back().hash, vchSig, key.GetPubKey());
+        BOOST_CHECK(cache.Get(vChecks.back().hash, vchSig, pubkey));
+        BOOST_CHECK(pubkey == key.GetPubKey());
+
+        // a different signature over the same message is a different entry
+        std::vector<unsigned char> vchSigOther = vchSig;
+        vchSigOther[5] ^= 1;
+        BOOST_CHECK(!cache.Get(vChecks.back().hash, vchSigOther, pubkey));
+    }
+
+    CSigRecoveryCacheStats stats;
+    cache.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.nSize, 10U);
+    BOOST_CHECK_EQUAL(stats.nEvictions, 10U);
+    BOOST_CHECK_EQUAL(stats.nHits, 20U);
+    BOOST_CHECK_EQUAL(stats.nMisses, 40U);
+
+    mapArgs.erase("-maxmsgsigcachesize");
+}
+
+/**
+ * CPU spent on a ping flood: 5,000 masternodes ping three times a minute apart
+ * and every ping arrives from 8 peers. Run test_lytix with --log_level=message
+ * to see the timings.
+ */
+BOOST_AUTO_TEST_CASE(sigverify_ping_flood)
+{
+    static const int nNodes = 5000;
+    static const int nPingsPerNode = 3;
+    static const int nPeers = 8;
+
+    CKey key;
+    key.MakeNewKey(true);
+    int64_t nTime = GetTime();
+
+    std::vector<CTxIn> vVins;
+    for (int i = 0; i < nNodes; i++)
+        vVins.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+
+    std::vector<CDataStream> vPings;
+    for (int j = 0; j < nPingsPerNode; j++) {
+        for (int i = 0; i < nNodes; i++) {
+            CMasternodePing mnp;
+            mnp.vin = vVins[i];
+            mnp.blockHash = GetRandHash();
+            mnp.sigTime = nTime + j * 60;
+            std::string strError;
+            BOOST_REQUIRE(obfuScationSigner.SignMessage(mnp.GetStrMessage(), strError, mnp.vchSig, key));
+
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+            ss << mnp;
+            vPings.push_back(ss);
+        }
+    }
+
+    // every round of pings is relayed by all peers before the next one starts
+    std::vector<const CDataStream*> vFlood;
+    for (int j = 0; j < nPingsPerNode; j++)
+        for (int p = 0; p < nPeers; p++)
+            for (int i = 0; i < nNodes; i++)
+                vFlood.push_back(&vPings[j * nNodes + i]);
+
+    // every copy is deserialized and hashed, every new ping has its key recovered
+    std::set<uint256> setSeen;
+    int nRecovered = 0;
+    int64_t nStart = GetTimeMicros();
+    BOOST_FOREACH (const CDataStream* pmsg, vFlood) {
+        CDataStream vRecv(*pmsg);
+        CMasternodePing mnp;
+        vRecv >> mnp;
+        if (!setSeen.insert(mnp.GetHash()).second) continue;
+
+        CSigCheck check(mnp.GetStrMessage(), mnp.vchSig);
+        BOOST_CHECK(check.pubkeyRecovered.RecoverCompact(check.hash, check.vchSig));
+        nRecovered++;
+    }
+    int64_t nTimeBaseline = GetTimeMicros() - nStart;
+
+    // relayed copies are dropped by the raw message filter, and pings that come
+    // too soon after the last accepted one are dropped before key recovery
+    mnodeman.Clear();
+    setSeen.clear();
+    std::map<COutPoint, int64_t> mapLastPing;
+    int nFiltered = 0;
+    int nRecoveredFiltered = 0;
+    nStart = GetTimeMicros();
+    BOOST_FOREACH (const CDataStream* pmsg, vFlood) {
+        if (mnodeman.IsPingMessageSeen(*pmsg)) {
+            nFiltered++;
+            continue;
+        }
+        CDataStream vRecv(*pmsg);
+        CMasternodePing mnp;
+        vRecv >> mnp;
+        if (!setSeen.insert(mnp.GetHash()).second) continue;
+
+        std::map<COutPoint, int64_t>::iterator it = mapLastPing.find(mnp.vin.prevout);
+        if (it != mapLastPing.end() && mnp.sigTime - it->second < MASTERNODE_MIN_MNP_SECONDS - 60) continue;
+
+        CSigCheck check(mnp.GetStrMessage(), mnp.vchSig);
+        BOOST_CHECK(check.pubkeyRecovered.RecoverCompact(check.hash, check.vchSig));
+        mapLastPing[mnp.vin.prevout] = mnp.sigTime;
+        nRecoveredFiltered++;
+    }
+    int64_t nTimeFiltered = GetTimeMicros() - nStart;
+    mnodeman.Clear();
+
+    BOOST_CHECK_EQUAL(nRecovered, nNodes * nPingsPerNode);
+    BOOST_CHECK_EQUAL(nRecoveredFiltered, nNodes);
+    // the filter may drop a handful of new pings as false positives, never less than the copies
+    BOOST_CHECK(nFiltered >= nNodes * nPingsPerNode * (nPeers - 1));
+    BOOST_CHECK(nFiltered <= nNodes * nPingsPerNode * (nPeers - 1) + 10);
+
+    // the flood arrives over nPingsPerNode minutes
+    BOOST_TEST_MESSAGE("ping flood of " << vFlood.size() << " messages over " << nPingsPerNode * 60 << "s");
+    BOOST_TEST_MESSAGE("  baseline: " << nTimeBaseline / 1000 << "ms, " << (double)nTimeBaseline / vFlood.size() << "us/msg, "
+                                      << nTimeBaseline / (nPingsPerNode * 60) << "us of CPU per second, " << nRecovered << " key recoveries");
+    BOOST_TEST_MESSAGE("  filtered: " << nTimeFiltered / 1000 << "ms, " << (double)nTimeFiltered / vFlood.size() << "us/msg, "
+                                      << nTimeFiltered / (nPingsPerNode * 60) << "us of CPU per second, " << nRecoveredFiltered << " key recoveries");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -100,4 +100,60 @@ BOOST_AUTO_TEST_CASE(getlocator_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(blockhashchain_test)
+{
+    // A main chain of 3000 blocks and a side chain forking off at 2500.
+    std::vector<uint256> vHashMain(3000);
+    std::vector<CBlockIndex> vBlocksMain(3000);
+    for (unsigned int i=0; i<vBlocksMain.size(); i++) {
+        vHashMain[i] = i;
+        vBlocksMain[i].nHeight = i;
+        vBlocksMain[i].pprev = i ? &vBlocksMain[i - 1] : NULL;
+        vBlocksMain[i].phashBlock = &vHashMain[i];
+    }
+    std::vector<uint256> vHashSide(400);
+    std::vector<CBlockIndex> vBlocksSide(400);
+    for (unsigned int i=0; i<vBlocksSide.size(); i++) {
+        vHashSide[i] = i + 100000;
+        vBlocksSide[i].nHeight = i + 2501;
+        vBlocksSide[i].pprev = i ? &vBlocksSide[i - 1] : &vBlocksMain[2500];
+        vBlocksSide[i].phashBlock = &vHashSide[i];
+    }
+
+    CBlockHashChain hashes;
+    uint256 hash;
+    BOOST_CHECK_EQUAL(hashes.Height(), -1);
+    BOOST_CHECK(!hashes.Get(0, hash));
+
+    // Connect the main chain block by block.
+    for (unsigned int i=0; i<vBlocksMain.size(); i++)
+        hashes.SetTip(&vBlocksMain[i]);
+    BOOST_CHECK_EQUAL(hashes.Height(), 2999);
+    for (int i=0; i<3000; i++) {
+        BOOST_CHECK(hashes.Get(i, hash));
+        BOOST_CHECK(hash == vHashMain[i]);
+    }
+    BOOST_CHECK(!hashes.Get(3000, hash));
+
+    // Reorganize to the shorter side chain, heights above its tip are gone.
+    hashes.SetTip(&vBlocksSide.back());
+    BOOST_CHECK_EQUAL(hashes.Height(), 2900);
+    for (int i=2000; i<3000; i++) {
+        bool fFound = hashes.Get(i, hash);
+        BOOST_CHECK_EQUAL(fFound, i <= 2900);
+        if (fFound)
+            BOOST_CHECK(hash == (i > 2500 ? vHashSide[i - 2501] : vHashMain[i]));
+    }
+
+    // And back to the main chain.
+    hashes.SetTip(&vBlocksMain.back());
+    for (int i=2000; i<3000; i++) {
+        BOOST_CHECK(hashes.Get(i, hash));
+        BOOST_CHECK(hash == vHashMain[i]);
+    }
+
+    hashes.SetTip(NULL);
+    BOOST_CHECK(!hashes.Get(2999, hash));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -293,6 +293,20 @@ BOOST_AUTO_TEST_CASE(checkzerocoinspend_test)
     CoinSpend spend1(Params().Zerocoin_Params(true), Params().Zerocoin_Params(false), serializedCoinSpend);
     BOOST_CHECK_MESSAGE(spend1.Verify(accumulator), "Failed deserialized check of CoinSpend");
 
+    // the same proofs as a deferred check, and against an accumulator the coin isn't in
+    CZerocoinSpendCheck check(spend1, Params().Zerocoin_Params(false), accumulator.getValue());
+    BOOST_CHECK_MESSAGE(check(), "Failed deferred check of CoinSpend");
+    CZerocoinSpendCheck checkOther(spend1, Params().Zerocoin_Params(false), accumulator.getValue() + 1);
+    BOOST_CHECK_MESSAGE(!checkOther(), "Deferred check of CoinSpend passed with the wrong accumulator");
+
+    // as handed to the script check threads
+    CBlockCheck blockCheck;
+    blockCheck.Set(check);
+    BOOST_CHECK_MESSAGE(blockCheck(), "Failed block check of CoinSpend");
+    CBlockCheck blockCheckOther;
+    blockCheckOther.Set(checkOther);
+    BOOST_CHECK_MESSAGE(!blockCheckOther(), "Block check of CoinSpend passed with the wrong accumulator");
+
     CScript script;
     CTxOut txOut(1 * COIN, script);
 
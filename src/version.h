@@ -12,7 +12,7 @@
  * network protocol versioning
  */
 
-static const int PROTOCOL_VERSION = 71033;
+static const int PROTOCOL_VERSION = 71034;
 
 //! initial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 209;
@@ -27,6 +27,9 @@ static const int MIN_PEER_PROTO_VERSION_AFTER_ENFORCEMENT = 71033;
 //! masternodes older than this proto version use old strMessage format for mnannounce
 static const int MIN_PEER_MNANNOUNCE = 71030;
 
+//! "dsegd" and "dmaxsegd" delta list syncs are understood starting with this version
+static const int MNLIST_DELTA_VERSION = 71034;
+
 //! nTime field added to CAddress, starting with this version;
 //! if possible, avoid requesting addresses nodes older than this
 static const int CADDR_TIME_VERSION = 71027;
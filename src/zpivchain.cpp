@@ -318,13 +318,18 @@ bool RemoveSerialFromDB(const CBigNum& bnSerial)
 }
 
 libzerocoin::CoinSpend TxInToZerocoinSpend(const CTxIn& txin)
+{
+    return TxInToZerocoinSpend(txin, chainActive.Height());
+}
+
+libzerocoin::CoinSpend TxInToZerocoinSpend(const CTxIn& txin, int nChainHeight)
 {
     // extract the CoinSpend from the txin
     std::vector<char, zero_after_free_allocator<char> > dataTxIn;
     dataTxIn.insert(dataTxIn.end(), txin.scriptSig.begin() + BIGNUM_SIZE, txin.scriptSig.end());
     CDataStream serializedCoinSpend(dataTxIn, SER_NETWORK, PROTOCOL_VERSION);
 
-    libzerocoin::ZerocoinParams* paramsAccumulator = Params().Zerocoin_Params(chainActive.Height() < Params().Zerocoin_Block_V2_Start());
+    libzerocoin::ZerocoinParams* paramsAccumulator = Params().Zerocoin_Params(nChainHeight < Params().Zerocoin_Block_V2_Start());
     libzerocoin::CoinSpend spend(Params().Zerocoin_Params(true), paramsAccumulator, serializedCoinSpend);
 
     return spend;